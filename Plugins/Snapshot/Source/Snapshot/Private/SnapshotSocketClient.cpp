@@ -8,6 +8,14 @@
 #include "snapshot_connect_token.h"
 #include "snapshot_platform.h"
 #include "snapshot_crypto.h"
+#include "snapshot_packets.h"
+#include "snapshot_spsc_queue.h"
+
+struct SnapshotClientPacketQueueEntry
+{
+    int packet_bytes;
+    uint8_t packet_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+};
 
 FSnapshotSocketClient::FSnapshotSocketClient(const FString& InSocketDescription, const FName& InSocketProtocol)
     : FSnapshotSocket(ESnapshotSocketType::TYPE_Client, InSocketDescription, InSocketProtocol)
@@ -17,11 +25,14 @@ FSnapshotSocketClient::FSnapshotSocketClient(const FString& InSocketDescription,
     ServerPort = 0;
     bConnected = false;
     bUpdatedThisFrame = false;
+    PacketQueue = snapshot_spsc_queue_create(NULL, SNAPSHOT_PACKET_QUEUE_SIZE, sizeof(SnapshotClientPacketQueueEntry));
+    check(PacketQueue);
 }
 
 FSnapshotSocketClient::~FSnapshotSocketClient()
 {
     Close();
+    snapshot_spsc_queue_destroy(PacketQueue);
     UE_LOG(LogSnapshot, Display, TEXT("Client socket destroyed"));
 }
 
@@ -38,10 +49,9 @@ bool FSnapshotSocketClient::Close()
         SnapshotClient = NULL;
     }
 
-    PacketData PassthroughPacket;
-    while (PacketQueue.Dequeue(PassthroughPacket))
+    while (snapshot_spsc_queue_front(PacketQueue))
     {
-        FMemory::Free(PassthroughPacket.packet_data);
+        snapshot_spsc_queue_pop(PacketQueue);
     }
 
     UE_LOG(LogSnapshot, Display, TEXT("Client socket closed"));
@@ -201,8 +211,9 @@ bool FSnapshotSocketClient::RecvFrom(uint8* Data, int32 BufferSize, int32& Bytes
         bUpdatedThisFrame = true;
     }
 
-    PacketData PassthroughPacket;
-    if (!PacketQueue.Dequeue(PassthroughPacket))
+    // the packet is read straight out of its slot in the ring, and the slot is released once it has been copied to the engine's buffer
+    SnapshotClientPacketQueueEntry* PassthroughPacket = (SnapshotClientPacketQueueEntry*)snapshot_spsc_queue_front(PacketQueue);
+    if (!PassthroughPacket)
     {
         // we have finished receiving passthrough packets for this frame
         bUpdatedThisFrame = false;
@@ -210,17 +221,17 @@ bool FSnapshotSocketClient::RecvFrom(uint8* Data, int32 BufferSize, int32& Bytes
     }
 
     // drop packet if it is too large to copy to the recieve buffer
-    if (PassthroughPacket.packet_bytes > BufferSize)
+    if (PassthroughPacket->packet_bytes > BufferSize)
     {
-        UE_LOG(LogSnapshot, Error, TEXT("Passthrough packet is too large to receive. Packet is %d bytes, but buffer is only %d bytes."), PassthroughPacket.packet_bytes, BufferSize);
-        FMemory::Free(PassthroughPacket.packet_data);
+        UE_LOG(LogSnapshot, Error, TEXT("Passthrough packet is too large to receive. Packet is %d bytes, but buffer is only %d bytes."), PassthroughPacket->packet_bytes, BufferSize);
+        snapshot_spsc_queue_pop(PacketQueue);
         return false;
     }
 
     // Copy data from packet to buffer.
-    memcpy(Data, PassthroughPacket.packet_data, PassthroughPacket.packet_bytes);
-    BytesRead = PassthroughPacket.packet_bytes;
-    FMemory::Free(PassthroughPacket.packet_data);
+    memcpy(Data, PassthroughPacket->packet_data, PassthroughPacket->packet_bytes);
+    BytesRead = PassthroughPacket->packet_bytes;
+    snapshot_spsc_queue_pop(PacketQueue);
 
     // Packects *only* come from the server
     bool bIsValid;
@@ -250,11 +261,19 @@ void FSnapshotSocketClient::ProcessPassthroughPacket(void* context, const uint8_
 
     FSnapshotSocketClient* self = (FSnapshotSocketClient*)context;
 
-    uint8_t* packet_data_copy = (uint8_t*)FMemory::Malloc(packet_bytes);
+    // packet_data points at the decrypted packet in the client's receive buffer, which is reused by the next receive, so it is copied once into a slot
+
+    SnapshotClientPacketQueueEntry* Entry = (SnapshotClientPacketQueueEntry*)snapshot_spsc_queue_begin_push(self->PacketQueue);
+    if (!Entry)
+    {
+        UE_LOG(LogSnapshot, Warning, TEXT("Client packet queue is full. Dropped passthrough packet"));
+        return;
+    }
 
-    memcpy(packet_data_copy, packet_data, packet_bytes);
+    Entry->packet_bytes = packet_bytes;
+    memcpy(Entry->packet_data, packet_data, packet_bytes);
 
-    self->PacketQueue.Enqueue({ packet_data_copy, packet_bytes });
+    snapshot_spsc_queue_end_push(self->PacketQueue);
 }
 
 void FSnapshotSocketClient::ClientStateChanged(void* context, int previous, int current)
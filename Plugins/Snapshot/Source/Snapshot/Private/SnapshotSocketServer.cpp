@@ -8,6 +8,30 @@
 #include "snapshot_address.h"
 #include "snapshot_platform.h"
 #include "snapshot_base64.h"
+#include "snapshot_packets.h"
+#include "snapshot_spsc_queue.h"
+#include "SocketSubsystem.h"
+#include "Misc/ScopeLock.h"
+
+#define SNAPSHOT_IO_THREAD_DEFAULT_UPDATE_RATE 1000
+#define SNAPSHOT_IO_THREAD_SEND_QUEUE_SIZE 1024
+
+struct SnapshotServerPacketQueueEntry
+{
+    snapshot_address_t from;
+    int client_index;
+    uint64_t client_id;
+    int packet_bytes;
+    uint8_t packet_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+};
+
+struct SnapshotServerSendQueueEntry
+{
+    int client_index;
+    uint64_t client_id;
+    int packet_bytes;
+    uint8_t packet_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+};
 
 FSnapshotSocketServer::FSnapshotSocketServer(const FString& InSocketDescription, const FName& InSocketProtocol)
     : FSnapshotSocket(ESnapshotSocketType::TYPE_Server, InSocketDescription, InSocketProtocol)
@@ -15,31 +39,63 @@ FSnapshotSocketServer::FSnapshotSocketServer(const FString& InSocketDescription,
     UE_LOG(LogSnapshot, Display, TEXT("Server socket created"));
     SnapshotServer = NULL;
     bUpdatedThisFrame = false;
+    bUseIOThread = false;
+    IOThreadUpdateSeconds = 1.0 / SNAPSHOT_IO_THREAD_DEFAULT_UPDATE_RATE;
+    IOThread = NULL;
+    bQuitIOThread = false;
+    SendQueue = NULL;
+    PacketQueue = snapshot_spsc_queue_create(NULL, SNAPSHOT_PACKET_QUEUE_SIZE, sizeof(SnapshotServerPacketQueueEntry));
+    check(PacketQueue);
 }
 
 FSnapshotSocketServer::~FSnapshotSocketServer()
 {
     Close();
+    snapshot_spsc_queue_destroy(PacketQueue);
     UE_LOG(LogSnapshot, Display, TEXT("Server socket destroyed"));
 }
 
 void FSnapshotSocketServer::Update()
 {
-    // ...
+    // send passthrough packets queued by SendTo this frame, instead of waiting for the next server update
+    if (SnapshotServer && !bUseIOThread)
+    {
+        snapshot_server_flush_packets(SnapshotServer);
+    }
 }
 
 bool FSnapshotSocketServer::Close()
 {
+    // stop the network thread first, so the server is only touched from this thread from here on
+    if (IOThread)
+    {
+        bQuitIOThread = true;
+        snapshot_platform_thread_join(IOThread);
+        snapshot_platform_thread_destroy(IOThread);
+        IOThread = NULL;
+    }
+
+    if (SendQueue)
+    {
+        snapshot_spsc_queue_destroy(SendQueue);
+        SendQueue = NULL;
+    }
+
     if (SnapshotServer)
     {
         snapshot_server_destroy(SnapshotServer);
         SnapshotServer = NULL;
     }
 
-    PacketData PassthroughPacket;
-    while (PacketQueue.Dequeue(PassthroughPacket))
     {
-        FMemory::Free(PassthroughPacket.packet_data);
+        FScopeLock Lock(&ClientAddressCacheLock);
+        ClientAddressCache.Reset();
+        ClientIndexByAddressHash.Reset();
+    }
+
+    while (snapshot_spsc_queue_front(PacketQueue))
+    {
+        snapshot_spsc_queue_pop(PacketQueue);
     }
 
     UE_LOG(LogSnapshot, Display, TEXT("Server socket closed"));
@@ -70,7 +126,7 @@ bool FSnapshotSocketServer::Bind(const FInternetAddr& Addr)
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config(&server_config);
-    server_config.context = this;
+    server_config.callback_context = this;
     server_config.protocol_id = TEST_PROTOCOL_ID;                                                           // todo: get protocol id from somewhere meaningful in the engine, eg. hash of code + content?
     server_config.process_passthrough_callback = ProcessPassthroughPacket;
     server_config.connect_disconnect_callback = ClientConnectDisconnect;
@@ -100,6 +156,44 @@ bool FSnapshotSocketServer::Bind(const FInternetAddr& Addr)
 
     UE_LOG(LogSnapshot, Display, TEXT("Created snapshot server"));
 
+    {
+        FScopeLock Lock(&ClientAddressCacheLock);
+        ClientAddressCache.SetNum(snapshot_server_max_clients(SnapshotServer));
+    }
+
+    bUseIOThread = FParse::Param(FCommandLine::Get(), TEXT("snapshotiothread"));
+
+    if (bUseIOThread)
+    {
+        int32 UpdateRate = SNAPSHOT_IO_THREAD_DEFAULT_UPDATE_RATE;
+        FParse::Value(FCommandLine::Get(), TEXT("-snapshotiothreadrate="), UpdateRate);
+        if (UpdateRate <= 0)
+        {
+            UpdateRate = SNAPSHOT_IO_THREAD_DEFAULT_UPDATE_RATE;
+        }
+        IOThreadUpdateSeconds = 1.0 / UpdateRate;
+
+        SendQueue = snapshot_spsc_queue_create(NULL, SNAPSHOT_IO_THREAD_SEND_QUEUE_SIZE, sizeof(SnapshotServerSendQueueEntry));
+        if (!SendQueue)
+        {
+            UE_LOG(LogSnapshot, Error, TEXT("Failed to create snapshot server send queue"));
+            Close();
+            return false;
+        }
+
+        bQuitIOThread = false;
+
+        IOThread = snapshot_platform_thread_create(NULL, IOThreadFunction, this);
+        if (!IOThread)
+        {
+            UE_LOG(LogSnapshot, Error, TEXT("Failed to create snapshot server network thread"));
+            Close();
+            return false;
+        }
+
+        UE_LOG(LogSnapshot, Display, TEXT("Snapshot server network thread updating at %d Hz"), UpdateRate);
+    }
+
     return true;
 }
 
@@ -107,22 +201,45 @@ bool FSnapshotSocketServer::SendTo(const uint8* Data, int32 Count, int32& BytesS
 {
     if (!SnapshotServer)
         return false;
-    
-    snapshot_address_t dest;
-    if (snapshot_address_parse(&dest, TCHAR_TO_ANSI(*(Destination.ToString(true)))) != SNAPSHOT_OK)
+
+    uint64 ClientId = 0;
+    const int32 ClientIndex = FindClientIndex(Destination, ClientId);
+    if (ClientIndex < 0)
     {
-        UE_LOG(LogSnapshot, Warning, TEXT("Invalid address passed to FSnapshotSocketServer::SendTo (%s)"), *Destination.ToString(true));
+        UE_LOG(LogSnapshot, Warning, TEXT("No connected client with address %s in FSnapshotSocketServer::SendTo"), *Destination.ToString(true));
         return false;
     }
 
-    int client_index = snapshot_server_find_client_index_by_address(SnapshotServer, &dest);
-    if (client_index < 0)
+    if (bUseIOThread)
     {
-        UE_LOG(LogSnapshot, Warning, TEXT("No connected client with address %s in FSnapshotSocketServer::SendTo"), *Destination.ToString(true));
-        return false;
+        // the network thread owns the server, so hand the packet over. the client id catches the slot being reused before the packet is sent
+
+        if (Count <= 0 || Count > SNAPSHOT_MAX_PASSTHROUGH_BYTES)
+        {
+            UE_LOG(LogSnapshot, Warning, TEXT("Invalid packet size %d passed to FSnapshotSocketServer::SendTo"), Count);
+            return false;
+        }
+
+        SnapshotServerSendQueueEntry* Entry = (SnapshotServerSendQueueEntry*)snapshot_spsc_queue_begin_push(SendQueue);
+        if (!Entry)
+        {
+            UE_LOG(LogSnapshot, Warning, TEXT("Send queue is full in FSnapshotSocketServer::SendTo"));
+            return false;
+        }
+
+        Entry->client_index = ClientIndex;
+        Entry->client_id = ClientId;
+        memcpy(Entry->packet_data, Data, Count);
+        Entry->packet_bytes = Count;
+
+        snapshot_spsc_queue_end_push(SendQueue);
+
+        BytesSent = Count;
+
+        return true;
     }
 
-    snapshot_server_send_passthrough_packet(SnapshotServer, client_index, Data, Count);
+    snapshot_server_send_passthrough_packet(SnapshotServer, ClientIndex, Data, Count);
     
     BytesSent = Count;
 
@@ -137,15 +254,16 @@ bool FSnapshotSocketServer::RecvFrom(uint8* Data, int32 BufferSize, int32& Bytes
     if (Flags != ESocketReceiveFlags::None)
         return false;
 
-    if (!bUpdatedThisFrame)
+    if (!bUseIOThread && !bUpdatedThisFrame)
     {
         // make sure we update the server prior to receiving any packets this frame
         snapshot_server_update(SnapshotServer, snapshot_platform_time());
         bUpdatedThisFrame = true;
     }
 
-    PacketData PassthroughPacket;
-    if (!PacketQueue.Dequeue(PassthroughPacket))
+    // the packet is read straight out of its slot in the ring, and the slot is released once it has been copied to the engine's buffer
+    SnapshotServerPacketQueueEntry* PassthroughPacket = (SnapshotServerPacketQueueEntry*)snapshot_spsc_queue_front(PacketQueue);
+    if (!PassthroughPacket)
     {
         // we have finished receiving packets for this frame
         bUpdatedThisFrame = false;
@@ -153,25 +271,40 @@ bool FSnapshotSocketServer::RecvFrom(uint8* Data, int32 BufferSize, int32& Bytes
     }
 
     // drop packet if it is too large to copy to the recieve buffer
-    if (PassthroughPacket.packet_bytes > BufferSize)
+    if (PassthroughPacket->packet_bytes > BufferSize)
     {
-        UE_LOG(LogSnapshot, Error, TEXT("Passthrough packet is too large to receive. Packet is %d bytes, but buffer is only %d bytes."), PassthroughPacket.packet_bytes, BufferSize);
-        FMemory::Free(PassthroughPacket.packet_data);
+        UE_LOG(LogSnapshot, Error, TEXT("Passthrough packet is too large to receive. Packet is %d bytes, but buffer is only %d bytes."), PassthroughPacket->packet_bytes, BufferSize);
+        snapshot_spsc_queue_pop(PacketQueue);
         return false;
     }
     
     // Copy data from packet to buffer.
-    memcpy(Data, PassthroughPacket.packet_data, PassthroughPacket.packet_bytes);
-    BytesRead = PassthroughPacket.packet_bytes;
-    FMemory::Free(PassthroughPacket.packet_data);
+    memcpy(Data, PassthroughPacket->packet_data, PassthroughPacket->packet_bytes);
+    BytesRead = PassthroughPacket->packet_bytes;
+
+    const snapshot_address_t From = PassthroughPacket->from;
+    const int ClientIndex = PassthroughPacket->client_index;
+    const uint64_t ClientId = PassthroughPacket->client_id;
+
+    snapshot_spsc_queue_pop(PacketQueue);
+
+    // Fill the source address from the cache. Only fall back to strings if the client disconnected after the packet was queued
+    {
+        FScopeLock Lock(&ClientAddressCacheLock);
+        if (ClientAddressCache.IsValidIndex(ClientIndex) && ClientAddressCache[ClientIndex].Address.IsValid() && ClientAddressCache[ClientIndex].ClientId == ClientId)
+        {
+            Source.SetRawIp(ClientAddressCache[ClientIndex].RawIp);
+            Source.SetPort(From.port);
+            return true;
+        }
+    }
 
-    // Convert snapshot address to string.
     char snapshot_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
-    snapshot_address_to_string(&PassthroughPacket.from, snapshot_address_string);
+    snapshot_address_to_string_without_port(&From, snapshot_address_string);
     FString UnrealAddressString = FString(ANSI_TO_TCHAR(snapshot_address_string));
     bool bIsValid;
     Source.SetIp(*UnrealAddressString, bIsValid);
-    Source.SetPort(PassthroughPacket.from.port);
+    Source.SetPort(From.port);
     return bIsValid;
 }
 
@@ -190,20 +323,32 @@ int32 FSnapshotSocketServer::GetPortNo()
 
 void FSnapshotSocketServer::ProcessPassthroughPacket(void* context, const snapshot_address_t* client_address, int client_index, const uint8_t* packet_data, int packet_bytes)
 {
-    // IMPORTANT: This is called from main thread inside snapshot_server_update
+    // IMPORTANT: This is called inside snapshot_server_update, on the main thread or on the network thread when it is enabled. PacketQueue is single producer, single consumer, so it is safe either way
 
     FSnapshotSocketServer* self = (FSnapshotSocketServer*)context;
 
-    uint8_t* packet_data_copy = (uint8_t*)FMemory::Malloc(packet_bytes);
+    // packet_data points at the decrypted packet in the server's receive buffer, which is reused by the next receive, so it is copied once into a slot
+
+    SnapshotServerPacketQueueEntry* Entry = (SnapshotServerPacketQueueEntry*)snapshot_spsc_queue_begin_push(self->PacketQueue);
+    if (!Entry)
+    {
+        UE_LOG(LogSnapshot, Warning, TEXT("Server packet queue is full. Dropped passthrough packet from client %d"), client_index);
+        return;
+    }
 
-    memcpy(packet_data_copy, packet_data, packet_bytes);
+    Entry->from = *client_address;
+    Entry->client_index = client_index;
+    Entry->client_id = snapshot_server_client_id(self->SnapshotServer, client_index);
+    Entry->packet_bytes = packet_bytes;
+    memcpy(Entry->packet_data, packet_data, packet_bytes);
 
-    self->PacketQueue.Enqueue({ *client_address, packet_data_copy, packet_bytes });
+    snapshot_spsc_queue_end_push(self->PacketQueue);
 }
 
 void FSnapshotSocketServer::ClientConnectDisconnect(void* context, int client_index, int connect)
 {
     // Called when clients connect and disconnect. All data for the client is still valid on the server in both cases (called *after* client connect, and *just before* client disconnect)
+    // IMPORTANT: With the network thread enabled this is called on the network thread, so don't touch game state from here directly
 
     FSnapshotSocketServer* self = (FSnapshotSocketServer*)context;
 
@@ -218,12 +363,115 @@ void FSnapshotSocketServer::ClientConnectDisconnect(void* context, int client_in
     {
         snapshot_printf(SNAPSHOT_LOG_LEVEL_INFO, "Server sees client %s connect in slot %d with id [%" PRIx64 "]", client_address_string, client_index, client_id);
 
+        // build the unreal address once here, straight from the address bytes, so the per packet path never touches strings.
+        // loopback clients have no address and their packets go through send_loopback_packet_callback, so they aren't cached
+
+        if (client_address->type == SNAPSHOT_ADDRESS_IPV4 || client_address->type == SNAPSHOT_ADDRESS_IPV6)
+        {
+            TArray<uint8> RawIp;
+            if (client_address->type == SNAPSHOT_ADDRESS_IPV4)
+            {
+                RawIp.Append(client_address->data.ipv4, 4);
+            }
+            else
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    RawIp.Add((uint8)(client_address->data.ipv6[i] >> 8));
+                    RawIp.Add((uint8)(client_address->data.ipv6[i] & 0xFF));
+                }
+            }
+
+            TSharedRef<FInternetAddr> Address = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+            Address->SetRawIp(RawIp);
+            Address->SetPort(client_address->port);
+
+            FScopeLock Lock(&self->ClientAddressCacheLock);
+            if (self->ClientAddressCache.IsValidIndex(client_index))
+            {
+                FClientAddressCacheEntry& Entry = self->ClientAddressCache[client_index];
+                Entry.Address = Address;
+                Entry.RawIp = MoveTemp(RawIp);
+                Entry.ClientId = client_id;
+                self->ClientIndexByAddressHash.Add(Address->GetTypeHash(), client_index);
+            }
+        }
+
         // todo: you probably want to do client setup stuff here
     }
     else
     {
         snapshot_printf(SNAPSHOT_LOG_LEVEL_INFO, "Server sees client %s disconnect from slot %d with id [%" PRIx64 "]", client_address_string, client_index, client_id);
 
+        FScopeLock Lock(&self->ClientAddressCacheLock);
+        if (self->ClientAddressCache.IsValidIndex(client_index) && self->ClientAddressCache[client_index].Address.IsValid())
+        {
+            FClientAddressCacheEntry& Entry = self->ClientAddressCache[client_index];
+            self->ClientIndexByAddressHash.RemoveSingle(Entry.Address->GetTypeHash(), client_index);
+            Entry.Address.Reset();
+            Entry.RawIp.Reset();
+            Entry.ClientId = 0;
+        }
+
         // todo: you probably want to do client teardown stuff here
     }
 }
+
+void FSnapshotSocketServer::ProcessSendQueue()
+{
+    SnapshotServerSendQueueEntry* Entry;
+    while ((Entry = (SnapshotServerSendQueueEntry*)snapshot_spsc_queue_front(SendQueue)) != NULL)
+    {
+        if (snapshot_server_client_connected(SnapshotServer, Entry->client_index) && snapshot_server_client_id(SnapshotServer, Entry->client_index) == Entry->client_id)
+        {
+            snapshot_server_send_passthrough_packet(SnapshotServer, Entry->client_index, Entry->packet_data, Entry->packet_bytes);
+        }
+        snapshot_spsc_queue_pop(SendQueue);
+    }
+}
+
+void FSnapshotSocketServer::IOThreadFunction(void* arg)
+{
+    FSnapshotSocketServer* self = (FSnapshotSocketServer*)arg;
+
+    double next_update_time = snapshot_platform_time();
+
+    while (!self->bQuitIOThread)
+    {
+        self->ProcessSendQueue();
+
+        snapshot_server_update(self->SnapshotServer, snapshot_platform_time());
+
+        // fixed rate. if we fall behind, don't try to catch up with a burst of updates
+
+        next_update_time += self->IOThreadUpdateSeconds;
+
+        const double current_time = snapshot_platform_time();
+
+        if (next_update_time > current_time)
+        {
+            snapshot_platform_sleep(next_update_time - current_time);
+        }
+        else
+        {
+            next_update_time = current_time;
+        }
+    }
+}
+
+int32 FSnapshotSocketServer::FindClientIndex(const FInternetAddr& Address, uint64& OutClientId)
+{
+    FScopeLock Lock(&ClientAddressCacheLock);
+
+    for (auto It = ClientIndexByAddressHash.CreateConstKeyIterator(Address.GetTypeHash()); It; ++It)
+    {
+        const FClientAddressCacheEntry& Entry = ClientAddressCache[It.Value()];
+        if (Entry.Address.IsValid() && *Entry.Address == Address)
+        {
+            OutClientId = Entry.ClientId;
+            return It.Value();
+        }
+    }
+
+    return -1;
+}
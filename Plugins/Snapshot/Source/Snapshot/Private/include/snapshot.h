@@ -12,7 +12,10 @@
 #include <assert.h>
 #include <memory.h>
 
-#define SNAPSHOT_MAX_CLIENTS                                    256
+#define SNAPSHOT_MAX_CLIENTS                                   4096
+#define SNAPSHOT_DEFAULT_MAX_CLIENTS                            256
+#define SNAPSHOT_DEFAULT_SNAPSHOT_BANDWIDTH_KBPS              1024
+#define SNAPSHOT_DEFAULT_PACING_RATE_KBPS                    10000
 
 #define SNAPSHOT_MAX_PACKET_BYTES                     ( 10 * 1024 )
 
@@ -22,6 +25,9 @@
 #define SNAPSHOT_SERVER_SOCKET_SNDBUF_SIZE          ( 1024 * 1024 )
 #define SNAPSHOT_SERVER_SOCKET_RCVBUF_SIZE          ( 1024 * 1024 )
 
+#define SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE                       16
+#define SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE                       64
+
 #define SNAPSHOT_NUM_DISCONNECT_PACKETS                          10
 
 #if !defined(SNAPSHOT_DEVELOPMENT)
@@ -0,0 +1,45 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_ADDRESS_MAP_H
+#define SNAPSHOT_ADDRESS_MAP_H
+
+#include "snapshot.h"
+#include "snapshot_address.h"
+
+// open addressing hash map from address -> int, with linear probing and backward shift deletion.
+// the owner provides the entry storage, so nothing is allocated after init. capacity must be a power of two,
+// and should be at least twice the number of addresses stored, so probe sequences stay short.
+
+struct snapshot_address_map_entry_t
+{
+    struct snapshot_address_t address;
+    uint32_t hash;
+    int value;
+};
+
+struct snapshot_address_map_t
+{
+    uint64_t seed;
+    int capacity;
+    int num_entries;
+    struct snapshot_address_map_entry_t * entries;
+};
+
+int snapshot_address_map_capacity( int max_entries );
+
+uint32_t snapshot_address_hash( const struct snapshot_address_t * address, uint64_t seed );
+
+void snapshot_address_map_init( struct snapshot_address_map_t * map, struct snapshot_address_map_entry_t * entries, int capacity );
+
+void snapshot_address_map_reset( struct snapshot_address_map_t * map );
+
+int snapshot_address_map_find( const struct snapshot_address_map_t * map, const struct snapshot_address_t * address );
+
+bool snapshot_address_map_insert( struct snapshot_address_map_t * map, const struct snapshot_address_t * address, int value );
+
+bool snapshot_address_map_remove( struct snapshot_address_map_t * map, const struct snapshot_address_t * address );
+
+#endif // #ifndef SNAPSHOT_ADDRESS_MAP_H
@@ -0,0 +1,35 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_ARENA_H
+#define SNAPSHOT_ARENA_H
+
+#include "snapshot.h"
+
+#define SNAPSHOT_ARENA_ALIGNMENT                                          64
+#define SNAPSHOT_ARENA_HUGE_PAGE_BYTES                     ( 2 * 1024 * 1024 )
+
+// one contiguous block that objects are carved from front to back, and freed all at once. every allocation is cache line aligned.
+// arenas of a huge page or more are huge page aligned and advised to the platform, so walking all clients touches fewer tlb entries.
+// size the arena by summing snapshot_arena_bytes for each allocation that will be made from it.
+
+struct snapshot_arena_t
+{
+    void * context;
+    uint8_t * memory;
+    uint8_t * base;
+    size_t size;
+    size_t offset;
+};
+
+size_t snapshot_arena_bytes( size_t bytes );
+
+int snapshot_arena_create( struct snapshot_arena_t * arena, void * context, size_t bytes );
+
+void snapshot_arena_destroy( struct snapshot_arena_t * arena );
+
+void * snapshot_arena_alloc( struct snapshot_arena_t * arena, size_t bytes );
+
+#endif // #ifndef SNAPSHOT_ARENA_H
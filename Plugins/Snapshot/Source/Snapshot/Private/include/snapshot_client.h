@@ -53,6 +53,12 @@ struct snapshot_client_config_t
     void (*state_change_callback)(void*,int,int);
     void (*send_loopback_packet_callback)(void*,const struct snapshot_address_t*,uint8_t*,int);
     void (*process_passthrough_callback)(void*,const uint8_t*,int);
+    bool enable_gro;
+    bool use_arena;
+    int num_snapshot_objects;
+    int snapshot_object_bytes;
+    bool enable_fragment_resend;
+    double stats_update_interval;
 #if SNAPSHOT_DEVELOPMENT
     struct snapshot_network_simulator_t * network_simulator;
 #endif // #if SNAPSHOT_DEVELOPMENT
@@ -88,6 +94,13 @@ void snapshot_client_send_passthrough_packet( struct snapshot_client_t * client,
 
 uint16_t snapshot_client_port( struct snapshot_client_t * client );
 
+// when num_snapshot_objects is set, snapshots from the server are applied to the client's copy of the objects,
+// and a payload is sent back each update so acks for them reach the server. see snapshot_delta.h
+
+uint32_t snapshot_client_snapshot_sequence( struct snapshot_client_t * client );
+
+const uint8_t * snapshot_client_snapshot_object( struct snapshot_client_t * client, int object_index );
+
 const struct snapshot_address_t * snapshot_client_server_address( struct snapshot_client_t * client );
 
 const char * snapshot_client_state_name( int client_state );
@@ -0,0 +1,72 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_DELTA_H
+#define SNAPSHOT_DELTA_H
+
+#include "snapshot.h"
+
+#define SNAPSHOT_DELTA_MAX_OBJECTS                                  65536
+#define SNAPSHOT_DELTA_MAX_OBJECT_BYTES                               256
+#define SNAPSHOT_DELTA_HISTORY_SIZE                                    64
+#define SNAPSHOT_DELTA_SENT_BUFFER_SIZE                               256
+#define SNAPSHOT_DELTA_SENT_OBJECTS_SIZE                            16384
+
+// delta compressed snapshots. the world is an array of fixed size objects, and each object is an array of 32 bit words.
+// the server side world remembers the snapshot each word last changed in, and keeps a list of the objects that changed in
+// each of the last SNAPSHOT_DELTA_HISTORY_SIZE snapshots, so finding what changed costs in proportion to what changed.
+
+struct snapshot_delta_world_t * snapshot_delta_world_create( void * context, int num_objects, int object_bytes );
+
+void snapshot_delta_world_destroy( struct snapshot_delta_world_t * world );
+
+void snapshot_delta_world_set_object( struct snapshot_delta_world_t * world, int object_index, const uint8_t * object_data );
+
+// priority is how much an object's accumulated priority grows each time it is passed over. the default is 1
+
+void snapshot_delta_world_set_object_priority( struct snapshot_delta_world_t * world, int object_index, float priority );
+
+uint32_t snapshot_delta_world_advance( struct snapshot_delta_world_t * world );
+
+uint32_t snapshot_delta_world_sequence( struct snapshot_delta_world_t * world );
+
+// per-client view of the world. each object is delta encoded against the latest snapshot of it the client has acked, and
+// objects the client is behind on are kept in a dirty set. each write is a priority accumulator pass: dirty objects gain
+// their priority, and are taken highest first until the byte budget is spent. objects that are sent have their priority
+// reset, and the rest carry theirs over to the next write, so nothing starves. objects in a payload packet are remembered
+// by packet sequence, so the endpoint ack stream can mark them acked.
+
+struct snapshot_delta_client_t * snapshot_delta_client_create( void * context, struct snapshot_delta_world_t * world );
+
+void snapshot_delta_client_destroy( struct snapshot_delta_client_t * client );
+
+void snapshot_delta_client_reset( struct snapshot_delta_client_t * client );
+
+void snapshot_delta_client_acked( struct snapshot_delta_client_t * client, const uint16_t * acks, int num_acks );
+
+int snapshot_delta_client_num_dirty_objects( struct snapshot_delta_client_t * client );
+
+// writes the latest snapshot for a payload packet with the given sequence. returns the number of bytes written, which is
+// never more than budget_bytes, or zero if there is nothing to send. the buffer must be four byte aligned and a multiple of
+// four bytes long. num_deferred is set to the number of dirty objects that didn't fit in the budget
+
+int snapshot_delta_client_write( struct snapshot_delta_client_t * client, uint16_t packet_sequence, uint8_t * buffer, int budget_bytes, int * num_deferred );
+
+// client side. each object remembers the snapshot it was last updated from, and is only updated from newer snapshots.
+// nothing is applied unless the whole snapshot reads cleanly
+
+struct snapshot_delta_receiver_t * snapshot_delta_receiver_create( void * context, int num_objects, int object_bytes );
+
+void snapshot_delta_receiver_destroy( struct snapshot_delta_receiver_t * receiver );
+
+void snapshot_delta_receiver_reset( struct snapshot_delta_receiver_t * receiver );
+
+int snapshot_delta_receiver_read( struct snapshot_delta_receiver_t * receiver, const uint8_t * data, int bytes );
+
+uint32_t snapshot_delta_receiver_sequence( struct snapshot_delta_receiver_t * receiver );
+
+const uint8_t * snapshot_delta_receiver_object( struct snapshot_delta_receiver_t * receiver, int object_index );
+
+#endif // #ifndef SNAPSHOT_DELTA_H
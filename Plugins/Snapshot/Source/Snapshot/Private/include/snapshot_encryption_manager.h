@@ -8,23 +8,39 @@
 
 #include "snapshot.h"
 #include "snapshot_address.h"
+#include "snapshot_address_map.h"
+#include "snapshot_timer_wheel.h"
 
-#define SNAPSHOT_MAX_ENCRYPTION_MAPPINGS ( SNAPSHOT_MAX_CLIENTS * 4 )
+#define SNAPSHOT_ENCRYPTION_MAPPINGS_PER_CLIENT 4
 
 struct snapshot_encryption_manager_t
 {
+    void * context;
+    int max_encryption_mappings;
     int num_encryption_mappings;
-    int timeout[SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    double expire_time[SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    double last_access_time[SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    struct snapshot_address_t address[SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    int client_index[SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    uint8_t send_key[SNAPSHOT_KEY_BYTES*SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
-    uint8_t receive_key[SNAPSHOT_KEY_BYTES*SNAPSHOT_MAX_ENCRYPTION_MAPPINGS];
+    int * timeout;
+    double * expire_time;
+    double * last_access_time;
+    struct snapshot_address_t * address;
+    int * client_index;
+    uint8_t * send_key;
+    uint8_t * receive_key;
+    struct snapshot_address_map_t address_map;
+    struct snapshot_address_map_entry_t * address_map_entries;
+    struct snapshot_timer_wheel_t * timer_wheel;
+    int first_timer_id;
 };
 
+struct snapshot_encryption_manager_t * snapshot_encryption_manager_create( void * context, int max_encryption_mappings );
+
+void snapshot_encryption_manager_destroy( struct snapshot_encryption_manager_t * encryption_manager );
+
 void snapshot_encryption_manager_reset( struct snapshot_encryption_manager_t * encryption_manager );
 
+void snapshot_encryption_manager_set_timer_wheel( struct snapshot_encryption_manager_t * encryption_manager, struct snapshot_timer_wheel_t * timer_wheel, int first_timer_id );
+
+void snapshot_encryption_manager_process_expiry_timer( struct snapshot_encryption_manager_t * encryption_manager, int index, double time );
+
 int snapshot_encryption_manager_entry_expired( struct snapshot_encryption_manager_t * encryption_manager, int index, double time );
 
 int snapshot_encryption_manager_add_encryption_mapping( struct snapshot_encryption_manager_t * encryption_manager, 
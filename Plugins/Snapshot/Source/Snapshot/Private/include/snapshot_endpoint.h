@@ -8,14 +8,21 @@
 
 #include "snapshot_packet_header.h"
 
+struct snapshot_arena_t;
+struct snapshot_payload_iovec_t;
+
 #define SNAPSHOT_FRAGMENT_HEADER_BYTES                                      5
 
+#define SNAPSHOT_PARITY_FRAGMENT_HEADER_BYTES                               8
+
 #define SNAPSHOT_MAX_FRAGMENTS                                            256
 
 #define SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS                               256
 
 #define SNAPSHOT_ENDPOINT_NAME_BYTES                                      256
 
+#define SNAPSHOT_ENDPOINT_FRAGMENT_ACKS_BYTES                             512
+
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_SENT                          0
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_RECEIVED                      1
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_ACKED                         2
@@ -26,7 +33,15 @@
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT                        7
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED                    8
 #define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID                     9
-#define SNAPSHOT_ENDPOINT_NUM_COUNTERS                                     10
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_PARITY_FRAGMENTS_SENT                10
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECOVERED                  11
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RESENT                     12
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_SENT                   13
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_RECEIVED               14
+#define SNAPSHOT_ENDPOINT_COUNTER_NUM_REASSEMBLIES_EVICTED                 15
+#define SNAPSHOT_ENDPOINT_NUM_COUNTERS                                     16
+
+#define SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY                       6
 
 struct snapshot_endpoint_config_t
 {
@@ -40,14 +55,35 @@ struct snapshot_endpoint_config_t
     int sent_packets_buffer_size;
     int received_packets_buffer_size;
     int fragment_reassembly_buffer_size;
+    int fragment_reassembly_slots;
     float rtt_smoothing_factor;
     float packet_loss_smoothing_factor;
     float bandwidth_smoothing_factor;
     int packet_header_size;
+    double stats_update_interval;
+    bool enable_congestion_control;
+    float congestion_target_delay;
+    float congestion_min_kbps;
+    float congestion_initial_kbps;
+    float congestion_max_kbps;
+    float fec_overhead;
+    bool enable_fragment_resend;
+    int fragment_resend_buffer_size;
 };
 
 void snapshot_endpoint_default_config( struct snapshot_endpoint_config_t * config );
 
+// running totals for the packets in the oldest half of a sent or received packet buffer. packet loss and bandwidth
+// are calculated from these, and they are updated as packets enter and leave that half of the buffer
+
+struct snapshot_endpoint_window_t
+{
+    int num_packets;
+    uint64_t packet_bytes;
+    double start_time;
+    double finish_time;
+};
+
 struct snapshot_endpoint_t
 {
     void * context;
@@ -64,21 +100,82 @@ struct snapshot_endpoint_t
     struct snapshot_sequence_buffer_t * sent_packets;
     struct snapshot_sequence_buffer_t * received_packets;
     struct snapshot_sequence_buffer_t * fragment_reassembly;
+    uint8_t * reassembly_slab;
+    int reassembly_slot_bytes;
+    uint16_t * reassembly_slot_sequence;
+    int next_reassembly_slot;
+    int fec_group_size;
+    uint8_t * parity_data;
+    struct snapshot_sequence_buffer_t * resend_payloads;
+    uint8_t * resend_slab;
+    struct snapshot_endpoint_window_t sent_window;
+    struct snapshot_endpoint_window_t received_window;
+    struct snapshot_endpoint_window_t acked_window;
+    int num_dropped_packets;
+    double last_stats_update_time;
+    float pacing_rate_kbps;
+    float congestion_rtt;
+    float congestion_base_rtt[SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY];
+    int congestion_base_rtt_index;
+    double congestion_base_rtt_time;
+    double last_congestion_update_time;
+    double last_congestion_decrease_time;
     uint64_t counters[SNAPSHOT_ENDPOINT_NUM_COUNTERS];
+    bool arena_allocated;
 };
 
 struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_config_t * config, double time );
 
+// same as above, but the endpoint and its sequence buffers are carved from an arena sized with snapshot_endpoint_arena_bytes
+
+size_t snapshot_endpoint_arena_bytes( const struct snapshot_endpoint_config_t * config );
+
+// the most packets one payload can be written as: every fragment, plus the parity fragments that go with them
+
+int snapshot_endpoint_max_write_packets( const struct snapshot_endpoint_config_t * config );
+
+struct snapshot_endpoint_t * snapshot_endpoint_create_in_arena( struct snapshot_arena_t * arena, struct snapshot_endpoint_config_t * config, double time );
+
 void snapshot_endpoint_destroy( struct snapshot_endpoint_t * endpoint );
 
 uint16_t snapshot_endpoint_sequence( struct snapshot_endpoint_t * endpoint );
 
 void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uint8_t * payload_data, int payload_bytes, int * num_packets, uint8_t ** packet_data, int * packet_bytes );
 
-void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes, uint8_t * payload_buffer, uint8_t ** out_payload_data, int * out_payload_bytes, uint16_t * out_packet_sequence, uint16_t * out_packet_ack, uint32_t * out_packet_ack_bits );
+// same as above, but nothing is allocated or copied. each packet is a header plus a slice of payload_data, which must stay
+// valid until the packets are written with snapshot_write_payload_iovec. iovecs must hold SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS entries.
+// with fec_overhead set, fragmented payloads are followed by one xor parity fragment for every ceil(1/fec_overhead) fragments,
+// so the receiver can rebuild one lost fragment per group. parity fragments point into the endpoint, and are only valid until
+// the next payload is written. receivers always understand parity fragments, whatever their own config
+
+void snapshot_endpoint_write_payload_iovecs( struct snapshot_endpoint_t * endpoint, const uint8_t * payload_data, int payload_bytes, int * num_iovecs, struct snapshot_payload_iovec_t * iovecs );
+
+// fragmented payloads are handed off from the endpoint's reassembly slab, and stay valid until the next call to process packet.
+// the slab has fragment_reassembly_slots slots, and a payload only takes one when its first fragment arrives. when they are all
+// in use, the oldest unfinished payload is dropped to make room
+
+void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes, uint8_t ** out_payload_data, int * out_payload_bytes, uint16_t * out_packet_sequence, uint16_t * out_packet_ack, uint32_t * out_packet_ack_bits );
+
+// with enable_fragment_resend, fragmented payloads are kept until they are acked, and the receiving endpoint reports the
+// fragments still missing from each payload it is reassembling, so only those are sent again. both ends must enable it.
+// fragment acks go to the other side like any other endpoint packet, and resends come out as iovecs that are valid until the
+// next payload is written. a resend waits for at least an rtt after the previous send, so fragments still in flight aren't
+// sent twice. a payload that loses every fragment is never reported, so that is left to the application
+
+int snapshot_endpoint_write_fragment_acks( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int max_packet_bytes );
+
+void snapshot_endpoint_write_resend_iovecs( struct snapshot_endpoint_t * endpoint, int * num_iovecs, struct snapshot_payload_iovec_t * iovecs );
 
 void snapshot_endpoint_mark_payload_processed( struct snapshot_endpoint_t * endpoint, uint16_t sequence, uint16_t ack, uint32_t ack_bits, int payload_bytes );
 
+// acks normally ride along in the header of every packet the endpoint writes. a side that has nothing to send can carry them
+// some other way instead: write them out with snapshot_endpoint_write_acks, and apply them on the other end with
+// snapshot_endpoint_process_acks
+
+void snapshot_endpoint_write_acks( struct snapshot_endpoint_t * endpoint, uint16_t * ack, uint32_t * ack_bits );
+
+void snapshot_endpoint_process_acks( struct snapshot_endpoint_t * endpoint, uint16_t ack, uint32_t ack_bits );
+
 uint16_t * snapshot_endpoint_get_acks( struct snapshot_endpoint_t * endpoint, int * num_acks );
 
 void snapshot_endpoint_clear_acks( struct snapshot_endpoint_t * endpoint );
@@ -93,6 +190,16 @@ float snapshot_endpoint_packet_loss( struct snapshot_endpoint_t * endpoint );
 
 void snapshot_endpoint_bandwidth( struct snapshot_endpoint_t * endpoint, float * sent_bandwidth_kbps, float * received_bandwidth_kbps, float * acked_bandwidth_kbps );
 
+// with congestion control enabled, each stats update moves the pacing rate toward keeping queuing delay (the latest rtt over
+// the lowest rtt seen in the last minute) at the target delay. packet loss backs the rate off, and it is never allowed to get
+// far ahead of the acked bandwidth. the max payload size is what the pacing rate can deliver in one base rtt plus the target
+// delay. with congestion control disabled, the pacing rate is zero, which means unlimited, and payloads are only limited by
+// SNAPSHOT_MAX_PAYLOAD_BYTES
+
+float snapshot_endpoint_pacing_rate( struct snapshot_endpoint_t * endpoint );
+
+int snapshot_endpoint_max_payload_bytes( struct snapshot_endpoint_t * endpoint );
+
 const uint64_t * snapshot_endpoint_counters( struct snapshot_endpoint_t * endpoint );
 
 // -------------------------------------------------------------------
@@ -0,0 +1,32 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_PACKET_ALLOCATOR_H
+#define SNAPSHOT_PACKET_ALLOCATOR_H
+
+#include "snapshot.h"
+
+#define SNAPSHOT_PACKET_ALLOCATOR_SMALL_PACKET_BYTES                 2048
+#define SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES                      3
+#define SNAPSHOT_PACKET_ALLOCATOR_THREAD_CACHE_SIZE                    64
+#define SNAPSHOT_PACKET_ALLOCATOR_MAX_FREE_BLOCKS                    4096
+
+// slab allocator behind snapshot_create_packet and snapshot_destroy_packet. packet buffers are rounded up to one of a few
+// size classes (fragments, payloads and max size packets) and recycled through free lists instead of going back to the heap.
+// each thread keeps a small cache per size class, and only takes the global lock to move a batch of blocks in or out of it.
+// only buffers allocated with the default (NULL) context are pooled. buffers from a user context go straight to snapshot_malloc
+// and snapshot_free with that context, and must be freed with the same context they were allocated with.
+
+int snapshot_packet_allocator_init();
+
+void snapshot_packet_allocator_term();
+
+uint8_t * snapshot_packet_allocator_alloc( void * context, int bytes );
+
+void snapshot_packet_allocator_free( void * context, uint8_t * buffer );
+
+void snapshot_packet_allocator_counters( uint64_t * hits, uint64_t * misses );
+
+#endif // #ifndef SNAPSHOT_PACKET_ALLOCATOR_H
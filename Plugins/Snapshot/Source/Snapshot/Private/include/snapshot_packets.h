@@ -16,6 +16,8 @@
 
 #define SNAPSHOT_MAX_PASSTHROUGH_BYTES            1500
 
+#define SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES         24
+
 #define SNAPSHOT_CONNECTION_REQUEST_PACKET           0
 #define SNAPSHOT_CONNECTION_DENIED_PACKET            1
 #define SNAPSHOT_CONNECTION_CHALLENGE_PACKET         2
@@ -68,11 +70,16 @@ struct snapshot_connection_response_packet_t
     uint8_t challenge_token_data[SNAPSHOT_CHALLENGE_TOKEN_BYTES];
 };
 
+// clients ack the payload packets they have received from the server on their keep alives, so acks never take up the
+// payload channel. keep alives from the server carry no acks
+
 struct snapshot_keep_alive_packet_t
 {
     uint8_t packet_type;
     int client_index;
     int max_clients;
+    uint16_t ack;
+    uint32_t ack_bits;
 };
 
 struct snapshot_payload_packet_t
@@ -94,6 +101,17 @@ struct snapshot_disconnect_packet_t
     uint8_t packet_type;
 };
 
+// a payload packet in two pieces: a small header in a side buffer, and a slice of the payload it was split from.
+// the slice is only copied once, when the packet is gathered into its output buffer and encrypted in place there
+
+struct snapshot_payload_iovec_t
+{
+    uint8_t header[SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES];
+    int header_bytes;
+    const uint8_t * data;
+    int data_bytes;
+};
+
 uint8_t * snapshot_create_packet( void * context, int packet_bytes );
 
 void snapshot_destroy_packet( void * context, uint8_t * packet );
@@ -104,6 +122,8 @@ struct snapshot_passthrough_packet_t * snapshot_wrap_passthrough_packet( uint8_t
 
 uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * write_packet_key, uint64_t protocol_id, int * out_bytes );
 
+int snapshot_write_payload_iovec( const struct snapshot_payload_iovec_t * iovec, uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * write_packet_key, uint64_t protocol_id, int * out_bytes );
+
 void * snapshot_read_packet( uint8_t * buffer, 
                              int buffer_length, 
                              uint64_t * sequence, 
@@ -55,12 +55,40 @@ int snapshot_platform_hostname_resolve( const char * hostname, const char * port
 
 snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size );
 
+// same as above, but the port may be shared with other reuse port sockets, and incoming packets are spread across them by source address.
+// returns NULL if the platform doesn't support it
+
+snapshot_platform_socket_t * snapshot_platform_socket_create_reuse_port( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size );
+
 void snapshot_platform_socket_destroy( snapshot_platform_socket_t * socket );
 
 void snapshot_platform_socket_send_packet( snapshot_platform_socket_t * socket, const snapshot_address_t * to, const void * packet_data, int packet_bytes );
 
+void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, int num_packets );
+
+// same as above, but with kernel timed release enabled each packet is held until its send time, in platform time. a send time of zero means now.
+// without kernel timed release the send times are ignored
+
+void snapshot_platform_socket_send_packets_at( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, const double * send_time, int num_packets );
+
 int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket, snapshot_address_t * from, void * packet_data, int max_packet_size );
 
+// receives up to max_packets in one go. returns the number received. packet_data pointers may be reordered so valid packets are contiguous.
+// invalid packets are dropped from the count, so a return of zero doesn't mean the socket has been drained. num_received is set to how
+// many datagrams were taken off the socket, including the dropped ones, and only zero there means the socket is empty
+
+int snapshot_platform_socket_receive_packets( snapshot_platform_socket_t * socket, snapshot_address_t * from, void ** packet_data, int * packet_bytes, int max_packet_size, int max_packets, int * num_received );
+
+// optional kernel segmentation offload. returns SNAPSHOT_ERROR if the platform doesn't support it, in which case the socket works as before
+
+int snapshot_platform_socket_enable_gso( snapshot_platform_socket_t * socket );
+
+int snapshot_platform_socket_enable_gro( snapshot_platform_socket_t * socket );
+
+// optional kernel timed release (SO_TXTIME). returns SNAPSHOT_ERROR if the platform doesn't support it
+
+int snapshot_platform_socket_enable_txtime( snapshot_platform_socket_t * socket );
+
 // ----------------------------------------------------------------
 
 snapshot_platform_thread_t * snapshot_platform_thread_create( void * context, snapshot_platform_thread_func_t func, void * arg );
@@ -79,6 +107,12 @@ void snapshot_platform_mutex_acquire( struct snapshot_platform_mutex_t * mutex )
 
 void snapshot_platform_mutex_release( struct snapshot_platform_mutex_t * mutex );
 
+// ----------------------------------------------------------------
+
+// hint that a large, huge page aligned block of memory should be backed by huge pages. does nothing if the platform doesn't support it
+
+void snapshot_platform_advise_huge_pages( void * memory, size_t bytes );
+
 #ifdef __cplusplus
 
 struct snapshot_platform_mutex_helper_t
@@ -23,6 +23,9 @@ struct snapshot_platform_socket_t
     void * context;
     int type;
     snapshot_platform_socket_handle_t handle;
+    bool gso;
+    bool txtime;
+    struct snapshot_platform_socket_gro_t * gro;
 };
 
 // -------------------------------------
@@ -8,49 +8,78 @@
 
 #include "snapshot.h"
 
-#define SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE 256
+// sliding window of received sequence numbers, one bit per packet (RFC 6479). the bitmap is a ring of 64 bit blocks with one
+// block more than the window, so sliding forward only ever clears whole blocks. the window must be a power of two in [64,4096]
+
+#ifndef SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE
+#define SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE                          256
+#endif // #ifndef SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE
+
+#define SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE                          SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE
+
+#define SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS                           ( SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE / 64 + 1 )
+
+static_assert( SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE >= 64 && SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE <= 4096, "replay protection window must be in [64,4096]" );
+static_assert( ( SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE & ( SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE - 1 ) ) == 0, "replay protection window must be a power of two" );
 
 struct snapshot_replay_protection_t
 {
     uint64_t most_recent_sequence;
-    uint64_t received_packet[SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE];
+    uint64_t received_bitmap[SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS];
 };
 
 inline void snapshot_replay_protection_reset( struct snapshot_replay_protection_t * replay_protection )
 {
     snapshot_assert( replay_protection );
     replay_protection->most_recent_sequence = 0;
-    memset( replay_protection->received_packet, 0xFF, sizeof( replay_protection->received_packet ) );
+    memset( replay_protection->received_bitmap, 0, sizeof( replay_protection->received_bitmap ) );
 }
 
 inline int snapshot_replay_protection_already_received( struct snapshot_replay_protection_t * replay_protection, uint64_t sequence )
 {
     snapshot_assert( replay_protection );
 
-    if ( sequence + SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE <= replay_protection->most_recent_sequence )
+    if ( sequence + SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE <= replay_protection->most_recent_sequence )
         return 1;
-    
-    int index = (int) ( sequence % SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE );
 
-    if ( replay_protection->received_packet[index] == UINT64_MAX )
+    // anything newer than the most recent sequence falls in a block that will be cleared when the window slides
+
+    if ( sequence > replay_protection->most_recent_sequence )
         return 0;
 
-    if ( replay_protection->received_packet[index] >= sequence )
-        return 1;
+    const int block = (int) ( ( sequence / 64 ) % SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS );
 
-    return 0;
+    return (int) ( ( replay_protection->received_bitmap[block] >> ( sequence % 64 ) ) & 1 );
 }
 
 inline void snapshot_replay_protection_advance_sequence( struct snapshot_replay_protection_t * replay_protection, uint64_t sequence )
 {
     snapshot_assert( replay_protection );
 
+    if ( sequence + SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE <= replay_protection->most_recent_sequence )
+        return;
+
     if ( sequence > replay_protection->most_recent_sequence )
+    {
+        // clear the blocks the window slides over. a jump of more than the whole ring clears everything
+
+        const uint64_t current_block = replay_protection->most_recent_sequence / 64;
+
+        uint64_t num_blocks = sequence / 64 - current_block;
+        if ( num_blocks > SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS )
+            num_blocks = SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS;
+
+        for ( uint64_t i = 1; i <= num_blocks; ++i )
+        {
+            replay_protection->received_bitmap[( current_block + i ) % SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS] = 0;
+        }
+
         replay_protection->most_recent_sequence = sequence;
+    }
 
-    int index = (int) ( sequence % SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE );
+    const int block = (int) ( ( sequence / 64 ) % SNAPSHOT_REPLAY_PROTECTION_NUM_BLOCKS );
 
-    replay_protection->received_packet[index] = sequence;
+    replay_protection->received_bitmap[block] |= 1ULL << ( sequence % 64 );
 }
 
 #endif // #ifndef SNAPSHOT_REPLAY_PROTECTION_H
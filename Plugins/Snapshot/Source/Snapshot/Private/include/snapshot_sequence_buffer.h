@@ -8,6 +8,8 @@
 
 #include "snapshot.h"
 
+struct snapshot_arena_t;
+
 struct snapshot_sequence_buffer_t
 {
     void * context;
@@ -16,10 +18,25 @@ struct snapshot_sequence_buffer_t
     int entry_stride;
     uint32_t * entry_sequence;
     uint8_t * entry_data;
+    uint64_t received_bits;
+    bool arena_allocated;
 };
 
+// received_bits mirrors the 64 most recent sequence numbers: bit n is set when sequence - 1 - n is in the buffer.
+// it is kept up to date on insert, advance and remove, so ack bits come from the low 32 bits instead of 32 lookups.
+
+int snapshot_sequence_greater_than( uint16_t s1, uint16_t s2 );
+
+int snapshot_sequence_less_than( uint16_t s1, uint16_t s2 );
+
 struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create( void * context, int num_entries, int entry_stride );
 
+// same as above, but carved from an arena sized with snapshot_sequence_buffer_arena_bytes. destroy doesn't free anything
+
+size_t snapshot_sequence_buffer_arena_bytes( int num_entries, int entry_stride );
+
+struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create_in_arena( struct snapshot_arena_t * arena, void * context, int num_entries, int entry_stride );
+
 void snapshot_sequence_buffer_destroy( struct snapshot_sequence_buffer_t * sequence_buffer );
 
 void snapshot_sequence_buffer_reset( struct snapshot_sequence_buffer_t * sequence_buffer );
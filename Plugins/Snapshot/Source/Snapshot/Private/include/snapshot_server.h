@@ -38,21 +38,52 @@
 #define SNAPSHOT_SERVER_COUNTER_PACKETS_SENT                                        24
 #define SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_LOOPBACK                               25
 #define SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_SIMULATOR                              26
+#define SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES                                  27
+#define SNAPSHOT_SERVER_COUNTER_SNAPSHOT_OBJECTS_DEFERRED                           28
+#define SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT                                  29
 
-#define SNAPSHOT_SERVER_NUM_COUNTERS                                                27
+#define SNAPSHOT_SERVER_NUM_COUNTERS                                                30
 
 struct snapshot_server_config_t
 {
     void * context;
+    void * callback_context;
     int max_clients;
     uint64_t protocol_id;
     uint8_t private_key[SNAPSHOT_KEY_BYTES];
     struct snapshot_network_simulator_t * network_simulator;
+    bool enable_gso;
+    bool enable_gro;
+    bool reuse_port;
+    bool use_arena;
+    int num_snapshot_objects;
+    int snapshot_object_bytes;
+    float snapshot_bandwidth_kbps;
+    bool enable_congestion_control;
+    bool enable_pacing;
+    bool enable_txtime;
+    float pacing_rate_kbps;
+    float fec_overhead;
+    bool enable_fragment_resend;
+    double stats_update_interval;
+    int reported_max_clients;
+    int (*assign_client_index_callback)(void*,int);
     void (*connect_disconnect_callback)(void*,int,int);
     void (*send_loopback_packet_callback)(void*,const struct snapshot_address_t*,uint8_t*,int);
     void (*process_passthrough_callback)(void*,const struct snapshot_address_t*,int,const uint8_t*,int);
+    void (*process_payload_callback)(void*,int,const uint8_t*,int);
 };
 
+// context is passed to the allocator for everything the server allocates, and callback_context is passed to the callbacks.
+// keep context NULL unless you have installed an allocator that needs it, since packets are only pooled for the NULL context
+
+// assign_client_index_callback is called just before a client connects to a slot. it returns the client index the client is
+// told it has in keep alives, or -1 to deny the connection. reported_max_clients is the max clients sent along with it. both
+// default to the server's own slots, and are there so the sharded server can hand out client indices across all its shards
+
+// stats_update_interval is how often each client endpoint recalculates packet loss and bandwidth, in seconds. the default of
+// zero recalculates them on every update
+
 void snapshot_default_server_config( struct snapshot_server_config_t * config );
 
 struct snapshot_server_t * snapshot_server_create( const char * server_address, const struct snapshot_server_config_t * config, double time );
@@ -61,6 +92,16 @@ void snapshot_server_destroy( struct snapshot_server_t * server );
 
 void snapshot_server_update( struct snapshot_server_t * server, double time );
 
+void snapshot_server_flush_packets( struct snapshot_server_t * server );
+
+// with enable_pacing, fragment trains are spread out at pacing_rate_kbps (or the congestion controlled rate, if lower) instead
+// of going out back to back, but never over more than the time between updates. paced packets wait in a queue per client that
+// holds a whole fragment train, and call this between updates to release the ones that are due. with enable_txtime on linux,
+// packets are handed to the kernel straight away with a SO_TXTIME release time instead, which only has an effect with the fq
+// or etf qdisc
+
+void snapshot_server_send_paced_packets( struct snapshot_server_t * server );
+
 int snapshot_server_connected_clients( struct snapshot_server_t * server );
 
 int snapshot_server_max_clients( struct snapshot_server_t * server );
@@ -95,6 +136,16 @@ uint16_t snapshot_server_port( struct snapshot_server_t * server );
 
 void snapshot_server_set_flags( struct snapshot_server_t * server, uint64_t flags );
 
+// when num_snapshot_objects is set, each update closes a snapshot of the objects and sends each connected client the objects
+// it is behind on, delta compressed against the latest state of each object that client has acked. each client has a byte
+// budget that fills at snapshot_bandwidth_kbps, limited by how fast the client is acking, and the highest priority objects
+// are sent first. objects that don't fit wait for a later update. with enable_congestion_control, the client endpoint's
+// pacing rate and max payload size limit the budget instead. see snapshot_delta.h and snapshot_endpoint.h
+
+void snapshot_server_set_snapshot_object( struct snapshot_server_t * server, int object_index, const uint8_t * object_data );
+
+void snapshot_server_set_snapshot_object_priority( struct snapshot_server_t * server, int object_index, float priority );
+
 #if SNAPSHOT_DEVELOPMENT
 void snapshot_server_set_development_flags( struct snapshot_server_t * server, uint64_t flags );
 #endif // #if SNAPSHOT_DEVELOPMENT
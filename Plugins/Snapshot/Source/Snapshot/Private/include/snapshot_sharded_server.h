@@ -0,0 +1,52 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_SHARDED_SERVER_H
+#define SNAPSHOT_SHARDED_SERVER_H
+
+#include "snapshot.h"
+#include "snapshot_server.h"
+
+#define SNAPSHOT_SHARDED_SERVER_MAX_SHARDS                                          64
+
+// runs num_shards servers on the same port, each on its own worker thread with its own reuse port socket.
+// the kernel hashes each client address to one socket, so receive, decrypt, endpoint processing and send for
+// that client all happen on one worker. connect, disconnect, payload and passthrough callbacks are handed to the
+// game thread through lock free queues, and are called with global client indices from snapshot_sharded_server_update.
+// max_clients is enforced across all shards, and each shard has room for twice its even share, so an uneven hash doesn't
+// turn clients away early. client indices are global, including the one each client is told in keep alives.
+// the network simulator and loopback clients are not supported.
+
+struct snapshot_sharded_server_t * snapshot_sharded_server_create( const char * server_address, const struct snapshot_server_config_t * config, int num_shards );
+
+void snapshot_sharded_server_destroy( struct snapshot_sharded_server_t * sharded_server );
+
+void snapshot_sharded_server_update( struct snapshot_sharded_server_t * sharded_server );
+
+int snapshot_sharded_server_num_shards( struct snapshot_sharded_server_t * sharded_server );
+
+int snapshot_sharded_server_max_clients( struct snapshot_sharded_server_t * sharded_server );
+
+int snapshot_sharded_server_num_connected_clients( struct snapshot_sharded_server_t * sharded_server );
+
+int snapshot_sharded_server_client_connected( struct snapshot_sharded_server_t * sharded_server, int client_index );
+
+uint64_t snapshot_sharded_server_client_id( struct snapshot_sharded_server_t * sharded_server, int client_index );
+
+struct snapshot_address_t * snapshot_sharded_server_client_address( struct snapshot_sharded_server_t * sharded_server, int client_index );
+
+void * snapshot_sharded_server_client_user_data( struct snapshot_sharded_server_t * sharded_server, int client_index );
+
+void snapshot_sharded_server_send_passthrough_packet( struct snapshot_sharded_server_t * sharded_server, int client_index, const uint8_t * passthrough_data, int passthrough_bytes );
+
+void snapshot_sharded_server_disconnect_client( struct snapshot_sharded_server_t * sharded_server, int client_index );
+
+uint16_t snapshot_sharded_server_port( struct snapshot_sharded_server_t * sharded_server );
+
+#if SNAPSHOT_DEVELOPMENT
+void snapshot_sharded_server_set_development_flags( struct snapshot_sharded_server_t * sharded_server, uint64_t flags );
+#endif // #if SNAPSHOT_DEVELOPMENT
+
+#endif // #ifndef SNAPSHOT_SHARDED_SERVER_H
@@ -0,0 +1,29 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_SPSC_QUEUE_H
+#define SNAPSHOT_SPSC_QUEUE_H
+
+#include "snapshot.h"
+
+// lock free single producer, single consumer queue of fixed size entries. capacity must be a power of two.
+// the producer writes into the entry returned by begin push and publishes it with end push. the consumer reads
+// the entry returned by front and releases it with pop. exactly one thread may push, and exactly one thread may pop.
+
+struct snapshot_spsc_queue_t * snapshot_spsc_queue_create( void * context, int capacity, int entry_bytes );
+
+void snapshot_spsc_queue_destroy( struct snapshot_spsc_queue_t * queue );
+
+void * snapshot_spsc_queue_begin_push( struct snapshot_spsc_queue_t * queue );
+
+void snapshot_spsc_queue_end_push( struct snapshot_spsc_queue_t * queue );
+
+void * snapshot_spsc_queue_front( struct snapshot_spsc_queue_t * queue );
+
+void snapshot_spsc_queue_pop( struct snapshot_spsc_queue_t * queue );
+
+int snapshot_spsc_queue_capacity( struct snapshot_spsc_queue_t * queue );
+
+#endif // #ifndef SNAPSHOT_SPSC_QUEUE_H
@@ -8,4 +8,8 @@
 
 void snapshot_run_tests();
 
+// wall clock benchmarks. these are kept out of snapshot_run_tests so the unit run stays quiet and fast
+
+void snapshot_run_benchmarks();
+
 #endif // #ifndef SNAPSHOT_TESTS_H
@@ -0,0 +1,35 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#ifndef SNAPSHOT_TIMER_WHEEL_H
+#define SNAPSHOT_TIMER_WHEEL_H
+
+#include "snapshot.h"
+
+#define SNAPSHOT_TIMER_WHEEL_LEVELS                                   4
+#define SNAPSHOT_TIMER_WHEEL_SLOT_BITS                                6
+#define SNAPSHOT_TIMER_WHEEL_SLOTS    ( 1 << SNAPSHOT_TIMER_WHEEL_SLOT_BITS )
+
+// hierarchical timer wheel. timers are identified by an index in [0,max_timers), so each owner maps its own ids onto a range.
+// scheduling and cancelling is constant time, and advancing only touches timers in slots whose time has come.
+// a timer fires on the first tick strictly after its deadline, so it is never early and at most one tick late.
+
+struct snapshot_timer_wheel_t * snapshot_timer_wheel_create( void * context, int max_timers, double tick_seconds, double time );
+
+void snapshot_timer_wheel_destroy( struct snapshot_timer_wheel_t * timer_wheel );
+
+void snapshot_timer_wheel_schedule( struct snapshot_timer_wheel_t * timer_wheel, int timer_id, double deadline );
+
+void snapshot_timer_wheel_cancel( struct snapshot_timer_wheel_t * timer_wheel, int timer_id );
+
+bool snapshot_timer_wheel_scheduled( struct snapshot_timer_wheel_t * timer_wheel, int timer_id );
+
+void snapshot_timer_wheel_advance( struct snapshot_timer_wheel_t * timer_wheel, double time );
+
+int snapshot_timer_wheel_pop_expired( struct snapshot_timer_wheel_t * timer_wheel );
+
+double snapshot_timer_wheel_tick_seconds( struct snapshot_timer_wheel_t * timer_wheel );
+
+#endif // #ifndef SNAPSHOT_TIMER_WHEEL_H
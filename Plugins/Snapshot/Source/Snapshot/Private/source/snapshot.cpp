@@ -6,6 +6,7 @@
 #include "snapshot.h"
 #include "snapshot_crypto.h"
 #include "snapshot_platform.h"
+#include "snapshot_packet_allocator.h"
 
 #include <stdarg.h>
 #include <stdlib.h>
@@ -23,11 +24,18 @@ int snapshot_init()
         return SNAPSHOT_ERROR;
     }
 
+    if ( snapshot_packet_allocator_init() != SNAPSHOT_OK )
+    {
+        return SNAPSHOT_ERROR;
+    }
+
     return SNAPSHOT_OK;
 }
 
 void snapshot_term()
 {
+    snapshot_packet_allocator_term();
+
     snapshot_platform_term();
 }
 
@@ -0,0 +1,202 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_address_map.h"
+#include "snapshot_crypto.h"
+
+static inline uint64_t snapshot_address_hash_mix( uint64_t h )
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint32_t snapshot_address_hash( const struct snapshot_address_t * address, uint64_t seed )
+{
+    snapshot_assert( address );
+
+    // the seed is random per map, so remote peers can't pick source addresses that all land in the same probe sequence
+
+    uint64_t h = seed ^ ( ( (uint64_t) address->type ) << 56 ) ^ ( ( (uint64_t) address->port ) << 32 );
+
+    if ( address->type == SNAPSHOT_ADDRESS_IPV4 )
+    {
+        h ^= ( ( (uint64_t) address->data.ipv4[0] ) )       |
+             ( ( (uint64_t) address->data.ipv4[1] ) << 8 )  |
+             ( ( (uint64_t) address->data.ipv4[2] ) << 16 ) |
+             ( ( (uint64_t) address->data.ipv4[3] ) << 24 );
+    }
+    else if ( address->type == SNAPSHOT_ADDRESS_IPV6 )
+    {
+        h ^= ( ( (uint64_t) address->data.ipv6[0] ) )       |
+             ( ( (uint64_t) address->data.ipv6[1] ) << 16 ) |
+             ( ( (uint64_t) address->data.ipv6[2] ) << 32 ) |
+             ( ( (uint64_t) address->data.ipv6[3] ) << 48 );
+
+        h = snapshot_address_hash_mix( h );
+
+        h ^= ( ( (uint64_t) address->data.ipv6[4] ) )       |
+             ( ( (uint64_t) address->data.ipv6[5] ) << 16 ) |
+             ( ( (uint64_t) address->data.ipv6[6] ) << 32 ) |
+             ( ( (uint64_t) address->data.ipv6[7] ) << 48 );
+    }
+
+    h = snapshot_address_hash_mix( h );
+
+    return (uint32_t) ( h ^ ( h >> 32 ) );
+}
+
+int snapshot_address_map_capacity( int max_entries )
+{
+    snapshot_assert( max_entries > 0 );
+
+    int capacity = 1;
+    while ( capacity < max_entries * 2 )
+        capacity <<= 1;
+
+    return capacity;
+}
+
+void snapshot_address_map_init( struct snapshot_address_map_t * map, struct snapshot_address_map_entry_t * entries, int capacity )
+{
+    snapshot_assert( map );
+    snapshot_assert( entries );
+    snapshot_assert( capacity > 0 );
+    snapshot_assert( ( capacity & ( capacity - 1 ) ) == 0 );
+
+    map->capacity = capacity;
+    map->entries = entries;
+
+    snapshot_address_map_reset( map );
+}
+
+void snapshot_address_map_reset( struct snapshot_address_map_t * map )
+{
+    snapshot_assert( map );
+
+    snapshot_crypto_random_bytes( (uint8_t*) &map->seed, sizeof(map->seed) );
+
+    map->num_entries = 0;
+
+    memset( map->entries, 0, sizeof(struct snapshot_address_map_entry_t) * map->capacity );
+
+    for ( int i = 0; i < map->capacity; ++i )
+    {
+        map->entries[i].value = -1;
+    }
+}
+
+static int snapshot_address_map_find_slot( const struct snapshot_address_map_t * map, const struct snapshot_address_t * address, uint32_t hash )
+{
+    const int mask = map->capacity - 1;
+
+    int slot = (int) ( hash & mask );
+
+    while ( map->entries[slot].address.type != SNAPSHOT_ADDRESS_NONE )
+    {
+        if ( map->entries[slot].hash == hash && snapshot_address_equal( &map->entries[slot].address, address ) )
+            return slot;
+
+        slot = ( slot + 1 ) & mask;
+    }
+
+    return -1;
+}
+
+int snapshot_address_map_find( const struct snapshot_address_map_t * map, const struct snapshot_address_t * address )
+{
+    snapshot_assert( map );
+    snapshot_assert( address );
+
+    if ( address->type == SNAPSHOT_ADDRESS_NONE )
+        return -1;
+
+    const int slot = snapshot_address_map_find_slot( map, address, snapshot_address_hash( address, map->seed ) );
+
+    return ( slot != -1 ) ? map->entries[slot].value : -1;
+}
+
+bool snapshot_address_map_insert( struct snapshot_address_map_t * map, const struct snapshot_address_t * address, int value )
+{
+    snapshot_assert( map );
+    snapshot_assert( address );
+    snapshot_assert( address->type != SNAPSHOT_ADDRESS_NONE );
+
+    const uint32_t hash = snapshot_address_hash( address, map->seed );
+
+    const int mask = map->capacity - 1;
+
+    int slot = (int) ( hash & mask );
+
+    while ( map->entries[slot].address.type != SNAPSHOT_ADDRESS_NONE )
+    {
+        if ( map->entries[slot].hash == hash && snapshot_address_equal( &map->entries[slot].address, address ) )
+        {
+            map->entries[slot].value = value;
+            return true;
+        }
+
+        slot = ( slot + 1 ) & mask;
+    }
+
+    // always keep at least one empty slot, so probe sequences terminate
+
+    if ( map->num_entries + 1 >= map->capacity )
+        return false;
+
+    map->entries[slot].address = *address;
+    map->entries[slot].hash = hash;
+    map->entries[slot].value = value;
+    map->num_entries++;
+
+    return true;
+}
+
+bool snapshot_address_map_remove( struct snapshot_address_map_t * map, const struct snapshot_address_t * address )
+{
+    snapshot_assert( map );
+    snapshot_assert( address );
+
+    if ( address->type == SNAPSHOT_ADDRESS_NONE )
+        return false;
+
+    int slot = snapshot_address_map_find_slot( map, address, snapshot_address_hash( address, map->seed ) );
+
+    if ( slot == -1 )
+        return false;
+
+    // backward shift deletion: pull later entries in the probe sequence back into the hole, so no tombstones are needed
+
+    const int mask = map->capacity - 1;
+
+    int next = slot;
+
+    while ( true )
+    {
+        next = ( next + 1 ) & mask;
+
+        if ( map->entries[next].address.type == SNAPSHOT_ADDRESS_NONE )
+            break;
+
+        const int ideal = (int) ( map->entries[next].hash & mask );
+
+        const bool stays = ( slot <= next ) ? ( slot < ideal && ideal <= next ) : ( slot < ideal || ideal <= next );
+
+        if ( !stays )
+        {
+            map->entries[slot] = map->entries[next];
+            slot = next;
+        }
+    }
+
+    memset( &map->entries[slot], 0, sizeof(struct snapshot_address_map_entry_t) );
+    map->entries[slot].value = -1;
+    map->num_entries--;
+
+    return true;
+}
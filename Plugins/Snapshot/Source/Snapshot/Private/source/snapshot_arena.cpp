@@ -0,0 +1,86 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_arena.h"
+#include "snapshot_platform.h"
+
+static size_t snapshot_arena_align( size_t value, size_t alignment )
+{
+    return ( value + alignment - 1 ) & ~( alignment - 1 );
+}
+
+size_t snapshot_arena_bytes( size_t bytes )
+{
+    return snapshot_arena_align( bytes, SNAPSHOT_ARENA_ALIGNMENT );
+}
+
+int snapshot_arena_create( struct snapshot_arena_t * arena, void * context, size_t bytes )
+{
+    snapshot_assert( arena );
+    snapshot_assert( bytes > 0 );
+
+    memset( arena, 0, sizeof( struct snapshot_arena_t ) );
+
+    const bool huge_pages = bytes >= SNAPSHOT_ARENA_HUGE_PAGE_BYTES;
+
+    const size_t alignment = huge_pages ? SNAPSHOT_ARENA_HUGE_PAGE_BYTES : SNAPSHOT_ARENA_ALIGNMENT;
+
+    const size_t size = snapshot_arena_align( bytes, alignment );
+
+    uint8_t * memory = (uint8_t*) snapshot_malloc( context, size + alignment );
+    if ( !memory )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to allocate %d byte arena", (int) size );
+        return SNAPSHOT_ERROR;
+    }
+
+    arena->context = context;
+    arena->memory = memory;
+    arena->base = (uint8_t*) snapshot_arena_align( (size_t) memory, alignment );
+    arena->size = size;
+    arena->offset = 0;
+
+    if ( huge_pages )
+    {
+        snapshot_platform_advise_huge_pages( arena->base, arena->size );
+    }
+
+    return SNAPSHOT_OK;
+}
+
+void snapshot_arena_destroy( struct snapshot_arena_t * arena )
+{
+    snapshot_assert( arena );
+
+    // the arena struct may itself live inside the arena
+
+    void * context = arena->context;
+    uint8_t * memory = arena->memory;
+
+    if ( memory )
+    {
+        snapshot_free( context, memory );
+    }
+}
+
+void * snapshot_arena_alloc( struct snapshot_arena_t * arena, size_t bytes )
+{
+    snapshot_assert( arena );
+    snapshot_assert( arena->base );
+
+    const size_t aligned_bytes = snapshot_arena_bytes( bytes );
+
+    if ( arena->offset + aligned_bytes > arena->size )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "arena is out of memory" );
+        return NULL;
+    }
+
+    void * p = arena->base + arena->offset;
+
+    arena->offset += aligned_bytes;
+
+    return p;
+}
@@ -10,8 +10,11 @@
 #include "snapshot_challenge_token.h"
 #include "snapshot_replay_protection.h"
 #include "snapshot_packets.h"
+#include "snapshot_read_write.h"
 #include "snapshot_network_simulator.h"
 #include "snapshot_endpoint.h"
+#include "snapshot_arena.h"
+#include "snapshot_delta.h"
 #include <time.h>
 
 #define SNAPSHOT_CLIENT_MAX_SIM_RECEIVE_PACKETS 256
@@ -48,6 +51,7 @@ void snapshot_default_client_config( struct snapshot_client_config_t * config )
 struct snapshot_client_t
 {
     struct snapshot_client_config_t config;
+    struct snapshot_arena_t arena;
     int state;
     double time;
     double connect_start_time;
@@ -64,6 +68,7 @@ struct snapshot_client_t
     struct snapshot_connect_token_t connect_token;
     struct snapshot_platform_socket_t * socket;
     struct snapshot_endpoint_t * endpoint;
+    struct snapshot_delta_receiver_t * snapshot_receiver;
     struct snapshot_replay_protection_t replay_protection;
     uint64_t challenge_token_sequence;
     uint8_t challenge_token_data[SNAPSHOT_CHALLENGE_TOKEN_BYTES];
@@ -71,6 +76,10 @@ struct snapshot_client_t
     uint8_t write_packet_key[SNAPSHOT_KEY_BYTES];
     uint8_t allowed_packets[SNAPSHOT_NUM_PACKETS];
     int loopback;
+    void * receive_packet_data[SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE];
+    int receive_packet_bytes[SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE];
+    struct snapshot_address_t receive_from[SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE];
+    uint8_t receive_buffer[SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE][SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
 #if SNAPSHOT_DEVELOPMENT
     uint64_t development_flags;
     uint8_t * sim_receive_packet_data[SNAPSHOT_CLIENT_MAX_SIM_RECEIVE_PACKETS];
@@ -115,11 +124,38 @@ struct snapshot_client_t * snapshot_client_create( const char * bind_address_str
             snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create client socket" );
             return NULL;
         }
+
+        if ( config->enable_gro && snapshot_platform_socket_enable_gro( socket ) != SNAPSHOT_OK )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "client udp gro is not available" );
+        }
     }
 
-    struct snapshot_client_t * client = (struct snapshot_client_t*) snapshot_malloc( config->context, sizeof( struct snapshot_client_t ) );
+    snapshot_endpoint_config_t endpoint_config;
+    snapshot_endpoint_default_config( &endpoint_config );
+    snapshot_copy_string( endpoint_config.name, "client", sizeof(endpoint_config.name) );
+    endpoint_config.context = config->context;
+    endpoint_config.enable_fragment_resend = config->enable_fragment_resend;
+    endpoint_config.stats_update_interval = config->stats_update_interval;
 
-    memset( client, 0, sizeof(snapshot_client_t) );
+    // in arena mode the client struct and its endpoint are carved from one allocation
+
+    struct snapshot_arena_t arena;
+    memset( &arena, 0, sizeof( arena ) );
+
+    struct snapshot_client_t * client = NULL;
+
+    if ( config->use_arena )
+    {
+        if ( snapshot_arena_create( &arena, config->context, snapshot_arena_bytes( sizeof( struct snapshot_client_t ) ) + snapshot_endpoint_arena_bytes( &endpoint_config ) ) == SNAPSHOT_OK )
+        {
+            client = (struct snapshot_client_t*) snapshot_arena_alloc( &arena, sizeof( struct snapshot_client_t ) );
+        }
+    }
+    else
+    {
+        client = (struct snapshot_client_t*) snapshot_malloc( config->context, sizeof( struct snapshot_client_t ) );
+    }
 
     if ( !client )
     {
@@ -130,6 +166,10 @@ struct snapshot_client_t * snapshot_client_create( const char * bind_address_str
         return NULL;
     }
 
+    memset( client, 0, sizeof(snapshot_client_t) );
+
+    client->arena = arena;
+
 #if SNAPSHOT_DEVELOPMENT
     if ( config->network_simulator )
     {
@@ -163,6 +203,11 @@ struct snapshot_client_t * snapshot_client_create( const char * bind_address_str
 
     snapshot_replay_protection_reset( &client->replay_protection );
 
+    for ( int i = 0; i < SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE; ++i )
+    {
+        client->receive_packet_data[i] = client->receive_buffer[i] + SNAPSHOT_PACKET_PREFIX_BYTES;
+    }
+
     client->allowed_packets[SNAPSHOT_CONNECTION_DENIED_PACKET] = 1;
     client->allowed_packets[SNAPSHOT_CONNECTION_CHALLENGE_PACKET] = 1;
     client->allowed_packets[SNAPSHOT_KEEP_ALIVE_PACKET] = 1;
@@ -170,12 +215,14 @@ struct snapshot_client_t * snapshot_client_create( const char * bind_address_str
     client->allowed_packets[SNAPSHOT_PASSTHROUGH_PACKET] = 1;
     client->allowed_packets[SNAPSHOT_DISCONNECT_PACKET] = 1;
 
-    snapshot_endpoint_config_t endpoint_config;
-    snapshot_endpoint_default_config( &endpoint_config );
-    snapshot_copy_string( endpoint_config.name, "client", sizeof(endpoint_config.name) );
-    endpoint_config.context = config->context;
-    
-    client->endpoint = snapshot_endpoint_create( &endpoint_config, time );
+    if ( client->arena.memory )
+    {
+        client->endpoint = snapshot_endpoint_create_in_arena( &client->arena, &endpoint_config, time );
+    }
+    else
+    {
+        client->endpoint = snapshot_endpoint_create( &endpoint_config, time );
+    }
 
     if ( !client->endpoint )
     {
@@ -184,6 +231,17 @@ struct snapshot_client_t * snapshot_client_create( const char * bind_address_str
         return NULL;
     }
 
+    if ( config->num_snapshot_objects > 0 )
+    {
+        client->snapshot_receiver = snapshot_delta_receiver_create( config->context, config->num_snapshot_objects, config->snapshot_object_bytes );
+        if ( !client->snapshot_receiver )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create client snapshot receiver" );
+            snapshot_client_destroy( client );
+            return NULL;
+        }
+    }
+
     return client;
 }
 
@@ -204,13 +262,26 @@ void snapshot_client_destroy( struct snapshot_client_t * client )
     {
         snapshot_endpoint_destroy( client->endpoint );
     }
+
+    if ( client->snapshot_receiver )
+    {
+        snapshot_delta_receiver_destroy( client->snapshot_receiver );
+    }
     
     if ( client->socket )
     {
         snapshot_platform_socket_destroy( client->socket );
     }
 
-    snapshot_free( client->config.context, client );
+    if ( client->arena.memory )
+    {
+        struct snapshot_arena_t arena = client->arena;
+        snapshot_arena_destroy( &arena );
+    }
+    else
+    {
+        snapshot_free( client->config.context, client );
+    }
 }
 
 void snapshot_client_set_state( struct snapshot_client_t * client, int client_state )
@@ -239,6 +310,11 @@ void snapshot_client_reset_before_next_connect( struct snapshot_client_t * clien
     snapshot_replay_protection_reset( &client->replay_protection );
 
     snapshot_endpoint_reset( client->endpoint );
+
+    if ( client->snapshot_receiver )
+    {
+        snapshot_delta_receiver_reset( client->snapshot_receiver );
+    }
 }
 
 void snapshot_client_reset_connection_data( struct snapshot_client_t * client, int client_state )
@@ -318,9 +394,13 @@ int snapshot_client_process_payload( struct snapshot_client_t * client, uint8_t
 
 #endif // #if SNAPSHOT_DEVELOPME SNAPSHOT_OKNT
 
-    (void) client;
+    if ( client->snapshot_receiver )
+    {
+        if ( snapshot_delta_receiver_read( client->snapshot_receiver, payload_data, payload_bytes ) != SNAPSHOT_OK )
+            return SNAPSHOT_ERROR;
 
-    // todo: process real payload
+        client->counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_RECEIVED]++;
+    }
 
     return SNAPSHOT_OK;
 }
@@ -459,8 +539,6 @@ bool snapshot_client_process_packet( struct snapshot_client_t * client, const st
                 uint8_t * payload_packet_data = payload_packet->payload_data;
                 int payload_packet_bytes = payload_packet->payload_bytes;
 
-                uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
-
                 uint8_t * payload_data = NULL;
                 int payload_bytes = 0;
 
@@ -468,7 +546,7 @@ bool snapshot_client_process_packet( struct snapshot_client_t * client, const st
                 uint16_t payload_ack = 0;
                 uint32_t payload_ack_bits = 0;
 
-                snapshot_endpoint_process_packet( client->endpoint, payload_packet_data, payload_packet_bytes, buffer, &payload_data, &payload_bytes, &payload_sequence, &payload_ack, &payload_ack_bits );
+                snapshot_endpoint_process_packet( client->endpoint, payload_packet_data, payload_packet_bytes, &payload_data, &payload_bytes, &payload_sequence, &payload_ack, &payload_ack_bits );
 
                 if ( payload_data )
                 {
@@ -560,20 +638,30 @@ void snapshot_client_receive_packets( struct snapshot_client_t * client )
     else
 #endif // #if SNAPSHOT_DEVELOPMENT
     {
-        // process packets received from socket
+        // process packets received from socket, draining it in batches. a short batch doesn't mean the socket is empty,
+        // and neither does one where every packet was dropped for being truncated or from an unknown address family, so
+        // keep going until the socket itself has nothing left to give
 
         while ( 1 )
         {
-            struct snapshot_address_t from;
-            uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
-            uint8_t * packet_data = buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
-            int packet_bytes = snapshot_platform_socket_receive_packet( client->socket, &from, packet_data, SNAPSHOT_MAX_PACKET_BYTES );
-            if ( packet_bytes == 0 )
-                break;
+            int num_datagrams_received = 0;
 
-            client->counters[SNAPSHOT_CLIENT_COUNTER_PACKETS_RECEIVED]++;
+            int num_packets_received = snapshot_platform_socket_receive_packets( client->socket, 
+                                                                                 client->receive_from, 
+                                                                                 client->receive_packet_data, 
+                                                                                 client->receive_packet_bytes, 
+                                                                                 SNAPSHOT_MAX_PACKET_BYTES, 
+                                                                                 SNAPSHOT_CLIENT_RECEIVE_BATCH_SIZE,
+                                                                                 &num_datagrams_received );
 
-            snapshot_client_process_packet( client, &from, packet_data, packet_bytes );
+            for ( int i = 0; i < num_packets_received; ++i )
+            {
+                client->counters[SNAPSHOT_CLIENT_COUNTER_PACKETS_RECEIVED]++;
+                snapshot_client_process_packet( client, &client->receive_from[i], (uint8_t*) client->receive_packet_data[i], client->receive_packet_bytes[i] );
+            }
+
+            if ( num_datagrams_received == 0 )
+                break;
         }
     }
 }
@@ -675,7 +763,11 @@ void snapshot_client_send_internal_packets( struct snapshot_client_t * client )
 
         case SNAPSHOT_CLIENT_STATE_CONNECTED:
         {
-            if ( client->last_internal_packet_send_time + 0.1 >= client->time )
+            // with snapshots on, keep alives carry the acks for the server's snapshot payloads, so they go out every update
+
+            const double keep_alive_interval = client->snapshot_receiver ? 0.0 : 0.1;
+
+            if ( client->last_internal_packet_send_time + keep_alive_interval >= client->time )
                 return;
 
             snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "client sent connection keep-alive packet to server" );
@@ -684,6 +776,7 @@ void snapshot_client_send_internal_packets( struct snapshot_client_t * client )
             packet.packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
             packet.client_index = 0;
             packet.max_clients = 0;
+            snapshot_endpoint_write_acks( client->endpoint, &packet.ack, &packet.ack_bits );
 
             snapshot_client_send_packet_to_server( client, &packet );
 
@@ -800,6 +893,52 @@ void snapshot_client_update_state_machine( struct snapshot_client_t * client )
     }
 }
 
+static void snapshot_client_send_endpoint_packet( struct snapshot_client_t * client, const uint8_t * data, int bytes )
+{
+    uint8_t * packet_data = snapshot_create_packet( client->config.context, bytes );
+
+    memcpy( packet_data, data, bytes );
+
+    snapshot_payload_packet_t * packet = snapshot_wrap_payload_packet( packet_data, bytes );
+
+    snapshot_client_send_packet_to_server( client, packet );
+
+    snapshot_destroy_packet( client->config.context, packet_data );
+
+    client->counters[SNAPSHOT_CLIENT_COUNTER_PAYLOAD_PACKETS_SENT]++;
+}
+
+static void snapshot_client_send_fragment_resends( struct snapshot_client_t * client )
+{
+    // report fragments missing from payloads the server is sending us, then resend the ones it says are missing from ours
+
+    snapshot_endpoint_update( client->endpoint, client->time );
+
+    uint8_t fragment_acks_data[SNAPSHOT_ENDPOINT_FRAGMENT_ACKS_BYTES];
+
+    const int fragment_acks_bytes = snapshot_endpoint_write_fragment_acks( client->endpoint, fragment_acks_data, sizeof( fragment_acks_data ) );
+
+    if ( fragment_acks_bytes > 0 )
+    {
+        snapshot_client_send_endpoint_packet( client, fragment_acks_data, fragment_acks_bytes );
+    }
+
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+    snapshot_endpoint_write_resend_iovecs( client->endpoint, &num_iovecs, iovecs );
+
+    for ( int i = 0; i < num_iovecs; i++ )
+    {
+        uint8_t fragment_data[SNAPSHOT_MAX_PACKET_BYTES];
+
+        memcpy( fragment_data, iovecs[i].header, iovecs[i].header_bytes );
+        memcpy( fragment_data + iovecs[i].header_bytes, iovecs[i].data, iovecs[i].data_bytes );
+
+        snapshot_client_send_endpoint_packet( client, fragment_data, iovecs[i].header_bytes + iovecs[i].data_bytes );
+    }
+}
+
 void snapshot_client_send_payload( struct snapshot_client_t * client )
 {
     snapshot_assert( client );
@@ -807,6 +946,11 @@ void snapshot_client_send_payload( struct snapshot_client_t * client )
     if ( client->state != SNAPSHOT_CLIENT_STATE_CONNECTED )
         return;
 
+    if ( client->config.enable_fragment_resend )
+    {
+        snapshot_client_send_fragment_resends( client );
+    }
+
 #if SNAPSHOT_DEVELOPMENT
 
     // test payload for validation
@@ -858,8 +1002,6 @@ void snapshot_client_send_payload( struct snapshot_client_t * client )
         return;
     }
 #endif // #if SNAPSHOT_DEVELOPMENT
-
-    // todo: generate real payload
 }
 
 void snapshot_client_update( struct snapshot_client_t * client, double time )
@@ -1014,6 +1156,20 @@ void snapshot_client_set_development_flags( struct snapshot_client_t * client, u
 
 #endif // #if SNAPSHOT_DEVELOPMENT
 
+uint32_t snapshot_client_snapshot_sequence( struct snapshot_client_t * client )
+{
+    snapshot_assert( client );
+    snapshot_assert( client->snapshot_receiver );
+    return snapshot_delta_receiver_sequence( client->snapshot_receiver );
+}
+
+const uint8_t * snapshot_client_snapshot_object( struct snapshot_client_t * client, int object_index )
+{
+    snapshot_assert( client );
+    snapshot_assert( client->snapshot_receiver );
+    return snapshot_delta_receiver_object( client->snapshot_receiver, object_index );
+}
+
 const uint64_t * snapshot_client_counters( struct snapshot_client_t * client )
 {
     snapshot_assert( client );
@@ -0,0 +1,723 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_delta.h"
+#include "snapshot_packets.h"
+#include "snapshot_address.h"
+#include "snapshot_bitpacker.h"
+#include "snapshot_stream.h"
+#include "snapshot_serialize.h"
+
+#include <stdlib.h>
+
+// every changed word costs at least its changed bit plus 32 bits of value, which bounds how many words one payload can change
+
+#define SNAPSHOT_DELTA_MAX_OBJECT_WORDS                 ( SNAPSHOT_DELTA_MAX_OBJECT_BYTES / 4 )
+#define SNAPSHOT_DELTA_MAX_CHANGED_WORDS                ( SNAPSHOT_MAX_PAYLOAD_BYTES * 8 / 33 + 1 )
+#define SNAPSHOT_DELTA_HEADER_BITS                                           64
+#define SNAPSHOT_DELTA_OBJECT_INDEX_BITS                                     38
+
+static_assert( SNAPSHOT_DELTA_MAX_OBJECT_WORDS <= 64, "changed words for an object must fit in a 64 bit mask" );
+
+template <typename Stream> bool snapshot_delta_serialize_header( Stream & stream, uint32_t & sequence, int & num_changed_objects, int num_objects )
+{
+    serialize_uint32( stream, sequence );
+    serialize_int( stream, num_changed_objects, 0, num_objects );
+    return true;
+}
+
+template <typename Stream> bool snapshot_delta_serialize_object( Stream & stream, int object_words, uint64_t & changed_words, uint32_t * values )
+{
+    for ( int i = 0; i < object_words; i++ )
+    {
+        bool changed = false;
+        if ( Stream::IsWriting )
+        {
+            changed = ( changed_words >> i ) & 1;
+        }
+        serialize_bool( stream, changed );
+        if ( changed )
+        {
+            if ( Stream::IsReading )
+            {
+                changed_words |= 1ULL << i;
+            }
+            serialize_bits( stream, values[i], 32 );
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------
+
+struct snapshot_delta_write_entry_t
+{
+    float priority;
+    int object_index;
+};
+
+struct snapshot_delta_world_t
+{
+    void * context;
+    int num_objects;
+    int object_words;
+    uint32_t sequence;
+    uint32_t * words;
+    uint32_t * word_sequence;
+    uint32_t * object_sequence;
+    float * object_priority;
+    int * history_objects;
+    int history_num_objects[SNAPSHOT_DELTA_HISTORY_SIZE];
+    struct snapshot_delta_write_entry_t * write_entries;
+    int * write_objects;
+    uint64_t * write_changed_words;
+};
+
+struct snapshot_delta_world_t * snapshot_delta_world_create( void * context, int num_objects, int object_bytes )
+{
+    snapshot_assert( num_objects > 0 );
+    snapshot_assert( num_objects <= SNAPSHOT_DELTA_MAX_OBJECTS );
+    snapshot_assert( object_bytes > 0 );
+    snapshot_assert( object_bytes <= SNAPSHOT_DELTA_MAX_OBJECT_BYTES );
+    snapshot_assert( ( object_bytes % 4 ) == 0 );
+
+    struct snapshot_delta_world_t * world = (struct snapshot_delta_world_t*) snapshot_malloc( context, sizeof( struct snapshot_delta_world_t ) );
+    if ( !world )
+        return NULL;
+
+    memset( world, 0, sizeof( struct snapshot_delta_world_t ) );
+
+    world->context = context;
+    world->num_objects = num_objects;
+    world->object_words = object_bytes / 4;
+
+    const size_t num_words = (size_t) num_objects * world->object_words;
+
+    world->words = (uint32_t*) snapshot_malloc( context, num_words * sizeof( uint32_t ) );
+    world->word_sequence = (uint32_t*) snapshot_malloc( context, num_words * sizeof( uint32_t ) );
+    world->object_sequence = (uint32_t*) snapshot_malloc( context, num_objects * sizeof( uint32_t ) );
+    world->object_priority = (float*) snapshot_malloc( context, num_objects * sizeof( float ) );
+    world->history_objects = (int*) snapshot_malloc( context, (size_t) SNAPSHOT_DELTA_HISTORY_SIZE * num_objects * sizeof( int ) );
+    world->write_entries = (struct snapshot_delta_write_entry_t*) snapshot_malloc( context, num_objects * sizeof( struct snapshot_delta_write_entry_t ) );
+    world->write_objects = (int*) snapshot_malloc( context, num_objects * sizeof( int ) );
+    world->write_changed_words = (uint64_t*) snapshot_malloc( context, num_objects * sizeof( uint64_t ) );
+
+    if ( !world->words || !world->word_sequence || !world->object_sequence || !world->object_priority || !world->history_objects || 
+         !world->write_entries || !world->write_objects || !world->write_changed_words )
+    {
+        snapshot_delta_world_destroy( world );
+        return NULL;
+    }
+
+    memset( world->words, 0, num_words * sizeof( uint32_t ) );
+    memset( world->word_sequence, 0, num_words * sizeof( uint32_t ) );
+    memset( world->object_sequence, 0, num_objects * sizeof( uint32_t ) );
+
+    for ( int i = 0; i < num_objects; i++ )
+    {
+        world->object_priority[i] = 1.0f;
+    }
+
+    return world;
+}
+
+void snapshot_delta_world_destroy( struct snapshot_delta_world_t * world )
+{
+    snapshot_assert( world );
+
+    void * context = world->context;
+
+    if ( world->words )
+        snapshot_free( context, world->words );
+    if ( world->word_sequence )
+        snapshot_free( context, world->word_sequence );
+    if ( world->object_sequence )
+        snapshot_free( context, world->object_sequence );
+    if ( world->object_priority )
+        snapshot_free( context, world->object_priority );
+    if ( world->history_objects )
+        snapshot_free( context, world->history_objects );
+    if ( world->write_entries )
+        snapshot_free( context, world->write_entries );
+    if ( world->write_objects )
+        snapshot_free( context, world->write_objects );
+    if ( world->write_changed_words )
+        snapshot_free( context, world->write_changed_words );
+
+    snapshot_free( context, world );
+}
+
+void snapshot_delta_world_set_object( struct snapshot_delta_world_t * world, int object_index, const uint8_t * object_data )
+{
+    snapshot_assert( world );
+    snapshot_assert( object_index >= 0 );
+    snapshot_assert( object_index < world->num_objects );
+    snapshot_assert( object_data );
+
+    // changes go into the snapshot being built, which is the one after the latest
+
+    const uint32_t building_sequence = world->sequence + 1;
+
+    uint32_t * words = world->words + (size_t) object_index * world->object_words;
+    uint32_t * word_sequence = world->word_sequence + (size_t) object_index * world->object_words;
+
+    bool changed = false;
+
+    for ( int i = 0; i < world->object_words; i++ )
+    {
+        uint32_t value;
+        memcpy( &value, object_data + i * 4, 4 );
+        if ( value != words[i] )
+        {
+            words[i] = value;
+            word_sequence[i] = building_sequence;
+            changed = true;
+        }
+    }
+
+    if ( changed && world->object_sequence[object_index] != building_sequence )
+    {
+        const int history_index = building_sequence % SNAPSHOT_DELTA_HISTORY_SIZE;
+        world->history_objects[(size_t) history_index * world->num_objects + world->history_num_objects[history_index]++] = object_index;
+        world->object_sequence[object_index] = building_sequence;
+    }
+}
+
+void snapshot_delta_world_set_object_priority( struct snapshot_delta_world_t * world, int object_index, float priority )
+{
+    snapshot_assert( world );
+    snapshot_assert( object_index >= 0 );
+    snapshot_assert( object_index < world->num_objects );
+    snapshot_assert( priority >= 0.0f );
+    world->object_priority[object_index] = priority;
+}
+
+uint32_t snapshot_delta_world_advance( struct snapshot_delta_world_t * world )
+{
+    snapshot_assert( world );
+
+    // the oldest snapshot in the history makes way for the next one to be built
+
+    world->sequence++;
+    world->history_num_objects[( world->sequence + 1 ) % SNAPSHOT_DELTA_HISTORY_SIZE] = 0;
+
+    return world->sequence;
+}
+
+uint32_t snapshot_delta_world_sequence( struct snapshot_delta_world_t * world )
+{
+    snapshot_assert( world );
+    return world->sequence;
+}
+
+// ---------------------------------------------------------------
+
+struct snapshot_delta_sent_packet_t
+{
+    uint16_t packet_sequence;
+    uint32_t snapshot_sequence;
+    uint64_t first_object;
+    int num_objects;
+};
+
+struct snapshot_delta_client_t
+{
+    void * context;
+    struct snapshot_delta_world_t * world;
+    uint32_t world_sequence;
+    bool full_scan;
+    uint32_t * acked_sequence;
+    float * accumulated_priority;
+    int num_dirty_objects;
+    int * dirty_objects;
+    int * dirty_index;
+    uint64_t sent_objects_head;
+    uint16_t sent_objects[SNAPSHOT_DELTA_SENT_OBJECTS_SIZE];
+    struct snapshot_delta_sent_packet_t sent_packets[SNAPSHOT_DELTA_SENT_BUFFER_SIZE];
+};
+
+struct snapshot_delta_client_t * snapshot_delta_client_create( void * context, struct snapshot_delta_world_t * world )
+{
+    snapshot_assert( world );
+
+    struct snapshot_delta_client_t * client = (struct snapshot_delta_client_t*) snapshot_malloc( context, sizeof( struct snapshot_delta_client_t ) );
+    if ( !client )
+        return NULL;
+
+    memset( client, 0, sizeof( struct snapshot_delta_client_t ) );
+
+    client->context = context;
+    client->world = world;
+
+    const int num_objects = world->num_objects;
+
+    client->acked_sequence = (uint32_t*) snapshot_malloc( context, num_objects * sizeof( uint32_t ) );
+    client->accumulated_priority = (float*) snapshot_malloc( context, num_objects * sizeof( float ) );
+    client->dirty_objects = (int*) snapshot_malloc( context, num_objects * sizeof( int ) );
+    client->dirty_index = (int*) snapshot_malloc( context, num_objects * sizeof( int ) );
+
+    if ( !client->acked_sequence || !client->accumulated_priority || !client->dirty_objects || !client->dirty_index )
+    {
+        snapshot_delta_client_destroy( client );
+        return NULL;
+    }
+
+    snapshot_delta_client_reset( client );
+
+    return client;
+}
+
+void snapshot_delta_client_destroy( struct snapshot_delta_client_t * client )
+{
+    snapshot_assert( client );
+
+    void * context = client->context;
+
+    if ( client->acked_sequence )
+        snapshot_free( context, client->acked_sequence );
+    if ( client->accumulated_priority )
+        snapshot_free( context, client->accumulated_priority );
+    if ( client->dirty_objects )
+        snapshot_free( context, client->dirty_objects );
+    if ( client->dirty_index )
+        snapshot_free( context, client->dirty_index );
+
+    snapshot_free( context, client );
+}
+
+void snapshot_delta_client_reset( struct snapshot_delta_client_t * client )
+{
+    snapshot_assert( client );
+
+    const int num_objects = client->world->num_objects;
+
+    // a new client has acked nothing, so the next write scans the whole world for objects that differ from all zero
+
+    client->world_sequence = 0;
+    client->full_scan = true;
+    client->num_dirty_objects = 0;
+    client->sent_objects_head = 0;
+
+    memset( client->acked_sequence, 0, num_objects * sizeof( uint32_t ) );
+    memset( client->accumulated_priority, 0, num_objects * sizeof( float ) );
+    memset( client->sent_packets, 0, sizeof( client->sent_packets ) );
+
+    for ( int i = 0; i < num_objects; i++ )
+    {
+        client->dirty_index[i] = -1;
+    }
+}
+
+static void snapshot_delta_client_add_dirty( struct snapshot_delta_client_t * client, int object_index )
+{
+    if ( client->dirty_index[object_index] >= 0 )
+        return;
+    if ( client->world->object_sequence[object_index] <= client->acked_sequence[object_index] )
+        return;
+    client->dirty_index[object_index] = client->num_dirty_objects;
+    client->dirty_objects[client->num_dirty_objects++] = object_index;
+}
+
+static void snapshot_delta_client_remove_dirty( struct snapshot_delta_client_t * client, int object_index )
+{
+    const int index = client->dirty_index[object_index];
+    if ( index < 0 )
+        return;
+    const int last_object = client->dirty_objects[--client->num_dirty_objects];
+    client->dirty_objects[index] = last_object;
+    client->dirty_index[last_object] = index;
+    client->dirty_index[object_index] = -1;
+    client->accumulated_priority[object_index] = 0.0f;
+}
+
+void snapshot_delta_client_acked( struct snapshot_delta_client_t * client, const uint16_t * acks, int num_acks )
+{
+    snapshot_assert( client );
+    snapshot_assert( acks || num_acks == 0 );
+
+    const uint32_t * object_sequence = client->world->object_sequence;
+
+    for ( int i = 0; i < num_acks; i++ )
+    {
+        struct snapshot_delta_sent_packet_t * sent_packet = &client->sent_packets[acks[i] % SNAPSHOT_DELTA_SENT_BUFFER_SIZE];
+        if ( sent_packet->snapshot_sequence == 0 || sent_packet->packet_sequence != acks[i] )
+            continue;
+
+        // the object list for an old packet may have been overwritten. those objects just stay dirty and get sent again
+
+        if ( client->sent_objects_head - sent_packet->first_object <= SNAPSHOT_DELTA_SENT_OBJECTS_SIZE )
+        {
+            for ( int j = 0; j < sent_packet->num_objects; j++ )
+            {
+                const int object_index = client->sent_objects[( sent_packet->first_object + j ) % SNAPSHOT_DELTA_SENT_OBJECTS_SIZE];
+                if ( sent_packet->snapshot_sequence > client->acked_sequence[object_index] )
+                {
+                    client->acked_sequence[object_index] = sent_packet->snapshot_sequence;
+                }
+                if ( object_sequence[object_index] <= client->acked_sequence[object_index] )
+                {
+                    snapshot_delta_client_remove_dirty( client, object_index );
+                }
+            }
+        }
+
+        sent_packet->snapshot_sequence = 0;
+    }
+}
+
+int snapshot_delta_client_num_dirty_objects( struct snapshot_delta_client_t * client )
+{
+    snapshot_assert( client );
+    return client->num_dirty_objects;
+}
+
+static void snapshot_delta_client_update_dirty( struct snapshot_delta_client_t * client )
+{
+    struct snapshot_delta_world_t * world = client->world;
+
+    if ( !client->full_scan && world->sequence - client->world_sequence < SNAPSHOT_DELTA_HISTORY_SIZE )
+    {
+        // only objects in the history lists since the last write can have become dirty
+
+        for ( uint32_t sequence = client->world_sequence + 1; sequence <= world->sequence; sequence++ )
+        {
+            const int history_index = sequence % SNAPSHOT_DELTA_HISTORY_SIZE;
+            const int * history_objects = world->history_objects + (size_t) history_index * world->num_objects;
+            for ( int i = 0; i < world->history_num_objects[history_index]; i++ )
+            {
+                snapshot_delta_client_add_dirty( client, history_objects[i] );
+            }
+        }
+    }
+    else
+    {
+        for ( int i = 0; i < world->num_objects; i++ )
+        {
+            snapshot_delta_client_add_dirty( client, i );
+        }
+    }
+
+    client->world_sequence = world->sequence;
+    client->full_scan = false;
+}
+
+static int snapshot_delta_compare_priority( const void * a, const void * b )
+{
+    const struct snapshot_delta_write_entry_t * entry_a = (const struct snapshot_delta_write_entry_t*) a;
+    const struct snapshot_delta_write_entry_t * entry_b = (const struct snapshot_delta_write_entry_t*) b;
+    if ( entry_a->priority != entry_b->priority )
+        return entry_a->priority > entry_b->priority ? -1 : 1;
+    return entry_a->object_index - entry_b->object_index;
+}
+
+static int snapshot_delta_compare_objects( const void * a, const void * b )
+{
+    return *( (const int*) a ) - *( (const int*) b );
+}
+
+static int snapshot_delta_count_bits( uint64_t value )
+{
+    int count = 0;
+    while ( value )
+    {
+        value &= value - 1;
+        count++;
+    }
+    return count;
+}
+
+template <typename Stream> bool snapshot_delta_world_serialize( Stream & stream, struct snapshot_delta_world_t * world, int num_write_objects )
+{
+    uint32_t sequence = world->sequence;
+
+    if ( !snapshot_delta_serialize_header( stream, sequence, num_write_objects, world->num_objects ) )
+        return false;
+
+    // object indices are sent plus one relative to the previous object, so the first object is relative to zero
+
+    uint32_t previous = 0;
+
+    for ( int i = 0; i < num_write_objects; i++ )
+    {
+        const int object_index = world->write_objects[i];
+        uint32_t current = object_index + 1;
+        serialize_int_relative( stream, previous, current );
+        if ( !snapshot_delta_serialize_object( stream, world->object_words, world->write_changed_words[object_index], world->words + (size_t) object_index * world->object_words ) )
+            return false;
+        previous = current;
+    }
+
+    return true;
+}
+
+int snapshot_delta_client_write( struct snapshot_delta_client_t * client, uint16_t packet_sequence, uint8_t * buffer, int budget_bytes, int * num_deferred )
+{
+    snapshot_assert( client );
+    snapshot_assert( buffer );
+    snapshot_assert( ( ( (uintptr_t) buffer ) % 4 ) == 0 );
+    snapshot_assert( budget_bytes >= 0 );
+    snapshot_assert( num_deferred );
+
+    struct snapshot_delta_world_t * world = client->world;
+
+    snapshot_assert( world->history_num_objects[( world->sequence + 1 ) % SNAPSHOT_DELTA_HISTORY_SIZE] == 0 );
+
+    *num_deferred = 0;
+
+    snapshot_delta_client_update_dirty( client );
+
+    if ( client->num_dirty_objects == 0 )
+        return 0;
+
+    // every dirty object gains its priority, so objects that keep missing out climb until they get in
+
+    for ( int i = 0; i < client->num_dirty_objects; i++ )
+    {
+        const int object_index = client->dirty_objects[i];
+        client->accumulated_priority[object_index] += world->object_priority[object_index];
+        world->write_entries[i].priority = client->accumulated_priority[object_index];
+        world->write_entries[i].object_index = object_index;
+    }
+
+    const int num_entries = client->num_dirty_objects;
+
+    qsort( world->write_entries, num_entries, sizeof( struct snapshot_delta_write_entry_t ), snapshot_delta_compare_priority );
+
+    // take objects highest priority first while they fit. the bit counts are upper bounds, so the snapshot never goes over
+
+    const int write_bytes = budget_bytes & ~3;
+    const int max_bits = write_bytes * 8;
+
+    int write_bits = SNAPSHOT_DELTA_HEADER_BITS;
+    int num_write_objects = 0;
+
+    for ( int i = 0; i < num_entries; i++ )
+    {
+        const int object_index = world->write_entries[i].object_index;
+
+        const uint32_t acked_sequence = client->acked_sequence[object_index];
+        const uint32_t * word_sequence = world->word_sequence + (size_t) object_index * world->object_words;
+
+        uint64_t changed_words = 0;
+        for ( int j = 0; j < world->object_words; j++ )
+        {
+            if ( word_sequence[j] > acked_sequence )
+            {
+                changed_words |= 1ULL << j;
+            }
+        }
+
+        const int object_bits = SNAPSHOT_DELTA_OBJECT_INDEX_BITS + world->object_words + 32 * snapshot_delta_count_bits( changed_words );
+        if ( write_bits + object_bits > max_bits || num_write_objects == SNAPSHOT_DELTA_SENT_OBJECTS_SIZE )
+        {
+            (*num_deferred)++;
+            continue;
+        }
+
+        write_bits += object_bits;
+        world->write_objects[num_write_objects++] = object_index;
+        world->write_changed_words[object_index] = changed_words;
+        client->accumulated_priority[object_index] = 0.0f;
+    }
+
+    if ( num_write_objects == 0 )
+        return 0;
+
+    qsort( world->write_objects, num_write_objects, sizeof( int ), snapshot_delta_compare_objects );
+
+    snapshot::WriteStream stream( buffer, write_bytes );
+
+    if ( !snapshot_delta_world_serialize( stream, world, num_write_objects ) )
+        return 0;
+
+    stream.Flush();
+
+    // remember what went in this packet, so it can be marked acked when the packet is
+
+    struct snapshot_delta_sent_packet_t * sent_packet = &client->sent_packets[packet_sequence % SNAPSHOT_DELTA_SENT_BUFFER_SIZE];
+    sent_packet->packet_sequence = packet_sequence;
+    sent_packet->snapshot_sequence = world->sequence;
+    sent_packet->first_object = client->sent_objects_head;
+    sent_packet->num_objects = num_write_objects;
+
+    for ( int i = 0; i < num_write_objects; i++ )
+    {
+        client->sent_objects[client->sent_objects_head++ % SNAPSHOT_DELTA_SENT_OBJECTS_SIZE] = (uint16_t) world->write_objects[i];
+    }
+
+    snapshot_assert( stream.GetBytesProcessed() <= budget_bytes );
+
+    return stream.GetBytesProcessed();
+}
+
+// ---------------------------------------------------------------
+
+struct snapshot_delta_receiver_t
+{
+    void * context;
+    int num_objects;
+    int object_words;
+    uint32_t sequence;
+    uint32_t * words;
+    uint32_t * object_sequence;
+    int num_changed_words;
+    int changed_word_index[SNAPSHOT_DELTA_MAX_CHANGED_WORDS];
+    uint32_t changed_word_value[SNAPSHOT_DELTA_MAX_CHANGED_WORDS];
+    uint32_t read_buffer[SNAPSHOT_MAX_PAYLOAD_BYTES / 4];
+};
+
+struct snapshot_delta_receiver_t * snapshot_delta_receiver_create( void * context, int num_objects, int object_bytes )
+{
+    snapshot_assert( num_objects > 0 );
+    snapshot_assert( num_objects <= SNAPSHOT_DELTA_MAX_OBJECTS );
+    snapshot_assert( object_bytes > 0 );
+    snapshot_assert( object_bytes <= SNAPSHOT_DELTA_MAX_OBJECT_BYTES );
+    snapshot_assert( ( object_bytes % 4 ) == 0 );
+
+    struct snapshot_delta_receiver_t * receiver = (struct snapshot_delta_receiver_t*) snapshot_malloc( context, sizeof( struct snapshot_delta_receiver_t ) );
+    if ( !receiver )
+        return NULL;
+
+    receiver->context = context;
+    receiver->num_objects = num_objects;
+    receiver->object_words = object_bytes / 4;
+
+    receiver->words = (uint32_t*) snapshot_malloc( context, (size_t) num_objects * receiver->object_words * sizeof( uint32_t ) );
+    receiver->object_sequence = (uint32_t*) snapshot_malloc( context, num_objects * sizeof( uint32_t ) );
+
+    if ( !receiver->words || !receiver->object_sequence )
+    {
+        snapshot_delta_receiver_destroy( receiver );
+        return NULL;
+    }
+
+    snapshot_delta_receiver_reset( receiver );
+
+    return receiver;
+}
+
+void snapshot_delta_receiver_destroy( struct snapshot_delta_receiver_t * receiver )
+{
+    snapshot_assert( receiver );
+    if ( receiver->words )
+        snapshot_free( receiver->context, receiver->words );
+    if ( receiver->object_sequence )
+        snapshot_free( receiver->context, receiver->object_sequence );
+    snapshot_free( receiver->context, receiver );
+}
+
+void snapshot_delta_receiver_reset( struct snapshot_delta_receiver_t * receiver )
+{
+    snapshot_assert( receiver );
+    receiver->sequence = 0;
+    receiver->num_changed_words = 0;
+    memset( receiver->words, 0, (size_t) receiver->num_objects * receiver->object_words * sizeof( uint32_t ) );
+    memset( receiver->object_sequence, 0, receiver->num_objects * sizeof( uint32_t ) );
+}
+
+template <typename Stream> bool snapshot_delta_receiver_serialize( Stream & stream, struct snapshot_delta_receiver_t * receiver, uint32_t & sequence )
+{
+    int num_changed_objects = 0;
+
+    if ( !snapshot_delta_serialize_header( stream, sequence, num_changed_objects, receiver->num_objects ) )
+        return false;
+
+    if ( sequence == 0 )
+        return false;
+
+    receiver->num_changed_words = 0;
+
+    uint32_t previous = 0;
+
+    for ( int i = 0; i < num_changed_objects; i++ )
+    {
+        uint32_t current = 0;
+        serialize_int_relative( stream, previous, current );
+        if ( current <= previous || current > (uint32_t) receiver->num_objects )
+            return false;
+
+        const int object_index = current - 1;
+
+        uint64_t changed_words = 0;
+        uint32_t values[SNAPSHOT_DELTA_MAX_OBJECT_WORDS];
+        if ( !snapshot_delta_serialize_object( stream, receiver->object_words, changed_words, values ) )
+            return false;
+
+        // an object we already have a newer snapshot of is read past, but not applied
+
+        if ( sequence > receiver->object_sequence[object_index] )
+        {
+            for ( int j = 0; j < receiver->object_words; j++ )
+            {
+                if ( ( changed_words >> j ) & 1 )
+                {
+                    if ( receiver->num_changed_words == SNAPSHOT_DELTA_MAX_CHANGED_WORDS )
+                        return false;
+                    receiver->changed_word_index[receiver->num_changed_words] = object_index * receiver->object_words + j;
+                    receiver->changed_word_value[receiver->num_changed_words] = values[j];
+                    receiver->num_changed_words++;
+                }
+            }
+        }
+
+        previous = current;
+    }
+
+    return true;
+}
+
+int snapshot_delta_receiver_read( struct snapshot_delta_receiver_t * receiver, const uint8_t * data, int bytes )
+{
+    snapshot_assert( receiver );
+    snapshot_assert( data );
+
+    if ( bytes <= 0 || bytes > SNAPSHOT_MAX_PAYLOAD_BYTES )
+        return SNAPSHOT_ERROR;
+
+    // the bit reader reads whole aligned words, so the snapshot is copied into a zero padded word buffer first
+
+    const int read_bytes = ( bytes + 3 ) & ~3;
+    memset( ( (uint8_t*) receiver->read_buffer ) + read_bytes - 4, 0, 4 );
+    memcpy( receiver->read_buffer, data, bytes );
+
+    snapshot::ReadStream stream( (const uint8_t*) receiver->read_buffer, bytes );
+
+    uint32_t sequence = 0;
+
+    if ( !snapshot_delta_receiver_serialize( stream, receiver, sequence ) )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "failed to read snapshot" );
+        return SNAPSHOT_ERROR;
+    }
+
+    // each object is delta encoded against a snapshot of it we have acked, so it can be applied over any snapshot of it since
+
+    for ( int i = 0; i < receiver->num_changed_words; i++ )
+    {
+        receiver->words[receiver->changed_word_index[i]] = receiver->changed_word_value[i];
+        receiver->object_sequence[receiver->changed_word_index[i] / receiver->object_words] = sequence;
+    }
+
+    if ( sequence > receiver->sequence )
+    {
+        receiver->sequence = sequence;
+    }
+
+    return SNAPSHOT_OK;
+}
+
+uint32_t snapshot_delta_receiver_sequence( struct snapshot_delta_receiver_t * receiver )
+{
+    snapshot_assert( receiver );
+    return receiver->sequence;
+}
+
+const uint8_t * snapshot_delta_receiver_object( struct snapshot_delta_receiver_t * receiver, int object_index )
+{
+    snapshot_assert( receiver );
+    snapshot_assert( object_index >= 0 );
+    snapshot_assert( object_index < receiver->num_objects );
+    return (const uint8_t*) ( receiver->words + (size_t) object_index * receiver->object_words );
+}
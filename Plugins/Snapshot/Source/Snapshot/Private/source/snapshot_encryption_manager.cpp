@@ -5,6 +5,70 @@
 
 #include "snapshot_encryption_manager.h"
 
+struct snapshot_encryption_manager_t * snapshot_encryption_manager_create( void * context, int max_encryption_mappings )
+{
+    snapshot_assert( max_encryption_mappings > 0 );
+
+    struct snapshot_encryption_manager_t * encryption_manager = (struct snapshot_encryption_manager_t*) snapshot_malloc( context, sizeof( struct snapshot_encryption_manager_t ) );
+    if ( !encryption_manager )
+        return NULL;
+
+    memset( encryption_manager, 0, sizeof( struct snapshot_encryption_manager_t ) );
+
+    encryption_manager->context = context;
+    encryption_manager->max_encryption_mappings = max_encryption_mappings;
+
+    const int address_map_size = snapshot_address_map_capacity( max_encryption_mappings );
+
+    encryption_manager->timeout = (int*) snapshot_malloc( context, max_encryption_mappings * sizeof( int ) );
+    encryption_manager->expire_time = (double*) snapshot_malloc( context, max_encryption_mappings * sizeof( double ) );
+    encryption_manager->last_access_time = (double*) snapshot_malloc( context, max_encryption_mappings * sizeof( double ) );
+    encryption_manager->address = (struct snapshot_address_t*) snapshot_malloc( context, max_encryption_mappings * sizeof( struct snapshot_address_t ) );
+    encryption_manager->client_index = (int*) snapshot_malloc( context, max_encryption_mappings * sizeof( int ) );
+    encryption_manager->send_key = (uint8_t*) snapshot_malloc( context, max_encryption_mappings * SNAPSHOT_KEY_BYTES );
+    encryption_manager->receive_key = (uint8_t*) snapshot_malloc( context, max_encryption_mappings * SNAPSHOT_KEY_BYTES );
+    encryption_manager->address_map_entries = (struct snapshot_address_map_entry_t*) snapshot_malloc( context, address_map_size * sizeof( struct snapshot_address_map_entry_t ) );
+
+    if ( !encryption_manager->timeout || !encryption_manager->expire_time || !encryption_manager->last_access_time || !encryption_manager->address ||
+         !encryption_manager->client_index || !encryption_manager->send_key || !encryption_manager->receive_key || !encryption_manager->address_map_entries )
+    {
+        snapshot_encryption_manager_destroy( encryption_manager );
+        return NULL;
+    }
+
+    snapshot_address_map_init( &encryption_manager->address_map, encryption_manager->address_map_entries, address_map_size );
+
+    snapshot_encryption_manager_reset( encryption_manager );
+
+    return encryption_manager;
+}
+
+void snapshot_encryption_manager_destroy( struct snapshot_encryption_manager_t * encryption_manager )
+{
+    snapshot_assert( encryption_manager );
+
+    void * context = encryption_manager->context;
+
+    if ( encryption_manager->timeout )
+        snapshot_free( context, encryption_manager->timeout );
+    if ( encryption_manager->expire_time )
+        snapshot_free( context, encryption_manager->expire_time );
+    if ( encryption_manager->last_access_time )
+        snapshot_free( context, encryption_manager->last_access_time );
+    if ( encryption_manager->address )
+        snapshot_free( context, encryption_manager->address );
+    if ( encryption_manager->client_index )
+        snapshot_free( context, encryption_manager->client_index );
+    if ( encryption_manager->send_key )
+        snapshot_free( context, encryption_manager->send_key );
+    if ( encryption_manager->receive_key )
+        snapshot_free( context, encryption_manager->receive_key );
+    if ( encryption_manager->address_map_entries )
+        snapshot_free( context, encryption_manager->address_map_entries );
+
+    snapshot_free( context, encryption_manager );
+}
+
 void snapshot_encryption_manager_reset( struct snapshot_encryption_manager_t * encryption_manager )
 {
     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "reset encryption manager" );
@@ -13,18 +77,103 @@ void snapshot_encryption_manager_reset( struct snapshot_encryption_manager_t * e
 
     encryption_manager->num_encryption_mappings = 0;
     
+    const int max_encryption_mappings = encryption_manager->max_encryption_mappings;
+
     int i;
-    for ( i = 0; i < SNAPSHOT_MAX_ENCRYPTION_MAPPINGS; ++i )
+    for ( i = 0; i < max_encryption_mappings; ++i )
     {
         encryption_manager->client_index[i] = -1;
         encryption_manager->expire_time[i] = -1.0;
         encryption_manager->last_access_time[i] = -1000.0;
+        encryption_manager->timeout[i] = 0;
         memset( &encryption_manager->address[i], 0, sizeof( struct snapshot_address_t ) );
+        memset( encryption_manager->send_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
+        memset( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
+    }
+
+    snapshot_address_map_reset( &encryption_manager->address_map );
+
+    if ( encryption_manager->timer_wheel )
+    {
+        for ( i = 0; i < max_encryption_mappings; ++i )
+        {
+            snapshot_timer_wheel_cancel( encryption_manager->timer_wheel, encryption_manager->first_timer_id + i );
+        }
+    }
+}
+
+void snapshot_encryption_manager_set_timer_wheel( struct snapshot_encryption_manager_t * encryption_manager, struct snapshot_timer_wheel_t * timer_wheel, int first_timer_id )
+{
+    snapshot_assert( encryption_manager );
+    snapshot_assert( first_timer_id >= 0 );
+    encryption_manager->timer_wheel = timer_wheel;
+    encryption_manager->first_timer_id = first_timer_id;
+}
+
+static void snapshot_encryption_manager_schedule_expiry( struct snapshot_encryption_manager_t * encryption_manager, int index )
+{
+    if ( !encryption_manager->timer_wheel )
+        return;
+
+    const int timer_id = encryption_manager->first_timer_id + index;
+
+    double deadline = -1.0;
+
+    if ( encryption_manager->timeout[index] > 0 )
+    {
+        deadline = encryption_manager->last_access_time[index] + encryption_manager->timeout[index];
     }
 
-    memset( encryption_manager->timeout, 0, sizeof( encryption_manager->timeout ) );    
-    memset( encryption_manager->send_key, 0, sizeof( encryption_manager->send_key ) );
-    memset( encryption_manager->receive_key, 0, sizeof( encryption_manager->receive_key ) );
+    if ( encryption_manager->expire_time[index] >= 0.0 && ( deadline < 0.0 || encryption_manager->expire_time[index] < deadline ) )
+    {
+        deadline = encryption_manager->expire_time[index];
+    }
+
+    if ( deadline >= 0.0 )
+    {
+        snapshot_timer_wheel_schedule( encryption_manager->timer_wheel, timer_id, deadline );
+    }
+    else
+    {
+        snapshot_timer_wheel_cancel( encryption_manager->timer_wheel, timer_id );
+    }
+}
+
+static void snapshot_encryption_manager_cancel_expiry( struct snapshot_encryption_manager_t * encryption_manager, int index )
+{
+    if ( encryption_manager->timer_wheel )
+    {
+        snapshot_timer_wheel_cancel( encryption_manager->timer_wheel, encryption_manager->first_timer_id + index );
+    }
+}
+
+void snapshot_encryption_manager_process_expiry_timer( struct snapshot_encryption_manager_t * encryption_manager, int index, double time )
+{
+    snapshot_assert( encryption_manager );
+    snapshot_assert( index >= 0 );
+    snapshot_assert( index < encryption_manager->max_encryption_mappings );
+
+    // mappings owned by a connected client are removed when the client disconnects
+
+    if ( encryption_manager->address[index].type == SNAPSHOT_ADDRESS_NONE || encryption_manager->client_index[index] != -1 )
+        return;
+
+    // finds don't reschedule, so a mapping that was accessed since it was scheduled just moves its deadline out
+
+    if ( !snapshot_encryption_manager_entry_expired( encryption_manager, index, time ) )
+    {
+        snapshot_encryption_manager_schedule_expiry( encryption_manager, index );
+        return;
+    }
+
+    // an older mapping for an address that has since been re-added is left for add to reuse. removing by address would hit the newer one
+
+    struct snapshot_address_t address = encryption_manager->address[index];
+
+    if ( snapshot_address_map_find( &encryption_manager->address_map, &address ) != index )
+        return;
+
+    snapshot_encryption_manager_remove_encryption_mapping( encryption_manager, &address, time );
 }
 
 int snapshot_encryption_manager_entry_expired( struct snapshot_encryption_manager_t * encryption_manager, int index, double time )
@@ -41,25 +190,33 @@ int snapshot_encryption_manager_add_encryption_mapping( struct snapshot_encrypti
                                                         double expire_time,
                                                         int timeout )
 {
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    // the address map always points at the most recent mapping for an address
+
+    int i = snapshot_address_map_find( &encryption_manager->address_map, address );
+
+    if ( i != -1 && !snapshot_encryption_manager_entry_expired( encryption_manager, i, time ) )
     {
-        if ( snapshot_address_equal( &encryption_manager->address[i], address ) && !snapshot_encryption_manager_entry_expired( encryption_manager, i, time ) )
-        {
-            encryption_manager->timeout[i] = timeout;
-            encryption_manager->expire_time[i] = expire_time;
-            encryption_manager->last_access_time[i] = time;
-            memcpy( encryption_manager->send_key + i * SNAPSHOT_KEY_BYTES, send_key, SNAPSHOT_KEY_BYTES );
-            memcpy( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, receive_key, SNAPSHOT_KEY_BYTES );
-            return 1;
-        }
+        encryption_manager->timeout[i] = timeout;
+        encryption_manager->expire_time[i] = expire_time;
+        encryption_manager->last_access_time[i] = time;
+        memcpy( encryption_manager->send_key + i * SNAPSHOT_KEY_BYTES, send_key, SNAPSHOT_KEY_BYTES );
+        memcpy( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, receive_key, SNAPSHOT_KEY_BYTES );
+        snapshot_encryption_manager_schedule_expiry( encryption_manager, i );
+        return 1;
     }
 
-    for ( i = 0; i < SNAPSHOT_MAX_ENCRYPTION_MAPPINGS; ++i )
+    for ( i = 0; i < encryption_manager->max_encryption_mappings; ++i )
     {
         if ( encryption_manager->address[i].type == SNAPSHOT_ADDRESS_NONE || 
             ( snapshot_encryption_manager_entry_expired( encryption_manager, i, time ) && encryption_manager->client_index[i] == -1 ) )
         {
+            if ( encryption_manager->address[i].type != SNAPSHOT_ADDRESS_NONE && snapshot_address_map_find( &encryption_manager->address_map, &encryption_manager->address[i] ) == i )
+            {
+                snapshot_address_map_remove( &encryption_manager->address_map, &encryption_manager->address[i] );
+            }
+
+            snapshot_address_map_insert( &encryption_manager->address_map, address, i );
+
             encryption_manager->timeout[i] = timeout;
             encryption_manager->address[i] = *address;
             encryption_manager->expire_time[i] = expire_time;
@@ -68,6 +225,7 @@ int snapshot_encryption_manager_add_encryption_mapping( struct snapshot_encrypti
             memcpy( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, receive_key, SNAPSHOT_KEY_BYTES );
             if ( i + 1 > encryption_manager->num_encryption_mappings )
                 encryption_manager->num_encryption_mappings = i + 1;
+            snapshot_encryption_manager_schedule_expiry( encryption_manager, i );
             return 1;
         }
     }
@@ -80,49 +238,52 @@ int snapshot_encryption_manager_remove_encryption_mapping( struct snapshot_encry
     snapshot_assert( encryption_manager );
     snapshot_assert( address );
 
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    int i = snapshot_address_map_find( &encryption_manager->address_map, address );
+
+    if ( i == -1 )
+        return 0;
+
+    snapshot_address_map_remove( &encryption_manager->address_map, address );
+
+    snapshot_encryption_manager_cancel_expiry( encryption_manager, i );
+
+    encryption_manager->expire_time[i] = -1.0;
+    encryption_manager->last_access_time[i] = -1000.0;
+    memset( &encryption_manager->address[i], 0, sizeof( struct snapshot_address_t ) );
+    memset( encryption_manager->send_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
+    memset( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
+
+    if ( i + 1 == encryption_manager->num_encryption_mappings )
     {
-        if ( snapshot_address_equal( &encryption_manager->address[i], address ) )
+        int index = i - 1;
+        while ( index >= 0 )
         {
-            encryption_manager->expire_time[i] = -1.0;
-            encryption_manager->last_access_time[i] = -1000.0;
-            memset( &encryption_manager->address[i], 0, sizeof( struct snapshot_address_t ) );
-            memset( encryption_manager->send_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
-            memset( encryption_manager->receive_key + i * SNAPSHOT_KEY_BYTES, 0, SNAPSHOT_KEY_BYTES );
-
-            if ( i + 1 == encryption_manager->num_encryption_mappings )
+            if ( !snapshot_encryption_manager_entry_expired( encryption_manager, index, time ) || encryption_manager->client_index[index] != -1 )
             {
-                int index = i - 1;
-                while ( index >= 0 )
-                {
-                    if ( !snapshot_encryption_manager_entry_expired( encryption_manager, index, time ) || encryption_manager->client_index[index] != -1 )
-                    {
-                        break;
-                    }
-                    encryption_manager->address[index].type = SNAPSHOT_ADDRESS_NONE;
-                    index--;
-                }
-                encryption_manager->num_encryption_mappings = index + 1;
+                break;
             }
-
-            return 1;
+            if ( snapshot_address_map_find( &encryption_manager->address_map, &encryption_manager->address[index] ) == index )
+            {
+                snapshot_address_map_remove( &encryption_manager->address_map, &encryption_manager->address[index] );
+            }
+            snapshot_encryption_manager_cancel_expiry( encryption_manager, index );
+            encryption_manager->address[index].type = SNAPSHOT_ADDRESS_NONE;
+            index--;
         }
+        encryption_manager->num_encryption_mappings = index + 1;
     }
 
-    return 0;
+    return 1;
 }
 
 int snapshot_encryption_manager_find_encryption_mapping( struct snapshot_encryption_manager_t * encryption_manager, const struct snapshot_address_t * address, double time )
 {
-    int i;
-    for ( i = 0; i < encryption_manager->num_encryption_mappings; ++i )
+    int i = snapshot_address_map_find( &encryption_manager->address_map, address );
+
+    if ( i != -1 && !snapshot_encryption_manager_entry_expired( encryption_manager, i, time ) )
     {
-        if ( snapshot_address_equal( &encryption_manager->address[i], address ) && !snapshot_encryption_manager_entry_expired( encryption_manager, i, time ) )
-        {
-            encryption_manager->last_access_time[i] = time;
-            return i;
-        }
+        encryption_manager->last_access_time[i] = time;
+        return i;
     }
     return -1;
 }
@@ -142,6 +303,7 @@ void snapshot_encryption_manager_set_expire_time( struct snapshot_encryption_man
     snapshot_assert( index >= 0 );
     snapshot_assert( index < encryption_manager->num_encryption_mappings );
     encryption_manager->expire_time[index] = expire_time;
+    snapshot_encryption_manager_schedule_expiry( encryption_manager, index );
 }
 
 
@@ -8,9 +8,18 @@
 #include "snapshot_read_write.h"
 #include "snapshot_packet_header.h"
 #include "snapshot_sequence_buffer.h"
+#include "snapshot_arena.h"
 
 #include <math.h>
-#include <float.h>
+
+#define SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_SECONDS                    10.0
+#define SNAPSHOT_ENDPOINT_CONGESTION_GAIN                                 1.0
+#define SNAPSHOT_ENDPOINT_CONGESTION_LOSS_THRESHOLD                      5.0f
+#define SNAPSHOT_ENDPOINT_CONGESTION_LOSS_INTERVAL                        1.0
+#define SNAPSHOT_ENDPOINT_CONGESTION_LOSS_DECREASE                      0.75f
+#define SNAPSHOT_ENDPOINT_CONGESTION_ACKED_HEADROOM                      2.0f
+#define SNAPSHOT_ENDPOINT_FRAGMENT_RESEND_RTT_FACTOR                     1.25
+#define SNAPSHOT_ENDPOINT_FRAGMENT_RESEND_MIN_SECONDS                    0.01
 
 // -----------------------------------------------------------------------------------------
 
@@ -29,6 +38,7 @@ struct snapshot_endpoint_received_packet_data_t
 
 struct snapshot_endpoint_fragment_reassembly_data_t
 {
+    uint16_t sequence;
     int num_fragments_received;
     int num_fragments_total;
     uint16_t payload_sequence;
@@ -36,17 +46,54 @@ struct snapshot_endpoint_fragment_reassembly_data_t
     uint32_t payload_ack_bits;
     uint8_t * payload_data;
     int payload_bytes;
-    uint8_t fragment_received[SNAPSHOT_MAX_FRAGMENTS];
+    int slot;
+    int parity_group_size;
+    uint64_t fragment_received[SNAPSHOT_MAX_FRAGMENTS/64];
+    uint64_t parity_received[SNAPSHOT_MAX_FRAGMENTS/64];
 };
 
-void snapshot_fragment_reassembly_data_cleanup( void * context, void * data )
+struct snapshot_endpoint_resend_payload_data_t
 {
-    struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) data;
-    if ( reassembly_data->payload_data )
-    {
-        snapshot_destroy_packet( context, reassembly_data->payload_data );
-        reassembly_data->payload_data = NULL;
-    }
+    double last_send_time;
+    uint16_t sequence;
+    uint16_t ack;
+    uint32_t ack_bits;
+    int num_fragments;
+    int payload_bytes;
+    uint8_t * payload_data;
+    uint64_t fragment_resend[SNAPSHOT_MAX_FRAGMENTS/64];
+};
+
+static_assert( SNAPSHOT_MAX_FRAGMENTS % 64 == 0, "max fragments must be a multiple of 64" );
+
+static int snapshot_endpoint_reassembly_slot_bytes( const struct snapshot_endpoint_config_t * config )
+{
+    // enough whole fragments to hold the largest payload, since a payload that needs more than that is too large to receive anyway
+
+    int slot_bytes = ( ( SNAPSHOT_MAX_PAYLOAD_BYTES + config->fragment_size - 1 ) / config->fragment_size ) * config->fragment_size;
+    if ( slot_bytes > config->max_fragments * config->fragment_size )
+        slot_bytes = config->max_fragments * config->fragment_size;
+    return slot_bytes;
+}
+
+static int snapshot_endpoint_fec_group_size( const struct snapshot_endpoint_config_t * config )
+{
+    if ( config->fec_overhead <= 0.0f )
+        return 0;
+
+    int group_size = (int) ceilf( 1.0f / config->fec_overhead );
+    if ( group_size < 1 )
+        group_size = 1;
+    return group_size;
+}
+
+static int snapshot_endpoint_parity_data_bytes( const struct snapshot_endpoint_config_t * config )
+{
+    const int group_size = snapshot_endpoint_fec_group_size( config );
+    if ( group_size == 0 )
+        return 0;
+
+    return ( ( config->max_fragments + group_size - 1 ) / group_size ) * config->fragment_size;
 }
 
 int snapshot_read_fragment_header( char * name, 
@@ -146,6 +193,90 @@ int snapshot_read_fragment_header( char * name,
     return (int) ( p - packet_data );
 }
 
+int snapshot_read_parity_fragment_header( char * name, 
+                                          const uint8_t * packet_data, 
+                                          int packet_bytes, 
+                                          int max_fragments, 
+                                          int fragment_size, 
+                                          int * group_index, 
+                                          int * group_size, 
+                                          int * num_fragments, 
+                                          int * payload_bytes, 
+                                          int * parity_bytes, 
+                                          uint16_t * sequence, 
+                                          uint16_t * ack, 
+                                          uint32_t * ack_bits )
+{
+    if ( packet_bytes < SNAPSHOT_PARITY_FRAGMENT_HEADER_BYTES )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] packet is too small to read parity fragment header", name );
+        return -1;
+    }
+
+    const uint8_t * p = packet_data;
+
+    uint8_t prefix_byte = snapshot_read_uint8( &p );
+    if ( prefix_byte != 3 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] prefix byte is not a parity fragment", name );
+        return -1;
+    }
+
+    *sequence = snapshot_read_uint16( &p );
+    *group_index = (int) snapshot_read_uint8( &p );
+    *num_fragments = ( (int) snapshot_read_uint8( &p ) ) + 1;
+    *group_size = (int) snapshot_read_uint8( &p );
+    *payload_bytes = (int) snapshot_read_uint16( &p );
+
+    if ( *num_fragments > max_fragments )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] num fragments %d outside of range of max fragments %d", name, *num_fragments, max_fragments );
+        return -1;
+    }
+
+    if ( *group_size < 1 || *group_index * *group_size >= *num_fragments )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] parity group %d of size %d outside of range of num fragments %d", name, *group_index, *group_size, *num_fragments );
+        return -1;
+    }
+
+    if ( *payload_bytes <= ( *num_fragments - 1 ) * fragment_size || *payload_bytes > *num_fragments * fragment_size )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] payload bytes %d does not match num fragments %d", name, *payload_bytes, *num_fragments );
+        return -1;
+    }
+
+    // parity fragments carry the packet header too, so the first fragment can be rebuilt along with its acks
+
+    uint16_t packet_sequence = 0;
+
+    int packet_header_bytes = snapshot_read_packet_header( name, p, packet_bytes - (int) ( p - packet_data ), &packet_sequence, ack, ack_bits );
+
+    if ( packet_header_bytes < 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] bad packet header in parity fragment", name );
+        return -1;
+    }
+
+    if ( packet_sequence != *sequence )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] bad packet sequence in parity fragment. expected %d, got %d", name, *sequence, packet_sequence );
+        return -1;
+    }
+
+    p += packet_header_bytes;
+
+    *parity_bytes = packet_bytes - (int) ( p - packet_data );
+
+    if ( *parity_bytes <= 0 || *parity_bytes > fragment_size )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] parity fragment is %d bytes, fragment size is %d", name, *parity_bytes, fragment_size );
+        return -1;
+    }
+
+    return (int) ( p - packet_data );
+}
+
 void snapshot_store_fragment_data( struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data, 
                                    int fragment_id, 
                                    int fragment_size, 
@@ -175,6 +306,10 @@ void snapshot_store_fragment_data( struct snapshot_endpoint_fragment_reassembly_
     if ( fragment_id == reassembly_data->num_fragments_total - 1 )
     {
         reassembly_data->payload_bytes = ( reassembly_data->num_fragments_total - 1 ) * fragment_size + fragment_bytes;
+
+        // parity is over whole fragments, so the short last fragment is zero padded
+
+        memset( reassembly_data->payload_data + fragment_id * fragment_size + fragment_bytes, 0, fragment_size - fragment_bytes );
     }
 }
 
@@ -200,13 +335,23 @@ void snapshot_endpoint_default_config( struct snapshot_endpoint_config_t * confi
     config->sent_packets_buffer_size = 256;
     config->received_packets_buffer_size = 256;
     config->fragment_reassembly_buffer_size = 64;
+    config->fragment_reassembly_slots = 8;                  // note: payloads being reassembled at once. each slot holds one max size payload
     config->rtt_smoothing_factor = 0.0025f;
     config->packet_loss_smoothing_factor = 0.1f;
     config->bandwidth_smoothing_factor = 0.1f;
     config->packet_header_size = 28;                        // note: UDP over IPv4 = 20 + 8 bytes, UDP over IPv6 = 40 + 8 bytes
+    config->stats_update_interval = 0.0;                    // note: 0.0 recalculates packet loss and bandwidth on every update
+    config->enable_congestion_control = false;
+    config->congestion_target_delay = 25.0f;                // note: milliseconds of queuing delay, like rtt
+    config->congestion_min_kbps = 64.0f;
+    config->congestion_initial_kbps = 256.0f;
+    config->congestion_max_kbps = 100000.0f;
+    config->fec_overhead = 0.0f;                            // note: 0.25 sends one parity fragment for every four fragments
+    config->enable_fragment_resend = false;
+    config->fragment_resend_buffer_size = 16;
 }
 
-struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_config_t * config, double time )
+static void snapshot_endpoint_validate_config( struct snapshot_endpoint_config_t * config )
 {
     snapshot_assert( config );
     snapshot_assert( config->fragment_above > 0 );
@@ -217,6 +362,37 @@ struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_
     snapshot_assert( config->ack_buffer_size > 0 );
     snapshot_assert( config->sent_packets_buffer_size > 0 );
     snapshot_assert( config->received_packets_buffer_size > 0 );
+    snapshot_assert( config->fragment_reassembly_buffer_size > 0 );
+    snapshot_assert( config->fragment_reassembly_slots > 0 );
+    snapshot_assert( config->fragment_reassembly_slots <= config->fragment_reassembly_buffer_size );
+    snapshot_assert( config->stats_update_interval >= 0.0 );
+    snapshot_assert( !config->enable_congestion_control || config->congestion_target_delay > 0.0f );
+    snapshot_assert( !config->enable_congestion_control || config->congestion_min_kbps > 0.0f );
+    snapshot_assert( !config->enable_congestion_control || config->congestion_min_kbps <= config->congestion_initial_kbps );
+    snapshot_assert( !config->enable_congestion_control || config->congestion_initial_kbps <= config->congestion_max_kbps );
+    snapshot_assert( config->fec_overhead >= 0.0f );
+    snapshot_assert( !config->enable_fragment_resend || config->fragment_resend_buffer_size > 0 );
+    snapshot_assert( snapshot_endpoint_max_write_packets( config ) <= SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS );
+    (void) config;
+}
+
+static void snapshot_endpoint_reset_congestion( struct snapshot_endpoint_t * endpoint )
+{
+    endpoint->pacing_rate_kbps = endpoint->config.enable_congestion_control ? endpoint->config.congestion_initial_kbps : 0.0f;
+    endpoint->congestion_rtt = -1.0f;
+    for ( int i = 0; i < SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY; i++ )
+    {
+        endpoint->congestion_base_rtt[i] = -1.0f;
+    }
+    endpoint->congestion_base_rtt_index = 0;
+    endpoint->congestion_base_rtt_time = endpoint->time;
+    endpoint->last_congestion_update_time = endpoint->time;
+    endpoint->last_congestion_decrease_time = endpoint->time;
+}
+
+struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_config_t * config, double time )
+{
+    snapshot_endpoint_validate_config( config );
 
     struct snapshot_endpoint_t * endpoint = (struct snapshot_endpoint_t*) snapshot_malloc( config->context, sizeof( struct snapshot_endpoint_t ) );
 
@@ -227,6 +403,9 @@ struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_
     endpoint->context = config->context;
     endpoint->config = *config;
     endpoint->time = time;
+    endpoint->last_stats_update_time = time;
+
+    snapshot_endpoint_reset_congestion( endpoint );
 
     endpoint->acks = (uint16_t*) snapshot_malloc( config->context, config->ack_buffer_size * sizeof( uint16_t ) );
     
@@ -236,7 +415,111 @@ struct snapshot_endpoint_t * snapshot_endpoint_create( struct snapshot_endpoint_
 
     endpoint->fragment_reassembly = snapshot_sequence_buffer_create( config->context, config->fragment_reassembly_buffer_size, sizeof( struct snapshot_endpoint_fragment_reassembly_data_t ) );
 
+    endpoint->reassembly_slot_bytes = snapshot_endpoint_reassembly_slot_bytes( config );
+
+    endpoint->reassembly_slab = (uint8_t*) snapshot_malloc( config->context, (size_t) config->fragment_reassembly_slots * endpoint->reassembly_slot_bytes );
+
+    endpoint->reassembly_slot_sequence = (uint16_t*) snapshot_malloc( config->context, config->fragment_reassembly_slots * sizeof( uint16_t ) );
+
+    endpoint->fec_group_size = snapshot_endpoint_fec_group_size( config );
+
+    if ( endpoint->fec_group_size > 0 )
+    {
+        endpoint->parity_data = (uint8_t*) snapshot_malloc( config->context, snapshot_endpoint_parity_data_bytes( config ) );
+    }
+
+    if ( config->enable_fragment_resend )
+    {
+        endpoint->resend_payloads = snapshot_sequence_buffer_create( config->context, config->fragment_resend_buffer_size, sizeof( struct snapshot_endpoint_resend_payload_data_t ) );
+        endpoint->resend_slab = (uint8_t*) snapshot_malloc( config->context, (size_t) config->fragment_resend_buffer_size * SNAPSHOT_MAX_PAYLOAD_BYTES );
+    }
+
+    memset( endpoint->acks, 0, config->ack_buffer_size * sizeof( uint16_t ) );
+    memset( endpoint->reassembly_slot_sequence, 0, config->fragment_reassembly_slots * sizeof( uint16_t ) );
+
+    return endpoint;
+}
+
+int snapshot_endpoint_max_write_packets( const struct snapshot_endpoint_config_t * config )
+{
+    snapshot_assert( config );
+    return config->max_fragments + snapshot_endpoint_parity_data_bytes( config ) / config->fragment_size;
+}
+
+size_t snapshot_endpoint_arena_bytes( const struct snapshot_endpoint_config_t * config )
+{
+    snapshot_assert( config );
+
+    return snapshot_arena_bytes( sizeof( struct snapshot_endpoint_t ) ) +
+           snapshot_arena_bytes( config->ack_buffer_size * sizeof( uint16_t ) ) +
+           snapshot_sequence_buffer_arena_bytes( config->sent_packets_buffer_size, sizeof( struct snapshot_endpoint_sent_packet_data_t ) ) +
+           snapshot_sequence_buffer_arena_bytes( config->received_packets_buffer_size, sizeof( struct snapshot_endpoint_received_packet_data_t ) ) +
+           snapshot_sequence_buffer_arena_bytes( config->fragment_reassembly_buffer_size, sizeof( struct snapshot_endpoint_fragment_reassembly_data_t ) ) +
+           snapshot_arena_bytes( (size_t) config->fragment_reassembly_slots * snapshot_endpoint_reassembly_slot_bytes( config ) ) +
+           snapshot_arena_bytes( config->fragment_reassembly_slots * sizeof( uint16_t ) ) +
+           snapshot_arena_bytes( snapshot_endpoint_parity_data_bytes( config ) ) +
+           ( config->enable_fragment_resend ? snapshot_sequence_buffer_arena_bytes( config->fragment_resend_buffer_size, sizeof( struct snapshot_endpoint_resend_payload_data_t ) ) +
+                                              snapshot_arena_bytes( (size_t) config->fragment_resend_buffer_size * SNAPSHOT_MAX_PAYLOAD_BYTES ) : 0 );
+}
+
+struct snapshot_endpoint_t * snapshot_endpoint_create_in_arena( struct snapshot_arena_t * arena, struct snapshot_endpoint_config_t * config, double time )
+{
+    snapshot_assert( arena );
+
+    snapshot_endpoint_validate_config( config );
+
+    struct snapshot_endpoint_t * endpoint = (struct snapshot_endpoint_t*) snapshot_arena_alloc( arena, sizeof( struct snapshot_endpoint_t ) );
+    if ( !endpoint )
+        return NULL;
+
+    memset( endpoint, 0, sizeof( struct snapshot_endpoint_t ) );
+
+    endpoint->context = config->context;
+    endpoint->config = *config;
+    endpoint->time = time;
+    endpoint->last_stats_update_time = time;
+    endpoint->arena_allocated = true;
+
+    snapshot_endpoint_reset_congestion( endpoint );
+
+    endpoint->acks = (uint16_t*) snapshot_arena_alloc( arena, config->ack_buffer_size * sizeof( uint16_t ) );
+
+    endpoint->sent_packets = snapshot_sequence_buffer_create_in_arena( arena, config->context, config->sent_packets_buffer_size, sizeof( struct snapshot_endpoint_sent_packet_data_t ) );
+
+    endpoint->received_packets = snapshot_sequence_buffer_create_in_arena( arena, config->context, config->received_packets_buffer_size, sizeof( struct snapshot_endpoint_received_packet_data_t ) );
+
+    endpoint->fragment_reassembly = snapshot_sequence_buffer_create_in_arena( arena, config->context, config->fragment_reassembly_buffer_size, sizeof( struct snapshot_endpoint_fragment_reassembly_data_t ) );
+
+    endpoint->reassembly_slot_bytes = snapshot_endpoint_reassembly_slot_bytes( config );
+
+    endpoint->reassembly_slab = (uint8_t*) snapshot_arena_alloc( arena, (size_t) config->fragment_reassembly_slots * endpoint->reassembly_slot_bytes );
+
+    endpoint->reassembly_slot_sequence = (uint16_t*) snapshot_arena_alloc( arena, config->fragment_reassembly_slots * sizeof( uint16_t ) );
+
+    endpoint->fec_group_size = snapshot_endpoint_fec_group_size( config );
+
+    if ( endpoint->fec_group_size > 0 )
+    {
+        endpoint->parity_data = (uint8_t*) snapshot_arena_alloc( arena, snapshot_endpoint_parity_data_bytes( config ) );
+    }
+
+    if ( config->enable_fragment_resend )
+    {
+        endpoint->resend_payloads = snapshot_sequence_buffer_create_in_arena( arena, config->context, config->fragment_resend_buffer_size, sizeof( struct snapshot_endpoint_resend_payload_data_t ) );
+        endpoint->resend_slab = (uint8_t*) snapshot_arena_alloc( arena, (size_t) config->fragment_resend_buffer_size * SNAPSHOT_MAX_PAYLOAD_BYTES );
+    }
+
+    if ( !endpoint->acks || !endpoint->sent_packets || !endpoint->received_packets || !endpoint->fragment_reassembly || !endpoint->reassembly_slab || !endpoint->reassembly_slot_sequence )
+        return NULL;
+
+    if ( endpoint->fec_group_size > 0 && !endpoint->parity_data )
+        return NULL;
+
+    if ( config->enable_fragment_resend && ( !endpoint->resend_payloads || !endpoint->resend_slab ) )
+        return NULL;
+
     memset( endpoint->acks, 0, config->ack_buffer_size * sizeof( uint16_t ) );
+    memset( endpoint->reassembly_slot_sequence, 0, config->fragment_reassembly_slots * sizeof( uint16_t ) );
 
     return endpoint;
 }
@@ -247,19 +530,28 @@ void snapshot_endpoint_destroy( struct snapshot_endpoint_t * endpoint )
     snapshot_assert( endpoint->acks );
     snapshot_assert( endpoint->sent_packets );
     snapshot_assert( endpoint->received_packets );
+    snapshot_assert( endpoint->reassembly_slab );
+    snapshot_assert( endpoint->reassembly_slot_sequence );
 
-    for ( int i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
-    {
-        struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
+    // arena endpoints are freed along with the arena
 
-        if ( reassembly_data && reassembly_data->payload_data )
-        {
-            snapshot_destroy_packet( endpoint->context, reassembly_data->payload_data );
-            reassembly_data->payload_data = NULL;
-        }
-    }
+    if ( endpoint->arena_allocated )
+        return;
 
     snapshot_free( endpoint->context, endpoint->acks );
+    snapshot_free( endpoint->context, endpoint->reassembly_slab );
+    snapshot_free( endpoint->context, endpoint->reassembly_slot_sequence );
+
+    if ( endpoint->parity_data )
+    {
+        snapshot_free( endpoint->context, endpoint->parity_data );
+    }
+
+    if ( endpoint->resend_payloads )
+    {
+        snapshot_sequence_buffer_destroy( endpoint->resend_payloads );
+        snapshot_free( endpoint->context, endpoint->resend_slab );
+    }
 
     snapshot_sequence_buffer_destroy( endpoint->sent_packets );
     snapshot_sequence_buffer_destroy( endpoint->received_packets );
@@ -274,15 +566,212 @@ uint16_t snapshot_endpoint_sequence( struct snapshot_endpoint_t * endpoint )
     return endpoint->sequence;
 }
 
-void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uint8_t * payload_data, int payload_bytes, int * num_packets, uint8_t ** packet_data, int * packet_bytes )
+// -----------------------------------------------------------------------------------------
+
+static void snapshot_endpoint_window_enter( struct snapshot_endpoint_window_t * window, double time, int packet_bytes )
+{
+    if ( window->num_packets == 0 )
+    {
+        window->start_time = time;
+        window->finish_time = time;
+    }
+    else
+    {
+        if ( time < window->start_time )
+            window->start_time = time;
+        if ( time > window->finish_time )
+            window->finish_time = time;
+    }
+    window->num_packets++;
+    window->packet_bytes += packet_bytes;
+}
+
+static void snapshot_endpoint_window_leave( struct snapshot_endpoint_window_t * window, int packet_bytes )
+{
+    snapshot_assert( window->num_packets > 0 );
+    snapshot_assert( window->packet_bytes >= (uint64_t) packet_bytes );
+    window->num_packets--;
+    window->packet_bytes -= packet_bytes;
+    if ( window->num_packets == 0 )
+    {
+        memset( window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+    }
+}
+
+static void snapshot_endpoint_window_bandwidth( struct snapshot_endpoint_window_t * window, float smoothing_factor, float * bandwidth_kbps )
+{
+    if ( window->num_packets == 0 || window->finish_time <= window->start_time )
+        return;
+
+    float window_bandwidth_kbps = (float) ( ( (double) window->packet_bytes ) / ( window->finish_time - window->start_time ) * 8.0f / 1000.0f );
+    if ( fabs( *bandwidth_kbps - window_bandwidth_kbps ) > 0.00001 )
+    {
+        *bandwidth_kbps += ( window_bandwidth_kbps - *bandwidth_kbps ) * smoothing_factor;
+    }
+    else
+    {
+        *bandwidth_kbps = window_bandwidth_kbps;
+    }
+}
+
+static bool snapshot_endpoint_in_window( struct snapshot_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    // the window is the oldest half of the buffer: [sequence - num_entries, sequence - num_entries/2 - 1]
+
+    const uint16_t offset = sequence_buffer->sequence - 1 - sequence;
+    return offset >= sequence_buffer->num_entries / 2 && offset < sequence_buffer->num_entries;
+}
+
+static void snapshot_endpoint_sent_packet_enter( struct snapshot_endpoint_t * endpoint, struct snapshot_endpoint_sent_packet_data_t * sent_packet_data )
+{
+    snapshot_endpoint_window_enter( &endpoint->sent_window, sent_packet_data->time, sent_packet_data->packet_bytes );
+    if ( sent_packet_data->acked )
+        snapshot_endpoint_window_enter( &endpoint->acked_window, sent_packet_data->time, sent_packet_data->packet_bytes );
+    else
+        endpoint->num_dropped_packets++;
+}
+
+static void snapshot_endpoint_sent_packet_leave( struct snapshot_endpoint_t * endpoint, struct snapshot_endpoint_sent_packet_data_t * sent_packet_data )
+{
+    snapshot_endpoint_window_leave( &endpoint->sent_window, sent_packet_data->packet_bytes );
+    if ( sent_packet_data->acked )
+        snapshot_endpoint_window_leave( &endpoint->acked_window, sent_packet_data->packet_bytes );
+    else
+        endpoint->num_dropped_packets--;
+}
+
+static void snapshot_endpoint_slide_sent_window( struct snapshot_endpoint_t * endpoint, uint16_t sequence )
+{
+    // must be called before sequence is inserted in the sent packets buffer, while packets leaving the window are still there
+
+    struct snapshot_sequence_buffer_t * sent_packets = endpoint->sent_packets;
+
+    if ( !snapshot_sequence_greater_than( sequence + 1, sent_packets->sequence ) )
+        return;
+
+    const int num_entries = sent_packets->num_entries;
+    const int num_steps = (uint16_t) ( sequence + 1 - sent_packets->sequence );
+
+    if ( num_steps >= num_entries )
+    {
+        memset( &endpoint->sent_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+        memset( &endpoint->acked_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+        endpoint->num_dropped_packets = 0;
+        return;
+    }
+
+    for ( int i = 0; i < num_steps; ++i )
+    {
+        const uint16_t buffer_sequence = sent_packets->sequence + (uint16_t) i;
+
+        struct snapshot_endpoint_sent_packet_data_t * leaving = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( sent_packets, buffer_sequence - (uint16_t) num_entries );
+        if ( leaving )
+        {
+            snapshot_endpoint_sent_packet_leave( endpoint, leaving );
+
+            struct snapshot_endpoint_sent_packet_data_t * oldest = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( sent_packets, buffer_sequence - (uint16_t) num_entries + 1 );
+            if ( oldest && endpoint->sent_window.num_packets > 0 )
+                endpoint->sent_window.start_time = oldest->time;
+            if ( oldest && oldest->acked && endpoint->acked_window.num_packets > 0 )
+                endpoint->acked_window.start_time = oldest->time;
+        }
+
+        struct snapshot_endpoint_sent_packet_data_t * entering = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( sent_packets, buffer_sequence - (uint16_t) ( num_entries / 2 ) );
+        if ( entering )
+        {
+            snapshot_endpoint_sent_packet_enter( endpoint, entering );
+        }
+    }
+}
+
+static void snapshot_endpoint_slide_received_window( struct snapshot_endpoint_t * endpoint, uint16_t sequence )
+{
+    // must be called before sequence is inserted in the received packets buffer, or the buffer is advanced to it
+
+    struct snapshot_sequence_buffer_t * received_packets = endpoint->received_packets;
+
+    if ( !snapshot_sequence_greater_than( sequence + 1, received_packets->sequence ) )
+        return;
+
+    const int num_entries = received_packets->num_entries;
+    const int num_steps = (uint16_t) ( sequence + 1 - received_packets->sequence );
+
+    if ( num_steps >= num_entries )
+    {
+        memset( &endpoint->received_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+        return;
+    }
+
+    for ( int i = 0; i < num_steps; ++i )
+    {
+        const uint16_t buffer_sequence = received_packets->sequence + (uint16_t) i;
+
+        struct snapshot_endpoint_received_packet_data_t * leaving = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_find( received_packets, buffer_sequence - (uint16_t) num_entries );
+        if ( leaving )
+        {
+            snapshot_endpoint_window_leave( &endpoint->received_window, leaving->packet_bytes );
+
+            struct snapshot_endpoint_received_packet_data_t * oldest = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_find( received_packets, buffer_sequence - (uint16_t) num_entries + 1 );
+            if ( oldest && endpoint->received_window.num_packets > 0 )
+                endpoint->received_window.start_time = oldest->time;
+        }
+
+        struct snapshot_endpoint_received_packet_data_t * entering = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_find( received_packets, buffer_sequence - (uint16_t) ( num_entries / 2 ) );
+        if ( entering )
+        {
+            snapshot_endpoint_window_enter( &endpoint->received_window, entering->time, entering->packet_bytes );
+        }
+    }
+}
+
+static_assert( SNAPSHOT_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES <= SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES, "fragment header does not fit in payload iovec" );
+static_assert( SNAPSHOT_PARITY_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES <= SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES, "parity fragment header does not fit in payload iovec" );
+
+static void snapshot_endpoint_write_fragment_iovec( struct snapshot_endpoint_t * endpoint, 
+                                                    struct snapshot_payload_iovec_t * iovec, 
+                                                    uint16_t sequence, 
+                                                    uint16_t ack, 
+                                                    uint32_t ack_bits, 
+                                                    int fragment_id, 
+                                                    int num_fragments, 
+                                                    const uint8_t * payload_data, 
+                                                    int payload_bytes )
+{
+    uint8_t * p = iovec->header;
+
+    snapshot_write_uint8( &p, 1 ); // fragment
+    snapshot_write_uint16( &p, sequence );
+    snapshot_write_uint8( &p, (uint8_t) fragment_id );
+    snapshot_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+
+    if ( fragment_id == 0 )
+    {
+        p += snapshot_write_packet_header( p, sequence, ack, ack_bits );
+    }
+
+    const int fragment_start = fragment_id * endpoint->config.fragment_size;
+
+    int bytes_to_copy = endpoint->config.fragment_size;
+    if ( fragment_start + bytes_to_copy > payload_bytes )
+    {
+        bytes_to_copy = payload_bytes - fragment_start;
+    }
+
+    iovec->header_bytes = (int) ( p - iovec->header );
+    iovec->data = payload_data + fragment_start;
+    iovec->data_bytes = bytes_to_copy;
+}
+
+void snapshot_endpoint_write_payload_iovecs( struct snapshot_endpoint_t * endpoint, const uint8_t * payload_data, int payload_bytes, int * num_iovecs, struct snapshot_payload_iovec_t * iovecs )
 {
     snapshot_assert( endpoint );
     snapshot_assert( payload_data );
     snapshot_assert( payload_bytes > 0 );
     snapshot_assert( payload_bytes <= SNAPSHOT_MAX_PAYLOAD_BYTES );
-    snapshot_assert( num_packets );
-    snapshot_assert( packet_data );
-    snapshot_assert( packet_bytes );
+    snapshot_assert( num_iovecs );
+    snapshot_assert( iovecs );
+
+    *num_iovecs = 0;
 
     if ( payload_bytes > SNAPSHOT_MAX_PAYLOAD_BYTES )
     {
@@ -297,6 +786,8 @@ void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uin
 
     snapshot_sequence_buffer_generate_ack_bits( endpoint->received_packets, &ack, &ack_bits );
 
+    snapshot_endpoint_slide_sent_window( endpoint, sequence );
+
     struct snapshot_endpoint_sent_packet_data_t * sent_packet_data = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_insert( endpoint->sent_packets, sequence );
 
     snapshot_assert( sent_packet_data );
@@ -311,17 +802,11 @@ void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uin
 
         snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] sending payload %d without fragmentation", endpoint->config.name, sequence );
 
-        uint8_t header[SNAPSHOT_MAX_PACKET_HEADER_BYTES];
-
-        memset( header, 0, SNAPSHOT_MAX_PACKET_HEADER_BYTES );
-
-        int header_bytes = snapshot_write_packet_header( header, sequence, ack, ack_bits );
-
-        *num_packets = 1;
-        packet_data[0] = payload_data - header_bytes;
-        packet_bytes[0] = payload_bytes + header_bytes;
+        iovecs[0].header_bytes = snapshot_write_packet_header( iovecs[0].header, sequence, ack, ack_bits );
+        iovecs[0].data = payload_data;
+        iovecs[0].data_bytes = payload_bytes;
 
-        memcpy( packet_data[0], header, header_bytes );
+        *num_iovecs = 1;
     }
     else
     {
@@ -334,63 +819,386 @@ void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uin
         snapshot_assert( num_fragments >= 1 );
         snapshot_assert( num_fragments <= endpoint->config.max_fragments );
 
-        int fragment_buffer_size = SNAPSHOT_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES + endpoint->config.fragment_size;
+        for ( int fragment_id = 0; fragment_id < num_fragments; ++fragment_id )
+        {
+            snapshot_endpoint_write_fragment_iovec( endpoint, &iovecs[fragment_id], sequence, ack, ack_bits, fragment_id, num_fragments, payload_data, payload_bytes );
+
+            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT]++;
+        }
 
-        uint8_t * q = payload_data;
+        *num_iovecs = num_fragments;
 
-        uint8_t * end = q + payload_bytes;
+        // with fragment resend on, a copy of the payload is kept until it is acked, so missing fragments can be sent again
 
-        for ( int fragment_id = 0; fragment_id < num_fragments; ++fragment_id )
+        if ( endpoint->resend_payloads )
         {
-            uint8_t * fragment_packet_data = snapshot_create_packet( endpoint->context, fragment_buffer_size );
+            struct snapshot_endpoint_resend_payload_data_t * resend_payload = (struct snapshot_endpoint_resend_payload_data_t*) snapshot_sequence_buffer_insert( endpoint->resend_payloads, sequence );
 
-            uint8_t * p = fragment_packet_data;
+            snapshot_assert( resend_payload );
 
-            snapshot_write_uint8( &p, 1 ); // fragment
-            snapshot_write_uint16( &p, sequence );
-            snapshot_write_uint8( &p, (uint8_t) fragment_id );
-            snapshot_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+            const int index = sequence % endpoint->config.fragment_resend_buffer_size;
 
-            if ( fragment_id == 0 )
-            {
-                uint8_t header[SNAPSHOT_MAX_PACKET_HEADER_BYTES];
-                memset( header, 0, SNAPSHOT_MAX_PACKET_HEADER_BYTES );
-                int header_bytes = snapshot_write_packet_header( header, sequence, ack, ack_bits );
-                memcpy( p, header, header_bytes );
-                p += header_bytes;
-            }
+            resend_payload->last_send_time = endpoint->time;
+            resend_payload->sequence = sequence;
+            resend_payload->ack = ack;
+            resend_payload->ack_bits = ack_bits;
+            resend_payload->num_fragments = num_fragments;
+            resend_payload->payload_bytes = payload_bytes;
+            resend_payload->payload_data = endpoint->resend_slab + (size_t) index * SNAPSHOT_MAX_PAYLOAD_BYTES;
+            memset( resend_payload->fragment_resend, 0, sizeof( resend_payload->fragment_resend ) );
+            memcpy( resend_payload->payload_data, payload_data, payload_bytes );
+        }
+
+        // parity fragments go after the fragments they cover. each one is the xor of the fragments in its group
+
+        const int group_size = endpoint->fec_group_size;
 
-            int bytes_to_copy = endpoint->config.fragment_size;
-            if ( q + bytes_to_copy > end )
+        if ( group_size > 0 )
+        {
+            const int num_groups = ( num_fragments + group_size - 1 ) / group_size;
+
+            for ( int group_index = 0; group_index < num_groups; ++group_index )
             {
-                bytes_to_copy = (int) ( end - q );
+                uint8_t * parity = endpoint->parity_data + group_index * endpoint->config.fragment_size;
+
+                memset( parity, 0, endpoint->config.fragment_size );
+
+                int parity_bytes = 0;
+
+                for ( int fragment_id = group_index * group_size; fragment_id < num_fragments && fragment_id < ( group_index + 1 ) * group_size; ++fragment_id )
+                {
+                    const uint8_t * fragment_data = iovecs[fragment_id].data;
+                    const int fragment_bytes = iovecs[fragment_id].data_bytes;
+                    for ( int i = 0; i < fragment_bytes; ++i )
+                    {
+                        parity[i] ^= fragment_data[i];
+                    }
+                    if ( fragment_bytes > parity_bytes )
+                    {
+                        parity_bytes = fragment_bytes;
+                    }
+                }
+
+                struct snapshot_payload_iovec_t * iovec = &iovecs[num_fragments + group_index];
+
+                uint8_t * p = iovec->header;
+
+                snapshot_write_uint8( &p, 3 ); // parity fragment
+                snapshot_write_uint16( &p, sequence );
+                snapshot_write_uint8( &p, (uint8_t) group_index );
+                snapshot_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+                snapshot_write_uint8( &p, (uint8_t) group_size );
+                snapshot_write_uint16( &p, (uint16_t) payload_bytes );
+
+                p += snapshot_write_packet_header( p, sequence, ack, ack_bits );
+
+                iovec->header_bytes = (int) ( p - iovec->header );
+                iovec->data = parity;
+                iovec->data_bytes = parity_bytes;
+
+                sent_packet_data->packet_bytes += parity_bytes;
+
+                endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PARITY_FRAGMENTS_SENT]++;
             }
 
-            memcpy( p, q, bytes_to_copy );
+            *num_iovecs += num_groups;
+        }
+    }
 
-            p += bytes_to_copy;
-            q += bytes_to_copy;
+    endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_SENT]++;
+}
 
-            int fragment_packet_bytes = (int) ( p - fragment_packet_data );
+void snapshot_endpoint_write_packets( struct snapshot_endpoint_t * endpoint, uint8_t * payload_data, int payload_bytes, int * num_packets, uint8_t ** packet_data, int * packet_bytes )
+{
+    snapshot_assert( endpoint );
+    snapshot_assert( payload_data );
+    snapshot_assert( num_packets );
+    snapshot_assert( packet_data );
+    snapshot_assert( packet_bytes );
 
-            packet_data[fragment_id] = fragment_packet_data;
-            packet_bytes[fragment_id] = fragment_packet_bytes;
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
 
-            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_SENT]++;
+    snapshot_endpoint_write_payload_iovecs( endpoint, payload_data, payload_bytes, &num_iovecs, iovecs );
+
+    if ( num_iovecs == 0 )
+        return;
+
+    if ( payload_bytes <= endpoint->config.fragment_above )
+    {
+        // regular packet. the header goes in front of the payload, so there is nothing to copy
+
+        snapshot_assert( num_iovecs == 1 );
+
+        *num_packets = 1;
+        packet_data[0] = payload_data - iovecs[0].header_bytes;
+        packet_bytes[0] = payload_bytes + iovecs[0].header_bytes;
+
+        memcpy( packet_data[0], iovecs[0].header, iovecs[0].header_bytes );
+    }
+    else
+    {
+        // fragmented packet. each fragment is copied into a packet buffer of its own
+
+        int fragment_buffer_size = SNAPSHOT_PARITY_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES + endpoint->config.fragment_size;
+
+        for ( int i = 0; i < num_iovecs; ++i )
+        {
+            uint8_t * fragment_packet_data = snapshot_create_packet( endpoint->context, fragment_buffer_size );
+
+            memcpy( fragment_packet_data, iovecs[i].header, iovecs[i].header_bytes );
+            memcpy( fragment_packet_data + iovecs[i].header_bytes, iovecs[i].data, iovecs[i].data_bytes );
+
+            packet_data[i] = fragment_packet_data;
+            packet_bytes[i] = iovecs[i].header_bytes + iovecs[i].data_bytes;
         }
 
-        *num_packets = num_fragments;
+        *num_packets = num_iovecs;
     }
+}
 
-    endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_SENT]++;
+// a slot belongs to the payload whose sequence it holds for as long as that payload is still being reassembled. slots are handed
+// out in turn, so when none are free the one taken next is the oldest, and its unfinished payload is dropped
+
+static bool snapshot_endpoint_reassembly_slot_in_use( struct snapshot_endpoint_t * endpoint, int slot )
+{
+    struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_find( endpoint->fragment_reassembly, endpoint->reassembly_slot_sequence[slot] );
+    return reassembly_data && reassembly_data->slot == slot;
+}
+
+static int snapshot_endpoint_take_reassembly_slot( struct snapshot_endpoint_t * endpoint, uint16_t sequence )
+{
+    const int num_slots = endpoint->config.fragment_reassembly_slots;
+
+    int slot = endpoint->next_reassembly_slot;
+
+    for ( int i = 0; i < num_slots; ++i )
+    {
+        const int index = ( endpoint->next_reassembly_slot + i ) % num_slots;
+        if ( !snapshot_endpoint_reassembly_slot_in_use( endpoint, index ) )
+        {
+            slot = index;
+            break;
+        }
+    }
+
+    if ( snapshot_endpoint_reassembly_slot_in_use( endpoint, slot ) )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] dropped reassembly of payload %d to make room for payload %d", endpoint->config.name, endpoint->reassembly_slot_sequence[slot], sequence );
+        snapshot_sequence_buffer_remove( endpoint->fragment_reassembly, endpoint->reassembly_slot_sequence[slot] );
+        endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_REASSEMBLIES_EVICTED]++;
+    }
+
+    endpoint->reassembly_slot_sequence[slot] = sequence;
+    endpoint->next_reassembly_slot = ( slot + 1 ) % num_slots;
+
+    return slot;
+}
+
+// parity for a group is kept in the slot of the lowest fragment in the group that hasn't arrived yet, so it costs no memory
+// beyond the reassembly slab. once only one fragment in the group is missing, xoring the rest into that slot rebuilds it
+
+static int snapshot_endpoint_parity_group_missing( struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data, int group_index, int * first_missing, int * second_missing )
+{
+    const int group_size = reassembly_data->parity_group_size;
+    const int group_start = group_index * group_size;
+    int group_end = group_start + group_size;
+    if ( group_end > reassembly_data->num_fragments_total )
+        group_end = reassembly_data->num_fragments_total;
+
+    int num_missing = 0;
+    *first_missing = -1;
+    *second_missing = -1;
+
+    for ( int fragment_id = group_start; fragment_id < group_end; ++fragment_id )
+    {
+        if ( reassembly_data->fragment_received[fragment_id >> 6] & ( 1ULL << ( fragment_id & 63 ) ) )
+            continue;
+
+        if ( num_missing == 0 )
+            *first_missing = fragment_id;
+        else if ( num_missing == 1 )
+            *second_missing = fragment_id;
+
+        num_missing++;
+    }
+
+    return num_missing;
 }
 
-void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes, uint8_t * payload_buffer, uint8_t ** out_payload_data, int * out_payload_bytes, uint16_t * out_payload_sequence, uint16_t * out_payload_ack, uint32_t * out_payload_ack_bits )
+static void snapshot_endpoint_recover_fragment( struct snapshot_endpoint_t * endpoint, struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data, int group_index )
+{
+    const uint64_t parity_bit = 1ULL << ( group_index & 63 );
+
+    if ( ( reassembly_data->parity_received[group_index >> 6] & parity_bit ) == 0 )
+        return;
+
+    int missing_id, second_missing;
+    if ( snapshot_endpoint_parity_group_missing( reassembly_data, group_index, &missing_id, &second_missing ) != 1 )
+        return;
+
+    const int fragment_size = endpoint->config.fragment_size;
+    const int group_size = reassembly_data->parity_group_size;
+    const int group_start = group_index * group_size;
+    int group_end = group_start + group_size;
+    if ( group_end > reassembly_data->num_fragments_total )
+        group_end = reassembly_data->num_fragments_total;
+
+    uint8_t * missing_data = reassembly_data->payload_data + missing_id * fragment_size;
+
+    for ( int fragment_id = group_start; fragment_id < group_end; ++fragment_id )
+    {
+        if ( fragment_id == missing_id )
+            continue;
+
+        const uint8_t * fragment_data = reassembly_data->payload_data + fragment_id * fragment_size;
+        for ( int i = 0; i < fragment_size; ++i )
+        {
+            missing_data[i] ^= fragment_data[i];
+        }
+    }
+
+    snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] recovered fragment %d of payload %d from parity", endpoint->config.name, missing_id, reassembly_data->payload_sequence );
+
+    reassembly_data->parity_received[group_index >> 6] &= ~parity_bit;
+    reassembly_data->fragment_received[missing_id >> 6] |= 1ULL << ( missing_id & 63 );
+    reassembly_data->num_fragments_received++;
+
+    endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECOVERED]++;
+}
+
+static void snapshot_endpoint_store_parity_data( struct snapshot_endpoint_t * endpoint, struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data, int group_index, const uint8_t * parity_data, int parity_bytes )
+{
+    const uint64_t parity_bit = 1ULL << ( group_index & 63 );
+
+    if ( reassembly_data->parity_received[group_index >> 6] & parity_bit )
+        return;
+
+    int first_missing, second_missing;
+    if ( snapshot_endpoint_parity_group_missing( reassembly_data, group_index, &first_missing, &second_missing ) == 0 )
+        return;
+
+    const int fragment_size = endpoint->config.fragment_size;
+
+    uint8_t * slot_data = reassembly_data->payload_data + first_missing * fragment_size;
+    memcpy( slot_data, parity_data, parity_bytes );
+    memset( slot_data + parity_bytes, 0, fragment_size - parity_bytes );
+
+    reassembly_data->parity_received[group_index >> 6] |= parity_bit;
+
+    snapshot_endpoint_recover_fragment( endpoint, reassembly_data, group_index );
+}
+
+static void snapshot_endpoint_move_parity_data( struct snapshot_endpoint_t * endpoint, struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data, int fragment_id )
+{
+    // a fragment is about to land in the slot holding its group's parity, so the parity moves to the next missing slot
+
+    if ( reassembly_data->parity_group_size == 0 )
+        return;
+
+    const int group_index = fragment_id / reassembly_data->parity_group_size;
+
+    if ( ( reassembly_data->parity_received[group_index >> 6] & ( 1ULL << ( group_index & 63 ) ) ) == 0 )
+        return;
+
+    int first_missing, second_missing;
+    snapshot_endpoint_parity_group_missing( reassembly_data, group_index, &first_missing, &second_missing );
+
+    if ( first_missing != fragment_id )
+        return;
+
+    // parity is only held while two or more fragments in the group are missing
+
+    snapshot_assert( second_missing > fragment_id );
+
+    const int fragment_size = endpoint->config.fragment_size;
+
+    memcpy( reassembly_data->payload_data + second_missing * fragment_size, reassembly_data->payload_data + fragment_id * fragment_size, fragment_size );
+}
+
+static double snapshot_endpoint_resend_delay( struct snapshot_endpoint_t * endpoint )
+{
+    double resend_delay = endpoint->rtt * 0.001 * SNAPSHOT_ENDPOINT_FRAGMENT_RESEND_RTT_FACTOR;
+    if ( resend_delay < SNAPSHOT_ENDPOINT_FRAGMENT_RESEND_MIN_SECONDS )
+    {
+        resend_delay = SNAPSHOT_ENDPOINT_FRAGMENT_RESEND_MIN_SECONDS;
+    }
+    return resend_delay;
+}
+
+static void snapshot_endpoint_process_fragment_acks( struct snapshot_endpoint_t * endpoint, const uint8_t * packet_data, int packet_bytes )
+{
+    if ( !endpoint->resend_payloads )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] ignoring fragment acks. fragment resend is not enabled", endpoint->config.name );
+        return;
+    }
+
+    if ( packet_bytes < 2 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment acks. packet is too small", endpoint->config.name );
+        endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_INVALID]++;
+        return;
+    }
+
+    endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_RECEIVED]++;
+
+    const double resend_delay = snapshot_endpoint_resend_delay( endpoint );
+
+    const uint8_t * p = packet_data + 1;
+    const uint8_t * end = packet_data + packet_bytes;
+
+    const int num_entries = snapshot_read_uint8( &p );
+
+    for ( int i = 0; i < num_entries; ++i )
+    {
+        if ( end - p < 3 )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment acks. packet is truncated", endpoint->config.name );
+            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_INVALID]++;
+            return;
+        }
+
+        const uint16_t sequence = snapshot_read_uint16( &p );
+        const int num_fragments = ( (int) snapshot_read_uint8( &p ) ) + 1;
+        const int mask_bytes = ( num_fragments + 7 ) / 8;
+
+        if ( end - p < mask_bytes )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring invalid fragment acks. packet is truncated", endpoint->config.name );
+            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_INVALID]++;
+            return;
+        }
+
+        const uint8_t * mask = p;
+
+        p += mask_bytes;
+
+        struct snapshot_endpoint_resend_payload_data_t * resend_payload = (struct snapshot_endpoint_resend_payload_data_t*) snapshot_sequence_buffer_find( endpoint->resend_payloads, sequence );
+
+        if ( !resend_payload || resend_payload->num_fragments != num_fragments )
+            continue;
+
+        // fragments sent less than an rtt ago may still be in flight, so the receiver can't have seen them yet
+
+        if ( endpoint->time - resend_payload->last_send_time < resend_delay )
+            continue;
+
+        for ( int fragment_id = 0; fragment_id < num_fragments; ++fragment_id )
+        {
+            if ( ( mask[fragment_id >> 3] & ( 1 << ( fragment_id & 7 ) ) ) == 0 )
+            {
+                resend_payload->fragment_resend[fragment_id >> 6] |= 1ULL << ( fragment_id & 63 );
+            }
+        }
+    }
+}
+
+void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int packet_bytes, uint8_t ** out_payload_data, int * out_payload_bytes, uint16_t * out_payload_sequence, uint16_t * out_payload_ack, uint32_t * out_payload_ack_bits )
 {
     snapshot_assert( endpoint );
     snapshot_assert( packet_data );
     snapshot_assert( packet_bytes > 0 );
-    snapshot_assert( payload_buffer );
     snapshot_assert( out_payload_data );
     snapshot_assert( out_payload_sequence );
     snapshot_assert( out_payload_ack );
@@ -451,19 +1259,47 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
         *out_payload_ack = ack;
         *out_payload_ack_bits = ack_bits;
     }
+    else if ( prefix_byte == 5 )
+    {
+        snapshot_endpoint_process_fragment_acks( endpoint, packet_data, packet_bytes );
+    }
     else
     {
-        // fragment
+        // fragment or parity fragment
+
+        const bool parity = prefix_byte == 3;
 
         int fragment_id;
         int num_fragments;
         int fragment_bytes;
+        int group_size = 0;
+        int parity_payload_bytes = 0;
 
         uint16_t sequence;
         uint16_t ack;
         uint32_t ack_bits;
 
-        int fragment_header_bytes = snapshot_read_fragment_header( endpoint->config.name, 
+        int fragment_header_bytes;
+
+        if ( parity )
+        {
+            fragment_header_bytes = snapshot_read_parity_fragment_header( endpoint->config.name, 
+                                                                          packet_data, 
+                                                                          packet_bytes, 
+                                                                          endpoint->config.max_fragments, 
+                                                                          endpoint->config.fragment_size,
+                                                                          &fragment_id, 
+                                                                          &group_size, 
+                                                                          &num_fragments, 
+                                                                          &parity_payload_bytes, 
+                                                                          &fragment_bytes, 
+                                                                          &sequence, 
+                                                                          &ack, 
+                                                                          &ack_bits );
+        }
+        else
+        {
+            fragment_header_bytes = snapshot_read_fragment_header( endpoint->config.name, 
                                                                    packet_data, 
                                                                    packet_bytes, 
                                                                    endpoint->config.max_fragments, 
@@ -474,6 +1310,7 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
                                                                    &sequence, 
                                                                    &ack, 
                                                                    &ack_bits );
+        }
 
         if ( fragment_header_bytes < 0 )
         {
@@ -482,11 +1319,26 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
             return;
         }
 
+        if ( num_fragments * endpoint->config.fragment_size > endpoint->reassembly_slot_bytes )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] payload too large to receive. payload has %d fragments, maximum is %d", endpoint->config.name, num_fragments, endpoint->reassembly_slot_bytes / endpoint->config.fragment_size );
+            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE]++;
+            return;
+        }
+
         struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*)  snapshot_sequence_buffer_find( endpoint->fragment_reassembly, sequence );
 
         if ( !reassembly_data )
         {
-            reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_insert_with_cleanup( endpoint->fragment_reassembly, sequence, snapshot_fragment_reassembly_data_cleanup );
+            // a resent fragment can turn up after its payload has already been reassembled. don't start over on it
+
+            if ( snapshot_sequence_buffer_exists( endpoint->received_packets, sequence ) )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] ignoring fragment %d of payload %d. payload already received", endpoint->config.name, fragment_id, sequence );
+                return;
+            }
+
+            reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_insert( endpoint->fragment_reassembly, sequence );
 
             if ( !reassembly_data )
             {
@@ -495,15 +1347,21 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
                 return;
             }
 
+            snapshot_endpoint_slide_received_window( endpoint, sequence );
+
             snapshot_sequence_buffer_advance( endpoint->received_packets, sequence );
 
-            int payload_buffer_size = num_fragments * endpoint->config.fragment_size;
+            const int slot = snapshot_endpoint_take_reassembly_slot( endpoint, sequence );
 
+            reassembly_data->sequence = sequence;
             reassembly_data->num_fragments_received = 0;
             reassembly_data->num_fragments_total = num_fragments;
-            reassembly_data->payload_data = snapshot_create_packet( endpoint->context, payload_buffer_size );
+            reassembly_data->slot = slot;
+            reassembly_data->payload_data = endpoint->reassembly_slab + (size_t) slot * endpoint->reassembly_slot_bytes;
             reassembly_data->payload_bytes = 0;
+            reassembly_data->parity_group_size = 0;
             memset( reassembly_data->fragment_received, 0, sizeof( reassembly_data->fragment_received ) );
+            memset( reassembly_data->parity_received, 0, sizeof( reassembly_data->parity_received ) );
         }
 
         if ( num_fragments != (int) reassembly_data->num_fragments_total )
@@ -513,25 +1371,56 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
             return;
         }
 
-        if ( reassembly_data->fragment_received[fragment_id] )
+        if ( parity )
         {
-            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring fragment %d of payload %d. fragment already received", endpoint->config.name, fragment_id, sequence );
-            return;
+            if ( reassembly_data->parity_group_size != 0 && reassembly_data->parity_group_size != group_size )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring invalid parity fragment. group size mismatch. expected %d, got %d", endpoint->config.name, reassembly_data->parity_group_size, group_size );
+                endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_INVALID]++;
+                return;
+            }
+
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] received parity fragment %d of payload %d", endpoint->config.name, fragment_id, sequence );
+
+            reassembly_data->parity_group_size = group_size;
+            reassembly_data->payload_bytes = parity_payload_bytes;
+            reassembly_data->payload_sequence = sequence;
+            reassembly_data->payload_ack = ack;
+            reassembly_data->payload_ack_bits = ack_bits;
+
+            snapshot_endpoint_store_parity_data( endpoint, reassembly_data, fragment_id, packet_data + fragment_header_bytes, fragment_bytes );
         }
+        else
+        {
+            const uint64_t fragment_bit = 1ULL << ( fragment_id & 63 );
+
+            if ( reassembly_data->fragment_received[fragment_id >> 6] & fragment_bit )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "[%s] ignoring fragment %d of payload %d. fragment already received", endpoint->config.name, fragment_id, sequence );
+                return;
+            }
+
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] received fragment %d of payload %d (%d/%d)", endpoint->config.name, fragment_id, sequence, reassembly_data->num_fragments_received+1, num_fragments );
 
-        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] received fragment %d of payload %d (%d/%d)", endpoint->config.name, fragment_id, sequence, reassembly_data->num_fragments_received+1, num_fragments );
+            snapshot_endpoint_move_parity_data( endpoint, reassembly_data, fragment_id );
 
-        reassembly_data->num_fragments_received++;
-        reassembly_data->fragment_received[fragment_id] = 1;
+            reassembly_data->num_fragments_received++;
+            reassembly_data->fragment_received[fragment_id >> 6] |= fragment_bit;
 
-        snapshot_store_fragment_data( reassembly_data, 
-                                      fragment_id, 
-                                      endpoint->config.fragment_size, 
-                                      packet_data + fragment_header_bytes, 
-                                      packet_bytes - fragment_header_bytes,
-                                      sequence, 
-                                      ack, 
-                                      ack_bits );
+            snapshot_store_fragment_data( reassembly_data, 
+                                          fragment_id, 
+                                          endpoint->config.fragment_size, 
+                                          packet_data + fragment_header_bytes, 
+                                          packet_bytes - fragment_header_bytes,
+                                          sequence, 
+                                          ack, 
+                                          ack_bits );
+
+            if ( reassembly_data->parity_group_size > 0 )
+            {
+                snapshot_endpoint_recover_fragment( endpoint, reassembly_data, fragment_id / reassembly_data->parity_group_size );
+            }
+        }
 
         endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECEIVED]++;
 
@@ -550,9 +1439,10 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
                 return;
             }
 
-            memcpy( payload_buffer, reassembly_data->payload_data, payload_bytes );
+            // the payload is handed off straight from the slab. removing the entry frees its slot, but nothing can take the slot
+            // before the next call to process packet
 
-            snapshot_sequence_buffer_remove_with_cleanup( endpoint->fragment_reassembly, sequence, snapshot_fragment_reassembly_data_cleanup );
+            snapshot_sequence_buffer_remove( endpoint->fragment_reassembly, sequence );
 
             if ( !snapshot_sequence_buffer_test_insert( endpoint->received_packets, sequence ) )
             {
@@ -561,7 +1451,7 @@ void snapshot_endpoint_process_packet( struct snapshot_endpoint_t * endpoint, ui
                 return;
             }
 
-            *out_payload_data = payload_buffer;
+            *out_payload_data = reassembly_data->payload_data;
             *out_payload_bytes = payload_bytes;
             *out_payload_sequence = reassembly_data->payload_sequence;
             *out_payload_ack = reassembly_data->payload_ack;
@@ -578,6 +1468,18 @@ void snapshot_endpoint_mark_payload_processed( snapshot_endpoint_t * endpoint, u
 
     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] marking packet %d as processed", endpoint->config.name, sequence );
 
+    snapshot_endpoint_slide_received_window( endpoint, sequence );
+
+    // packets that arrive late can land directly in the window. if the packet is already there, replace it
+
+    const bool in_window = snapshot_endpoint_in_window( endpoint->received_packets, sequence );
+
+    struct snapshot_endpoint_received_packet_data_t * existing_packet_data = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_find( endpoint->received_packets, sequence );
+    if ( existing_packet_data && in_window )
+    {
+        snapshot_endpoint_window_leave( &endpoint->received_window, existing_packet_data->packet_bytes );
+    }
+
     struct snapshot_endpoint_received_packet_data_t * received_packet_data = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_insert( endpoint->received_packets, sequence );
 
     snapshot_assert( received_packet_data );
@@ -585,7 +1487,27 @@ void snapshot_endpoint_mark_payload_processed( snapshot_endpoint_t * endpoint, u
     received_packet_data->time = endpoint->time;
     received_packet_data->packet_bytes = endpoint->config.packet_header_size + payload_bytes;
 
-    snapshot_sequence_buffer_advance_with_cleanup( endpoint->fragment_reassembly, sequence, snapshot_fragment_reassembly_data_cleanup );
+    if ( in_window )
+    {
+        snapshot_endpoint_window_enter( &endpoint->received_window, received_packet_data->time, received_packet_data->packet_bytes );
+    }
+
+    snapshot_sequence_buffer_advance( endpoint->fragment_reassembly, sequence );
+
+    snapshot_endpoint_process_acks( endpoint, ack, ack_bits );
+}
+
+void snapshot_endpoint_write_acks( struct snapshot_endpoint_t * endpoint, uint16_t * ack, uint32_t * ack_bits )
+{
+    snapshot_assert( endpoint );
+    snapshot_assert( ack );
+    snapshot_assert( ack_bits );
+    snapshot_sequence_buffer_generate_ack_bits( endpoint->received_packets, ack, ack_bits );
+}
+
+void snapshot_endpoint_process_acks( struct snapshot_endpoint_t * endpoint, uint16_t ack, uint32_t ack_bits )
+{
+    snapshot_assert( endpoint );
 
     for ( int i = 0; i < 32; ++i )
     {
@@ -599,9 +1521,19 @@ void snapshot_endpoint_mark_payload_processed( snapshot_endpoint_t * endpoint, u
             {
                 snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] acked packet %d", endpoint->config.name, ack_sequence );
                 endpoint->acks[endpoint->num_acks++] = ack_sequence;
+                if ( endpoint->resend_payloads )
+                {
+                    snapshot_sequence_buffer_remove( endpoint->resend_payloads, ack_sequence );
+                }
                 endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_ACKED]++;
                 sent_packet_data->acked = 1;
 
+                if ( snapshot_endpoint_in_window( endpoint->sent_packets, ack_sequence ) )
+                {
+                    endpoint->num_dropped_packets--;
+                    snapshot_endpoint_window_enter( &endpoint->acked_window, sent_packet_data->time, sent_packet_data->packet_bytes );
+                }
+
                 float rtt = (float) ( endpoint->time - sent_packet_data->time ) * 1000.0f;
                 snapshot_assert( rtt >= 0.0 );
                 if ( ( endpoint->rtt == 0.0f && rtt > 0.0f ) || fabs( endpoint->rtt - rtt ) < 0.00001 )
@@ -612,12 +1544,135 @@ void snapshot_endpoint_mark_payload_processed( snapshot_endpoint_t * endpoint, u
                 {
                     endpoint->rtt += ( rtt - endpoint->rtt ) * endpoint->config.rtt_smoothing_factor;
                 }
+
+                // the smoothed rtt is far too slow to see a queue build, so congestion control works from the raw samples
+
+                if ( endpoint->config.enable_congestion_control )
+                {
+                    if ( endpoint->congestion_rtt < 0.0f || rtt < endpoint->congestion_rtt )
+                    {
+                        endpoint->congestion_rtt = rtt;
+                    }
+                    float * base_rtt = &endpoint->congestion_base_rtt[endpoint->congestion_base_rtt_index];
+                    if ( *base_rtt < 0.0f || rtt < *base_rtt )
+                    {
+                        *base_rtt = rtt;
+                    }
+                }
             }
         }
         ack_bits >>= 1;
     }
 }
 
+int snapshot_endpoint_write_fragment_acks( struct snapshot_endpoint_t * endpoint, uint8_t * packet_data, int max_packet_bytes )
+{
+    snapshot_assert( endpoint );
+    snapshot_assert( packet_data );
+    snapshot_assert( max_packet_bytes >= 2 );
+
+    if ( !endpoint->config.enable_fragment_resend )
+        return 0;
+
+    uint8_t * p = packet_data;
+
+    snapshot_write_uint8( &p, 5 ); // fragment acks
+    
+    uint8_t * num_entries_byte = p;
+
+    snapshot_write_uint8( &p, 0 );
+
+    int num_entries = 0;
+
+    for ( int i = 0; i < endpoint->config.fragment_reassembly_buffer_size && num_entries < 255; ++i )
+    {
+        struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
+        if ( !reassembly_data )
+            continue;
+
+        const int num_fragments = reassembly_data->num_fragments_total;
+        const int mask_bytes = ( num_fragments + 7 ) / 8;
+
+        if ( ( p - packet_data ) + 3 + mask_bytes > max_packet_bytes )
+            break;
+
+        snapshot_write_uint16( &p, reassembly_data->sequence );
+        snapshot_write_uint8( &p, (uint8_t) ( num_fragments - 1 ) );
+
+        for ( int j = 0; j < mask_bytes; ++j )
+        {
+            p[j] = (uint8_t) ( reassembly_data->fragment_received[j >> 3] >> ( ( j & 7 ) * 8 ) );
+        }
+
+        p += mask_bytes;
+
+        num_entries++;
+    }
+
+    if ( num_entries == 0 )
+        return 0;
+
+    *num_entries_byte = (uint8_t) num_entries;
+
+    endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_SENT]++;
+
+    return (int) ( p - packet_data );
+}
+
+void snapshot_endpoint_write_resend_iovecs( struct snapshot_endpoint_t * endpoint, int * num_iovecs, struct snapshot_payload_iovec_t * iovecs )
+{
+    snapshot_assert( endpoint );
+    snapshot_assert( num_iovecs );
+    snapshot_assert( iovecs );
+
+    *num_iovecs = 0;
+
+    if ( !endpoint->resend_payloads )
+        return;
+
+    for ( int i = 0; i < endpoint->config.fragment_resend_buffer_size; ++i )
+    {
+        struct snapshot_endpoint_resend_payload_data_t * resend_payload = (struct snapshot_endpoint_resend_payload_data_t*) snapshot_sequence_buffer_at_index( endpoint->resend_payloads, i );
+        if ( !resend_payload )
+            continue;
+
+        bool resent = false;
+
+        for ( int fragment_id = 0; fragment_id < resend_payload->num_fragments && *num_iovecs < SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS; ++fragment_id )
+        {
+            const uint64_t fragment_bit = 1ULL << ( fragment_id & 63 );
+
+            if ( ( resend_payload->fragment_resend[fragment_id >> 6] & fragment_bit ) == 0 )
+                continue;
+
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "[%s] resending fragment %d of payload %d", endpoint->config.name, fragment_id, resend_payload->sequence );
+
+            snapshot_endpoint_write_fragment_iovec( endpoint, 
+                                                    &iovecs[*num_iovecs], 
+                                                    resend_payload->sequence, 
+                                                    resend_payload->ack, 
+                                                    resend_payload->ack_bits, 
+                                                    fragment_id, 
+                                                    resend_payload->num_fragments, 
+                                                    resend_payload->payload_data, 
+                                                    resend_payload->payload_bytes );
+
+            resend_payload->fragment_resend[fragment_id >> 6] &= ~fragment_bit;
+
+            (*num_iovecs)++;
+
+            endpoint->counters[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RESENT]++;
+
+            resent = true;
+        }
+
+        if ( resent )
+        {
+            resend_payload->last_send_time = endpoint->time;
+        }
+    }
+}
+
 uint16_t * snapshot_endpoint_get_acks( struct snapshot_endpoint_t * endpoint, int * num_acks )
 {
     snapshot_assert( endpoint );
@@ -642,20 +1697,91 @@ void snapshot_endpoint_reset( struct snapshot_endpoint_t * endpoint )
     memset( endpoint->acks, 0, endpoint->config.ack_buffer_size * sizeof( uint16_t ) );
     memset( endpoint->counters, 0, SNAPSHOT_ENDPOINT_NUM_COUNTERS * sizeof( uint64_t ) );
 
-    for ( int i = 0; i < endpoint->config.fragment_reassembly_buffer_size; ++i )
+    snapshot_sequence_buffer_reset( endpoint->sent_packets );
+    snapshot_sequence_buffer_reset( endpoint->received_packets );
+    snapshot_sequence_buffer_reset( endpoint->fragment_reassembly );
+    endpoint->next_reassembly_slot = 0;
+
+    if ( endpoint->resend_payloads )
     {
-        struct snapshot_endpoint_fragment_reassembly_data_t * reassembly_data = (struct snapshot_endpoint_fragment_reassembly_data_t*) snapshot_sequence_buffer_at_index( endpoint->fragment_reassembly, i );
+        snapshot_sequence_buffer_reset( endpoint->resend_payloads );
+    }
+
+    memset( &endpoint->sent_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+    memset( &endpoint->received_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+    memset( &endpoint->acked_window, 0, sizeof( struct snapshot_endpoint_window_t ) );
+    endpoint->num_dropped_packets = 0;
+
+    snapshot_endpoint_reset_congestion( endpoint );
+}
+
+static void snapshot_endpoint_update_congestion( struct snapshot_endpoint_t * endpoint, double time )
+{
+    const double delta_time = time - endpoint->last_congestion_update_time;
+    if ( delta_time <= 0.0 )
+        return;
+
+    endpoint->last_congestion_update_time = time;
+
+    // the base rtt is the lowest rtt over the last minute, kept in buckets so an old minimum ages out when the route changes
+
+    if ( time - endpoint->congestion_base_rtt_time >= SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_SECONDS )
+    {
+        endpoint->congestion_base_rtt_index = ( endpoint->congestion_base_rtt_index + 1 ) % SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY;
+        endpoint->congestion_base_rtt[endpoint->congestion_base_rtt_index] = endpoint->congestion_rtt;
+        endpoint->congestion_base_rtt_time = time;
+    }
+
+    // with nothing acked since the last update there is nothing to go on, so hold the rate where it is
+
+    if ( endpoint->congestion_rtt < 0.0f )
+        return;
 
-        if ( reassembly_data && reassembly_data->payload_data )
+    float base_rtt = endpoint->congestion_rtt;
+    for ( int i = 0; i < SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY; i++ )
+    {
+        if ( endpoint->congestion_base_rtt[i] >= 0.0f && endpoint->congestion_base_rtt[i] < base_rtt )
         {
-            snapshot_destroy_packet( endpoint->context, reassembly_data->payload_data );
-            reassembly_data->payload_data = NULL;
+            base_rtt = endpoint->congestion_base_rtt[i];
         }
     }
 
-    snapshot_sequence_buffer_reset( endpoint->sent_packets );
-    snapshot_sequence_buffer_reset( endpoint->received_packets );
-    snapshot_sequence_buffer_reset( endpoint->fragment_reassembly );
+    // ledbat style: the rate grows while queuing delay is under the target, and shrinks in proportion as it goes over
+
+    const float target_delay = endpoint->config.congestion_target_delay;
+    const float queuing_delay = endpoint->congestion_rtt - base_rtt;
+
+    float off_target = ( target_delay - queuing_delay ) / target_delay;
+    if ( off_target < -1.0f )
+        off_target = -1.0f;
+
+    const double step_time = delta_time < 1.0 ? delta_time : 1.0;
+
+    float pacing_rate_kbps = endpoint->pacing_rate_kbps * (float) ( 1.0 + SNAPSHOT_ENDPOINT_CONGESTION_GAIN * off_target * step_time );
+
+    // loss on a lossy link doesn't always mean congestion, so it backs the rate off at most once per interval
+
+    if ( endpoint->packet_loss > SNAPSHOT_ENDPOINT_CONGESTION_LOSS_THRESHOLD && time - endpoint->last_congestion_decrease_time >= SNAPSHOT_ENDPOINT_CONGESTION_LOSS_INTERVAL )
+    {
+        pacing_rate_kbps *= SNAPSHOT_ENDPOINT_CONGESTION_LOSS_DECREASE;
+        endpoint->last_congestion_decrease_time = time;
+    }
+
+    // the rate can't run far ahead of what is actually getting through
+
+    if ( endpoint->acked_bandwidth_kbps > 0.0f && pacing_rate_kbps > endpoint->acked_bandwidth_kbps * SNAPSHOT_ENDPOINT_CONGESTION_ACKED_HEADROOM )
+    {
+        pacing_rate_kbps = endpoint->acked_bandwidth_kbps * SNAPSHOT_ENDPOINT_CONGESTION_ACKED_HEADROOM;
+    }
+
+    if ( pacing_rate_kbps < endpoint->config.congestion_min_kbps )
+        pacing_rate_kbps = endpoint->config.congestion_min_kbps;
+    if ( pacing_rate_kbps > endpoint->config.congestion_max_kbps )
+        pacing_rate_kbps = endpoint->config.congestion_max_kbps;
+
+    endpoint->pacing_rate_kbps = pacing_rate_kbps;
+
+    endpoint->congestion_rtt = -1.0f;
 }
 
 void snapshot_endpoint_update( struct snapshot_endpoint_t * endpoint, double time )
@@ -663,22 +1789,21 @@ void snapshot_endpoint_update( struct snapshot_endpoint_t * endpoint, double tim
     snapshot_assert( endpoint );
 
     endpoint->time = time;
-    
+
+    // smoothing is applied once per stats update, so a longer interval also means slower smoothing
+
+    if ( endpoint->config.stats_update_interval > 0.0 && time - endpoint->last_stats_update_time < endpoint->config.stats_update_interval )
+        return;
+
+    endpoint->last_stats_update_time = time;
+
+    // packet loss and bandwidth come from running totals over the oldest half of the sent and received packet buffers.
+    // they are kept up to date as packets are sent, received and acked, so there is nothing to scan here
+
     // calculate packet loss
     {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int num_dropped = 0;
         int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( int i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct snapshot_endpoint_sent_packet_data_t * sent_packet_data = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( sent_packet_data && !sent_packet_data->acked )
-            {
-                num_dropped++;
-            }
-        }
-        float packet_loss = ( (float) num_dropped ) / ( (float) num_samples ) * 100.0f;
+        float packet_loss = ( (float) endpoint->num_dropped_packets ) / ( (float) num_samples ) * 100.0f;
         if ( fabs( endpoint->packet_loss - packet_loss ) > 0.00001 )
         {
             endpoint->packet_loss += ( packet_loss - endpoint->packet_loss ) * endpoint->config.packet_loss_smoothing_factor;
@@ -689,121 +1814,15 @@ void snapshot_endpoint_update( struct snapshot_endpoint_t * endpoint, double tim
         }
     }
 
-    // calculate sent bandwidth
-    {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( int i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct snapshot_endpoint_sent_packet_data_t * sent_packet_data = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( !sent_packet_data )
-            {
-                continue;
-            }
-            bytes_sent += sent_packet_data->packet_bytes;
-            if ( sent_packet_data->time < start_time )
-            {
-                start_time = sent_packet_data->time;
-            }
-            if ( sent_packet_data->time > finish_time )
-            {
-                finish_time = sent_packet_data->time;
-            }
-        }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
-        {
-            float sent_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->sent_bandwidth_kbps - sent_bandwidth_kbps ) > 0.00001 )
-            {
-                endpoint->sent_bandwidth_kbps += ( sent_bandwidth_kbps - endpoint->sent_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
-            }
-            else
-            {
-                endpoint->sent_bandwidth_kbps = sent_bandwidth_kbps;
-            }
-        }
-    }
+    // calculate sent, received and acked bandwidth
 
-    // calculate received bandwidth
-    {
-        uint32_t base_sequence = ( endpoint->received_packets->sequence - endpoint->config.received_packets_buffer_size + 1 ) + 0xFFFF;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.received_packets_buffer_size / 2;
-        for ( int i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct snapshot_endpoint_received_packet_data_t * received_packet_data = (struct snapshot_endpoint_received_packet_data_t*) snapshot_sequence_buffer_find( endpoint->received_packets, sequence );
-            if ( !received_packet_data )
-            {
-                continue;
-            }
-            bytes_sent += received_packet_data->packet_bytes;
-            if ( received_packet_data->time < start_time )
-            {
-                start_time = received_packet_data->time;
-            }
-            if ( received_packet_data->time > finish_time )
-            {
-                finish_time = received_packet_data->time;
-            }
-        }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
-        {
-            float received_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->received_bandwidth_kbps - received_bandwidth_kbps ) > 0.00001 )
-            {
-                endpoint->received_bandwidth_kbps += ( received_bandwidth_kbps - endpoint->received_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
-            }
-            else
-            {
-                endpoint->received_bandwidth_kbps = received_bandwidth_kbps;
-            }
-        }
-    }
+    snapshot_endpoint_window_bandwidth( &endpoint->sent_window, endpoint->config.bandwidth_smoothing_factor, &endpoint->sent_bandwidth_kbps );
+    snapshot_endpoint_window_bandwidth( &endpoint->received_window, endpoint->config.bandwidth_smoothing_factor, &endpoint->received_bandwidth_kbps );
+    snapshot_endpoint_window_bandwidth( &endpoint->acked_window, endpoint->config.bandwidth_smoothing_factor, &endpoint->acked_bandwidth_kbps );
 
-    // calculate acked bandwidth
+    if ( endpoint->config.enable_congestion_control )
     {
-        uint32_t base_sequence = ( endpoint->sent_packets->sequence - endpoint->config.sent_packets_buffer_size + 1 ) + 0xFFFF;
-        int bytes_sent = 0;
-        double start_time = FLT_MAX;
-        double finish_time = 0.0;
-        int num_samples = endpoint->config.sent_packets_buffer_size / 2;
-        for ( int i = 0; i < num_samples; ++i )
-        {
-            uint16_t sequence = (uint16_t) ( base_sequence + i );
-            struct snapshot_endpoint_sent_packet_data_t * sent_packet_data = (struct snapshot_endpoint_sent_packet_data_t*) snapshot_sequence_buffer_find( endpoint->sent_packets, sequence );
-            if ( !sent_packet_data || !sent_packet_data->acked )
-            {
-                continue;
-            }
-            bytes_sent += sent_packet_data->packet_bytes;
-            if ( sent_packet_data->time < start_time )
-            {
-                start_time = sent_packet_data->time;
-            }
-            if ( sent_packet_data->time > finish_time )
-            {
-                finish_time = sent_packet_data->time;
-            }
-        }
-        if ( start_time != FLT_MAX && finish_time != 0.0 )
-        {
-            float acked_bandwidth_kbps = (float) ( ( (double) bytes_sent ) / ( finish_time - start_time ) * 8.0f / 1000.0f );
-            if ( fabs( endpoint->acked_bandwidth_kbps - acked_bandwidth_kbps ) > 0.00001 )
-            {
-                endpoint->acked_bandwidth_kbps += ( acked_bandwidth_kbps - endpoint->acked_bandwidth_kbps ) * endpoint->config.bandwidth_smoothing_factor;
-            }
-            else
-            {
-                endpoint->acked_bandwidth_kbps = acked_bandwidth_kbps;
-            }
-        }
+        snapshot_endpoint_update_congestion( endpoint, time );
     }
 }
 
@@ -830,6 +1849,44 @@ void snapshot_endpoint_bandwidth( struct snapshot_endpoint_t * endpoint, float *
     *acked_bandwidth_kbps = endpoint->acked_bandwidth_kbps;
 }
 
+float snapshot_endpoint_pacing_rate( struct snapshot_endpoint_t * endpoint )
+{
+    snapshot_assert( endpoint );
+    return endpoint->pacing_rate_kbps;
+}
+
+int snapshot_endpoint_max_payload_bytes( struct snapshot_endpoint_t * endpoint )
+{
+    snapshot_assert( endpoint );
+
+    if ( !endpoint->config.enable_congestion_control )
+        return SNAPSHOT_MAX_PAYLOAD_BYTES;
+
+    float base_rtt = -1.0f;
+    for ( int i = 0; i < SNAPSHOT_ENDPOINT_CONGESTION_BASE_RTT_HISTORY; i++ )
+    {
+        if ( endpoint->congestion_base_rtt[i] >= 0.0f && ( base_rtt < 0.0f || endpoint->congestion_base_rtt[i] < base_rtt ) )
+        {
+            base_rtt = endpoint->congestion_base_rtt[i];
+        }
+    }
+
+    if ( base_rtt < 0.0f )
+        base_rtt = 0.0f;
+
+    // a payload that fits in one unfragmented packet is always allowed
+
+    const double max_payload_bytes = endpoint->pacing_rate_kbps * 1000.0 / 8.0 * ( base_rtt + endpoint->config.congestion_target_delay ) / 1000.0;
+
+    if ( max_payload_bytes < endpoint->config.fragment_above )
+        return endpoint->config.fragment_above < SNAPSHOT_MAX_PAYLOAD_BYTES ? endpoint->config.fragment_above : SNAPSHOT_MAX_PAYLOAD_BYTES;
+
+    if ( max_payload_bytes > SNAPSHOT_MAX_PAYLOAD_BYTES )
+        return SNAPSHOT_MAX_PAYLOAD_BYTES;
+
+    return (int) max_payload_bytes;
+}
+
 const uint64_t * snapshot_endpoint_counters( struct snapshot_endpoint_t * endpoint )
 {
     snapshot_assert( endpoint );
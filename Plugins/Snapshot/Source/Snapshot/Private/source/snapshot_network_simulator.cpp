@@ -12,8 +12,8 @@
 #include <stdlib.h>
 #include <math.h>
 
-#define SNAPSHOT_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES ( SNAPSHOT_MAX_CLIENTS * 256 )
-#define SNAPSHOT_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS ( SNAPSHOT_MAX_CLIENTS * 64 )
+#define SNAPSHOT_NETWORK_SIMULATOR_PACKET_ENTRIES_PER_CLIENT 256
+#define SNAPSHOT_NETWORK_SIMULATOR_PENDING_RECEIVE_PACKETS_PER_CLIENT 64
 
 struct snapshot_network_simulator_packet_entry_t
 {
@@ -33,13 +33,17 @@ struct snapshot_network_simulator_t
     float duplicate_percent;
     double time;
     int current_index;
+    int num_packet_entries;
+    int max_pending_receive_packets;
     int num_pending_receive_packets;
-    struct snapshot_network_simulator_packet_entry_t packet_entries[SNAPSHOT_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES];
-    struct snapshot_network_simulator_packet_entry_t pending_receive_packets[SNAPSHOT_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS];
+    struct snapshot_network_simulator_packet_entry_t * packet_entries;
+    struct snapshot_network_simulator_packet_entry_t * pending_receive_packets;
 };
 
-struct snapshot_network_simulator_t * snapshot_network_simulator_create( void * context )
+struct snapshot_network_simulator_t * snapshot_network_simulator_create( void * context, int max_clients )
 {
+    snapshot_assert( max_clients > 0 );
+
     struct snapshot_network_simulator_t * network_simulator = (struct snapshot_network_simulator_t*) snapshot_malloc( context, sizeof( struct snapshot_network_simulator_t ) );
 
     snapshot_assert( network_simulator );
@@ -47,6 +51,17 @@ struct snapshot_network_simulator_t * snapshot_network_simulator_create( void *
     memset( network_simulator, 0, sizeof( struct snapshot_network_simulator_t ) );
 
     network_simulator->context = context;
+    network_simulator->num_packet_entries = max_clients * SNAPSHOT_NETWORK_SIMULATOR_PACKET_ENTRIES_PER_CLIENT;
+    network_simulator->max_pending_receive_packets = max_clients * SNAPSHOT_NETWORK_SIMULATOR_PENDING_RECEIVE_PACKETS_PER_CLIENT;
+
+    network_simulator->packet_entries = (struct snapshot_network_simulator_packet_entry_t*) snapshot_malloc( context, network_simulator->num_packet_entries * sizeof( struct snapshot_network_simulator_packet_entry_t ) );
+    network_simulator->pending_receive_packets = (struct snapshot_network_simulator_packet_entry_t*) snapshot_malloc( context, network_simulator->max_pending_receive_packets * sizeof( struct snapshot_network_simulator_packet_entry_t ) );
+
+    snapshot_assert( network_simulator->packet_entries );
+    snapshot_assert( network_simulator->pending_receive_packets );
+
+    memset( network_simulator->packet_entries, 0, network_simulator->num_packet_entries * sizeof( struct snapshot_network_simulator_packet_entry_t ) );
+    memset( network_simulator->pending_receive_packets, 0, network_simulator->max_pending_receive_packets * sizeof( struct snapshot_network_simulator_packet_entry_t ) );
 
     return network_simulator;
 }
@@ -70,7 +85,7 @@ void snapshot_network_simulator_reset( struct snapshot_network_simulator_t * net
     snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "network simulator reset" );
 
     int i;
-    for ( i = 0; i < SNAPSHOT_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    for ( i = 0; i < network_simulator->num_packet_entries; ++i )
     {
         if ( network_simulator->packet_entries[i].packet_data != NULL )
         {
@@ -101,6 +116,8 @@ void snapshot_network_simulator_destroy( struct snapshot_network_simulator_t * n
 {
     snapshot_assert( network_simulator );
     snapshot_network_simulator_reset( network_simulator );
+    snapshot_free( network_simulator->context, network_simulator->packet_entries );
+    snapshot_free( network_simulator->context, network_simulator->pending_receive_packets );
     snapshot_free( network_simulator->context, network_simulator );
 }
 
@@ -133,7 +150,7 @@ void snapshot_network_simulator_queue_packet( struct snapshot_network_simulator_
     network_simulator->packet_entries[network_simulator->current_index].packet_bytes = packet_bytes;
     network_simulator->packet_entries[network_simulator->current_index].delivery_time = network_simulator->time + delay;
     network_simulator->current_index++;
-    network_simulator->current_index %= SNAPSHOT_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES;
+    network_simulator->current_index %= network_simulator->num_packet_entries;
 }
 
 void snapshot_network_simulator_send_packet( struct snapshot_network_simulator_t * network_simulator, 
@@ -237,12 +254,12 @@ void snapshot_network_simulator_update( struct snapshot_network_simulator_t * ne
 
     // walk across packet entries and move any that are ready to be received into the pending receive buffer
 
-    for ( i = 0; i < SNAPSHOT_NETWORK_SIMULATOR_NUM_PACKET_ENTRIES; ++i )
+    for ( i = 0; i < network_simulator->num_packet_entries; ++i )
     {
         if ( !network_simulator->packet_entries[i].packet_data )
             continue;
 
-        if ( network_simulator->num_pending_receive_packets == SNAPSHOT_NETWORK_SIMULATOR_NUM_PENDING_RECEIVE_PACKETS )
+        if ( network_simulator->num_pending_receive_packets == network_simulator->max_pending_receive_packets )
             break;
 
         if ( network_simulator->packet_entries[i].packet_data && network_simulator->packet_entries[i].delivery_time <= time )
@@ -0,0 +1,248 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_packet_allocator.h"
+#include "snapshot_packets.h"
+#include "snapshot_packet_header.h"
+#include "snapshot_endpoint.h"
+#include "snapshot_platform.h"
+
+#include <atomic>
+#include <memory.h>
+
+#define SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES                         32
+#define SNAPSHOT_PACKET_ALLOCATOR_BATCH_SIZE                          ( SNAPSHOT_PACKET_ALLOCATOR_THREAD_CACHE_SIZE / 2 )
+
+struct snapshot_packet_block_t
+{
+    void * context;
+    struct snapshot_packet_block_t * next;
+    int size_class;
+};
+
+static_assert( sizeof( struct snapshot_packet_block_t ) <= SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES, "packet block header does not fit" );
+
+// size classes are in buffer bytes, which include the packet prefix and postfix. small covers fragments and mtu sized packets,
+// medium covers payloads and reassembled payloads, and large covers anything up to the max packet size
+
+static const int snapshot_packet_allocator_class_bytes[SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES] =
+{
+    SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_PACKET_ALLOCATOR_SMALL_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES,
+    SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PAYLOAD_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES,
+    SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES,
+};
+
+static_assert( SNAPSHOT_PACKET_ALLOCATOR_SMALL_PACKET_BYTES >= SNAPSHOT_PARITY_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES + 1024, "small size class must hold a default size fragment" );
+
+struct snapshot_packet_allocator_t
+{
+    struct snapshot_platform_mutex_t mutex;
+    struct snapshot_packet_block_t * free_list[SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES];
+    int num_free[SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES];
+};
+
+static struct snapshot_packet_allocator_t snapshot_packet_allocator;
+static std::atomic<bool> snapshot_packet_allocator_initialized( false );
+static std::atomic<uint64_t> snapshot_packet_allocator_hits( 0 );
+static std::atomic<uint64_t> snapshot_packet_allocator_misses( 0 );
+
+static void snapshot_packet_allocator_free_block( struct snapshot_packet_block_t * block )
+{
+    snapshot_free( block->context, block );
+}
+
+static void snapshot_packet_allocator_spill( int size_class, struct snapshot_packet_block_t ** blocks, int num_blocks )
+{
+    // hand blocks back to the global free list, and give anything over the cap back to the heap
+
+    if ( snapshot_packet_allocator_initialized.load( std::memory_order_acquire ) )
+    {
+        snapshot_platform_mutex_guard( &snapshot_packet_allocator.mutex );
+        while ( num_blocks > 0 && snapshot_packet_allocator.num_free[size_class] < SNAPSHOT_PACKET_ALLOCATOR_MAX_FREE_BLOCKS )
+        {
+            struct snapshot_packet_block_t * block = blocks[--num_blocks];
+            block->next = snapshot_packet_allocator.free_list[size_class];
+            snapshot_packet_allocator.free_list[size_class] = block;
+            snapshot_packet_allocator.num_free[size_class]++;
+        }
+    }
+
+    for ( int i = 0; i < num_blocks; i++ )
+    {
+        snapshot_packet_allocator_free_block( blocks[i] );
+    }
+}
+
+struct snapshot_packet_thread_cache_t
+{
+    struct snapshot_packet_block_t * blocks[SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES][SNAPSHOT_PACKET_ALLOCATOR_THREAD_CACHE_SIZE];
+    int num_blocks[SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES];
+
+    void flush()
+    {
+        for ( int i = 0; i < SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES; i++ )
+        {
+            snapshot_packet_allocator_spill( i, blocks[i], num_blocks[i] );
+            num_blocks[i] = 0;
+        }
+    }
+
+    ~snapshot_packet_thread_cache_t()
+    {
+        flush();
+    }
+};
+
+static thread_local struct snapshot_packet_thread_cache_t snapshot_packet_thread_cache;
+
+int snapshot_packet_allocator_init()
+{
+    snapshot_assert( !snapshot_packet_allocator_initialized.load() );
+
+    memset( snapshot_packet_allocator.free_list, 0, sizeof( snapshot_packet_allocator.free_list ) );
+    memset( snapshot_packet_allocator.num_free, 0, sizeof( snapshot_packet_allocator.num_free ) );
+
+    if ( snapshot_platform_mutex_create( &snapshot_packet_allocator.mutex ) != SNAPSHOT_OK )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create packet allocator mutex" );
+        return SNAPSHOT_ERROR;
+    }
+
+    snapshot_packet_allocator_hits.store( 0, std::memory_order_relaxed );
+    snapshot_packet_allocator_misses.store( 0, std::memory_order_relaxed );
+
+    snapshot_packet_allocator_initialized.store( true, std::memory_order_release );
+
+    return SNAPSHOT_OK;
+}
+
+void snapshot_packet_allocator_term()
+{
+    if ( !snapshot_packet_allocator_initialized.load() )
+        return;
+
+    // blocks cached by other threads are returned to the heap when those threads exit
+
+    snapshot_packet_thread_cache.flush();
+
+    snapshot_packet_allocator_initialized.store( false, std::memory_order_release );
+
+    {
+        snapshot_platform_mutex_guard( &snapshot_packet_allocator.mutex );
+        for ( int i = 0; i < SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES; i++ )
+        {
+            struct snapshot_packet_block_t * block = snapshot_packet_allocator.free_list[i];
+            while ( block )
+            {
+                struct snapshot_packet_block_t * next = block->next;
+                snapshot_packet_allocator_free_block( block );
+                block = next;
+            }
+            snapshot_packet_allocator.free_list[i] = NULL;
+            snapshot_packet_allocator.num_free[i] = 0;
+        }
+    }
+
+    snapshot_platform_mutex_destroy( &snapshot_packet_allocator.mutex );
+}
+
+uint8_t * snapshot_packet_allocator_alloc( void * context, int bytes )
+{
+    snapshot_assert( bytes > 0 );
+
+    int size_class = -1;
+    for ( int i = 0; i < SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES; i++ )
+    {
+        if ( bytes <= snapshot_packet_allocator_class_bytes[i] )
+        {
+            size_class = i;
+            break;
+        }
+    }
+
+    // only the default context is pooled. free lists are shared by every caller, so a recycled block from a user context
+    // could otherwise be handed to a different context, or outlive the allocator it came from
+
+    if ( context != NULL )
+        size_class = -1;
+
+    if ( size_class >= 0 && snapshot_packet_allocator_initialized.load( std::memory_order_acquire ) )
+    {
+        struct snapshot_packet_thread_cache_t & cache = snapshot_packet_thread_cache;
+
+        if ( cache.num_blocks[size_class] == 0 )
+        {
+            snapshot_platform_mutex_guard( &snapshot_packet_allocator.mutex );
+            while ( cache.num_blocks[size_class] < SNAPSHOT_PACKET_ALLOCATOR_BATCH_SIZE && snapshot_packet_allocator.free_list[size_class] )
+            {
+                struct snapshot_packet_block_t * block = snapshot_packet_allocator.free_list[size_class];
+                snapshot_packet_allocator.free_list[size_class] = block->next;
+                snapshot_packet_allocator.num_free[size_class]--;
+                cache.blocks[size_class][cache.num_blocks[size_class]++] = block;
+            }
+        }
+
+        if ( cache.num_blocks[size_class] > 0 )
+        {
+            struct snapshot_packet_block_t * block = cache.blocks[size_class][--cache.num_blocks[size_class]];
+            snapshot_packet_allocator_hits.fetch_add( 1, std::memory_order_relaxed );
+            return ( (uint8_t*) block ) + SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES;
+        }
+    }
+
+    // nothing to recycle, so go to the heap. oversize buffers and user context buffers are never pooled
+
+    const int block_bytes = SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES + ( size_class >= 0 ? snapshot_packet_allocator_class_bytes[size_class] : bytes );
+
+    struct snapshot_packet_block_t * block = (struct snapshot_packet_block_t*) snapshot_malloc( context, block_bytes );
+    if ( !block )
+        return NULL;
+
+    block->context = context;
+    block->next = NULL;
+    block->size_class = size_class;
+
+    snapshot_packet_allocator_misses.fetch_add( 1, std::memory_order_relaxed );
+
+    return ( (uint8_t*) block ) + SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES;
+}
+
+void snapshot_packet_allocator_free( void * context, uint8_t * buffer )
+{
+    snapshot_assert( buffer );
+
+    struct snapshot_packet_block_t * block = (struct snapshot_packet_block_t*) ( buffer - SNAPSHOT_PACKET_ALLOCATOR_HEADER_BYTES );
+
+    snapshot_assert( block->context == context );
+    (void) context;
+
+    const int size_class = block->size_class;
+
+    if ( size_class < 0 || !snapshot_packet_allocator_initialized.load( std::memory_order_acquire ) )
+    {
+        snapshot_packet_allocator_free_block( block );
+        return;
+    }
+
+    snapshot_assert( size_class < SNAPSHOT_PACKET_ALLOCATOR_NUM_SIZE_CLASSES );
+
+    struct snapshot_packet_thread_cache_t & cache = snapshot_packet_thread_cache;
+
+    if ( cache.num_blocks[size_class] == SNAPSHOT_PACKET_ALLOCATOR_THREAD_CACHE_SIZE )
+    {
+        cache.num_blocks[size_class] -= SNAPSHOT_PACKET_ALLOCATOR_BATCH_SIZE;
+        snapshot_packet_allocator_spill( size_class, &cache.blocks[size_class][cache.num_blocks[size_class]], SNAPSHOT_PACKET_ALLOCATOR_BATCH_SIZE );
+    }
+
+    cache.blocks[size_class][cache.num_blocks[size_class]++] = block;
+}
+
+void snapshot_packet_allocator_counters( uint64_t * hits, uint64_t * misses )
+{
+    snapshot_assert( hits );
+    snapshot_assert( misses );
+    *hits = snapshot_packet_allocator_hits.load( std::memory_order_relaxed );
+    *misses = snapshot_packet_allocator_misses.load( std::memory_order_relaxed );
+}
@@ -9,11 +9,12 @@
 #include "snapshot_read_write.h"
 #include "snapshot_replay_protection.h"
 #include "snapshot_crypto.h"
+#include "snapshot_packet_allocator.h"
 
 uint8_t * snapshot_create_packet( void * context, int packet_bytes )
 {
     snapshot_assert( packet_bytes > 0 );
-    uint8_t * buffer = (uint8_t*) snapshot_malloc( context, SNAPSHOT_PACKET_PREFIX_BYTES + packet_bytes + SNAPSHOT_PACKET_POSTFIX_BYTES );
+    uint8_t * buffer = snapshot_packet_allocator_alloc( context, SNAPSHOT_PACKET_PREFIX_BYTES + packet_bytes + SNAPSHOT_PACKET_POSTFIX_BYTES );
     if ( !buffer )
     {
         return NULL;
@@ -25,7 +26,7 @@ void snapshot_destroy_packet( void * context, uint8_t * packet )
 {
     snapshot_assert( packet );
     uint8_t * buffer = packet - SNAPSHOT_PACKET_PREFIX_BYTES;
-    snapshot_free( context, buffer );
+    snapshot_packet_allocator_free( context, buffer );
 }
 
 struct snapshot_payload_packet_t * snapshot_wrap_payload_packet( uint8_t * payload_data, int payload_bytes )
@@ -62,6 +63,60 @@ struct snapshot_passthrough_packet_t * snapshot_wrap_passthrough_packet( uint8_t
     return packet;
 }
 
+static uint8_t snapshot_write_packet_prefix( uint8_t ** p, uint8_t packet_type, uint64_t sequence )
+{
+    // write the prefix byte (this is a combination of the packet type and number of sequence bytes)
+
+    uint8_t sequence_bytes = (uint8_t) snapshot_sequence_number_bytes_required( sequence );
+
+    snapshot_assert( sequence_bytes >= 1 );
+    snapshot_assert( sequence_bytes <= 8 );
+
+    snapshot_assert( packet_type <= 0xF );
+
+    uint8_t prefix_byte = packet_type | ( sequence_bytes << 4 );
+
+    snapshot_write_uint8( p, prefix_byte );
+
+    // write the variable length sequence number [1,8] bytes.
+
+    uint64_t sequence_temp = sequence;
+
+    int i;
+    for ( i = 0; i < sequence_bytes; ++i )
+    {
+        snapshot_write_uint8( p, (uint8_t) ( sequence_temp & 0xFF ) );
+        sequence_temp >>= 8;
+    }
+
+    return prefix_byte;
+}
+
+static int snapshot_encrypt_packet( uint8_t prefix_byte, uint64_t sequence, uint8_t * encrypted_start, uint8_t * encrypted_finish, uint8_t * write_packet_key, uint64_t protocol_id )
+{
+    // encrypt the per-packet packet written with the prefix byte, protocol id and version as the associated data. this must match to decrypt
+
+    uint8_t additional_data[SNAPSHOT_VERSION_INFO_BYTES+8+1];
+    {
+        uint8_t * q = additional_data;
+        snapshot_write_bytes( &q, SNAPSHOT_VERSION_INFO, SNAPSHOT_VERSION_INFO_BYTES );
+        snapshot_write_uint64( &q, protocol_id );
+        snapshot_write_uint8( &q, prefix_byte );
+    }
+
+    uint8_t nonce[12];
+    {
+        uint8_t * q = nonce;
+        snapshot_write_uint32( &q, 0 );
+        snapshot_write_uint64( &q, sequence );
+    }
+
+    return snapshot_crypto_encrypt_aead( encrypted_start, 
+                                         encrypted_finish - encrypted_start, 
+                                         additional_data, sizeof( additional_data ), 
+                                         nonce, write_packet_key );
+}
+
 uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * write_packet_key, uint64_t protocol_id, int * out_bytes )
 {
     snapshot_assert( packet );
@@ -100,31 +155,9 @@ uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_len
 
         uint8_t * p = buffer;
 
-        // write the prefix byte (this is a combination of the packet type and number of sequence bytes)
-
         uint8_t * start = buffer;
 
-        uint8_t sequence_bytes = (uint8_t) snapshot_sequence_number_bytes_required( sequence );
-
-        snapshot_assert( sequence_bytes >= 1 );
-        snapshot_assert( sequence_bytes <= 8 );
-
-        snapshot_assert( packet_type <= 0xF );
-
-        uint8_t prefix_byte = packet_type | ( sequence_bytes << 4 );
-
-        snapshot_write_uint8( &p, prefix_byte );
-
-        // write the variable length sequence number [1,8] bytes.
-
-        uint64_t sequence_temp = sequence;
-
-        int i;
-        for ( i = 0; i < sequence_bytes; ++i )
-        {
-            snapshot_write_uint8( &p, (uint8_t) ( sequence_temp & 0xFF ) );
-            sequence_temp >>= 8;
-        }
+        uint8_t prefix_byte = snapshot_write_packet_prefix( &p, packet_type, sequence );
 
         // write packet data according to type. this data will be encrypted.
 
@@ -159,6 +192,8 @@ uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_len
                 struct snapshot_keep_alive_packet_t * keep_alive_packet = (struct snapshot_keep_alive_packet_t*) packet;
                 snapshot_write_uint32( &p, keep_alive_packet->client_index );
                 snapshot_write_uint32( &p, keep_alive_packet->max_clients );
+                snapshot_write_uint16( &p, keep_alive_packet->ack );
+                snapshot_write_uint32( &p, keep_alive_packet->ack_bits );
             }
             break;
 
@@ -206,32 +241,9 @@ uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_len
 
         uint8_t * encrypted_finish = p;
 
-        // encrypt the per-packet packet written with the prefix byte, protocol id and version as the associated data. this must match to decrypt
-
-        if ( write_packet_key )
+        if ( write_packet_key && snapshot_encrypt_packet( prefix_byte, sequence, encrypted_start, encrypted_finish, write_packet_key, protocol_id ) != SNAPSHOT_OK )
         {
-            uint8_t additional_data[SNAPSHOT_VERSION_INFO_BYTES+8+1];
-            {
-                uint8_t * q = additional_data;
-                snapshot_write_bytes( &q, SNAPSHOT_VERSION_INFO, SNAPSHOT_VERSION_INFO_BYTES );
-                snapshot_write_uint64( &q, protocol_id );
-                snapshot_write_uint8( &q, prefix_byte );
-            }
-
-            uint8_t nonce[12];
-            {
-                uint8_t * q = nonce;
-                snapshot_write_uint32( &q, 0 );
-                snapshot_write_uint64( &q, sequence );
-            }
-
-            if ( snapshot_crypto_encrypt_aead( encrypted_start, 
-                                               encrypted_finish - encrypted_start, 
-                                               additional_data, sizeof( additional_data ), 
-                                               nonce, write_packet_key ) != SNAPSHOT_OK )
-            {
-                return NULL;
-            }
+            return NULL;
         }
 
         p += SNAPSHOT_MAC_BYTES;
@@ -244,6 +256,49 @@ uint8_t * snapshot_write_packet( void * packet, uint8_t * buffer, int buffer_len
     }
 }
 
+int snapshot_write_payload_iovec( const struct snapshot_payload_iovec_t * iovec, uint8_t * buffer, int buffer_length, uint64_t sequence, uint8_t * write_packet_key, uint64_t protocol_id, int * out_bytes )
+{
+    snapshot_assert( iovec );
+    snapshot_assert( buffer );
+    snapshot_assert( out_bytes );
+    snapshot_assert( iovec->header_bytes >= 0 );
+    snapshot_assert( iovec->header_bytes <= SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES );
+    snapshot_assert( iovec->data_bytes >= 0 );
+    snapshot_assert( iovec->header_bytes + iovec->data_bytes > 0 );
+    snapshot_assert( iovec->header_bytes + iovec->data_bytes <= SNAPSHOT_MAX_PAYLOAD_BYTES );
+
+    uint8_t * p = buffer;
+
+    uint8_t prefix_byte = snapshot_write_packet_prefix( &p, SNAPSHOT_PAYLOAD_PACKET, sequence );
+
+    if ( ( p - buffer ) + iovec->header_bytes + iovec->data_bytes + SNAPSHOT_MAC_BYTES > buffer_length )
+        return SNAPSHOT_ERROR;
+
+    // gather the header and payload slice, then encrypt them where they are
+
+    uint8_t * encrypted_start = p;
+
+    memcpy( p, iovec->header, iovec->header_bytes );
+    p += iovec->header_bytes;
+
+    if ( iovec->data_bytes > 0 )
+    {
+        memcpy( p, iovec->data, iovec->data_bytes );
+        p += iovec->data_bytes;
+    }
+
+    uint8_t * encrypted_finish = p;
+
+    if ( write_packet_key && snapshot_encrypt_packet( prefix_byte, sequence, encrypted_start, encrypted_finish, write_packet_key, protocol_id ) != SNAPSHOT_OK )
+        return SNAPSHOT_ERROR;
+
+    p += SNAPSHOT_MAC_BYTES;
+
+    *out_bytes = (int) ( p - buffer );
+
+    return SNAPSHOT_OK;
+}
+
 void * snapshot_read_packet( uint8_t * buffer, 
                              int buffer_length, 
                              uint64_t * sequence, 
@@ -521,7 +576,7 @@ void * snapshot_read_packet( uint8_t * buffer,
 
             case SNAPSHOT_KEEP_ALIVE_PACKET:
             {
-                if ( decrypted_bytes != 8 )
+                if ( decrypted_bytes != 14 )
                 {
                     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "ignored keep alive packet. decrypted packet data is wrong size" );
                     return NULL;
@@ -532,6 +587,8 @@ void * snapshot_read_packet( uint8_t * buffer,
                 packet->packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
                 packet->client_index = snapshot_read_uint32( &p );
                 packet->max_clients = snapshot_read_uint32( &p );
+                packet->ack = snapshot_read_uint16( &p );
+                packet->ack_bits = snapshot_read_uint32( &p );
                 
                 return packet;
             }
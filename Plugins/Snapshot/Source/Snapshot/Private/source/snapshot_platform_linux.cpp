@@ -29,6 +29,22 @@
 #include <stdlib.h>
 #include <math.h>
 #include <alloca.h>
+#include <netinet/udp.h>
+#include <sys/mman.h>
+#include <linux/net_tstamp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif // #ifndef UDP_SEGMENT
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif // #ifndef UDP_GRO
+
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif // #ifndef SO_TXTIME
 
 // ---------------------------------------------------
 
@@ -149,9 +165,83 @@ void snapshot_platform_sleep( double time )
 
 // ---------------------------------------------------
 
+#define SNAPSHOT_PLATFORM_GSO_MAX_SEGMENTS                  64
+#define SNAPSHOT_PLATFORM_GSO_MAX_BYTES                  60000
+
+#define SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES                   8
+#define SNAPSHOT_PLATFORM_GRO_MESSAGE_BYTES              65536
+
+struct snapshot_platform_socket_gro_t
+{
+    int num_messages;
+    int message_index;
+    int message_offset;
+    int message_bytes[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+    int segment_size[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+    snapshot_address_t from[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+    uint8_t buffer[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES][SNAPSHOT_PLATFORM_GRO_MESSAGE_BYTES];
+};
+
+static socklen_t snapshot_platform_address_to_sockaddr( const snapshot_address_t * address, sockaddr_storage * socket_address )
+{
+    memset( socket_address, 0, sizeof(sockaddr_storage) );
+
+    if ( address->type == SNAPSHOT_ADDRESS_IPV6 )
+    {
+        sockaddr_in6 * addr_ipv6 = (sockaddr_in6*) socket_address;
+        addr_ipv6->sin6_family = AF_INET6;
+        for ( int i = 0; i < 8; ++i )
+        {
+            ( (uint16_t*) &addr_ipv6->sin6_addr ) [i] = snapshot_platform_htons( address->data.ipv6[i] );
+        }
+        addr_ipv6->sin6_port = snapshot_platform_htons( address->port );
+        return sizeof(sockaddr_in6);
+    }
+    else
+    {
+        sockaddr_in * addr_ipv4 = (sockaddr_in*) socket_address;
+        addr_ipv4->sin_family = AF_INET;
+        addr_ipv4->sin_addr.s_addr = ( ( (uint32_t) address->data.ipv4[0] ) )        | 
+                                     ( ( (uint32_t) address->data.ipv4[1] ) << 8 )   | 
+                                     ( ( (uint32_t) address->data.ipv4[2] ) << 16 )  | 
+                                     ( ( (uint32_t) address->data.ipv4[3] ) << 24 );
+        addr_ipv4->sin_port = snapshot_platform_htons( address->port );
+        return sizeof(sockaddr_in);
+    }
+}
+
+static bool snapshot_platform_sockaddr_to_address( const sockaddr_storage * socket_address, snapshot_address_t * address )
+{
+    if ( socket_address->ss_family == AF_INET6 )
+    {
+        const sockaddr_in6 * addr_ipv6 = (const sockaddr_in6*) socket_address;
+        address->type = SNAPSHOT_ADDRESS_IPV6;
+        for ( int i = 0; i < 8; ++i )
+        {
+            address->data.ipv6[i] = snapshot_platform_ntohs( ( (const uint16_t*) &addr_ipv6->sin6_addr ) [i] );
+        }
+        address->port = snapshot_platform_ntohs( addr_ipv6->sin6_port );
+        return true;
+    }
+    else if ( socket_address->ss_family == AF_INET )
+    {
+        const sockaddr_in * addr_ipv4 = (const sockaddr_in*) socket_address;
+        address->type = SNAPSHOT_ADDRESS_IPV4;
+        address->data.ipv4[0] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x000000FF ) );
+        address->data.ipv4[1] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x0000FF00 ) >> 8 );
+        address->data.ipv4[2] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0x00FF0000 ) >> 16 );
+        address->data.ipv4[3] = (uint8_t) ( ( addr_ipv4->sin_addr.s_addr & 0xFF000000 ) >> 24 );
+        address->port = snapshot_platform_ntohs( addr_ipv4->sin_port );
+        return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------
+
 void snapshot_platform_socket_destroy( snapshot_platform_socket_t * socket );
 
-snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size )
+static snapshot_platform_socket_t * snapshot_platform_socket_create_internal( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size, bool reuse_port )
 {
     snapshot_assert( address );
     snapshot_assert( address->type != SNAPSHOT_ADDRESS_NONE );
@@ -161,6 +251,9 @@ snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, sn
     snapshot_assert( socket );
 
     socket->context = context;
+    socket->gso = false;
+    socket->txtime = false;
+    socket->gro = NULL;
 
     // create socket
 
@@ -203,6 +296,19 @@ snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, sn
         return NULL;
     }
 
+    // share the port with other sockets. the kernel hashes each source address to one of them
+
+    if ( reuse_port )
+    {
+        int yes = 1;
+        if ( setsockopt( socket->handle, SOL_SOCKET, SO_REUSEPORT, (char*)( &yes ), sizeof( yes ) ) != 0 )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to set socket reuse port" );
+            snapshot_platform_socket_destroy( socket );
+            return NULL;
+        }
+    }
+
     // bind to port
 
     if ( address->type == SNAPSHOT_ADDRESS_IPV6 )
@@ -305,6 +411,16 @@ snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, sn
     return socket;
 }
 
+snapshot_platform_socket_t * snapshot_platform_socket_create( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size )
+{
+    return snapshot_platform_socket_create_internal( context, address, socket_type, timeout_seconds, send_buffer_size, receive_buffer_size, false );
+}
+
+snapshot_platform_socket_t * snapshot_platform_socket_create_reuse_port( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size )
+{
+    return snapshot_platform_socket_create_internal( context, address, socket_type, timeout_seconds, send_buffer_size, receive_buffer_size, true );
+}
+
 void snapshot_platform_socket_destroy( snapshot_platform_socket_t * socket )
 {
     snapshot_assert( socket );
@@ -312,6 +428,10 @@ void snapshot_platform_socket_destroy( snapshot_platform_socket_t * socket )
     {
         close( socket->handle );
     }
+    if ( socket->gro )
+    {
+        snapshot_free( socket->context, socket->gro );
+    }
     snapshot_free( socket->context, socket );
 }
 
@@ -365,7 +485,7 @@ void snapshot_platform_socket_send_packet( snapshot_platform_socket_t * socket,
     }
 }
 
-void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, int num_packets )
+static void snapshot_platform_socket_send_packets_internal( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, const double * send_time, int num_packets )
 {
     snapshot_assert( socket );
     snapshot_assert( to );
@@ -376,46 +496,174 @@ void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket,
     if ( num_packets == 0 )
         return;
 
+    // send times are in platform time, but the kernel wants them in CLOCK_MONOTONIC nanoseconds
+
+    double monotonic_offset = 0.0;
+    if ( send_time )
+    {
+        timespec ts;
+        clock_gettime( CLOCK_MONOTONIC, &ts );
+        monotonic_offset = ts.tv_sec + ( (double) ( ts.tv_nsec ) ) / 1000000000.0 - snapshot_platform_time();
+    }
+
     iovec * msg = (iovec*) alloca( sizeof(iovec) * num_packets );
 
+    sockaddr_storage * socket_address = (sockaddr_storage*) alloca( sizeof(sockaddr_storage) * num_packets );
+
+    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * num_packets );
+
+    const int control_bytes = CMSG_SPACE( sizeof(uint16_t) ) + CMSG_SPACE( sizeof(uint64_t) );
+
+    uint8_t * control_data = (uint8_t*) alloca( control_bytes * num_packets );
+
+    int * message_first_packet = (int*) alloca( sizeof(int) * num_packets );
+
+    int * message_num_packets = (int*) alloca( sizeof(int) * num_packets );
+
     for ( int i = 0; i < num_packets; ++i )
     {
+        snapshot_assert( to[i].type == SNAPSHOT_ADDRESS_IPV6 || to[i].type == SNAPSHOT_ADDRESS_IPV4 );
+        snapshot_assert( packet_data[i] );
+        snapshot_assert( packet_bytes[i] > 0 );
+
         msg[i].iov_base = packet_data[i];
         msg[i].iov_len = packet_bytes[i];
     }
 
-    sockaddr_in * socket_address = (sockaddr_in*) alloca( sizeof(sockaddr_in) * num_packets );
+    // with gso, runs of consecutive packets to the same address go down as one message and the kernel splits them back into datagrams.
+    // every packet in a run except the last must be the same size, which is exactly what a train of payload fragments looks like
 
-    for ( int i = 0; i < num_packets; ++i )
+    int num_messages = 0;
+
+    for ( int i = 0; i < num_packets; )
     {
-        snapshot_assert( to[i].type == SNAPSHOT_ADDRESS_IPV4 );                 // note: ipv6 not supported
-        memset( &socket_address[i], 0, sizeof(sockaddr_in) );
-        socket_address[i].sin_family = AF_INET;
-        socket_address[i].sin_addr.s_addr = ( ( (uint32_t) to[i].data.ipv4[0] ) )        | 
-                                            ( ( (uint32_t) to[i].data.ipv4[1] ) << 8 )   | 
-                                            ( ( (uint32_t) to[i].data.ipv4[2] ) << 16 )  | 
-                                            ( ( (uint32_t) to[i].data.ipv4[3] ) << 24 );
-        socket_address[i].sin_port = snapshot_platform_htons( to->port );
-    }
+        int run_packets = 1;
+        int run_bytes = packet_bytes[i];
 
-    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * num_packets );
+        if ( socket->gso )
+        {
+            while ( i + run_packets < num_packets && 
+                    run_packets < SNAPSHOT_PLATFORM_GSO_MAX_SEGMENTS && 
+                    packet_bytes[i+run_packets-1] == packet_bytes[i] &&
+                    packet_bytes[i+run_packets] <= packet_bytes[i] &&
+                    run_bytes + packet_bytes[i+run_packets] <= SNAPSHOT_PLATFORM_GSO_MAX_BYTES &&
+                    ( !send_time || send_time[i+run_packets] == send_time[i] ) &&
+                    snapshot_address_equal( &to[i+run_packets], &to[i] ) )
+            {
+                run_bytes += packet_bytes[i+run_packets];
+                run_packets++;
+            }
+        }
 
-    for ( int i = 0; i < num_packets; ++i )
-    {
-        packet_array[i].msg_hdr.msg_name = &socket_address[i];
-        packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
-        packet_array[i].msg_hdr.msg_iov = &msg[i];
-        packet_array[i].msg_hdr.msg_iovlen = 1;
+        mmsghdr * message = &packet_array[num_messages];
+
+        memset( message, 0, sizeof(mmsghdr) );
+
+        message->msg_hdr.msg_name = &socket_address[num_messages];
+        message->msg_hdr.msg_namelen = snapshot_platform_address_to_sockaddr( &to[i], &socket_address[num_messages] );
+        message->msg_hdr.msg_iov = &msg[i];
+        message->msg_hdr.msg_iovlen = run_packets;
+
+        const bool timed = send_time && send_time[i] > 0.0;
+
+        if ( run_packets > 1 || timed )
+        {
+            uint8_t * control = control_data + control_bytes * num_messages;
+            memset( control, 0, control_bytes );
+            message->msg_hdr.msg_control = control;
+            message->msg_hdr.msg_controllen = control_bytes;
+
+            cmsghdr * cmsg = CMSG_FIRSTHDR( &message->msg_hdr );
+            size_t used_control_bytes = 0;
+
+            if ( run_packets > 1 )
+            {
+                cmsg->cmsg_level = IPPROTO_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN( sizeof(uint16_t) );
+                uint16_t segment_size = (uint16_t) packet_bytes[i];
+                memcpy( CMSG_DATA( cmsg ), &segment_size, sizeof(uint16_t) );
+                used_control_bytes += CMSG_SPACE( sizeof(uint16_t) );
+                cmsg = CMSG_NXTHDR( &message->msg_hdr, cmsg );
+            }
+
+            if ( timed )
+            {
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_TXTIME;
+                cmsg->cmsg_len = CMSG_LEN( sizeof(uint64_t) );
+                uint64_t txtime = (uint64_t) ( ( send_time[i] + monotonic_offset ) * 1000000000.0 );
+                memcpy( CMSG_DATA( cmsg ), &txtime, sizeof(uint64_t) );
+                used_control_bytes += CMSG_SPACE( sizeof(uint64_t) );
+            }
+
+            message->msg_hdr.msg_controllen = used_control_bytes;
+        }
+
+        message_first_packet[num_messages] = i;
+        message_num_packets[num_messages] = run_packets;
+
+        num_messages++;
+
+        i += run_packets;
     }
 
-    int result = sendmmsg( socket->handle, packet_array, num_packets, 0 );
-    
-    if ( result == -1 )
+    // sendmmsg can send fewer messages than asked (eg. more than UIO_MAXIOV), so keep going until they are all sent.
+    // if the first message in a call fails, skip over it, just like a failed sendto in snapshot_platform_socket_send_packet
+
+    int num_sent = 0;
+
+    while ( num_sent < num_messages )
     {
-        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "sendmmsg failed to send packets" );
+        int result = sendmmsg( socket->handle, packet_array + num_sent, num_messages - num_sent, 0 );
+
+        if ( result <= 0 )
+        {
+            if ( result < 0 && errno == EINTR )
+                continue;
+
+            const int first_packet = message_first_packet[num_sent];
+
+            if ( message_num_packets[num_sent] > 1 )
+            {
+                // the route doesn't support segmentation offload (eg. no checksum offload on the nic). turn it off and send these individually
+
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_WARN, "udp gso send failed (%s). disabling gso on socket", strerror( errno ) );
+
+                socket->gso = false;
+
+                for ( int j = 0; j < message_num_packets[num_sent]; ++j )
+                {
+                    snapshot_platform_socket_send_packet( socket, &to[first_packet+j], packet_data[first_packet+j], packet_bytes[first_packet+j] );
+                }
+            }
+            else
+            {
+                char address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+                snapshot_address_to_string( &to[first_packet], address_string );
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sendmmsg (%s) failed: %s", address_string, strerror( errno ) );
+            }
+
+            num_sent++;
+        }
+        else
+        {
+            num_sent += result;
+        }
     }
 }
 
+void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, int num_packets )
+{
+    snapshot_platform_socket_send_packets_internal( socket, to, packet_data, packet_bytes, NULL, num_packets );
+}
+
+void snapshot_platform_socket_send_packets_at( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, const double * send_time, int num_packets )
+{
+    snapshot_assert( send_time );
+    snapshot_platform_socket_send_packets_internal( socket, to, packet_data, packet_bytes, socket->txtime ? send_time : NULL, num_packets );
+}
+
 int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket, snapshot_address_t * from, void * packet_data, int max_packet_size )
 {
     snapshot_assert( socket );
@@ -471,6 +719,278 @@ int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket
     return result;
 }
 
+static int snapshot_platform_socket_receive_packets_gro( snapshot_platform_socket_t * socket, snapshot_address_t * from, void ** packet_data, int * packet_bytes, int max_packet_size, int max_packets, int * num_received )
+{
+    snapshot_platform_socket_gro_t * gro = socket->gro;
+
+    snapshot_assert( gro );
+
+    // with gro the kernel hands us several same sized datagrams from one sender glued together, so receive into
+    // large buffers and split them back up. anything that doesn't fit in this call is kept for the next one
+
+    int num_packets = 0;
+    int num_dropped = 0;
+
+    while ( num_packets < max_packets )
+    {
+        if ( gro->message_index >= gro->num_messages )
+        {
+            iovec msg[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+            sockaddr_storage sockaddr_from[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+            mmsghdr packet_array[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES];
+            uint8_t control_data[SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES][CMSG_SPACE( sizeof(int) )];
+
+            memset( packet_array, 0, sizeof(packet_array) );
+
+            for ( int i = 0; i < SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES; ++i )
+            {
+                msg[i].iov_base = gro->buffer[i];
+                msg[i].iov_len = SNAPSHOT_PLATFORM_GRO_MESSAGE_BYTES;
+                packet_array[i].msg_hdr.msg_name = &sockaddr_from[i];
+                packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+                packet_array[i].msg_hdr.msg_iov = &msg[i];
+                packet_array[i].msg_hdr.msg_iovlen = 1;
+                packet_array[i].msg_hdr.msg_control = control_data[i];
+                packet_array[i].msg_hdr.msg_controllen = sizeof(control_data[i]);
+            }
+
+            const int flags = ( socket->type == SNAPSHOT_PLATFORM_SOCKET_BLOCKING && num_packets == 0 ) ? MSG_WAITFORONE : MSG_DONTWAIT;
+
+            int result = recvmmsg( socket->handle, packet_array, SNAPSHOT_PLATFORM_GRO_MAX_MESSAGES, flags, NULL );
+
+            if ( result <= 0 )
+            {
+                if ( result < 0 && errno != EAGAIN && errno != EINTR )
+                {
+                    snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "recvmmsg failed with error %d", errno );
+                }
+                break;
+            }
+
+            for ( int i = 0; i < result; ++i )
+            {
+                gro->message_bytes[i] = (int) packet_array[i].msg_len;
+                gro->segment_size[i] = gro->message_bytes[i];
+
+                if ( ( packet_array[i].msg_hdr.msg_flags & MSG_TRUNC ) || !snapshot_platform_sockaddr_to_address( &sockaddr_from[i], &gro->from[i] ) )
+                {
+                    gro->message_bytes[i] = 0;
+                    num_dropped++;
+                    continue;
+                }
+
+                for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &packet_array[i].msg_hdr ); cmsg != NULL; cmsg = CMSG_NXTHDR( &packet_array[i].msg_hdr, cmsg ) )
+                {
+                    if ( cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO )
+                    {
+                        int segment_size = 0;
+                        memcpy( &segment_size, CMSG_DATA( cmsg ), sizeof(int) );
+                        if ( segment_size > 0 )
+                        {
+                            gro->segment_size[i] = segment_size;
+                        }
+                    }
+                }
+            }
+
+            gro->num_messages = result;
+            gro->message_index = 0;
+            gro->message_offset = 0;
+        }
+
+        const int index = gro->message_index;
+
+        const int remaining_bytes = gro->message_bytes[index] - gro->message_offset;
+
+        if ( remaining_bytes <= 0 )
+        {
+            gro->message_index++;
+            gro->message_offset = 0;
+            continue;
+        }
+
+        const int bytes = ( gro->segment_size[index] < remaining_bytes ) ? gro->segment_size[index] : remaining_bytes;
+
+        if ( bytes <= max_packet_size )
+        {
+            memcpy( packet_data[num_packets], gro->buffer[index] + gro->message_offset, bytes );
+            packet_bytes[num_packets] = bytes;
+            from[num_packets] = gro->from[index];
+            num_packets++;
+        }
+        else
+        {
+            num_dropped++;
+        }
+
+        gro->message_offset += bytes;
+    }
+
+    *num_received = num_packets + num_dropped;
+
+    return num_packets;
+}
+
+int snapshot_platform_socket_receive_packets( snapshot_platform_socket_t * socket, snapshot_address_t * from, void ** packet_data, int * packet_bytes, int max_packet_size, int max_packets, int * num_received )
+{
+    snapshot_assert( socket );
+    snapshot_assert( from );
+    snapshot_assert( packet_data );
+    snapshot_assert( packet_bytes );
+    snapshot_assert( max_packet_size > 0 );
+    snapshot_assert( max_packets > 0 );
+    snapshot_assert( num_received );
+
+    *num_received = 0;
+
+    if ( socket->gro )
+    {
+        return snapshot_platform_socket_receive_packets_gro( socket, from, packet_data, packet_bytes, max_packet_size, max_packets, num_received );
+    }
+
+    iovec * msg = (iovec*) alloca( sizeof(iovec) * max_packets );
+
+    sockaddr_storage * sockaddr_from = (sockaddr_storage*) alloca( sizeof(sockaddr_storage) * max_packets );
+
+    mmsghdr * packet_array = (mmsghdr*) alloca( sizeof(mmsghdr) * max_packets );
+
+    for ( int i = 0; i < max_packets; ++i )
+    {
+        memset( &packet_array[i], 0, sizeof(mmsghdr) );
+        msg[i].iov_base = packet_data[i];
+        msg[i].iov_len = max_packet_size;
+        packet_array[i].msg_hdr.msg_name = &sockaddr_from[i];
+        packet_array[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        packet_array[i].msg_hdr.msg_iov = &msg[i];
+        packet_array[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // note: blocking sockets wait for the first packet only, then take whatever else is already queued
+
+    int result = recvmmsg( socket->handle, packet_array, max_packets, socket->type == SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING ? MSG_DONTWAIT : MSG_WAITFORONE, NULL );
+
+    if ( result <= 0 )
+    {
+        if ( result < 0 && errno != EAGAIN && errno != EINTR )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "recvmmsg failed with error %d", errno );
+        }
+
+        return 0;
+    }
+
+    *num_received = result;
+
+    int num_packets = 0;
+
+    for ( int i = 0; i < result; ++i )
+    {
+        if ( packet_array[i].msg_len == 0 || ( packet_array[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+            continue;
+
+        if ( !snapshot_platform_sockaddr_to_address( &sockaddr_from[i], &from[num_packets] ) )
+            continue;
+
+        // compact so the caller sees a contiguous run of valid packets
+
+        if ( num_packets != i )
+        {
+            void * temp = packet_data[num_packets];
+            packet_data[num_packets] = packet_data[i];
+            packet_data[i] = temp;
+        }
+
+        packet_bytes[num_packets] = (int) packet_array[i].msg_len;
+
+        num_packets++;
+    }
+
+    return num_packets;
+}
+
+int snapshot_platform_socket_enable_gso( snapshot_platform_socket_t * socket )
+{
+    snapshot_assert( socket );
+
+    // kernels without udp gso don't know the option, so this doubles as a feature check
+
+    int segment_size = 0;
+    socklen_t length = sizeof(segment_size);
+    if ( getsockopt( socket->handle, IPPROTO_UDP, UDP_SEGMENT, &segment_size, &length ) != 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "udp gso is not supported: %s", strerror( errno ) );
+        return SNAPSHOT_ERROR;
+    }
+
+    socket->gso = true;
+
+    return SNAPSHOT_OK;
+}
+
+int snapshot_platform_socket_enable_txtime( snapshot_platform_socket_t * socket )
+{
+    snapshot_assert( socket );
+
+    // the kernel only holds packets back until their send time with the fq or etf qdisc on the interface. with any
+    // other qdisc the option is accepted, but timed packets go out as soon as they are sent
+
+    struct sock_txtime txtime;
+    memset( &txtime, 0, sizeof(txtime) );
+    txtime.clockid = CLOCK_MONOTONIC;
+    txtime.flags = 0;
+
+    if ( setsockopt( socket->handle, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime) ) != 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "so_txtime is not supported: %s", strerror( errno ) );
+        return SNAPSHOT_ERROR;
+    }
+
+    socket->txtime = true;
+
+    return SNAPSHOT_OK;
+}
+
+int snapshot_platform_socket_enable_gro( snapshot_platform_socket_t * socket )
+{
+    snapshot_assert( socket );
+
+    if ( socket->gro )
+        return SNAPSHOT_OK;
+
+    snapshot_platform_socket_gro_t * gro = (snapshot_platform_socket_gro_t*) snapshot_malloc( socket->context, sizeof(snapshot_platform_socket_gro_t) );
+    if ( !gro )
+        return SNAPSHOT_ERROR;
+
+    int yes = 1;
+    if ( setsockopt( socket->handle, IPPROTO_UDP, UDP_GRO, &yes, sizeof(yes) ) != 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "udp gro is not supported: %s", strerror( errno ) );
+        snapshot_free( socket->context, gro );
+        return SNAPSHOT_ERROR;
+    }
+
+    gro->num_messages = 0;
+    gro->message_index = 0;
+    gro->message_offset = 0;
+
+    socket->gro = gro;
+
+    return SNAPSHOT_OK;
+}
+
+void snapshot_platform_advise_huge_pages( void * memory, size_t bytes )
+{
+    snapshot_assert( memory );
+#ifdef MADV_HUGEPAGE
+    if ( madvise( memory, bytes, MADV_HUGEPAGE ) != 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "transparent huge pages are not available: %s", strerror( errno ) );
+    }
+#else // #ifdef MADV_HUGEPAGE
+    (void) bytes;
+#endif // #ifdef MADV_HUGEPAGE
+}
+
 // ---------------------------------------------------
 
 struct thread_shim_data_t
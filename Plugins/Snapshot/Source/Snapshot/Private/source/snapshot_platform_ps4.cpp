@@ -430,6 +430,21 @@ void snapshot_platform_socket_send_packet( snapshot_platform_socket_t * socket,
     }
 }
 
+void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, int num_packets )
+{
+    snapshot_assert( to );
+    snapshot_assert( packet_data );
+    snapshot_assert( packet_bytes );
+    snapshot_assert( num_packets >= 0 );
+
+    // no batched send on this platform, so just loop
+
+    for ( int i = 0; i < num_packets; ++i )
+    {
+        snapshot_platform_socket_send_packet( socket, &to[i], packet_data[i], packet_bytes[i] );
+    }
+}
+
 int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket, snapshot_address_t * from, void * packet_data, int max_packet_size )
 {
     snapshot_assert( socket );
@@ -475,6 +490,73 @@ int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket
 
 }
 
+int snapshot_platform_socket_receive_packets( snapshot_platform_socket_t * socket, snapshot_address_t * from, void ** packet_data, int * packet_bytes, int max_packet_size, int max_packets, int * num_received )
+{
+    snapshot_assert( packet_bytes );
+    snapshot_assert( num_received );
+    snapshot_assert( max_packets > 0 );
+
+    // no batched receive on this platform, so just loop
+
+    int num_packets = 0;
+
+    while ( num_packets < max_packets )
+    {
+        int bytes = snapshot_platform_socket_receive_packet( socket, &from[num_packets], packet_data[num_packets], max_packet_size );
+        if ( bytes == 0 )
+            break;
+        packet_bytes[num_packets++] = bytes;
+    }
+
+    *num_received = num_packets;
+
+    return num_packets;
+}
+
+int snapshot_platform_socket_enable_gso( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+int snapshot_platform_socket_enable_gro( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+int snapshot_platform_socket_enable_txtime( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+void snapshot_platform_socket_send_packets_at( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, const double * send_time, int num_packets )
+{
+    // no kernel timed release on this platform, so packets go out now
+
+    (void) send_time;
+    snapshot_platform_socket_send_packets( socket, to, packet_data, packet_bytes, num_packets );
+}
+
+void snapshot_platform_advise_huge_pages( void * memory, size_t bytes )
+{
+    (void) memory;
+    (void) bytes;
+}
+
+snapshot_platform_socket_t * snapshot_platform_socket_create_reuse_port( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size )
+{
+    (void) context;
+    (void) address;
+    (void) socket_type;
+    (void) timeout_seconds;
+    (void) send_buffer_size;
+    (void) receive_buffer_size;
+    snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "reuse port sockets are not supported on this platform" );
+    return NULL;
+}
+
 int snapshot_platform_id()
 {
     return SNAPSHOT_PLATFORM_PS4;
@@ -30,9 +30,15 @@
 #include <wininet.h>
 #include <iphlpapi.h>
 #include <qos2.h>
+#include <timeapi.h>
 
 #pragma comment( lib, "WS2_32.lib" )
 #pragma comment( lib, "IPHLPAPI.lib" )
+#pragma comment( lib, "winmm.lib" )
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif // #ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
 
 #ifdef SetPort
 #undef SetPort
@@ -184,10 +190,59 @@ void snapshot_platform_mutex_destroy( snapshot_platform_mutex_t * mutex )
 
 // time
 
+// Sleep only wakes on the system timer tick, which is 15.6ms unless someone has raised the timer resolution, so a 1ms sleep
+// in an io loop really sleeps for a whole tick. each thread that sleeps gets a high resolution waitable timer instead. where
+// those aren't available (before windows 10 1803), the timer resolution is raised to 1ms for the length of the sleep
+
+struct snapshot_platform_sleep_timer_t
+{
+    HANDLE handle = NULL;
+    bool initialized = false;
+
+    ~snapshot_platform_sleep_timer_t()
+    {
+        if ( handle )
+        {
+            CloseHandle( handle );
+        }
+    }
+};
+
+static thread_local struct snapshot_platform_sleep_timer_t snapshot_platform_sleep_timer;
+
 void snapshot_platform_sleep( double time )
 {
-    const int milliseconds = (int) ( time * 1000 );
-    Sleep( milliseconds );
+    if ( time <= 0.0 )
+    {
+        Sleep( 0 );
+        return;
+    }
+
+    struct snapshot_platform_sleep_timer_t & timer = snapshot_platform_sleep_timer;
+
+    if ( !timer.initialized )
+    {
+        timer.handle = CreateWaitableTimerExW( NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+        timer.initialized = true;
+    }
+
+    if ( timer.handle )
+    {
+        // relative due time, in 100ns units
+
+        LARGE_INTEGER due_time;
+        due_time.QuadPart = -(LONGLONG) ( time * 10000000.0 );
+
+        if ( SetWaitableTimerEx( timer.handle, &due_time, 0, NULL, NULL, NULL, 0 ) )
+        {
+            WaitForSingleObject( timer.handle, INFINITE );
+            return;
+        }
+    }
+
+    timeBeginPeriod( 1 );
+    Sleep( (DWORD) ( time * 1000 ) );
+    timeEndPeriod( 1 );
 }
 
 double snapshot_platform_time()
@@ -497,6 +552,21 @@ void snapshot_platform_socket_send_packet( snapshot_platform_socket_t * socket,
     }
 }
 
+void snapshot_platform_socket_send_packets( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, int num_packets )
+{
+    snapshot_assert( to );
+    snapshot_assert( packet_data );
+    snapshot_assert( packet_bytes );
+    snapshot_assert( num_packets >= 0 );
+
+    // no batched send on this platform, so just loop
+
+    for ( int i = 0; i < num_packets; ++i )
+    {
+        snapshot_platform_socket_send_packet( socket, &to[i], packet_data[i], packet_bytes[i] );
+    }
+}
+
 int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket, snapshot_address_t * from, void * packet_data, int max_packet_size )
 {
     snapshot_assert( socket );
@@ -554,6 +624,73 @@ int snapshot_platform_socket_receive_packet( snapshot_platform_socket_t * socket
     return result;
 }
 
+int snapshot_platform_socket_receive_packets( snapshot_platform_socket_t * socket, snapshot_address_t * from, void ** packet_data, int * packet_bytes, int max_packet_size, int max_packets, int * num_received )
+{
+    snapshot_assert( packet_bytes );
+    snapshot_assert( num_received );
+    snapshot_assert( max_packets > 0 );
+
+    // no batched receive on this platform, so just loop
+
+    int num_packets = 0;
+
+    while ( num_packets < max_packets )
+    {
+        int bytes = snapshot_platform_socket_receive_packet( socket, &from[num_packets], packet_data[num_packets], max_packet_size );
+        if ( bytes == 0 )
+            break;
+        packet_bytes[num_packets++] = bytes;
+    }
+
+    *num_received = num_packets;
+
+    return num_packets;
+}
+
+int snapshot_platform_socket_enable_gso( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+int snapshot_platform_socket_enable_gro( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+int snapshot_platform_socket_enable_txtime( snapshot_platform_socket_t * socket )
+{
+    (void) socket;
+    return SNAPSHOT_ERROR;
+}
+
+void snapshot_platform_socket_send_packets_at( snapshot_platform_socket_t * socket, const snapshot_address_t * to, void ** packet_data, int * packet_bytes, const double * send_time, int num_packets )
+{
+    // no kernel timed release on this platform, so packets go out now
+
+    (void) send_time;
+    snapshot_platform_socket_send_packets( socket, to, packet_data, packet_bytes, num_packets );
+}
+
+void snapshot_platform_advise_huge_pages( void * memory, size_t bytes )
+{
+    (void) memory;
+    (void) bytes;
+}
+
+snapshot_platform_socket_t * snapshot_platform_socket_create_reuse_port( void * context, snapshot_address_t * address, int socket_type, float timeout_seconds, int send_buffer_size, int receive_buffer_size )
+{
+    (void) context;
+    (void) address;
+    (void) socket_type;
+    (void) timeout_seconds;
+    (void) send_buffer_size;
+    (void) receive_buffer_size;
+    snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "reuse port sockets are not supported on this platform" );
+    return NULL;
+}
+
 #if SNAPSHOT_UNREAL_ENGINE
 #include "Windows/PostWindowsApi.h"
 #include "Windows/HideWindowsPlatformTypes.h"
@@ -4,24 +4,60 @@
 */
 
 #include "snapshot_sequence_buffer.h"
+#include "snapshot_arena.h"
 
-struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create( void * context, int num_entries, int entry_stride )
+static void snapshot_sequence_buffer_init( struct snapshot_sequence_buffer_t * sequence_buffer, void * context, int num_entries, int entry_stride )
 {
-    snapshot_assert( num_entries > 0 );
-    snapshot_assert( entry_stride > 0 );
-
-    struct snapshot_sequence_buffer_t * sequence_buffer = (struct snapshot_sequence_buffer_t*) snapshot_malloc( context, sizeof( struct snapshot_sequence_buffer_t ) );
-
     sequence_buffer->context = context;
     sequence_buffer->sequence = 0;
     sequence_buffer->num_entries = num_entries;
     sequence_buffer->entry_stride = entry_stride;
-    sequence_buffer->entry_sequence = (uint32_t*) snapshot_malloc( context, num_entries * sizeof( uint32_t ) );
-    sequence_buffer->entry_data = (uint8_t*) snapshot_malloc( context, num_entries * entry_stride );
+    sequence_buffer->received_bits = 0;
     snapshot_assert( sequence_buffer->entry_sequence );
     snapshot_assert( sequence_buffer->entry_data );
     memset( sequence_buffer->entry_sequence, 0xFF, sizeof( uint32_t) * sequence_buffer->num_entries );
     memset( sequence_buffer->entry_data, 0, num_entries * entry_stride );
+}
+
+struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create( void * context, int num_entries, int entry_stride )
+{
+    snapshot_assert( num_entries > 0 );
+    snapshot_assert( entry_stride > 0 );
+
+    struct snapshot_sequence_buffer_t * sequence_buffer = (struct snapshot_sequence_buffer_t*) snapshot_malloc( context, sizeof( struct snapshot_sequence_buffer_t ) );
+
+    sequence_buffer->entry_sequence = (uint32_t*) snapshot_malloc( context, num_entries * sizeof( uint32_t ) );
+    sequence_buffer->entry_data = (uint8_t*) snapshot_malloc( context, num_entries * entry_stride );
+    sequence_buffer->arena_allocated = false;
+
+    snapshot_sequence_buffer_init( sequence_buffer, context, num_entries, entry_stride );
+
+    return sequence_buffer;
+}
+
+size_t snapshot_sequence_buffer_arena_bytes( int num_entries, int entry_stride )
+{
+    return snapshot_arena_bytes( sizeof( struct snapshot_sequence_buffer_t ) ) + snapshot_arena_bytes( num_entries * sizeof( uint32_t ) ) + snapshot_arena_bytes( num_entries * entry_stride );
+}
+
+struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create_in_arena( struct snapshot_arena_t * arena, void * context, int num_entries, int entry_stride )
+{
+    snapshot_assert( arena );
+    snapshot_assert( num_entries > 0 );
+    snapshot_assert( entry_stride > 0 );
+
+    struct snapshot_sequence_buffer_t * sequence_buffer = (struct snapshot_sequence_buffer_t*) snapshot_arena_alloc( arena, sizeof( struct snapshot_sequence_buffer_t ) );
+    if ( !sequence_buffer )
+        return NULL;
+
+    sequence_buffer->entry_sequence = (uint32_t*) snapshot_arena_alloc( arena, num_entries * sizeof( uint32_t ) );
+    sequence_buffer->entry_data = (uint8_t*) snapshot_arena_alloc( arena, num_entries * entry_stride );
+    sequence_buffer->arena_allocated = true;
+
+    if ( !sequence_buffer->entry_sequence || !sequence_buffer->entry_data )
+        return NULL;
+
+    snapshot_sequence_buffer_init( sequence_buffer, context, num_entries, entry_stride );
 
     return sequence_buffer;
 }
@@ -29,6 +65,8 @@ struct snapshot_sequence_buffer_t * snapshot_sequence_buffer_create( void * cont
 void snapshot_sequence_buffer_destroy( struct snapshot_sequence_buffer_t * sequence_buffer )
 {
     snapshot_assert( sequence_buffer );
+    if ( sequence_buffer->arena_allocated )
+        return;
     snapshot_free( sequence_buffer->context, sequence_buffer->entry_sequence );
     snapshot_free( sequence_buffer->context, sequence_buffer->entry_data );
     snapshot_free( sequence_buffer->context, sequence_buffer );
@@ -38,9 +76,39 @@ void snapshot_sequence_buffer_reset( struct snapshot_sequence_buffer_t * sequenc
 {
     snapshot_assert( sequence_buffer );
     sequence_buffer->sequence = 0;
+    sequence_buffer->received_bits = 0;
     memset( sequence_buffer->entry_sequence, 0xFF, sizeof( uint32_t) * sequence_buffer->num_entries );
 }
 
+static inline void snapshot_sequence_buffer_set_received_bit( struct snapshot_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    const uint16_t offset = sequence_buffer->sequence - 1 - sequence;
+    if ( offset < 64 )
+        sequence_buffer->received_bits |= ( 1ULL << offset );
+}
+
+static inline void snapshot_sequence_buffer_clear_received_bit( struct snapshot_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    const uint16_t offset = sequence_buffer->sequence - 1 - sequence;
+    if ( offset < 64 )
+        sequence_buffer->received_bits &= ~( 1ULL << offset );
+}
+
+static void snapshot_sequence_buffer_set_sequence( struct snapshot_sequence_buffer_t * sequence_buffer, uint16_t sequence )
+{
+    // slide the received bits forward. bits for sequences that fell out of the buffer are masked off,
+    // and the new sequence numbers come in as zero, since remove_entries has just cleared them
+
+    const uint16_t shift = sequence - sequence_buffer->sequence;
+
+    sequence_buffer->received_bits = ( shift < 64 ) ? ( sequence_buffer->received_bits << shift ) : 0;
+
+    if ( sequence_buffer->num_entries < 64 )
+        sequence_buffer->received_bits &= ( 1ULL << sequence_buffer->num_entries ) - 1;
+
+    sequence_buffer->sequence = sequence;
+}
+
 void snapshot_sequence_buffer_remove_entries( struct snapshot_sequence_buffer_t * sequence_buffer, 
                                               int start_sequence, 
                                               int finish_sequence, 
@@ -54,14 +122,21 @@ void snapshot_sequence_buffer_remove_entries( struct snapshot_sequence_buffer_t
     }
     if ( finish_sequence - start_sequence < sequence_buffer->num_entries )
     {
+        // the range can run past 65535 when the sequence wraps, so index by the 16 bit sequence, the same as insert does.
+        // when the buffer size doesn't divide 65536, the slot can hold a sequence from just before the wrap instead of
+        // one from a lap ago, so clear the received bit of whatever is actually in the slot
+
         int sequence;
         for ( sequence = start_sequence; sequence <= finish_sequence; ++sequence )
         {
+            const int index = ( (uint16_t) sequence ) % sequence_buffer->num_entries;
             if ( cleanup_function )
             {
-                cleanup_function( sequence_buffer->context, sequence_buffer->entry_data + sequence_buffer->entry_stride * ( sequence % sequence_buffer->num_entries ) );
+                cleanup_function( sequence_buffer->context, sequence_buffer->entry_data + sequence_buffer->entry_stride * index );
             }
-            sequence_buffer->entry_sequence[ sequence % sequence_buffer->num_entries ] = 0xFFFFFFFF;
+            if ( sequence_buffer->entry_sequence[index] != 0xFFFFFFFF )
+                snapshot_sequence_buffer_clear_received_bit( sequence_buffer, (uint16_t) sequence_buffer->entry_sequence[index] );
+            sequence_buffer->entry_sequence[index] = 0xFFFFFFFF;
         }
     }
     else
@@ -75,6 +150,7 @@ void snapshot_sequence_buffer_remove_entries( struct snapshot_sequence_buffer_t
             }
             sequence_buffer->entry_sequence[i] = 0xFFFFFFFF;
         }
+        sequence_buffer->received_bits = 0;
     }
 }
 
@@ -106,13 +182,18 @@ void * snapshot_sequence_buffer_insert( struct snapshot_sequence_buffer_t * sequ
     if ( snapshot_sequence_greater_than( sequence + 1, sequence_buffer->sequence ) )
     {
         snapshot_sequence_buffer_remove_entries( sequence_buffer, sequence_buffer->sequence, sequence, NULL );
-        sequence_buffer->sequence = sequence + 1;
+        snapshot_sequence_buffer_set_sequence( sequence_buffer, sequence + 1 );
     }
 
     int index = sequence % sequence_buffer->num_entries;
 
+    if ( sequence_buffer->entry_sequence[index] != 0xFFFFFFFF )
+        snapshot_sequence_buffer_clear_received_bit( sequence_buffer, (uint16_t) sequence_buffer->entry_sequence[index] );
+
     sequence_buffer->entry_sequence[index] = sequence;
 
+    snapshot_sequence_buffer_set_received_bit( sequence_buffer, sequence );
+
     return sequence_buffer->entry_data + index * sequence_buffer->entry_stride;
 }
 
@@ -123,7 +204,7 @@ void snapshot_sequence_buffer_advance( struct snapshot_sequence_buffer_t * seque
     if ( snapshot_sequence_greater_than( sequence + 1, sequence_buffer->sequence ) )
     {
         snapshot_sequence_buffer_remove_entries( sequence_buffer, sequence_buffer->sequence, sequence, NULL );
-        sequence_buffer->sequence = sequence + 1;
+        snapshot_sequence_buffer_set_sequence( sequence_buffer, sequence + 1 );
     }
 }
 
@@ -134,7 +215,7 @@ void * snapshot_sequence_buffer_insert_with_cleanup( struct snapshot_sequence_bu
     if ( snapshot_sequence_greater_than( sequence + 1, sequence_buffer->sequence ) )
     {
         snapshot_sequence_buffer_remove_entries( sequence_buffer, sequence_buffer->sequence, sequence, cleanup_function );
-        sequence_buffer->sequence = sequence + 1;
+        snapshot_sequence_buffer_set_sequence( sequence_buffer, sequence + 1 );
     }
     else if ( snapshot_sequence_less_than( sequence, sequence_buffer->sequence - ((uint16_t)sequence_buffer->num_entries) ) )
     {
@@ -145,11 +226,14 @@ void * snapshot_sequence_buffer_insert_with_cleanup( struct snapshot_sequence_bu
 
     if ( sequence_buffer->entry_sequence[index] != 0xFFFFFFFF )
     {
+        snapshot_sequence_buffer_clear_received_bit( sequence_buffer, (uint16_t) sequence_buffer->entry_sequence[index] );
         cleanup_function( sequence_buffer->context, sequence_buffer->entry_data + sequence_buffer->entry_stride * ( sequence % sequence_buffer->num_entries ) );
     }
 
     sequence_buffer->entry_sequence[index] = sequence;
 
+    snapshot_sequence_buffer_set_received_bit( sequence_buffer, sequence );
+
     return sequence_buffer->entry_data + index * sequence_buffer->entry_stride;
 }
 
@@ -159,14 +243,17 @@ void snapshot_sequence_buffer_advance_with_cleanup( struct snapshot_sequence_buf
     if ( snapshot_sequence_greater_than( sequence + 1, sequence_buffer->sequence ) )
     {
         snapshot_sequence_buffer_remove_entries( sequence_buffer, sequence_buffer->sequence, sequence, cleanup_function );
-        sequence_buffer->sequence = sequence + 1;
+        snapshot_sequence_buffer_set_sequence( sequence_buffer, sequence + 1 );
     }
 }
 
 void snapshot_sequence_buffer_remove( struct snapshot_sequence_buffer_t * sequence_buffer, uint16_t sequence )
 {
     snapshot_assert( sequence_buffer );
-    sequence_buffer->entry_sequence[ sequence % sequence_buffer->num_entries ] = 0xFFFFFFFF;
+    int index = sequence % sequence_buffer->num_entries;
+    if ( sequence_buffer->entry_sequence[index] != 0xFFFFFFFF )
+        snapshot_sequence_buffer_clear_received_bit( sequence_buffer, (uint16_t) sequence_buffer->entry_sequence[index] );
+    sequence_buffer->entry_sequence[index] = 0xFFFFFFFF;
 }
 
 void snapshot_sequence_buffer_remove_with_cleanup( struct snapshot_sequence_buffer_t * sequence_buffer, 
@@ -179,6 +266,7 @@ void snapshot_sequence_buffer_remove_with_cleanup( struct snapshot_sequence_buff
 
     if ( sequence_buffer->entry_sequence[index] != 0xFFFFFFFF )
     {
+        snapshot_sequence_buffer_clear_received_bit( sequence_buffer, (uint16_t) sequence_buffer->entry_sequence[index] );
         sequence_buffer->entry_sequence[index] = 0xFFFFFFFF;
         cleanup_function( sequence_buffer->context, sequence_buffer->entry_data + sequence_buffer->entry_stride * index );
     }
@@ -223,14 +311,5 @@ void snapshot_sequence_buffer_generate_ack_bits( struct snapshot_sequence_buffer
     snapshot_assert( ack_bits );
 
     *ack = sequence_buffer->sequence - 1;
-    *ack_bits = 0;
-    uint32_t mask = 1;
-    
-    for ( int i = 0; i < 32; ++i )
-    {
-        uint16_t sequence = *ack - ((uint16_t)i);
-        if ( snapshot_sequence_buffer_exists( sequence_buffer, sequence ) )
-            *ack_bits |= mask;
-        mask <<= 1;
-    }
+    *ack_bits = (uint32_t) sequence_buffer->received_bits;
 }
@@ -13,11 +13,22 @@
 #include "snapshot_encryption_manager.h"
 #include "snapshot_network_simulator.h"
 #include "snapshot_endpoint.h"
+#include "snapshot_address_map.h"
+#include "snapshot_timer_wheel.h"
+#include "snapshot_arena.h"
+#include "snapshot_delta.h"
 
 #include <time.h>
 
-#define SNAPSHOT_MAX_CONNECT_TOKEN_ENTRIES            ( SNAPSHOT_MAX_CLIENTS * 4 )
-#define SNAPSHOT_SERVER_MAX_SIM_RECEIVE_PACKETS     ( 256 * SNAPSHOT_MAX_CLIENTS )
+#define SNAPSHOT_CONNECT_TOKEN_ENTRIES_PER_CLIENT                         4
+#define SNAPSHOT_SERVER_SIM_RECEIVE_PACKETS_PER_CLIENT                  256
+#define SNAPSHOT_SERVER_SEND_QUEUE_SIZE                                1024
+#define SNAPSHOT_SERVER_SEND_QUEUE_BYTES                    ( 1024 * 1024 )
+#define SNAPSHOT_SERVER_KEEP_ALIVE_SECONDS                              0.1
+#define SNAPSHOT_SERVER_TIMER_WHEEL_TICK_SECONDS                       0.01
+#define SNAPSHOT_SERVER_SNAPSHOT_MIN_BANDWIDTH_KBPS                     256
+#define SNAPSHOT_SERVER_SNAPSHOT_BANDWIDTH_GROWTH                      1.25
+#define SNAPSHOT_SERVER_PACED_PACKET_OVERHEAD_BYTES   ( 1 + 8 + SNAPSHOT_PAYLOAD_IOVEC_HEADER_BYTES + SNAPSHOT_MAC_BYTES )
 
 // ------------------------------------------------------------------------------------------
 
@@ -25,7 +36,9 @@ void snapshot_default_server_config( struct snapshot_server_config_t * config )
 {
     snapshot_assert( config );
     memset( config, 0, sizeof(snapshot_server_config_t) );
-    config->max_clients = SNAPSHOT_MAX_CLIENTS;
+    config->max_clients = SNAPSHOT_DEFAULT_MAX_CLIENTS;
+    config->snapshot_bandwidth_kbps = SNAPSHOT_DEFAULT_SNAPSHOT_BANDWIDTH_KBPS;
+    config->pacing_rate_kbps = SNAPSHOT_DEFAULT_PACING_RATE_KBPS;
 #if SNAPSHOT_DEVELOPMENT
     config->network_simulator = NULL;
 #endif // #if SNAPSHOT_DEVELOPMENT
@@ -40,10 +53,10 @@ struct snapshot_connect_token_entry_t
     struct snapshot_address_t address;
 };
 
-void snapshot_connect_token_entries_reset( struct snapshot_connect_token_entry_t * connect_token_entries )
+void snapshot_connect_token_entries_reset( struct snapshot_connect_token_entry_t * connect_token_entries, int num_connect_token_entries )
 {
     int i;
-    for ( i = 0; i < SNAPSHOT_MAX_CONNECT_TOKEN_ENTRIES; ++i )
+    for ( i = 0; i < num_connect_token_entries; ++i )
     {
         connect_token_entries[i].time = -1000.0;
         memset( connect_token_entries[i].mac, 0, SNAPSHOT_MAC_BYTES );
@@ -52,6 +65,7 @@ void snapshot_connect_token_entries_reset( struct snapshot_connect_token_entry_t
 }
 
 int snapshot_connect_token_entries_find_or_add( struct snapshot_connect_token_entry_t * connect_token_entries, 
+                                                int num_connect_token_entries,
                                                 const struct snapshot_address_t * address, 
                                                 uint8_t * mac, 
                                                 double time )
@@ -67,7 +81,7 @@ int snapshot_connect_token_entries_find_or_add( struct snapshot_connect_token_en
     double oldest_token_time = 0.0;
 
     int i;
-    for ( i = 0; i < SNAPSHOT_MAX_CONNECT_TOKEN_ENTRIES; ++i )
+    for ( i = 0; i < num_connect_token_entries; ++i )
     {
         if ( memcmp( mac, connect_token_entries[i].mac, SNAPSHOT_MAC_BYTES ) == 0 )
             matching_token_index = i;
@@ -94,7 +108,7 @@ int snapshot_connect_token_entries_find_or_add( struct snapshot_connect_token_en
     // allow connect tokens we have already seen from the same address
 
     snapshot_assert( matching_token_index >= 0 );
-    snapshot_assert( matching_token_index < SNAPSHOT_MAX_CONNECT_TOKEN_ENTRIES );
+    snapshot_assert( matching_token_index < num_connect_token_entries );
     if ( snapshot_address_equal( &connect_token_entries[matching_token_index].address, address ) )
         return 1;
 
@@ -103,48 +117,175 @@ int snapshot_connect_token_entries_find_or_add( struct snapshot_connect_token_en
 
 // ------------------------------------------------------------------------------------------
 
+// per-client state that packet demux, receive and send touch, packed into one cache line per client.
+// cold state set up at connect time (client id, user data, replay protection, endpoints) lives in separate arrays
+
+#define SNAPSHOT_SERVER_CLIENT_HOT_BYTES                                 64
+
+struct snapshot_server_client_hot_t
+{
+    struct snapshot_address_t address;
+    int encryption_index;
+    int connected;
+    int confirmed;
+    int loopback;
+    int timeout;
+    uint64_t sequence;
+    double last_packet_receive_time;
+    double last_internal_packet_send_time;
+};
+
+static_assert( sizeof( struct snapshot_server_client_hot_t ) == SNAPSHOT_SERVER_CLIENT_HOT_BYTES, "server client hot state must be exactly one cache line" );
+
+struct snapshot_server_client_snapshot_t
+{
+    struct snapshot_delta_client_t * delta;
+    double budget_bytes;
+    double last_update_time;
+};
+
+// paced packets for a client wait in a ring of slots, already encrypted, until their send time comes around. each client has
+// a slot for every packet of the largest payload its endpoint can write, and each slot holds a packet of one fragment, so a
+// whole fragment train is paced
+
+struct snapshot_server_client_pacing_t
+{
+    double seconds_per_byte;
+    double next_send_time;
+    int head;
+    int num_packets;
+};
+
 struct snapshot_server_t
 {
     struct snapshot_server_config_t config;
+    struct snapshot_arena_t arena;
     struct snapshot_platform_socket_t * socket;
     struct snapshot_address_t address;
     bool allow_any_address;
     uint64_t flags;
     double time;
+    double update_interval;
+    double last_update_platform_time;
+    bool txtime;
     int max_clients;
     int num_connected_clients;
+    int * connected_clients;
+    int * client_connected_list_index;
+    int * client_reported_index;
     uint64_t global_sequence;
     uint64_t challenge_sequence;
     uint8_t allowed_packets[SNAPSHOT_NUM_PACKETS];
     uint8_t challenge_key[SNAPSHOT_KEY_BYTES];
-    int client_connected[SNAPSHOT_MAX_CLIENTS];
-    int client_timeout[SNAPSHOT_MAX_CLIENTS];
-    int client_loopback[SNAPSHOT_MAX_CLIENTS];
-    int client_confirmed[SNAPSHOT_MAX_CLIENTS];
-    int client_encryption_index[SNAPSHOT_MAX_CLIENTS];
-    uint64_t client_id[SNAPSHOT_MAX_CLIENTS];
-    uint64_t client_sequence[SNAPSHOT_MAX_CLIENTS];
-    double client_last_internal_packet_send_time[SNAPSHOT_MAX_CLIENTS];
-    double client_last_packet_receive_time[SNAPSHOT_MAX_CLIENTS];
-    uint8_t client_user_data[SNAPSHOT_MAX_CLIENTS][SNAPSHOT_USER_DATA_BYTES];
-    struct snapshot_replay_protection_t client_replay_protection[SNAPSHOT_MAX_CLIENTS];
-    struct snapshot_endpoint_t * client_endpoint[SNAPSHOT_MAX_CLIENTS];
-    struct snapshot_address_t client_address[SNAPSHOT_MAX_CLIENTS];
-    struct snapshot_connect_token_entry_t connect_token_entries[SNAPSHOT_MAX_CONNECT_TOKEN_ENTRIES];
-    struct snapshot_encryption_manager_t encryption_manager;
+    void * client_hot_memory;
+    struct snapshot_server_client_hot_t * client_hot;
+    uint64_t * client_id;
+    uint8_t (*client_user_data)[SNAPSHOT_USER_DATA_BYTES];
+    struct snapshot_replay_protection_t * client_replay_protection;
+    struct snapshot_endpoint_t ** client_endpoint;
+    struct snapshot_address_map_t client_address_map;
+    struct snapshot_address_map_entry_t * client_address_map_entries;
+    int num_connect_token_entries;
+    struct snapshot_connect_token_entry_t * connect_token_entries;
+    struct snapshot_encryption_manager_t * encryption_manager;
+    struct snapshot_timer_wheel_t * timer_wheel;
+    struct snapshot_delta_world_t * snapshot_world;
+    struct snapshot_server_client_snapshot_t * client_snapshot;
+    struct snapshot_server_client_pacing_t * client_pacing;
+    int paced_slots_per_client;
+    int paced_slot_bytes;
+    uint8_t * paced_packet_buffer;
+    double * paced_packet_send_time;
+    int * paced_packet_bytes;
+    void * receive_packet_data[SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE];
+    int receive_packet_bytes[SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE];
+    struct snapshot_address_t receive_from[SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE];
+    uint8_t receive_buffer[SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE][SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    int send_queue_num_packets;
+    int send_queue_bytes;
+    void * send_queue_packet_data[SNAPSHOT_SERVER_SEND_QUEUE_SIZE];
+    int send_queue_packet_bytes[SNAPSHOT_SERVER_SEND_QUEUE_SIZE];
+    struct snapshot_address_t send_queue_address[SNAPSHOT_SERVER_SEND_QUEUE_SIZE];
+    double send_queue_send_time[SNAPSHOT_SERVER_SEND_QUEUE_SIZE];
+    uint8_t send_queue_buffer[SNAPSHOT_SERVER_SEND_QUEUE_BYTES];
 #if SNAPSHOT_DEVELOPMENT
     uint64_t development_flags;
-    uint8_t * sim_receive_packet_data[SNAPSHOT_SERVER_MAX_SIM_RECEIVE_PACKETS];
-    int sim_receive_packet_bytes[SNAPSHOT_SERVER_MAX_SIM_RECEIVE_PACKETS];
-    struct snapshot_address_t sim_receive_from[SNAPSHOT_SERVER_MAX_SIM_RECEIVE_PACKETS];
+    int max_sim_receive_packets;
+    uint8_t ** sim_receive_packet_data;
+    int * sim_receive_packet_bytes;
+    struct snapshot_address_t * sim_receive_from;
 #endif // #if SNAPSHOT_DEVELOPMENT
     uint64_t counters[SNAPSHOT_SERVER_NUM_COUNTERS];
 };
 
+// in arena mode the server struct, per-client arrays and client endpoints are carved from one allocation sized up front
+
+static size_t snapshot_server_arena_bytes( int max_clients, int address_map_size, int num_connect_token_entries, int num_paced_packets, int paced_slot_bytes, const struct snapshot_endpoint_config_t * endpoint_config )
+{
+    size_t bytes = snapshot_arena_bytes( sizeof( struct snapshot_server_t ) );
+    bytes += snapshot_arena_bytes( ( max_clients + 1 ) * sizeof( struct snapshot_server_client_hot_t ) );
+    bytes += 3 * snapshot_arena_bytes( max_clients * sizeof( int ) );
+    bytes += snapshot_arena_bytes( max_clients * sizeof( uint64_t ) );
+    bytes += snapshot_arena_bytes( max_clients * SNAPSHOT_USER_DATA_BYTES );
+    bytes += snapshot_arena_bytes( max_clients * sizeof( struct snapshot_replay_protection_t ) );
+    bytes += snapshot_arena_bytes( max_clients * sizeof( struct snapshot_endpoint_t* ) );
+    bytes += snapshot_arena_bytes( address_map_size * sizeof( struct snapshot_address_map_entry_t ) );
+    bytes += snapshot_arena_bytes( num_connect_token_entries * sizeof( struct snapshot_connect_token_entry_t ) );
+    bytes += snapshot_arena_bytes( max_clients * sizeof( struct snapshot_server_client_snapshot_t ) );
+    bytes += snapshot_arena_bytes( max_clients * sizeof( struct snapshot_server_client_pacing_t ) );
+    bytes += snapshot_arena_bytes( (size_t) num_paced_packets * paced_slot_bytes );
+    bytes += snapshot_arena_bytes( num_paced_packets * sizeof( double ) );
+    bytes += snapshot_arena_bytes( num_paced_packets * sizeof( int ) );
+    bytes += max_clients * snapshot_endpoint_arena_bytes( endpoint_config );
+    return bytes;
+}
+
+static void * snapshot_server_alloc( struct snapshot_server_t * server, size_t bytes )
+{
+    if ( server->arena.memory )
+        return snapshot_arena_alloc( &server->arena, bytes );
+    return snapshot_malloc( server->config.context, bytes );
+}
+
+static void snapshot_server_free( struct snapshot_server_t * server, void * p )
+{
+    if ( p && !server->arena.memory )
+        snapshot_free( server->config.context, p );
+}
+
+static void snapshot_server_reset_client_snapshot( struct snapshot_server_t * server, int client_index )
+{
+    struct snapshot_server_client_snapshot_t * client_snapshot = &server->client_snapshot[client_index];
+    if ( client_snapshot->delta )
+    {
+        snapshot_delta_client_reset( client_snapshot->delta );
+    }
+    client_snapshot->budget_bytes = 0.0;
+    client_snapshot->last_update_time = server->time;
+}
+
+static void snapshot_server_reset_client_pacing( struct snapshot_server_t * server, int client_index )
+{
+    if ( !server->client_pacing )
+        return;
+
+    struct snapshot_server_client_pacing_t * pacing = &server->client_pacing[client_index];
+    pacing->seconds_per_byte = 0.0;
+    pacing->next_send_time = 0.0;
+    pacing->head = 0;
+    pacing->num_packets = 0;
+}
+
 struct snapshot_server_t * snapshot_server_create( const char * server_address_string, const struct snapshot_server_config_t * config, double time )
 {  
     snapshot_assert( config );
 
+    if ( config->max_clients < 1 || config->max_clients > SNAPSHOT_MAX_CLIENTS )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "server max clients must be in [1,%d]", SNAPSHOT_MAX_CLIENTS );
+        return NULL;
+    }
+
     struct snapshot_address_t server_address;
     memset( &server_address, 0, sizeof( server_address ) );
     if ( snapshot_address_parse( &server_address, server_address_string ) != SNAPSHOT_OK )
@@ -156,6 +297,8 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
 
     struct snapshot_platform_socket_t * socket = NULL;
 
+    bool txtime = false;
+
     if ( !config->network_simulator )
     {
         snapshot_address_t bind_address;
@@ -163,7 +306,14 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
         bind_address.type = server_address.type;
         bind_address.port = server_address.port;
 
-        socket = snapshot_platform_socket_create( config->context, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0.0f, SNAPSHOT_SERVER_SOCKET_SNDBUF_SIZE, SNAPSHOT_SERVER_SOCKET_RCVBUF_SIZE );
+        if ( config->reuse_port )
+        {
+            socket = snapshot_platform_socket_create_reuse_port( config->context, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0.0f, SNAPSHOT_SERVER_SOCKET_SNDBUF_SIZE, SNAPSHOT_SERVER_SOCKET_RCVBUF_SIZE );
+        }
+        else
+        {
+            socket = snapshot_platform_socket_create( config->context, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0.0f, SNAPSHOT_SERVER_SOCKET_SNDBUF_SIZE, SNAPSHOT_SERVER_SOCKET_RCVBUF_SIZE );
+        }
 
         if ( socket == NULL )
         {
@@ -171,6 +321,25 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
             return NULL;
         }
 
+        if ( config->enable_gso && snapshot_platform_socket_enable_gso( socket ) != SNAPSHOT_OK )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server udp gso is not available. fragments will be sent as individual packets" );
+        }
+
+        if ( config->enable_gro && snapshot_platform_socket_enable_gro( socket ) != SNAPSHOT_OK )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server udp gro is not available" );
+        }
+
+        if ( config->enable_pacing && config->enable_txtime )
+        {
+            txtime = snapshot_platform_socket_enable_txtime( socket ) == SNAPSHOT_OK;
+            if ( !txtime )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server udp txtime is not available. paced packets will be released by the server" );
+            }
+        }
+
         server_address.port = bind_address.port;
     }
     else
@@ -182,7 +351,44 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
         }
     }
 
-    struct snapshot_server_t * server = (struct snapshot_server_t*) snapshot_malloc( config->context, sizeof( struct snapshot_server_t ) );
+    // per-client state is sized by max clients, so large servers don't cost small servers anything
+
+    const int max_clients = config->max_clients;
+    const int address_map_size = snapshot_address_map_capacity( max_clients );
+    const int num_connect_token_entries = max_clients * SNAPSHOT_CONNECT_TOKEN_ENTRIES_PER_CLIENT;
+
+    snapshot_endpoint_config_t endpoint_config;
+    snapshot_endpoint_default_config( &endpoint_config );
+    endpoint_config.context = config->context;
+    endpoint_config.enable_congestion_control = config->enable_congestion_control;
+    endpoint_config.fec_overhead = config->fec_overhead;
+    endpoint_config.enable_fragment_resend = config->enable_fragment_resend;
+    endpoint_config.stats_update_interval = config->stats_update_interval;
+
+    // with txtime, paced packets go to the kernel with their send time, so only userspace pacing needs packet slots
+
+    const int num_client_pacing = config->enable_pacing ? max_clients : 0;
+    const int paced_slots_per_client = snapshot_endpoint_max_write_packets( &endpoint_config );
+    const int paced_slot_bytes = SNAPSHOT_SERVER_PACED_PACKET_OVERHEAD_BYTES + ( endpoint_config.fragment_above > endpoint_config.fragment_size ? endpoint_config.fragment_above : endpoint_config.fragment_size );
+    const int num_paced_packets = ( config->enable_pacing && !txtime ) ? max_clients * paced_slots_per_client : 0;
+
+    struct snapshot_arena_t arena;
+    memset( &arena, 0, sizeof( arena ) );
+
+    struct snapshot_server_t * server = NULL;
+
+    if ( config->use_arena )
+    {
+        if ( snapshot_arena_create( &arena, config->context, snapshot_server_arena_bytes( max_clients, address_map_size, num_connect_token_entries, num_paced_packets, paced_slot_bytes, &endpoint_config ) ) == SNAPSHOT_OK )
+        {
+            server = (struct snapshot_server_t*) snapshot_arena_alloc( &arena, sizeof( struct snapshot_server_t ) );
+        }
+    }
+    else
+    {
+        server = (struct snapshot_server_t*) snapshot_malloc( config->context, sizeof( struct snapshot_server_t ) );
+    }
+
     if ( !server )
     {
         if ( socket )
@@ -194,6 +400,8 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
 
     memset( server, 0, sizeof(snapshot_server_t) );
 
+    server->arena = arena;
+
 #if SNAPSHOT_DEVELOPMENT
     if ( config->network_simulator )
     {
@@ -209,30 +417,129 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
     server->socket = socket;
     server->address = server_address;
     server->time = time;
+    server->txtime = txtime;
     server->global_sequence = 1ULL << 63;
+    server->max_clients = config->max_clients;
+    server->num_connect_token_entries = num_connect_token_entries;
+
+    server->client_hot_memory = snapshot_server_alloc( server, ( max_clients + 1 ) * sizeof( struct snapshot_server_client_hot_t ) );
+    server->client_id = (uint64_t*) snapshot_server_alloc( server, max_clients * sizeof( uint64_t ) );
+    server->client_user_data = (uint8_t(*)[SNAPSHOT_USER_DATA_BYTES]) snapshot_server_alloc( server, max_clients * SNAPSHOT_USER_DATA_BYTES );
+    server->client_replay_protection = (struct snapshot_replay_protection_t*) snapshot_server_alloc( server, max_clients * sizeof( struct snapshot_replay_protection_t ) );
+    server->client_endpoint = (struct snapshot_endpoint_t**) snapshot_server_alloc( server, max_clients * sizeof( struct snapshot_endpoint_t* ) );
+    server->connected_clients = (int*) snapshot_server_alloc( server, max_clients * sizeof( int ) );
+    server->client_connected_list_index = (int*) snapshot_server_alloc( server, max_clients * sizeof( int ) );
+    server->client_reported_index = (int*) snapshot_server_alloc( server, max_clients * sizeof( int ) );
+    server->client_address_map_entries = (struct snapshot_address_map_entry_t*) snapshot_server_alloc( server, address_map_size * sizeof( struct snapshot_address_map_entry_t ) );
+    server->connect_token_entries = (struct snapshot_connect_token_entry_t*) snapshot_server_alloc( server, server->num_connect_token_entries * sizeof( struct snapshot_connect_token_entry_t ) );
+    server->client_snapshot = (struct snapshot_server_client_snapshot_t*) snapshot_server_alloc( server, max_clients * sizeof( struct snapshot_server_client_snapshot_t ) );
+    server->encryption_manager = snapshot_encryption_manager_create( config->context, max_clients * SNAPSHOT_ENCRYPTION_MAPPINGS_PER_CLIENT );
+
+    if ( num_client_pacing > 0 )
+    {
+        server->client_pacing = (struct snapshot_server_client_pacing_t*) snapshot_server_alloc( server, num_client_pacing * sizeof( struct snapshot_server_client_pacing_t ) );
+        if ( server->client_pacing )
+        {
+            memset( server->client_pacing, 0, num_client_pacing * sizeof( struct snapshot_server_client_pacing_t ) );
+        }
+    }
 
-    memset( server->client_connected, 0, sizeof( server->client_connected ) );
-    memset( server->client_loopback, 0, sizeof( server->client_loopback ) );
-    memset( server->client_confirmed, 0, sizeof( server->client_confirmed ) );
-    memset( server->client_id, 0, sizeof( server->client_id ) );
-    memset( server->client_sequence, 0, sizeof( server->client_sequence ) );
-    memset( server->client_last_internal_packet_send_time, 0, sizeof( server->client_last_internal_packet_send_time ) );
-    memset( server->client_last_packet_receive_time, 0, sizeof( server->client_last_packet_receive_time ) );
-    memset( server->client_address, 0, sizeof( server->client_address ) );
-    memset( server->client_user_data, 0, sizeof( server->client_user_data ) );
+    server->paced_slots_per_client = paced_slots_per_client;
+    server->paced_slot_bytes = paced_slot_bytes;
 
-    for ( int i = 0; i < SNAPSHOT_MAX_CLIENTS; ++i )
+    if ( num_paced_packets > 0 )
     {
-        server->client_encryption_index[i] = -1;
+        server->paced_packet_buffer = (uint8_t*) snapshot_server_alloc( server, (size_t) num_paced_packets * paced_slot_bytes );
+        server->paced_packet_send_time = (double*) snapshot_server_alloc( server, num_paced_packets * sizeof( double ) );
+        server->paced_packet_bytes = (int*) snapshot_server_alloc( server, num_paced_packets * sizeof( int ) );
     }
 
-    snapshot_connect_token_entries_reset( server->connect_token_entries );
+    // timer ids: keep alive per client, then timeout per client, then expiry per encryption mapping
 
-    snapshot_encryption_manager_reset( &server->encryption_manager );
+    server->timer_wheel = snapshot_timer_wheel_create( config->context, max_clients * ( 2 + SNAPSHOT_ENCRYPTION_MAPPINGS_PER_CLIENT ), SNAPSHOT_SERVER_TIMER_WHEEL_TICK_SECONDS, time );
 
-    for ( int i = 0; i < SNAPSHOT_MAX_CLIENTS; ++i )
+    if ( !server->client_hot_memory || !server->client_id || !server->client_user_data || !server->client_replay_protection || !server->client_endpoint ||
+         !server->connected_clients || !server->client_connected_list_index || !server->client_reported_index ||
+         !server->client_address_map_entries || !server->connect_token_entries || !server->client_snapshot || !server->encryption_manager || !server->timer_wheel ||
+         ( num_client_pacing > 0 && !server->client_pacing ) || ( num_paced_packets > 0 && ( !server->paced_packet_buffer || !server->paced_packet_send_time || !server->paced_packet_bytes ) ) )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to allocate server state for %d clients", max_clients );
+        snapshot_server_destroy( server );
+        return NULL;
+    }
+
+    memset( server->client_snapshot, 0, max_clients * sizeof( struct snapshot_server_client_snapshot_t ) );
+
+    if ( config->num_snapshot_objects > 0 )
+    {
+        server->snapshot_world = snapshot_delta_world_create( config->context, config->num_snapshot_objects, config->snapshot_object_bytes );
+        if ( !server->snapshot_world )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create snapshot world with %d objects", config->num_snapshot_objects );
+            snapshot_server_destroy( server );
+            return NULL;
+        }
+
+        for ( int i = 0; i < max_clients; ++i )
+        {
+            server->client_snapshot[i].delta = snapshot_delta_client_create( config->context, server->snapshot_world );
+            if ( !server->client_snapshot[i].delta )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create snapshot state for client %d", i );
+                snapshot_server_destroy( server );
+                return NULL;
+            }
+        }
+    }
+
+#if SNAPSHOT_DEVELOPMENT
+    if ( config->network_simulator )
+    {
+        server->max_sim_receive_packets = max_clients * SNAPSHOT_SERVER_SIM_RECEIVE_PACKETS_PER_CLIENT;
+        server->sim_receive_packet_data = (uint8_t**) snapshot_malloc( config->context, server->max_sim_receive_packets * sizeof( uint8_t* ) );
+        server->sim_receive_packet_bytes = (int*) snapshot_malloc( config->context, server->max_sim_receive_packets * sizeof( int ) );
+        server->sim_receive_from = (struct snapshot_address_t*) snapshot_malloc( config->context, server->max_sim_receive_packets * sizeof( struct snapshot_address_t ) );
+        if ( !server->sim_receive_packet_data || !server->sim_receive_packet_bytes || !server->sim_receive_from )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to allocate server network simulator receive buffers" );
+            snapshot_server_destroy( server );
+            return NULL;
+        }
+    }
+#endif // #if SNAPSHOT_DEVELOPMENT
+
+    // the hot block is allocated with one spare entry so it can start on a cache line boundary
+
+    server->client_hot = (struct snapshot_server_client_hot_t*) ( ( (uintptr_t) server->client_hot_memory + SNAPSHOT_SERVER_CLIENT_HOT_BYTES - 1 ) & ~( (uintptr_t) SNAPSHOT_SERVER_CLIENT_HOT_BYTES - 1 ) );
+
+    memset( server->client_hot, 0, max_clients * sizeof( struct snapshot_server_client_hot_t ) );
+    memset( server->client_id, 0, max_clients * sizeof( uint64_t ) );
+    memset( server->client_user_data, 0, max_clients * SNAPSHOT_USER_DATA_BYTES );
+    memset( server->client_endpoint, 0, max_clients * sizeof( struct snapshot_endpoint_t* ) );
+
+    for ( int i = 0; i < max_clients; ++i )
+    {
+        server->client_hot[i].encryption_index = -1;
+        server->connected_clients[i] = -1;
+        server->client_connected_list_index[i] = -1;
+        server->client_reported_index[i] = i;
+    }
+
+    snapshot_connect_token_entries_reset( server->connect_token_entries, server->num_connect_token_entries );
+
+    snapshot_encryption_manager_set_timer_wheel( server->encryption_manager, server->timer_wheel, max_clients * 2 );
+
+    snapshot_address_map_init( &server->client_address_map, server->client_address_map_entries, address_map_size );
+
+    for ( int i = 0; i < max_clients; ++i )
     {
         snapshot_replay_protection_reset( &server->client_replay_protection[i] );
+        snapshot_server_reset_client_snapshot( server, i );
+    }
+
+    for ( int i = 0; i < SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE; ++i )
+    {
+        server->receive_packet_data[i] = server->receive_buffer[i] + SNAPSHOT_PACKET_PREFIX_BYTES;
     }
 
     server->allowed_packets[SNAPSHOT_CONNECTION_REQUEST_PACKET] = 1;
@@ -242,14 +549,18 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
     server->allowed_packets[SNAPSHOT_PASSTHROUGH_PACKET] = 1;
     server->allowed_packets[SNAPSHOT_DISCONNECT_PACKET] = 1;
 
-    for ( int i = 0; i < SNAPSHOT_MAX_CLIENTS; i++ )
+    for ( int i = 0; i < max_clients; i++ )
     {
-        snapshot_endpoint_config_t endpoint_config;
-        snapshot_endpoint_default_config( &endpoint_config );
         snprintf( endpoint_config.name, sizeof(endpoint_config.name), "server[%d]", i );
-        endpoint_config.context = config->context;
         
-        server->client_endpoint[i] = snapshot_endpoint_create( &endpoint_config, time );
+        if ( server->arena.memory )
+        {
+            server->client_endpoint[i] = snapshot_endpoint_create_in_arena( &server->arena, &endpoint_config, time );
+        }
+        else
+        {
+            server->client_endpoint[i] = snapshot_endpoint_create( &endpoint_config, time );
+        }
 
         if ( !server->client_endpoint[i] )
         {
@@ -259,7 +570,6 @@ struct snapshot_server_t * snapshot_server_create( const char * server_address_s
         }
     }
 
-    server->max_clients = config->max_clients;
     server->num_connected_clients = 0;
     server->challenge_sequence = 0;    
 
@@ -289,20 +599,204 @@ void snapshot_server_destroy( struct snapshot_server_t * server )
 {
     snapshot_assert( server );
 
-    for ( int i = 0; i < SNAPSHOT_MAX_CLIENTS; i++ )
+    snapshot_server_flush_packets( server );
+
+    void * context = server->config.context;
+
+    if ( server->client_endpoint )
     {
-        if ( server->client_endpoint[i] )
+        for ( int i = 0; i < server->max_clients; i++ )
         {
-            snapshot_endpoint_destroy( server->client_endpoint[i] );
+            if ( server->client_endpoint[i] )
+            {
+                snapshot_endpoint_destroy( server->client_endpoint[i] );
+            }
         }
     }
 
+    if ( server->encryption_manager )
+    {
+        snapshot_encryption_manager_destroy( server->encryption_manager );
+    }
+
+    if ( server->timer_wheel )
+    {
+        snapshot_timer_wheel_destroy( server->timer_wheel );
+    }
+
+    if ( server->snapshot_world )
+    {
+        for ( int i = 0; i < server->max_clients; ++i )
+        {
+            if ( server->client_snapshot[i].delta )
+            {
+                snapshot_delta_client_destroy( server->client_snapshot[i].delta );
+            }
+        }
+
+        snapshot_delta_world_destroy( server->snapshot_world );
+    }
+
+    snapshot_server_free( server, server->client_hot_memory );
+    snapshot_server_free( server, server->client_id );
+    snapshot_server_free( server, server->client_user_data );
+    snapshot_server_free( server, server->client_replay_protection );
+    snapshot_server_free( server, server->client_endpoint );
+    snapshot_server_free( server, server->connected_clients );
+    snapshot_server_free( server, server->client_connected_list_index );
+    snapshot_server_free( server, server->client_reported_index );
+    snapshot_server_free( server, server->client_address_map_entries );
+    snapshot_server_free( server, server->connect_token_entries );
+    snapshot_server_free( server, server->client_snapshot );
+    snapshot_server_free( server, server->client_pacing );
+    snapshot_server_free( server, server->paced_packet_buffer );
+    snapshot_server_free( server, server->paced_packet_send_time );
+    snapshot_server_free( server, server->paced_packet_bytes );
+
+#if SNAPSHOT_DEVELOPMENT
+    if ( server->sim_receive_packet_data )
+        snapshot_free( context, server->sim_receive_packet_data );
+    if ( server->sim_receive_packet_bytes )
+        snapshot_free( context, server->sim_receive_packet_bytes );
+    if ( server->sim_receive_from )
+        snapshot_free( context, server->sim_receive_from );
+#endif // #if SNAPSHOT_DEVELOPMENT
+
     if ( server->socket )
     {
         snapshot_platform_socket_destroy( server->socket );
     }
 
-    snapshot_free( server->config.context, server );
+    if ( server->arena.memory )
+    {
+        struct snapshot_arena_t arena = server->arena;
+        snapshot_arena_destroy( &arena );
+    }
+    else
+    {
+        snapshot_free( context, server );
+    }
+}
+
+void snapshot_server_add_connected_client( struct snapshot_server_t * server, int client_index )
+{
+    snapshot_assert( server );
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < server->max_clients );
+    snapshot_assert( server->client_connected_list_index[client_index] == -1 );
+    snapshot_assert( server->num_connected_clients < server->max_clients );
+
+    server->connected_clients[server->num_connected_clients] = client_index;
+    server->client_connected_list_index[client_index] = server->num_connected_clients;
+    server->num_connected_clients++;
+}
+
+void snapshot_server_remove_connected_client( struct snapshot_server_t * server, int client_index )
+{
+    snapshot_assert( server );
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < server->max_clients );
+    snapshot_assert( server->num_connected_clients > 0 );
+
+    // swap remove. the last connected client moves into the hole, so the list stays dense
+
+    const int list_index = server->client_connected_list_index[client_index];
+
+    snapshot_assert( list_index >= 0 );
+    snapshot_assert( list_index < server->num_connected_clients );
+    snapshot_assert( server->connected_clients[list_index] == client_index );
+
+    const int last_client_index = server->connected_clients[server->num_connected_clients - 1];
+
+    server->connected_clients[list_index] = last_client_index;
+    server->client_connected_list_index[last_client_index] = list_index;
+
+    server->connected_clients[server->num_connected_clients - 1] = -1;
+    server->client_connected_list_index[client_index] = -1;
+
+    server->num_connected_clients--;
+}
+
+void snapshot_server_schedule_client_timeout( struct snapshot_server_t * server, int client_index )
+{
+    snapshot_assert( server );
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < server->max_clients );
+
+    if ( server->client_hot[client_index].timeout > 0 )
+    {
+        snapshot_timer_wheel_schedule( server->timer_wheel, server->max_clients + client_index, server->client_hot[client_index].last_packet_receive_time + server->client_hot[client_index].timeout );
+    }
+}
+
+void snapshot_server_flush_packets( struct snapshot_server_t * server )
+{
+    snapshot_assert( server );
+
+    if ( server->send_queue_num_packets == 0 )
+        return;
+
+    snapshot_assert( server->socket );
+
+    if ( server->txtime )
+    {
+        snapshot_platform_socket_send_packets_at( server->socket, server->send_queue_address, server->send_queue_packet_data, server->send_queue_packet_bytes, server->send_queue_send_time, server->send_queue_num_packets );
+    }
+    else
+    {
+        snapshot_platform_socket_send_packets( server->socket, server->send_queue_address, server->send_queue_packet_data, server->send_queue_packet_bytes, server->send_queue_num_packets );
+    }
+
+    server->counters[SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES]++;
+
+    server->send_queue_num_packets = 0;
+    server->send_queue_bytes = 0;
+}
+
+static uint8_t * snapshot_server_queue_reserve( struct snapshot_server_t * server, int max_packet_bytes )
+{
+    snapshot_assert( server );
+    snapshot_assert( max_packet_bytes > 0 );
+    snapshot_assert( max_packet_bytes <= SNAPSHOT_MAX_PACKET_BYTES );
+
+    if ( server->send_queue_num_packets == SNAPSHOT_SERVER_SEND_QUEUE_SIZE || server->send_queue_bytes + max_packet_bytes > SNAPSHOT_SERVER_SEND_QUEUE_BYTES )
+    {
+        snapshot_server_flush_packets( server );
+    }
+
+    return server->send_queue_buffer + server->send_queue_bytes;
+}
+
+static void snapshot_server_queue_commit( struct snapshot_server_t * server, const struct snapshot_address_t * to, int packet_bytes )
+{
+    snapshot_assert( server );
+    snapshot_assert( to );
+    snapshot_assert( packet_bytes > 0 );
+    snapshot_assert( server->send_queue_num_packets < SNAPSHOT_SERVER_SEND_QUEUE_SIZE );
+    snapshot_assert( server->send_queue_bytes + packet_bytes <= SNAPSHOT_SERVER_SEND_QUEUE_BYTES );
+
+    const int index = server->send_queue_num_packets;
+    server->send_queue_packet_data[index] = server->send_queue_buffer + server->send_queue_bytes;
+    server->send_queue_packet_bytes[index] = packet_bytes;
+    server->send_queue_address[index] = *to;
+    server->send_queue_send_time[index] = 0.0;
+    server->send_queue_num_packets++;
+    server->send_queue_bytes += packet_bytes;
+}
+
+void snapshot_server_queue_packet( struct snapshot_server_t * server, const struct snapshot_address_t * to, const uint8_t * packet_data, int packet_bytes )
+{
+    snapshot_assert( server );
+    snapshot_assert( to );
+    snapshot_assert( packet_data );
+    snapshot_assert( packet_bytes > 0 );
+    snapshot_assert( packet_bytes <= SNAPSHOT_MAX_PACKET_BYTES );
+
+    // packets are copied into the send queue, because zero copy packets point into payload buffers that are freed right after sending
+
+    uint8_t * queue_packet_data = snapshot_server_queue_reserve( server, packet_bytes );
+    memcpy( queue_packet_data, packet_data, packet_bytes );
+    snapshot_server_queue_commit( server, to, packet_bytes );
 }
 
 void snapshot_server_send_global_packet( snapshot_server_t * server, void * packet, const struct snapshot_address_t * to, uint8_t * packet_key )
@@ -329,67 +823,247 @@ void snapshot_server_send_global_packet( snapshot_server_t * server, void * pack
     else
 #endif // #if SNAPSHOT_DEVELOPMENT
     {
-        snapshot_platform_socket_send_packet( server->socket, to, packet_data, packet_bytes );
+        snapshot_server_queue_packet( server, to, packet_data, packet_bytes );
         server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT]++;
     }
 
-    server->global_sequence++;
+    server->global_sequence++;
+}
+
+static bool snapshot_server_client_send_key( struct snapshot_server_t * server, int client_index, uint8_t ** packet_key )
+{
+    *packet_key = NULL;
+
+    if ( server->client_hot[client_index].loopback )
+        return true;
+
+    if ( !snapshot_encryption_manager_touch( server->encryption_manager, 
+                                             server->client_hot[client_index].encryption_index, 
+                                             &server->client_hot[client_index].address, 
+                                             server->time ) )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "encryption mapping is out of date for client %d", client_index );
+        return false;
+    }
+
+    *packet_key = snapshot_encryption_manager_get_send_key( server->encryption_manager, server->client_hot[client_index].encryption_index );
+
+    return true;
+}
+
+static void snapshot_server_send_packet_data_to_client( struct snapshot_server_t * server, int client_index, uint8_t * packet_data, int packet_bytes )
+{
+    if ( !server->client_hot[client_index].loopback )
+    {
+#if SNAPSHOT_DEVELOPMENT
+        if ( server->config.network_simulator )
+        {
+            snapshot_network_simulator_send_packet( server->config.network_simulator, &server->address, &server->client_hot[client_index].address, packet_data, packet_bytes );
+            server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_SIMULATOR]++;
+        }
+        else
+#endif // #if SNAPSHOT_DEVELOPMENT
+        {
+            snapshot_server_queue_packet( server, &server->client_hot[client_index].address, packet_data, packet_bytes );
+            server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT]++;
+        }
+    }
+    else
+    {
+        server->config.send_loopback_packet_callback( server->config.callback_context, &server->address, packet_data, packet_bytes );
+        server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_LOOPBACK]++;
+    }
+}
+
+void snapshot_server_send_packet_to_client( struct snapshot_server_t * server, int client_index, void * packet )
+{
+    snapshot_assert( server );
+    snapshot_assert( packet );
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < server->max_clients );
+    snapshot_assert( server->client_hot[client_index].connected );
+
+    uint8_t * packet_key = NULL;
+
+    if ( !snapshot_server_client_send_key( server, client_index, &packet_key ) )
+        return;
+
+    uint8_t buffer[SNAPSHOT_MAX_PACKET_BYTES];
+
+    int packet_bytes = 0;
+
+    uint8_t * packet_data = snapshot_write_packet( packet, buffer, SNAPSHOT_MAX_PACKET_BYTES, server->client_hot[client_index].sequence, packet_key, server->config.protocol_id, &packet_bytes );
+
+    snapshot_assert( packet_bytes <= SNAPSHOT_MAX_PACKET_BYTES );
+
+    snapshot_server_send_packet_data_to_client( server, client_index, packet_data, packet_bytes );
+
+    server->client_hot[client_index].sequence++;
+}
+
+static bool snapshot_server_client_queued( struct snapshot_server_t * server, int client_index )
+{
+    bool queued = !server->client_hot[client_index].loopback;
+#if SNAPSHOT_DEVELOPMENT
+    queued = queued && !server->config.network_simulator;
+#endif // #if SNAPSHOT_DEVELOPMENT
+    return queued;
+}
+
+static int snapshot_server_paced_packet_index( struct snapshot_server_t * server, int client_index, int slot_index )
+{
+    return client_index * server->paced_slots_per_client + slot_index;
+}
+
+static void snapshot_server_release_paced_packet( struct snapshot_server_t * server, int client_index )
+{
+    struct snapshot_server_client_pacing_t * pacing = &server->client_pacing[client_index];
+
+    snapshot_assert( pacing->num_packets > 0 );
+
+    const int index = snapshot_server_paced_packet_index( server, client_index, pacing->head );
+
+    snapshot_server_queue_packet( server, &server->client_hot[client_index].address, server->paced_packet_buffer + (size_t) index * server->paced_slot_bytes, server->paced_packet_bytes[index] );
+
+    pacing->head = ( pacing->head + 1 ) % server->paced_slots_per_client;
+    pacing->num_packets--;
+
+    server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT]++;
+    server->counters[SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT]++;
+}
+
+static bool snapshot_server_hold_paced_packet( struct snapshot_server_t * server, int client_index, const struct snapshot_payload_iovec_t * iovec, uint64_t sequence, uint8_t * packet_key, double send_time )
+{
+    struct snapshot_server_client_pacing_t * pacing = &server->client_pacing[client_index];
+
+    // a whole train always fits, so the ring only fills when resends pile up behind a train that hasn't gone out yet. if the
+    // client is that far behind, the oldest packet goes out now rather than holding up the new one
+
+    if ( pacing->num_packets == server->paced_slots_per_client )
+    {
+        snapshot_server_release_paced_packet( server, client_index );
+    }
+
+    const int index = snapshot_server_paced_packet_index( server, client_index, ( pacing->head + pacing->num_packets ) % server->paced_slots_per_client );
+
+    int packet_bytes = 0;
+
+    if ( snapshot_write_payload_iovec( iovec, server->paced_packet_buffer + (size_t) index * server->paced_slot_bytes, server->paced_slot_bytes, sequence, packet_key, server->config.protocol_id, &packet_bytes ) != SNAPSHOT_OK )
+        return false;
+
+    server->paced_packet_send_time[index] = send_time;
+    server->paced_packet_bytes[index] = packet_bytes;
+    pacing->num_packets++;
+
+    return true;
+}
+
+static void snapshot_server_release_paced_packets( struct snapshot_server_t * server )
+{
+    if ( !server->paced_packet_buffer )
+        return;
+
+    const double current_time = snapshot_platform_time();
+
+    for ( int i = 0; i < server->num_connected_clients; ++i )
+    {
+        const int client_index = server->connected_clients[i];
+
+        struct snapshot_server_client_pacing_t * pacing = &server->client_pacing[client_index];
+
+        while ( pacing->num_packets > 0 && server->paced_packet_send_time[snapshot_server_paced_packet_index( server, client_index, pacing->head )] <= current_time )
+        {
+            snapshot_server_release_paced_packet( server, client_index );
+        }
+    }
+}
+
+void snapshot_server_send_paced_packets( struct snapshot_server_t * server )
+{
+    snapshot_assert( server );
+
+    snapshot_server_release_paced_packets( server );
+
+    snapshot_server_flush_packets( server );
 }
 
-void snapshot_server_send_packet_to_client( struct snapshot_server_t * server, int client_index, void * packet )
+void snapshot_server_send_payload_iovec_to_client( struct snapshot_server_t * server, int client_index, const struct snapshot_payload_iovec_t * iovec, struct snapshot_server_client_pacing_t * pacing )
 {
     snapshot_assert( server );
-    snapshot_assert( packet );
+    snapshot_assert( iovec );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    snapshot_assert( server->client_connected[client_index] );
+    snapshot_assert( server->client_hot[client_index].connected );
 
     uint8_t * packet_key = NULL;
 
-    if ( !server->client_loopback[client_index] )
+    if ( !snapshot_server_client_send_key( server, client_index, &packet_key ) )
+        return;
+
+    const uint64_t sequence = server->client_hot[client_index].sequence;
+
+    int packet_bytes = 0;
+
+    const bool queued = snapshot_server_client_queued( server, client_index );
+
+    double send_time = 0.0;
+
+    if ( queued && pacing )
     {
-        if ( !snapshot_encryption_manager_touch( &server->encryption_manager, 
-                                                 server->client_encryption_index[client_index], 
-                                                 &server->client_address[client_index], 
-                                                 server->time ) )
+        // the schedule only moves on for packets that really wait for their send time. a packet that can't be held goes out
+        // now, and doesn't push back the packets after it
+
+        send_time = pacing->next_send_time;
+
+        const double next_send_time = send_time + ( iovec->header_bytes + iovec->data_bytes ) * pacing->seconds_per_byte;
+
+        if ( server->txtime )
+        {
+            pacing->next_send_time = next_send_time;
+        }
+        else if ( snapshot_server_hold_paced_packet( server, client_index, iovec, sequence, packet_key, send_time ) )
         {
-            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "encryption mapping is out of date for client %d", client_index );
+            pacing->next_send_time = next_send_time;
+            server->client_hot[client_index].sequence++;
             return;
         }
-
-        packet_key = snapshot_encryption_manager_get_send_key( &server->encryption_manager, server->client_encryption_index[client_index] );
     }
 
-    uint8_t buffer[SNAPSHOT_MAX_PACKET_BYTES];
-
-    int packet_bytes = 0;
-
-    uint8_t * packet_data = snapshot_write_packet( packet, buffer, SNAPSHOT_MAX_PACKET_BYTES, server->client_sequence[client_index], packet_key, server->config.protocol_id, &packet_bytes );
+    if ( queued )
+    {
+        // gather the packet straight into the send queue and encrypt it there
 
-    snapshot_assert( packet_bytes <= SNAPSHOT_MAX_PACKET_BYTES );
+        uint8_t * buffer = snapshot_server_queue_reserve( server, SNAPSHOT_MAX_PACKET_BYTES );
 
-    if ( !server->client_loopback[client_index] )
-    {
-#if SNAPSHOT_DEVELOPMENT
-        if ( server->config.network_simulator )
+        if ( snapshot_write_payload_iovec( iovec, buffer, SNAPSHOT_MAX_PACKET_BYTES, sequence, packet_key, server->config.protocol_id, &packet_bytes ) != SNAPSHOT_OK )
         {
-            snapshot_network_simulator_send_packet( server->config.network_simulator, &server->address, &server->client_address[client_index], packet_data, packet_bytes );
-            server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_SIMULATOR]++;
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to write payload packet for client %d", client_index );
+            return;
         }
-        else
-#endif // #if SNAPSHOT_DEVELOPMENT
+
+        snapshot_server_queue_commit( server, &server->client_hot[client_index].address, packet_bytes );
+        server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT]++;
+
+        if ( pacing && server->txtime )
         {
-            snapshot_platform_socket_send_packet( server->socket, &server->client_address[client_index], packet_data, packet_bytes );
-            server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT]++;
+            server->send_queue_send_time[server->send_queue_num_packets - 1] = send_time;
+            server->counters[SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT]++;
         }
     }
     else
     {
-        server->config.send_loopback_packet_callback( server->config.context, &server->address, packet_data, packet_bytes );
-        server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_SENT_LOOPBACK]++;
+        uint8_t buffer[SNAPSHOT_MAX_PACKET_BYTES];
+
+        if ( snapshot_write_payload_iovec( iovec, buffer, SNAPSHOT_MAX_PACKET_BYTES, sequence, packet_key, server->config.protocol_id, &packet_bytes ) != SNAPSHOT_OK )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to write payload packet for client %d", client_index );
+            return;
+        }
+
+        snapshot_server_send_packet_data_to_client( server, client_index, buffer, packet_bytes );
     }
 
-    server->client_sequence[client_index]++;
+    server->client_hot[client_index].sequence++;
 }
 
 void snapshot_server_disconnect_client_internal( struct snapshot_server_t * server, int client_index, int send_disconnect_packets )
@@ -397,17 +1071,17 @@ void snapshot_server_disconnect_client_internal( struct snapshot_server_t * serv
     snapshot_assert( server );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    snapshot_assert( server->client_connected[client_index] );
-    snapshot_assert( !server->client_loopback[client_index] );
-    snapshot_assert( server->encryption_manager.client_index[server->client_encryption_index[client_index]] == client_index );
+    snapshot_assert( server->client_hot[client_index].connected );
+    snapshot_assert( !server->client_hot[client_index].loopback );
+    snapshot_assert( server->encryption_manager->client_index[server->client_hot[client_index].encryption_index] == client_index );
 
     char client_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
-    snapshot_address_to_string( &server->client_address[client_index], client_address_string );
+    snapshot_address_to_string( &server->client_hot[client_index].address, client_address_string );
     snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server disconnected client %s [%.16" PRIx64 "] from slot %d", client_address_string, server->client_id[client_index], client_index );
 
     if ( server->config.connect_disconnect_callback )
     {
-        server->config.connect_disconnect_callback( server->config.context, client_index, 0 );
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
     }
 
     if ( send_disconnect_packets )
@@ -435,23 +1109,30 @@ void snapshot_server_disconnect_client_internal( struct snapshot_server_t * serv
         snapshot_endpoint_reset( server->client_endpoint[client_index] );
     }
 
-    server->encryption_manager.client_index[server->client_encryption_index[client_index]] = -1;
+    snapshot_server_reset_client_snapshot( server, client_index );
+
+    snapshot_server_reset_client_pacing( server, client_index );
 
-    snapshot_encryption_manager_remove_encryption_mapping( &server->encryption_manager, &server->client_address[client_index], server->time );
+    server->encryption_manager->client_index[server->client_hot[client_index].encryption_index] = -1;
 
-    server->client_connected[client_index] = 0;
-    server->client_confirmed[client_index] = 0;
+    snapshot_encryption_manager_remove_encryption_mapping( server->encryption_manager, &server->client_hot[client_index].address, server->time );
+
+    snapshot_address_map_remove( &server->client_address_map, &server->client_hot[client_index].address );
+
+    snapshot_timer_wheel_cancel( server->timer_wheel, client_index );
+    snapshot_timer_wheel_cancel( server->timer_wheel, server->max_clients + client_index );
+
+    server->client_hot[client_index].connected = 0;
+    server->client_hot[client_index].confirmed = 0;
     server->client_id[client_index] = 0;
-    server->client_sequence[client_index] = 0;
-    server->client_last_internal_packet_send_time[client_index] = 0.0;
-    server->client_last_packet_receive_time[client_index] = 0.0;
-    memset( &server->client_address[client_index], 0, sizeof( struct snapshot_address_t ) );
-    server->client_encryption_index[client_index] = -1;
+    server->client_hot[client_index].sequence = 0;
+    server->client_hot[client_index].last_internal_packet_send_time = 0.0;
+    server->client_hot[client_index].last_packet_receive_time = 0.0;
+    memset( &server->client_hot[client_index].address, 0, sizeof( struct snapshot_address_t ) );
+    server->client_hot[client_index].encryption_index = -1;
     memset( server->client_user_data[client_index], 0, SNAPSHOT_USER_DATA_BYTES );
 
-    server->num_connected_clients--;
-
-    snapshot_assert( server->num_connected_clients >= 0 );
+    snapshot_server_remove_connected_client( server, client_index );
 
     server->counters[SNAPSHOT_SERVER_COUNTER_CLIENT_DISCONNECTS]++;
 }
@@ -462,12 +1143,12 @@ void snapshot_server_disconnect_client( struct snapshot_server_t * server, int c
 
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    snapshot_assert( server->client_loopback[client_index] == 0 );
+    snapshot_assert( server->client_hot[client_index].loopback == 0 );
 
-    if ( !server->client_connected[client_index] )
+    if ( !server->client_hot[client_index].connected )
         return;
 
-    if ( server->client_loopback[client_index] )
+    if ( server->client_hot[client_index].loopback )
         return;
 
     snapshot_server_disconnect_client_internal( server, client_index, 1 );
@@ -477,12 +1158,14 @@ void snapshot_server_disconnect_all_clients( struct snapshot_server_t * server )
 {
     snapshot_assert( server );
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
+    // walk backwards, so the swap remove on disconnect only moves clients that were already visited
+
+    for ( int i = server->num_connected_clients - 1; i >= 0; --i )
     {
-        if ( server->client_connected[i] && !server->client_loopback[i] )
+        const int client_index = server->connected_clients[i];
+        if ( !server->client_hot[client_index].loopback )
         {
-            snapshot_server_disconnect_client_internal( server, i, 1 );
+            snapshot_server_disconnect_client_internal( server, client_index, 1 );
         }
     }
 }
@@ -491,11 +1174,11 @@ int snapshot_server_find_client_index_by_id( struct snapshot_server_t * server,
 {
     snapshot_assert( server );
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {   
-        if ( server->client_connected[i] && server->client_id[i] == client_id )
-            return i;
+    for ( int i = 0; i < server->num_connected_clients; ++i )
+    {
+        const int client_index = server->connected_clients[i];
+        if ( server->client_id[client_index] == client_id )
+            return client_index;
     }
 
     return -1;
@@ -509,14 +1192,7 @@ int snapshot_server_find_client_index_by_address( struct snapshot_server_t * ser
     if ( address->type == 0 )
         return -1;
 
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {   
-        if ( server->client_connected[i] && snapshot_address_equal( &server->client_address[i], address ) )
-            return i;
-    }
-
-    return -1;
+    return snapshot_address_map_find( &server->client_address_map, address );
 }
 
 void snapshot_server_process_connection_request_packet( snapshot_server_t * server, 
@@ -564,6 +1240,7 @@ void snapshot_server_process_connection_request_packet( snapshot_server_t * serv
     }
 
     if ( !snapshot_connect_token_entries_find_or_add( server->connect_token_entries, 
+                                                      server->num_connect_token_entries,
                                                       from, 
                                                       packet->connect_token_data + SNAPSHOT_CONNECT_TOKEN_PRIVATE_BYTES - SNAPSHOT_MAC_BYTES, 
                                                       server->time ) )
@@ -588,7 +1265,7 @@ void snapshot_server_process_connection_request_packet( snapshot_server_t * serv
 
     double expire_time = ( connect_token_private.timeout_seconds >= 0 ) ? server->time + connect_token_private.timeout_seconds : -1.0;
 
-    if ( !snapshot_encryption_manager_add_encryption_mapping( &server->encryption_manager, 
+    if ( !snapshot_encryption_manager_add_encryption_mapping( server->encryption_manager, 
                                                               from, 
                                                               connect_token_private.server_to_client_key, 
                                                               connect_token_private.client_to_server_key, 
@@ -633,13 +1310,33 @@ int snapshot_server_find_free_client_index( struct snapshot_server_t * server )
     int i;
     for ( i = 0; i < server->max_clients; ++i )
     {
-        if ( !server->client_connected[i] )
+        if ( !server->client_hot[i].connected )
             return i;
     }
 
     return -1;
 }
 
+void snapshot_server_send_keep_alive( struct snapshot_server_t * server, int client_index )
+{
+    snapshot_assert( server );
+    snapshot_assert( server->client_hot[client_index].connected );
+    snapshot_assert( !server->client_hot[client_index].loopback );
+
+    snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server sent keep alive packet to client %d", client_index );
+    struct snapshot_keep_alive_packet_t packet;
+    packet.packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
+    packet.client_index = server->client_reported_index[client_index];
+    packet.max_clients = server->config.reported_max_clients > 0 ? server->config.reported_max_clients : server->max_clients;
+    packet.ack = 0;
+    packet.ack_bits = 0;
+    snapshot_server_send_packet_to_client( server, client_index, &packet );
+    server->counters[SNAPSHOT_SERVER_COUNTER_KEEP_ALIVE_PACKETS_SENT]++;
+    server->client_hot[client_index].last_internal_packet_send_time = server->time;
+
+    snapshot_timer_wheel_schedule( server->timer_wheel, client_index, server->time + SNAPSHOT_SERVER_KEEP_ALIVE_SECONDS );
+}
+
 void snapshot_server_connect_client( struct snapshot_server_t * server, 
                                      int client_index, 
                                      const struct snapshot_address_t * address, 
@@ -654,46 +1351,38 @@ void snapshot_server_connect_client( struct snapshot_server_t * server,
     snapshot_assert( address );
     snapshot_assert( encryption_index != -1 );
     snapshot_assert( user_data );
-    snapshot_assert( server->encryption_manager.client_index[encryption_index] == -1 );
+    snapshot_assert( server->encryption_manager->client_index[encryption_index] == -1 );
+    snapshot_assert( server->client_hot[client_index].connected == 0 );
 
-    server->num_connected_clients++;
-
-    snapshot_assert( server->num_connected_clients <= server->max_clients );
+    snapshot_server_add_connected_client( server, client_index );
 
-    snapshot_assert( server->client_connected[client_index] == 0 );
-
-    snapshot_encryption_manager_set_expire_time( &server->encryption_manager, encryption_index, -1.0 );
+    snapshot_encryption_manager_set_expire_time( server->encryption_manager, encryption_index, -1.0 );
     
-    server->encryption_manager.client_index[encryption_index] = client_index;
+    server->encryption_manager->client_index[encryption_index] = client_index;
 
-    server->client_connected[client_index] = 1;
-    server->client_timeout[client_index] = timeout_seconds;
-    server->client_encryption_index[client_index] = encryption_index;
+    server->client_hot[client_index].connected = 1;
+    server->client_hot[client_index].timeout = timeout_seconds;
+    server->client_hot[client_index].encryption_index = encryption_index;
     server->client_id[client_index] = client_id;
-    server->client_sequence[client_index] = 0;
-    server->client_address[client_index] = *address;
-    server->client_last_internal_packet_send_time[client_index] = server->time;
-    server->client_last_packet_receive_time[client_index] = server->time;
+    server->client_hot[client_index].sequence = 0;
+    server->client_hot[client_index].address = *address;
+    server->client_hot[client_index].last_internal_packet_send_time = server->time;
+    server->client_hot[client_index].last_packet_receive_time = server->time;
     memcpy( server->client_user_data[client_index], user_data, SNAPSHOT_USER_DATA_BYTES );
 
+    snapshot_address_map_insert( &server->client_address_map, address, client_index );
+
     char address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
 
     snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server accepted client %s [%.16" PRIx64 "] in slot %d", snapshot_address_to_string( address, address_string ), client_id, client_index );
 
-    struct snapshot_keep_alive_packet_t packet;
-    packet.packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
-    packet.client_index = client_index;
-    packet.max_clients = server->max_clients;
-
-    snapshot_server_send_packet_to_client( server, client_index, &packet );
-
-    server->counters[SNAPSHOT_SERVER_COUNTER_KEEP_ALIVE_PACKETS_SENT]++;
+    snapshot_server_send_keep_alive( server, client_index );
 
-    server->client_last_internal_packet_send_time[client_index] = server->time;
+    snapshot_server_schedule_client_timeout( server, client_index );
 
     if ( server->config.connect_disconnect_callback )
     {
-        server->config.connect_disconnect_callback( server->config.context, client_index, 1 );
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
     }
 
     server->counters[SNAPSHOT_SERVER_COUNTER_CLIENT_CONNECTS]++;
@@ -722,7 +1411,7 @@ void snapshot_server_process_connection_response_packet( struct snapshot_server_
         return;
     }
 
-    uint8_t * packet_send_key = snapshot_encryption_manager_get_send_key( &server->encryption_manager, encryption_index );
+    uint8_t * packet_send_key = snapshot_encryption_manager_get_send_key( server->encryption_manager, encryption_index );
 
     if ( !packet_send_key )
     {
@@ -758,7 +1447,28 @@ void snapshot_server_process_connection_response_packet( struct snapshot_server_
 
     snapshot_assert( client_index != -1 );
 
-    int timeout_seconds = snapshot_encryption_manager_get_timeout( &server->encryption_manager, encryption_index );
+    server->client_reported_index[client_index] = client_index;
+
+    if ( server->config.assign_client_index_callback )
+    {
+        const int reported_index = server->config.assign_client_index_callback( server->config.callback_context, client_index );
+
+        if ( reported_index < 0 )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server denied connection response. no client index assigned" );
+
+            struct snapshot_connection_denied_packet_t p;
+            p.packet_type = SNAPSHOT_CONNECTION_DENIED_PACKET;
+
+            snapshot_server_send_global_packet( server, &p, from, packet_send_key );
+
+            return;
+        }
+
+        server->client_reported_index[client_index] = reported_index;
+    }
+
+    int timeout_seconds = snapshot_encryption_manager_get_timeout( server->encryption_manager, encryption_index );
 
     snapshot_server_connect_client( server, client_index, from, challenge_token.client_id, encryption_index, timeout_seconds, challenge_token.user_data );
 }
@@ -771,9 +1481,9 @@ int snapshot_server_process_payload( struct snapshot_server_t * server, int clie
     snapshot_assert( payload_data );
     snapshot_assert( payload_bytes > 0 );
     snapshot_assert( payload_bytes <= SNAPSHOT_MAX_PAYLOAD_BYTES );
-    snapshot_assert( server->client_connected[client_index] );
+    snapshot_assert( server->client_hot[client_index].connected );
 
-    if ( !server->client_connected[client_index] )
+    if ( !server->client_hot[client_index].connected )
         return SNAPSHOT_ERROR;
 
 #if SNAPSHOT_DEVELOPMENT
@@ -789,11 +1499,11 @@ int snapshot_server_process_payload( struct snapshot_server_t * server, int clie
 
 #endif // #if SNAPSHOT_DEVELOPMENT
 
-    // todo: process the real payload
+    if ( server->config.process_payload_callback != NULL )
+    {
+        server->config.process_payload_callback( server->config.callback_context, client_index, payload_data, payload_bytes );
+    }
 
-    (void) server;
-    (void) client_index;
-    
     return SNAPSHOT_OK;
 }
 
@@ -809,7 +1519,7 @@ void snapshot_server_process_passthrough( struct snapshot_server_t * server, con
 
     if ( server->config.process_passthrough_callback != NULL )
     {
-        server->config.process_passthrough_callback( server->config.context, client_address, client_index, passthrough_data, passthrough_bytes );
+        server->config.process_passthrough_callback( server->config.callback_context, client_address, client_index, passthrough_data, passthrough_bytes );
     }
 }
 
@@ -834,14 +1544,14 @@ bool snapshot_server_process_packet( struct snapshot_server_t * server, const st
     {
         snapshot_assert( client_index >= 0 );
         snapshot_assert( client_index < server->max_clients );
-        encryption_index = server->client_encryption_index[client_index];
+        encryption_index = server->client_hot[client_index].encryption_index;
     }
     else
     {
-        encryption_index = snapshot_encryption_manager_find_encryption_mapping( &server->encryption_manager, from, server->time );
+        encryption_index = snapshot_encryption_manager_find_encryption_mapping( server->encryption_manager, from, server->time );
     }
     
-    uint8_t * read_packet_key = snapshot_encryption_manager_get_receive_key( &server->encryption_manager, encryption_index );
+    uint8_t * read_packet_key = snapshot_encryption_manager_get_receive_key( server->encryption_manager, encryption_index );
 
     if ( !read_packet_key && packet_data[0] != 0 )
     {
@@ -910,11 +1620,14 @@ bool snapshot_server_process_packet( struct snapshot_server_t * server, const st
             if ( client_index != -1 )
             {
                 snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server received keep alive packet from client %d", client_index );
-                server->client_last_packet_receive_time[client_index] = server->time;
-                if ( !server->client_confirmed[client_index] )
+                server->client_hot[client_index].last_packet_receive_time = server->time;
+                snapshot_server_schedule_client_timeout( server, client_index );
+                struct snapshot_keep_alive_packet_t * p = (struct snapshot_keep_alive_packet_t*) packet;
+                snapshot_endpoint_process_acks( server->client_endpoint[client_index], p->ack, p->ack_bits );
+                if ( !server->client_hot[client_index].confirmed )
                 {
                     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server confirmed connection with client %d", client_index );
-                    server->client_confirmed[client_index] = 1;
+                    server->client_hot[client_index].confirmed = 1;
                 }
                 return true;
             }
@@ -928,22 +1641,22 @@ bool snapshot_server_process_packet( struct snapshot_server_t * server, const st
             if ( client_index != -1 )
             {
                 snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server received payload packet from client %d", client_index );
-                server->client_last_packet_receive_time[client_index] = server->time;
-                if ( !server->client_confirmed[client_index] )
+                server->client_hot[client_index].last_packet_receive_time = server->time;
+                snapshot_server_schedule_client_timeout( server, client_index );
+                if ( !server->client_hot[client_index].confirmed )
                 {
                     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server confirmed connection with client %d", client_index );
-                    server->client_confirmed[client_index] = 1;
+                    server->client_hot[client_index].confirmed = 1;
                 }
                 struct snapshot_payload_packet_t * payload_packet = (snapshot_payload_packet_t*) packet;
                 uint8_t * payload_packet_data = payload_packet->payload_data;
                 int payload_packet_bytes = payload_packet->payload_bytes;
-                uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
                 uint8_t * payload_data = NULL;
                 int payload_bytes = 0;
                 uint16_t payload_sequence = 0;
                 uint16_t payload_ack = 0;
                 uint32_t payload_ack_bits = 0;
-                snapshot_endpoint_process_packet( server->client_endpoint[client_index], payload_packet_data, payload_packet_bytes, buffer, &payload_data, &payload_bytes, &payload_sequence, &payload_ack, &payload_ack_bits );
+                snapshot_endpoint_process_packet( server->client_endpoint[client_index], payload_packet_data, payload_packet_bytes, &payload_data, &payload_bytes, &payload_sequence, &payload_ack, &payload_ack_bits );
                 if ( payload_data )
                 {
                     if ( snapshot_server_process_payload( server, client_index, payload_data, payload_bytes ) == SNAPSHOT_OK )
@@ -963,14 +1676,15 @@ bool snapshot_server_process_packet( struct snapshot_server_t * server, const st
             if ( client_index != -1 )
             {
                 snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server received passthrough packet from client %d", client_index );
-                server->client_last_packet_receive_time[client_index] = server->time;
-                if ( !server->client_confirmed[client_index] )
+                server->client_hot[client_index].last_packet_receive_time = server->time;
+                snapshot_server_schedule_client_timeout( server, client_index );
+                if ( !server->client_hot[client_index].confirmed )
                 {
                     snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server confirmed connection with client %d", client_index );
-                    server->client_confirmed[client_index] = 1;
+                    server->client_hot[client_index].confirmed = 1;
                 }
                 struct snapshot_passthrough_packet_t * passthrough_packet = (snapshot_passthrough_packet_t*) packet;
-                snapshot_server_process_passthrough( server, &server->client_address[client_index], client_index, passthrough_packet->passthrough_data, passthrough_packet->passthrough_bytes );
+                snapshot_server_process_passthrough( server, &server->client_hot[client_index].address, client_index, passthrough_packet->passthrough_data, passthrough_packet->passthrough_bytes );
                 return true;
             }
         }
@@ -1007,7 +1721,7 @@ void snapshot_server_receive_packets( struct snapshot_server_t * server )
 
         int num_packets_received = snapshot_network_simulator_receive_packets( server->config.network_simulator, 
                                                                                &server->address, 
-                                                                               SNAPSHOT_SERVER_MAX_SIM_RECEIVE_PACKETS, 
+                                                                               server->max_sim_receive_packets, 
                                                                                server->sim_receive_packet_data, 
                                                                                server->sim_receive_packet_bytes, 
                                                                                server->sim_receive_from );
@@ -1023,66 +1737,30 @@ void snapshot_server_receive_packets( struct snapshot_server_t * server )
     else
 #endif // #if SNAPSHOT_DEVELOPMENT
     {
-        // process packets received from socket
+        // process packets received from socket, draining it in batches. a short batch doesn't mean the socket is empty,
+        // and neither does one where every packet was dropped for being truncated or from an unknown address family, so
+        // keep going until the socket itself has nothing left to give
 
-        while ( 1 )
+        while ( server->socket != NULL )
         {
-            struct snapshot_address_t from;
-            
-            uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
-            uint8_t* packet_data = buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
-
-            int packet_bytes = 0;
-            
-            if ( server->socket != NULL )
+            int num_datagrams_received = 0;
+
+            int num_packets_received = snapshot_platform_socket_receive_packets( server->socket, 
+                                                                                 server->receive_from, 
+                                                                                 server->receive_packet_data, 
+                                                                                 server->receive_packet_bytes, 
+                                                                                 SNAPSHOT_MAX_PACKET_BYTES, 
+                                                                                 SNAPSHOT_SERVER_RECEIVE_BATCH_SIZE,
+                                                                                 &num_datagrams_received );
+
+            for ( int i = 0; i < num_packets_received; ++i )
             {
-                packet_bytes = snapshot_platform_socket_receive_packet( server->socket, &from, packet_data + SNAPSHOT_PACKET_PREFIX_BYTES, SNAPSHOT_MAX_PACKET_BYTES );
+                server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_RECEIVED]++;
+                snapshot_server_process_packet( server, &server->receive_from[i], (uint8_t*) server->receive_packet_data[i], server->receive_packet_bytes[i] );
             }
 
-            if ( packet_bytes == 0 )
+            if ( num_datagrams_received == 0 )
                 break;
-
-            server->counters[SNAPSHOT_SERVER_COUNTER_PACKETS_RECEIVED]++;
-
-            snapshot_server_process_packet( server, &from, packet_data + SNAPSHOT_PACKET_PREFIX_BYTES, packet_bytes );
-        }
-    }
-}
-
-void snapshot_server_send_packets( struct snapshot_server_t * server )
-{
-    snapshot_assert( server );
-
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( server->client_connected[i] && !server->client_loopback[i] &&
-             ( server->client_last_internal_packet_send_time[i] + 0.1 <= server->time ) )
-        {
-            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "server sent keep alive packet to client %d", i );
-            struct snapshot_keep_alive_packet_t packet;
-            packet.packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
-            packet.client_index = i;
-            packet.max_clients = server->max_clients;
-            snapshot_server_send_packet_to_client( server, i, &packet );
-            server->counters[SNAPSHOT_SERVER_COUNTER_KEEP_ALIVE_PACKETS_SENT]++;
-            server->client_last_internal_packet_send_time[i] = server->time;
-        }
-    }
-}
-
-void snapshot_server_check_for_timeouts( struct snapshot_server_t * server )
-{
-    snapshot_assert( server );
-
-    int i;
-    for ( i = 0; i < server->max_clients; ++i )
-    {
-        if ( server->client_connected[i] && server->client_timeout[i] > 0 && !server->client_loopback[i] &&
-             ( server->client_last_packet_receive_time[i] + server->client_timeout[i] <= server->time ) )
-        {
-            snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server timed out client %d", i );
-            snapshot_server_disconnect_client_internal( server, i, 0 );
         }
     }
 }
@@ -1094,7 +1772,7 @@ int snapshot_server_client_connected( struct snapshot_server_t * server, int cli
     if ( client_index < 0 || client_index >= server->max_clients )
         return 0;
 
-    return server->client_connected[client_index];
+    return server->client_hot[client_index].connected;
 }
 
 uint64_t snapshot_server_client_id( struct snapshot_server_t * server, int client_index )
@@ -1114,7 +1792,7 @@ struct snapshot_address_t * snapshot_server_client_address( struct snapshot_serv
     if (client_index < 0 || client_index >= server->max_clients)
         return NULL;
 
-    return &server->client_address[client_index];
+    return &server->client_hot[client_index].address;
 }
 
 int snapshot_server_num_connected_clients( struct snapshot_server_t * server )
@@ -1141,15 +1819,127 @@ int snapshot_server_max_clients( struct snapshot_server_t * server )
     return server->max_clients;
 }
 
+static struct snapshot_server_client_pacing_t * snapshot_server_pace_payload( struct snapshot_server_t * server, int client_index, const struct snapshot_payload_iovec_t * iovecs, int num_iovecs )
+{
+    if ( !server->client_pacing || !snapshot_server_client_queued( server, client_index ) )
+        return NULL;
+
+    struct snapshot_server_client_pacing_t * pacing = &server->client_pacing[client_index];
+
+    // a lone packet only waits if there is something ahead of it, so it doesn't overtake the rest of a train
+
+    const double current_time = snapshot_platform_time();
+
+    if ( num_iovecs <= 1 && pacing->num_packets == 0 && pacing->next_send_time <= current_time )
+        return NULL;
+
+    double pacing_rate_kbps = server->config.pacing_rate_kbps;
+
+    if ( server->config.enable_congestion_control )
+    {
+        const float endpoint_pacing_rate_kbps = snapshot_endpoint_pacing_rate( server->client_endpoint[client_index] );
+        if ( pacing_rate_kbps > endpoint_pacing_rate_kbps )
+            pacing_rate_kbps = endpoint_pacing_rate_kbps;
+    }
+
+    if ( pacing_rate_kbps <= 0.0 )
+        return NULL;
+
+    int train_bytes = 0;
+    for ( int i = 0; i < num_iovecs; i++ )
+    {
+        train_bytes += iovecs[i].header_bytes + iovecs[i].data_bytes;
+    }
+
+    // the train is squeezed if it would run past the next update, so trains never back up behind each other
+
+    pacing->seconds_per_byte = 8.0 / ( pacing_rate_kbps * 1000.0 );
+
+    if ( server->update_interval > 0.0 && train_bytes * pacing->seconds_per_byte > server->update_interval )
+    {
+        pacing->seconds_per_byte = server->update_interval / train_bytes;
+    }
+
+    if ( pacing->next_send_time < current_time )
+    {
+        pacing->next_send_time = current_time;
+    }
+
+    return pacing;
+}
+
+static void snapshot_server_send_payload_data_to_client( struct snapshot_server_t * server, int client_index, const uint8_t * payload_data, int payload_bytes )
+{
+    // fragments are gathered from the payload as they are written, so nothing is allocated per fragment
+
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+    snapshot_endpoint_write_payload_iovecs( server->client_endpoint[client_index], payload_data, payload_bytes, &num_iovecs, iovecs );
+
+    struct snapshot_server_client_pacing_t * pacing = snapshot_server_pace_payload( server, client_index, iovecs, num_iovecs );
+
+    for ( int i = 0; i < num_iovecs; i++ )
+    {
+        snapshot_server_send_payload_iovec_to_client( server, client_index, &iovecs[i], pacing );
+
+        server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOAD_PACKETS_SENT]++;
+    }
+
+    server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT]++;
+}
+
+static void snapshot_server_send_fragment_resends_to_client( struct snapshot_server_t * server, int client_index )
+{
+    struct snapshot_endpoint_t * endpoint = server->client_endpoint[client_index];
+
+    // report fragments missing from payloads the client is sending us, then resend the ones it says are missing from ours
+
+    uint8_t fragment_acks_data[SNAPSHOT_ENDPOINT_FRAGMENT_ACKS_BYTES];
+
+    const int fragment_acks_bytes = snapshot_endpoint_write_fragment_acks( endpoint, fragment_acks_data, sizeof( fragment_acks_data ) );
+
+    if ( fragment_acks_bytes > 0 )
+    {
+        struct snapshot_payload_iovec_t iovec;
+        iovec.header_bytes = 0;
+        iovec.data = fragment_acks_data;
+        iovec.data_bytes = fragment_acks_bytes;
+
+        snapshot_server_send_payload_iovec_to_client( server, client_index, &iovec, NULL );
+
+        server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOAD_PACKETS_SENT]++;
+    }
+
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+    snapshot_endpoint_write_resend_iovecs( endpoint, &num_iovecs, iovecs );
+
+    for ( int i = 0; i < num_iovecs; i++ )
+    {
+        snapshot_server_send_payload_iovec_to_client( server, client_index, &iovecs[i], NULL );
+
+        server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOAD_PACKETS_SENT]++;
+    }
+}
+
 void snapshot_server_send_payload_to_client( struct snapshot_server_t * server, int client_index )
 {
     snapshot_assert( server );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
 
-    if ( !server->client_connected[client_index] )
+    if ( !server->client_hot[client_index].connected )
         return;
 
+    snapshot_endpoint_update( server->client_endpoint[client_index], server->time );
+
+    if ( server->config.enable_fragment_resend )
+    {
+        snapshot_server_send_fragment_resends_to_client( server, client_index );
+    }
+
 #if SNAPSHOT_DEVELOPMENT
 
     // test payload for validation
@@ -1162,66 +1952,163 @@ void snapshot_server_send_payload_to_client( struct snapshot_server_t * server,
 
         snapshot_generate_packet_data( payload_data, payload_bytes, SNAPSHOT_MAX_PAYLOAD_BYTES );
 
-        int num_packets = 0;
-        uint8_t * packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        snapshot_server_send_payload_data_to_client( server, client_index, payload_data, payload_bytes );
 
-        snapshot_endpoint_write_packets( server->client_endpoint[client_index], payload_data, payload_bytes, &num_packets, &packet_data[0], &packet_bytes[0] );
+        snapshot_destroy_packet( server->config.context, payload_data );
 
-        if ( num_packets == 1 )
-        {
-            // send whole packet
+        return;
+    }
+#endif // #if SNAPSHOT_DEVELOPMENT
 
-            snapshot_payload_packet_t * packet = snapshot_wrap_payload_packet( packet_data[0], packet_bytes[0] );
+    if ( !server->snapshot_world )
+        return;
 
-            snapshot_server_send_packet_to_client( server, client_index, packet );
+    struct snapshot_endpoint_t * endpoint = server->client_endpoint[client_index];
+    struct snapshot_server_client_snapshot_t * client_snapshot = &server->client_snapshot[client_index];
 
-            server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOAD_PACKETS_SENT]++;
-        }
-        else
-        {
-            // send fragments
+    // objects are marked acked as the client acks the payload packets that carried them
 
-            for ( int i = 0; i < num_packets; i++ )
-            {
-                snapshot_payload_packet_t * packet = snapshot_wrap_payload_packet( packet_data[i], packet_bytes[i] );
+    int num_acks = 0;
+    uint16_t * acks = snapshot_endpoint_get_acks( endpoint, &num_acks );
+    snapshot_delta_client_acked( client_snapshot->delta, acks, num_acks );
+    snapshot_endpoint_clear_acks( endpoint );
 
-                snapshot_server_send_packet_to_client( server, client_index, packet );
+    // the send rate is the configured bandwidth, held to a little over what the client has been acking so it can only ramp up
+    // as fast as the connection keeps up. with congestion control on, the endpoint pacing rate does that job instead. the
+    // budget fills at that rate each update, and never holds more than one payload
 
-                server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOAD_PACKETS_SENT]++;
+    double bandwidth_kbps = server->config.snapshot_bandwidth_kbps;
+    double max_budget_bytes = SNAPSHOT_MAX_PAYLOAD_BYTES;
 
-                snapshot_destroy_packet( server->config.context, packet_data[i] );
-            }
+    if ( server->config.enable_congestion_control )
+    {
+        const float pacing_rate_kbps = snapshot_endpoint_pacing_rate( endpoint );
+        if ( bandwidth_kbps > pacing_rate_kbps )
+            bandwidth_kbps = pacing_rate_kbps;
+        max_budget_bytes = snapshot_endpoint_max_payload_bytes( endpoint );
+    }
+    else
+    {
+        float sent_bandwidth_kbps, received_bandwidth_kbps, acked_bandwidth_kbps;
+        snapshot_endpoint_bandwidth( endpoint, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+        if ( acked_bandwidth_kbps > 0.0f )
+        {
+            double acked_limit_kbps = acked_bandwidth_kbps * SNAPSHOT_SERVER_SNAPSHOT_BANDWIDTH_GROWTH;
+            if ( acked_limit_kbps < SNAPSHOT_SERVER_SNAPSHOT_MIN_BANDWIDTH_KBPS )
+                acked_limit_kbps = SNAPSHOT_SERVER_SNAPSHOT_MIN_BANDWIDTH_KBPS;
+            if ( bandwidth_kbps > acked_limit_kbps )
+                bandwidth_kbps = acked_limit_kbps;
         }
+    }
 
-        snapshot_destroy_packet( server->config.context, payload_data );
+    if ( server->time > client_snapshot->last_update_time )
+    {
+        client_snapshot->budget_bytes += bandwidth_kbps * 1000.0 / 8.0 * ( server->time - client_snapshot->last_update_time );
+    }
+    if ( client_snapshot->budget_bytes > max_budget_bytes )
+    {
+        client_snapshot->budget_bytes = max_budget_bytes;
+    }
+    client_snapshot->last_update_time = server->time;
+
+    uint32_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES / 4];
+
+    int num_deferred = 0;
+
+    const int payload_bytes = snapshot_delta_client_write( client_snapshot->delta, snapshot_endpoint_sequence( endpoint ), (uint8_t*) payload_data, (int) client_snapshot->budget_bytes, &num_deferred );
 
-        server->counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT]++;
+    server->counters[SNAPSHOT_SERVER_COUNTER_SNAPSHOT_OBJECTS_DEFERRED] += num_deferred;
 
+    if ( payload_bytes == 0 )
         return;
+
+    client_snapshot->budget_bytes -= payload_bytes;
+
+    snapshot_server_send_payload_data_to_client( server, client_index, (const uint8_t*) payload_data, payload_bytes );
+}
+
+void snapshot_server_update_clients( struct snapshot_server_t * server )
+{
+    snapshot_assert( server );
+
+    if ( server->snapshot_world )
+    {
+        snapshot_delta_world_advance( server->snapshot_world );
     }
-#endif // #if SNAPSHOT_DEVELOPMENT
 
-    // todo: generate real payload
+    for ( int i = 0; i < server->num_connected_clients; ++i )
+    {
+        snapshot_server_send_payload_to_client( server, server->connected_clients[i] );
+    }
 }
 
-void snapshot_server_send_payloads( struct snapshot_server_t * server )
+void snapshot_server_process_timers( struct snapshot_server_t * server )
 {
     snapshot_assert( server );
-    for ( int i = 0; i < server->max_clients; i++ )
+
+    // only clients and encryption mappings whose deadline has passed come out of the wheel
+
+    snapshot_timer_wheel_advance( server->timer_wheel, server->time );
+
+    const int max_clients = server->max_clients;
+
+    int timer_id;
+    while ( ( timer_id = snapshot_timer_wheel_pop_expired( server->timer_wheel ) ) != -1 )
     {
-        snapshot_server_send_payload_to_client( server, i );
+        if ( timer_id < max_clients )
+        {
+            const int client_index = timer_id;
+
+            if ( server->client_hot[client_index].connected && !server->client_hot[client_index].loopback )
+            {
+                snapshot_server_send_keep_alive( server, client_index );
+            }
+        }
+        else if ( timer_id < max_clients * 2 )
+        {
+            const int client_index = timer_id - max_clients;
+
+            if ( !server->client_hot[client_index].connected || server->client_hot[client_index].loopback || server->client_hot[client_index].timeout <= 0 )
+                continue;
+
+            if ( server->client_hot[client_index].last_packet_receive_time + server->client_hot[client_index].timeout <= server->time )
+            {
+                snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server timed out client %d", client_index );
+                snapshot_server_disconnect_client_internal( server, client_index, 0 );
+            }
+            else
+            {
+                snapshot_server_schedule_client_timeout( server, client_index );
+            }
+        }
+        else
+        {
+            snapshot_encryption_manager_process_expiry_timer( server->encryption_manager, timer_id - max_clients * 2, server->time );
+        }
     }
 }
 
 void snapshot_server_update( struct snapshot_server_t * server, double time )
 {
     snapshot_assert( server );
+
+    // paced packets are scheduled and released on the platform clock, so the time between updates that trains are squeezed
+    // into is measured on it too, whatever time the caller passes in
+
+    const double platform_time = snapshot_platform_time();
+    if ( server->last_update_platform_time > 0.0 && platform_time > server->last_update_platform_time )
+    {
+        server->update_interval = platform_time - server->last_update_platform_time;
+    }
+    server->last_update_platform_time = platform_time;
+
     server->time = time;
     snapshot_server_receive_packets( server );
-    snapshot_server_send_payloads( server );
-    snapshot_server_send_packets( server );
-    snapshot_server_check_for_timeouts( server );
+    snapshot_server_update_clients( server );
+    snapshot_server_process_timers( server );
+    snapshot_server_release_paced_packets( server );
+    snapshot_server_flush_packets( server );
 }
 
 void snapshot_server_connect_loopback_client( struct snapshot_server_t * server, int client_index, uint64_t client_id, const uint8_t * user_data )
@@ -1229,21 +2116,19 @@ void snapshot_server_connect_loopback_client( struct snapshot_server_t * server,
     snapshot_assert( server );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    snapshot_assert( !server->client_connected[client_index] );
-
-    server->num_connected_clients++;
+    snapshot_assert( !server->client_hot[client_index].connected );
 
-    snapshot_assert( server->num_connected_clients <= server->max_clients );
+    snapshot_server_add_connected_client( server, client_index );
 
-    server->client_connected[client_index] = 1;
-    server->client_loopback[client_index] = 1;
-    server->client_confirmed[client_index] = 1;
-    server->client_encryption_index[client_index] = -1;
+    server->client_hot[client_index].connected = 1;
+    server->client_hot[client_index].loopback = 1;
+    server->client_hot[client_index].confirmed = 1;
+    server->client_hot[client_index].encryption_index = -1;
     server->client_id[client_index] = client_id;
-    server->client_sequence[client_index] = 0;
-    memset( &server->client_address[client_index], 0, sizeof( struct snapshot_address_t ) );
-    server->client_last_internal_packet_send_time[client_index] = server->time - 1.0;
-    server->client_last_packet_receive_time[client_index] = server->time - 1.0;
+    server->client_hot[client_index].sequence = 0;
+    memset( &server->client_hot[client_index].address, 0, sizeof( struct snapshot_address_t ) );
+    server->client_hot[client_index].last_internal_packet_send_time = server->time - 1.0;
+    server->client_hot[client_index].last_packet_receive_time = server->time - 1.0;
 
     if ( user_data )
     {
@@ -1258,7 +2143,7 @@ void snapshot_server_connect_loopback_client( struct snapshot_server_t * server,
 
     if ( server->config.connect_disconnect_callback )
     {
-        server->config.connect_disconnect_callback( server->config.context, client_index, 1 );
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 1 );
     }
 
     server->counters[SNAPSHOT_SERVER_COUNTER_CLIENT_LOOPBACK_CONNECTS]++;
@@ -1269,30 +2154,30 @@ void snapshot_server_disconnect_loopback_client( struct snapshot_server_t * serv
     snapshot_assert( server );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    snapshot_assert( server->client_connected[client_index] );
-    snapshot_assert( server->client_loopback[client_index] );
+    snapshot_assert( server->client_hot[client_index].connected );
+    snapshot_assert( server->client_hot[client_index].loopback );
 
     snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "server disconnected loopback client %d", client_index );
 
     if ( server->config.connect_disconnect_callback )
     {
-        server->config.connect_disconnect_callback( server->config.context, client_index, 0 );
+        server->config.connect_disconnect_callback( server->config.callback_context, client_index, 0 );
     }
 
-    server->client_connected[client_index] = 0;
-    server->client_loopback[client_index] = 0;
-    server->client_confirmed[client_index] = 0;
+    server->client_hot[client_index].connected = 0;
+    server->client_hot[client_index].loopback = 0;
+    server->client_hot[client_index].confirmed = 0;
     server->client_id[client_index] = 0;
-    server->client_sequence[client_index] = 0;
-    server->client_last_internal_packet_send_time[client_index] = 0.0;
-    server->client_last_packet_receive_time[client_index] = 0.0;
-    memset( &server->client_address[client_index], 0, sizeof( struct snapshot_address_t ) );
-    server->client_encryption_index[client_index] = -1;
+    server->client_hot[client_index].sequence = 0;
+    server->client_hot[client_index].last_internal_packet_send_time = 0.0;
+    server->client_hot[client_index].last_packet_receive_time = 0.0;
+    memset( &server->client_hot[client_index].address, 0, sizeof( struct snapshot_address_t ) );
+    server->client_hot[client_index].encryption_index = -1;
     memset( server->client_user_data[client_index], 0, SNAPSHOT_USER_DATA_BYTES );
 
-    server->num_connected_clients--;
+    snapshot_server_reset_client_snapshot( server, client_index );
 
-    snapshot_assert( server->num_connected_clients >= 0 );
+    snapshot_server_remove_connected_client( server, client_index );
 
     server->counters[SNAPSHOT_SERVER_COUNTER_CLIENT_LOOPBACK_DISCONNECTS]++;
 }
@@ -1323,7 +2208,7 @@ int snapshot_server_client_loopback( struct snapshot_server_t * server, int clie
     snapshot_assert( server );
     snapshot_assert( client_index >= 0 );
     snapshot_assert( client_index < server->max_clients );
-    return server->client_loopback[client_index];
+    return server->client_hot[client_index].loopback;
 }
 
 uint16_t snapshot_server_port( struct snapshot_server_t * server )
@@ -1348,6 +2233,20 @@ void snapshot_server_set_development_flags( struct snapshot_server_t * server, u
 
 #endif // #if SNAPSHOT_DEVELOPMENT
 
+void snapshot_server_set_snapshot_object( struct snapshot_server_t * server, int object_index, const uint8_t * object_data )
+{
+    snapshot_assert( server );
+    snapshot_assert( server->snapshot_world );
+    snapshot_delta_world_set_object( server->snapshot_world, object_index, object_data );
+}
+
+void snapshot_server_set_snapshot_object_priority( struct snapshot_server_t * server, int object_index, float priority )
+{
+    snapshot_assert( server );
+    snapshot_assert( server->snapshot_world );
+    snapshot_delta_world_set_object_priority( server->snapshot_world, object_index, priority );
+}
+
 const uint64_t * snapshot_server_counters( struct snapshot_server_t * server )
 {
     snapshot_assert( server );
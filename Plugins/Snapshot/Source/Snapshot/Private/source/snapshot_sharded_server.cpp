@@ -0,0 +1,710 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_sharded_server.h"
+#include "snapshot_server.h"
+#include "snapshot_address.h"
+#include "snapshot_platform.h"
+#include "snapshot_packets.h"
+#include "snapshot_spsc_queue.h"
+
+#include <atomic>
+
+#define SNAPSHOT_SHARDED_SERVER_EVENTS_PER_CLIENT                                    4
+#define SNAPSHOT_SHARDED_SERVER_COMMANDS_PER_CLIENT                                  4
+#define SNAPSHOT_SHARDED_SERVER_MIN_QUEUE_SIZE                                      16
+#define SNAPSHOT_SHARDED_SERVER_SHARD_HEADROOM                                       2
+#define SNAPSHOT_SHARDED_SERVER_WORKER_SLEEP_SECONDS                             0.001
+
+#define SNAPSHOT_SHARDED_SERVER_EVENT_CONNECT                                        0
+#define SNAPSHOT_SHARDED_SERVER_EVENT_DISCONNECT                                     1
+#define SNAPSHOT_SHARDED_SERVER_EVENT_PAYLOAD                                        2
+#define SNAPSHOT_SHARDED_SERVER_EVENT_PASSTHROUGH                                    3
+
+#define SNAPSHOT_SHARDED_SERVER_COMMAND_SEND_PASSTHROUGH                             0
+#define SNAPSHOT_SHARDED_SERVER_COMMAND_DISCONNECT_CLIENT                            1
+#define SNAPSHOT_SHARDED_SERVER_COMMAND_SET_DEVELOPMENT_FLAGS                        2
+
+// events flow from a worker to the game thread, commands flow from the game thread to a worker. both use the same layout
+
+struct snapshot_sharded_server_message_t
+{
+    int type;
+    int client_index;
+    int shard_client_index;
+    uint64_t client_id;
+    uint64_t flags;
+    struct snapshot_address_t address;
+    int bytes;
+    uint8_t data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+};
+
+struct snapshot_sharded_server_shard_t
+{
+    struct snapshot_sharded_server_t * sharded_server;
+    int shard_index;
+    struct snapshot_server_t * server;
+    struct snapshot_platform_thread_t * thread;
+    struct snapshot_spsc_queue_t * event_queue;
+    struct snapshot_spsc_queue_t * command_queue;
+    int * client_index;
+};
+
+struct snapshot_sharded_server_t
+{
+    struct snapshot_server_config_t config;
+    int num_shards;
+    int shard_max_clients;
+    int max_clients;
+    int num_connected_clients;
+    uint16_t port;
+    struct snapshot_platform_mutex_t client_slot_mutex;
+    bool client_slot_mutex_created;
+    int * client_slot_used;
+    int * client_shard;
+    int * client_shard_index;
+    int * client_connected;
+    uint64_t * client_id;
+    struct snapshot_address_t * client_address;
+    uint8_t (*client_user_data)[SNAPSHOT_USER_DATA_BYTES];
+    std::atomic<bool> quit;
+    struct snapshot_sharded_server_shard_t shards[SNAPSHOT_SHARDED_SERVER_MAX_SHARDS];
+};
+
+// ------------------------------------------------------------------------------------------
+
+static struct snapshot_sharded_server_message_t * snapshot_sharded_server_begin_event( struct snapshot_sharded_server_shard_t * shard, bool must_deliver )
+{
+    // connect and disconnect events must not be lost, so wait for the game thread to make room. payload and passthrough are dropped like any other lost packet
+
+    while ( true )
+    {
+        struct snapshot_sharded_server_message_t * event = (struct snapshot_sharded_server_message_t*) snapshot_spsc_queue_begin_push( shard->event_queue );
+
+        if ( event || !must_deliver || shard->sharded_server->quit.load( std::memory_order_acquire ) )
+            return event;
+
+        snapshot_platform_sleep( SNAPSHOT_SHARDED_SERVER_WORKER_SLEEP_SECONDS );
+    }
+}
+
+// the kernel hashes clients to shards without knowing how full they are, so each shard has more slots than its even share,
+// and the cap on max clients is enforced here across all shards instead. slots are taken by workers as clients connect, and
+// given back by the game thread once it has seen the disconnect, so a slot is never reused before the game thread is done with it
+
+static int snapshot_sharded_server_assign_client_index_callback( void * context, int shard_client_index )
+{
+    struct snapshot_sharded_server_shard_t * shard = (struct snapshot_sharded_server_shard_t*) context;
+
+    snapshot_assert( shard );
+    snapshot_assert( shard_client_index >= 0 );
+    snapshot_assert( shard_client_index < shard->sharded_server->shard_max_clients );
+
+    struct snapshot_sharded_server_t * sharded_server = shard->sharded_server;
+
+    int client_index = -1;
+
+    {
+        snapshot_platform_mutex_guard( &sharded_server->client_slot_mutex );
+        for ( int i = 0; i < sharded_server->max_clients; ++i )
+        {
+            if ( !sharded_server->client_slot_used[i] )
+            {
+                sharded_server->client_slot_used[i] = 1;
+                client_index = i;
+                break;
+            }
+        }
+    }
+
+    if ( client_index < 0 )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sharded server is full. denied client on shard %d", shard->shard_index );
+        return -1;
+    }
+
+    shard->client_index[shard_client_index] = client_index;
+
+    return client_index;
+}
+
+static void snapshot_sharded_server_connect_disconnect_callback( void * context, int client_index, int connected )
+{
+    struct snapshot_sharded_server_shard_t * shard = (struct snapshot_sharded_server_shard_t*) context;
+
+    snapshot_assert( shard );
+    snapshot_assert( shard->server );
+
+    struct snapshot_sharded_server_message_t * event = snapshot_sharded_server_begin_event( shard, true );
+    if ( !event )
+        return;
+
+    event->type = connected ? SNAPSHOT_SHARDED_SERVER_EVENT_CONNECT : SNAPSHOT_SHARDED_SERVER_EVENT_DISCONNECT;
+    event->client_index = shard->client_index[client_index];
+    event->shard_client_index = client_index;
+    event->client_id = snapshot_server_client_id( shard->server, client_index );
+    event->address = *snapshot_server_client_address( shard->server, client_index );
+    event->bytes = 0;
+
+    if ( connected )
+    {
+        memcpy( event->data, snapshot_server_client_user_data( shard->server, client_index ), SNAPSHOT_USER_DATA_BYTES );
+        event->bytes = SNAPSHOT_USER_DATA_BYTES;
+    }
+
+    snapshot_spsc_queue_end_push( shard->event_queue );
+}
+
+static void snapshot_sharded_server_process_payload_callback( void * context, int client_index, const uint8_t * payload_data, int payload_bytes )
+{
+    struct snapshot_sharded_server_shard_t * shard = (struct snapshot_sharded_server_shard_t*) context;
+
+    snapshot_assert( shard );
+    snapshot_assert( payload_bytes <= SNAPSHOT_MAX_PAYLOAD_BYTES );
+
+    struct snapshot_sharded_server_message_t * event = snapshot_sharded_server_begin_event( shard, false );
+    if ( !event )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sharded server event queue is full. dropped payload from client %d on shard %d", client_index, shard->shard_index );
+        return;
+    }
+
+    event->type = SNAPSHOT_SHARDED_SERVER_EVENT_PAYLOAD;
+    event->client_index = shard->client_index[client_index];
+    event->shard_client_index = client_index;
+    event->client_id = 0;
+    event->bytes = payload_bytes;
+    memcpy( event->data, payload_data, payload_bytes );
+
+    snapshot_spsc_queue_end_push( shard->event_queue );
+}
+
+static void snapshot_sharded_server_process_passthrough_callback( void * context, const struct snapshot_address_t * client_address, int client_index, const uint8_t * passthrough_data, int passthrough_bytes )
+{
+    struct snapshot_sharded_server_shard_t * shard = (struct snapshot_sharded_server_shard_t*) context;
+
+    snapshot_assert( shard );
+    snapshot_assert( client_address );
+    snapshot_assert( passthrough_bytes <= SNAPSHOT_MAX_PASSTHROUGH_BYTES );
+
+    struct snapshot_sharded_server_message_t * event = snapshot_sharded_server_begin_event( shard, false );
+    if ( !event )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sharded server event queue is full. dropped passthrough from client %d on shard %d", client_index, shard->shard_index );
+        return;
+    }
+
+    event->type = SNAPSHOT_SHARDED_SERVER_EVENT_PASSTHROUGH;
+    event->client_index = shard->client_index[client_index];
+    event->shard_client_index = client_index;
+    event->client_id = 0;
+    event->address = *client_address;
+    event->bytes = passthrough_bytes;
+    memcpy( event->data, passthrough_data, passthrough_bytes );
+
+    snapshot_spsc_queue_end_push( shard->event_queue );
+}
+
+static void snapshot_sharded_server_process_commands( struct snapshot_sharded_server_shard_t * shard )
+{
+    struct snapshot_sharded_server_message_t * command;
+
+    while ( ( command = (struct snapshot_sharded_server_message_t*) snapshot_spsc_queue_front( shard->command_queue ) ) != NULL )
+    {
+        if ( command->type == SNAPSHOT_SHARDED_SERVER_COMMAND_SET_DEVELOPMENT_FLAGS )
+        {
+#if SNAPSHOT_DEVELOPMENT
+            snapshot_server_set_development_flags( shard->server, command->flags );
+#endif // #if SNAPSHOT_DEVELOPMENT
+            snapshot_spsc_queue_pop( shard->command_queue );
+            continue;
+        }
+
+        // the slot may have been reused by another client since the game thread queued this command
+
+        const int client_index = command->shard_client_index;
+
+        if ( snapshot_server_client_connected( shard->server, client_index ) && snapshot_server_client_id( shard->server, client_index ) == command->client_id )
+        {
+            switch ( command->type )
+            {
+                case SNAPSHOT_SHARDED_SERVER_COMMAND_SEND_PASSTHROUGH:
+                    snapshot_server_send_passthrough_packet( shard->server, client_index, command->data, command->bytes );
+                    break;
+
+                case SNAPSHOT_SHARDED_SERVER_COMMAND_DISCONNECT_CLIENT:
+                    snapshot_server_disconnect_client( shard->server, client_index );
+                    break;
+
+                default:
+                    break;
+            }
+        }
+
+        snapshot_spsc_queue_pop( shard->command_queue );
+    }
+}
+
+static void snapshot_sharded_server_worker_thread_function( void * arg )
+{
+    struct snapshot_sharded_server_shard_t * shard = (struct snapshot_sharded_server_shard_t*) arg;
+
+    snapshot_assert( shard );
+
+    while ( !shard->sharded_server->quit.load( std::memory_order_acquire ) )
+    {
+        snapshot_sharded_server_process_commands( shard );
+
+        snapshot_server_update( shard->server, snapshot_platform_time() );
+
+        snapshot_platform_sleep( SNAPSHOT_SHARDED_SERVER_WORKER_SLEEP_SECONDS );
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+
+struct snapshot_sharded_server_t * snapshot_sharded_server_create( const char * server_address_string, const struct snapshot_server_config_t * config, int num_shards )
+{
+    snapshot_assert( server_address_string );
+    snapshot_assert( config );
+
+    if ( num_shards < 1 || num_shards > SNAPSHOT_SHARDED_SERVER_MAX_SHARDS )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "sharded server num shards must be in [1,%d]", SNAPSHOT_SHARDED_SERVER_MAX_SHARDS );
+        return NULL;
+    }
+
+    if ( config->max_clients < num_shards || config->max_clients > SNAPSHOT_MAX_CLIENTS )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "sharded server max clients must be in [%d,%d]", num_shards, SNAPSHOT_MAX_CLIENTS );
+        return NULL;
+    }
+
+    if ( config->network_simulator )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "sharded server does not support the network simulator" );
+        return NULL;
+    }
+
+    struct snapshot_address_t server_address;
+    memset( &server_address, 0, sizeof( server_address ) );
+    if ( snapshot_address_parse( &server_address, server_address_string ) != SNAPSHOT_OK )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to parse sharded server address" );
+        return NULL;
+    }
+
+    struct snapshot_sharded_server_t * sharded_server = (struct snapshot_sharded_server_t*) snapshot_malloc( config->context, sizeof( struct snapshot_sharded_server_t ) );
+    if ( !sharded_server )
+        return NULL;
+
+    memset( (void*) sharded_server, 0, sizeof( struct snapshot_sharded_server_t ) );
+
+    sharded_server->quit.store( false, std::memory_order_relaxed );
+    sharded_server->config = *config;
+    sharded_server->num_shards = num_shards;
+    sharded_server->max_clients = config->max_clients;
+
+    const int max_clients = sharded_server->max_clients;
+
+    const int shard_even_clients = ( max_clients + num_shards - 1 ) / num_shards;
+
+    sharded_server->shard_max_clients = shard_even_clients * SNAPSHOT_SHARDED_SERVER_SHARD_HEADROOM;
+    if ( sharded_server->shard_max_clients > max_clients )
+    {
+        sharded_server->shard_max_clients = max_clients;
+    }
+
+    // queues are sized from each shard's even share of clients, and rounded up to a power of two
+
+    int event_queue_size = SNAPSHOT_SHARDED_SERVER_MIN_QUEUE_SIZE;
+    while ( event_queue_size < shard_even_clients * SNAPSHOT_SHARDED_SERVER_EVENTS_PER_CLIENT )
+    {
+        event_queue_size *= 2;
+    }
+
+    int command_queue_size = SNAPSHOT_SHARDED_SERVER_MIN_QUEUE_SIZE;
+    while ( command_queue_size < shard_even_clients * SNAPSHOT_SHARDED_SERVER_COMMANDS_PER_CLIENT )
+    {
+        command_queue_size *= 2;
+    }
+
+    if ( snapshot_platform_mutex_create( &sharded_server->client_slot_mutex ) != SNAPSHOT_OK )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create sharded server client slot mutex" );
+        snapshot_sharded_server_destroy( sharded_server );
+        return NULL;
+    }
+
+    sharded_server->client_slot_mutex_created = true;
+
+    sharded_server->client_slot_used = (int*) snapshot_malloc( config->context, max_clients * sizeof( int ) );
+    sharded_server->client_shard = (int*) snapshot_malloc( config->context, max_clients * sizeof( int ) );
+    sharded_server->client_shard_index = (int*) snapshot_malloc( config->context, max_clients * sizeof( int ) );
+    sharded_server->client_connected = (int*) snapshot_malloc( config->context, max_clients * sizeof( int ) );
+    sharded_server->client_id = (uint64_t*) snapshot_malloc( config->context, max_clients * sizeof( uint64_t ) );
+    sharded_server->client_address = (struct snapshot_address_t*) snapshot_malloc( config->context, max_clients * sizeof( struct snapshot_address_t ) );
+    sharded_server->client_user_data = (uint8_t(*)[SNAPSHOT_USER_DATA_BYTES]) snapshot_malloc( config->context, max_clients * SNAPSHOT_USER_DATA_BYTES );
+
+    if ( !sharded_server->client_slot_used || !sharded_server->client_shard || !sharded_server->client_shard_index ||
+         !sharded_server->client_connected || !sharded_server->client_id || !sharded_server->client_address || !sharded_server->client_user_data )
+    {
+        snapshot_sharded_server_destroy( sharded_server );
+        return NULL;
+    }
+
+    memset( sharded_server->client_slot_used, 0, max_clients * sizeof( int ) );
+    memset( sharded_server->client_shard, 0, max_clients * sizeof( int ) );
+    memset( sharded_server->client_shard_index, 0, max_clients * sizeof( int ) );
+    memset( sharded_server->client_connected, 0, max_clients * sizeof( int ) );
+    memset( sharded_server->client_id, 0, max_clients * sizeof( uint64_t ) );
+    memset( sharded_server->client_address, 0, max_clients * sizeof( struct snapshot_address_t ) );
+    memset( sharded_server->client_user_data, 0, max_clients * SNAPSHOT_USER_DATA_BYTES );
+
+    // the first shard binds the port, so when the port is zero every other shard shares whatever port it got
+
+    for ( int i = 0; i < num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        shard->sharded_server = sharded_server;
+        shard->shard_index = i;
+        shard->event_queue = snapshot_spsc_queue_create( config->context, event_queue_size, sizeof( struct snapshot_sharded_server_message_t ) );
+        shard->command_queue = snapshot_spsc_queue_create( config->context, command_queue_size, sizeof( struct snapshot_sharded_server_message_t ) );
+        shard->client_index = (int*) snapshot_malloc( config->context, sharded_server->shard_max_clients * sizeof( int ) );
+
+        if ( !shard->event_queue || !shard->command_queue || !shard->client_index )
+        {
+            snapshot_sharded_server_destroy( sharded_server );
+            return NULL;
+        }
+
+        struct snapshot_server_config_t shard_config = *config;
+        shard_config.callback_context = shard;
+        shard_config.max_clients = sharded_server->shard_max_clients;
+        shard_config.reuse_port = true;
+        shard_config.reported_max_clients = max_clients;
+        shard_config.assign_client_index_callback = snapshot_sharded_server_assign_client_index_callback;
+        shard_config.connect_disconnect_callback = snapshot_sharded_server_connect_disconnect_callback;
+        shard_config.send_loopback_packet_callback = NULL;
+        shard_config.process_passthrough_callback = config->process_passthrough_callback ? snapshot_sharded_server_process_passthrough_callback : NULL;
+        shard_config.process_payload_callback = config->process_payload_callback ? snapshot_sharded_server_process_payload_callback : NULL;
+
+        char shard_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+        snapshot_address_to_string( &server_address, shard_address_string );
+
+        shard->server = snapshot_server_create( shard_address_string, &shard_config, snapshot_platform_time() );
+
+        if ( !shard->server )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create sharded server shard %d", i );
+            snapshot_sharded_server_destroy( sharded_server );
+            return NULL;
+        }
+
+        server_address.port = snapshot_server_port( shard->server );
+    }
+
+    sharded_server->port = server_address.port;
+
+    for ( int i = 0; i < num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        shard->thread = snapshot_platform_thread_create( config->context, snapshot_sharded_server_worker_thread_function, shard );
+
+        if ( !shard->thread )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_ERROR, "failed to create sharded server worker thread %d", i );
+            snapshot_sharded_server_destroy( sharded_server );
+            return NULL;
+        }
+    }
+
+    snapshot_printf( SNAPSHOT_LOG_LEVEL_INFO, "sharded server started on port %d with %d shards of up to %d clients, %d clients total", sharded_server->port, num_shards, sharded_server->shard_max_clients, max_clients );
+
+    return sharded_server;
+}
+
+void snapshot_sharded_server_destroy( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+
+    void * context = sharded_server->config.context;
+
+    sharded_server->quit.store( true, std::memory_order_release );
+
+    for ( int i = 0; i < sharded_server->num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        if ( shard->thread )
+        {
+            snapshot_platform_thread_join( shard->thread );
+            snapshot_platform_thread_destroy( shard->thread );
+            shard->thread = NULL;
+        }
+    }
+
+    // workers have stopped, so shards can be torn down from this thread
+
+    for ( int i = 0; i < sharded_server->num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        if ( shard->server )
+            snapshot_server_destroy( shard->server );
+        if ( shard->event_queue )
+            snapshot_spsc_queue_destroy( shard->event_queue );
+        if ( shard->command_queue )
+            snapshot_spsc_queue_destroy( shard->command_queue );
+        if ( shard->client_index )
+            snapshot_free( context, shard->client_index );
+    }
+
+    if ( sharded_server->client_slot_mutex_created )
+        snapshot_platform_mutex_destroy( &sharded_server->client_slot_mutex );
+    if ( sharded_server->client_slot_used )
+        snapshot_free( context, sharded_server->client_slot_used );
+    if ( sharded_server->client_shard )
+        snapshot_free( context, sharded_server->client_shard );
+    if ( sharded_server->client_shard_index )
+        snapshot_free( context, sharded_server->client_shard_index );
+
+    if ( sharded_server->client_connected )
+        snapshot_free( context, sharded_server->client_connected );
+    if ( sharded_server->client_id )
+        snapshot_free( context, sharded_server->client_id );
+    if ( sharded_server->client_address )
+        snapshot_free( context, sharded_server->client_address );
+    if ( sharded_server->client_user_data )
+        snapshot_free( context, sharded_server->client_user_data );
+
+    snapshot_free( context, sharded_server );
+}
+
+void snapshot_sharded_server_update( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+
+    for ( int i = 0; i < sharded_server->num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        struct snapshot_sharded_server_message_t * event;
+
+        while ( ( event = (struct snapshot_sharded_server_message_t*) snapshot_spsc_queue_front( shard->event_queue ) ) != NULL )
+        {
+            const int client_index = event->client_index;
+
+            snapshot_assert( client_index >= 0 );
+            snapshot_assert( client_index < sharded_server->max_clients );
+
+            switch ( event->type )
+            {
+                case SNAPSHOT_SHARDED_SERVER_EVENT_CONNECT:
+                {
+                    snapshot_assert( !sharded_server->client_connected[client_index] );
+                    sharded_server->client_connected[client_index] = 1;
+                    sharded_server->client_shard[client_index] = i;
+                    sharded_server->client_shard_index[client_index] = event->shard_client_index;
+                    sharded_server->client_id[client_index] = event->client_id;
+                    sharded_server->client_address[client_index] = event->address;
+                    memcpy( sharded_server->client_user_data[client_index], event->data, SNAPSHOT_USER_DATA_BYTES );
+                    sharded_server->num_connected_clients++;
+                    if ( sharded_server->config.connect_disconnect_callback )
+                    {
+                        sharded_server->config.connect_disconnect_callback( sharded_server->config.callback_context, client_index, 1 );
+                    }
+                }
+                break;
+
+                case SNAPSHOT_SHARDED_SERVER_EVENT_DISCONNECT:
+                {
+                    snapshot_assert( sharded_server->client_connected[client_index] );
+                    if ( sharded_server->config.connect_disconnect_callback )
+                    {
+                        sharded_server->config.connect_disconnect_callback( sharded_server->config.callback_context, client_index, 0 );
+                    }
+                    sharded_server->client_connected[client_index] = 0;
+                    sharded_server->client_id[client_index] = 0;
+                    memset( &sharded_server->client_address[client_index], 0, sizeof( struct snapshot_address_t ) );
+                    memset( sharded_server->client_user_data[client_index], 0, SNAPSHOT_USER_DATA_BYTES );
+                    sharded_server->num_connected_clients--;
+                    snapshot_assert( sharded_server->num_connected_clients >= 0 );
+                    {
+                        snapshot_platform_mutex_guard( &sharded_server->client_slot_mutex );
+                        sharded_server->client_slot_used[client_index] = 0;
+                    }
+                }
+                break;
+
+                case SNAPSHOT_SHARDED_SERVER_EVENT_PAYLOAD:
+                {
+                    if ( sharded_server->config.process_payload_callback )
+                    {
+                        sharded_server->config.process_payload_callback( sharded_server->config.callback_context, client_index, event->data, event->bytes );
+                    }
+                }
+                break;
+
+                case SNAPSHOT_SHARDED_SERVER_EVENT_PASSTHROUGH:
+                {
+                    if ( sharded_server->config.process_passthrough_callback )
+                    {
+                        sharded_server->config.process_passthrough_callback( sharded_server->config.callback_context, &event->address, client_index, event->data, event->bytes );
+                    }
+                }
+                break;
+
+                default:
+                    break;
+            }
+
+            snapshot_spsc_queue_pop( shard->event_queue );
+        }
+    }
+}
+
+int snapshot_sharded_server_num_shards( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+    return sharded_server->num_shards;
+}
+
+int snapshot_sharded_server_max_clients( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+    return sharded_server->max_clients;
+}
+
+int snapshot_sharded_server_num_connected_clients( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+    return sharded_server->num_connected_clients;
+}
+
+int snapshot_sharded_server_client_connected( struct snapshot_sharded_server_t * sharded_server, int client_index )
+{
+    snapshot_assert( sharded_server );
+
+    if ( client_index < 0 || client_index >= sharded_server->max_clients )
+        return 0;
+
+    return sharded_server->client_connected[client_index];
+}
+
+uint64_t snapshot_sharded_server_client_id( struct snapshot_sharded_server_t * sharded_server, int client_index )
+{
+    snapshot_assert( sharded_server );
+
+    if ( client_index < 0 || client_index >= sharded_server->max_clients )
+        return 0;
+
+    return sharded_server->client_id[client_index];
+}
+
+struct snapshot_address_t * snapshot_sharded_server_client_address( struct snapshot_sharded_server_t * sharded_server, int client_index )
+{
+    snapshot_assert( sharded_server );
+
+    if ( client_index < 0 || client_index >= sharded_server->max_clients )
+        return NULL;
+
+    return &sharded_server->client_address[client_index];
+}
+
+void * snapshot_sharded_server_client_user_data( struct snapshot_sharded_server_t * sharded_server, int client_index )
+{
+    snapshot_assert( sharded_server );
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < sharded_server->max_clients );
+    return sharded_server->client_user_data[client_index];
+}
+
+static void snapshot_sharded_server_push_command( struct snapshot_sharded_server_t * sharded_server, int type, int client_index, const uint8_t * data, int bytes )
+{
+    snapshot_assert( client_index >= 0 );
+    snapshot_assert( client_index < sharded_server->max_clients );
+
+    if ( !sharded_server->client_connected[client_index] )
+        return;
+
+    struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[sharded_server->client_shard[client_index]];
+
+    struct snapshot_sharded_server_message_t * command = (struct snapshot_sharded_server_message_t*) snapshot_spsc_queue_begin_push( shard->command_queue );
+    if ( !command )
+    {
+        snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sharded server command queue is full for shard %d", shard->shard_index );
+        return;
+    }
+
+    command->type = type;
+    command->client_index = client_index;
+    command->shard_client_index = sharded_server->client_shard_index[client_index];
+    command->client_id = sharded_server->client_id[client_index];
+    command->bytes = bytes;
+    if ( bytes > 0 )
+    {
+        memcpy( command->data, data, bytes );
+    }
+
+    snapshot_spsc_queue_end_push( shard->command_queue );
+}
+
+void snapshot_sharded_server_send_passthrough_packet( struct snapshot_sharded_server_t * sharded_server, int client_index, const uint8_t * passthrough_data, int passthrough_bytes )
+{
+    snapshot_assert( sharded_server );
+    snapshot_assert( passthrough_data );
+    snapshot_assert( passthrough_bytes > 0 );
+    snapshot_assert( passthrough_bytes <= SNAPSHOT_MAX_PASSTHROUGH_BYTES );
+
+    snapshot_sharded_server_push_command( sharded_server, SNAPSHOT_SHARDED_SERVER_COMMAND_SEND_PASSTHROUGH, client_index, passthrough_data, passthrough_bytes );
+}
+
+void snapshot_sharded_server_disconnect_client( struct snapshot_sharded_server_t * sharded_server, int client_index )
+{
+    snapshot_assert( sharded_server );
+
+    snapshot_sharded_server_push_command( sharded_server, SNAPSHOT_SHARDED_SERVER_COMMAND_DISCONNECT_CLIENT, client_index, NULL, 0 );
+}
+
+uint16_t snapshot_sharded_server_port( struct snapshot_sharded_server_t * sharded_server )
+{
+    snapshot_assert( sharded_server );
+    return sharded_server->port;
+}
+
+#if SNAPSHOT_DEVELOPMENT
+
+void snapshot_sharded_server_set_development_flags( struct snapshot_sharded_server_t * sharded_server, uint64_t flags )
+{
+    snapshot_assert( sharded_server );
+
+    // each shard's server belongs to its worker, so the flags go over the command queue like everything else
+
+    for ( int i = 0; i < sharded_server->num_shards; ++i )
+    {
+        struct snapshot_sharded_server_shard_t * shard = &sharded_server->shards[i];
+
+        struct snapshot_sharded_server_message_t * command = (struct snapshot_sharded_server_message_t*) snapshot_spsc_queue_begin_push( shard->command_queue );
+        if ( !command )
+        {
+            snapshot_printf( SNAPSHOT_LOG_LEVEL_DEBUG, "sharded server command queue is full for shard %d", shard->shard_index );
+            continue;
+        }
+
+        command->type = SNAPSHOT_SHARDED_SERVER_COMMAND_SET_DEVELOPMENT_FLAGS;
+        command->client_index = -1;
+        command->shard_client_index = -1;
+        command->client_id = 0;
+        command->flags = flags;
+        command->bytes = 0;
+
+        snapshot_spsc_queue_end_push( shard->command_queue );
+    }
+}
+
+#endif // #if SNAPSHOT_DEVELOPMENT
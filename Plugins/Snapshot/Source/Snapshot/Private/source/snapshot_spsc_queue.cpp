@@ -0,0 +1,132 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_spsc_queue.h"
+
+#include <atomic>
+
+#define SNAPSHOT_SPSC_QUEUE_CACHE_LINE_BYTES                             64
+
+struct snapshot_spsc_queue_t
+{
+    void * context;
+    int capacity;
+    int entry_bytes;
+    uint8_t * entries;
+
+    // producer side. the cached head avoids reading the consumer's cache line until the queue looks full
+
+    uint8_t producer_pad[SNAPSHOT_SPSC_QUEUE_CACHE_LINE_BYTES];
+    std::atomic<uint32_t> tail;
+    uint32_t cached_head;
+
+    // consumer side. the cached tail avoids reading the producer's cache line until the queue looks empty
+
+    uint8_t consumer_pad[SNAPSHOT_SPSC_QUEUE_CACHE_LINE_BYTES];
+    std::atomic<uint32_t> head;
+    uint32_t cached_tail;
+
+    uint8_t end_pad[SNAPSHOT_SPSC_QUEUE_CACHE_LINE_BYTES];
+};
+
+struct snapshot_spsc_queue_t * snapshot_spsc_queue_create( void * context, int capacity, int entry_bytes )
+{
+    snapshot_assert( capacity > 0 );
+    snapshot_assert( ( capacity & ( capacity - 1 ) ) == 0 );
+    snapshot_assert( entry_bytes > 0 );
+
+    struct snapshot_spsc_queue_t * queue = (struct snapshot_spsc_queue_t*) snapshot_malloc( context, sizeof( struct snapshot_spsc_queue_t ) );
+    if ( !queue )
+        return NULL;
+
+    queue->context = context;
+    queue->capacity = capacity;
+    queue->entry_bytes = entry_bytes;
+    queue->cached_head = 0;
+    queue->cached_tail = 0;
+    queue->tail.store( 0, std::memory_order_relaxed );
+    queue->head.store( 0, std::memory_order_relaxed );
+
+    queue->entries = (uint8_t*) snapshot_malloc( context, (size_t) capacity * entry_bytes );
+    if ( !queue->entries )
+    {
+        snapshot_spsc_queue_destroy( queue );
+        return NULL;
+    }
+
+    return queue;
+}
+
+void snapshot_spsc_queue_destroy( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+
+    void * context = queue->context;
+
+    if ( queue->entries )
+        snapshot_free( context, queue->entries );
+
+    snapshot_free( context, queue );
+}
+
+void * snapshot_spsc_queue_begin_push( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+
+    const uint32_t tail = queue->tail.load( std::memory_order_relaxed );
+
+    if ( tail - queue->cached_head >= (uint32_t) queue->capacity )
+    {
+        queue->cached_head = queue->head.load( std::memory_order_acquire );
+        if ( tail - queue->cached_head >= (uint32_t) queue->capacity )
+            return NULL;
+    }
+
+    return queue->entries + (size_t) ( tail & ( queue->capacity - 1 ) ) * queue->entry_bytes;
+}
+
+void snapshot_spsc_queue_end_push( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+
+    const uint32_t tail = queue->tail.load( std::memory_order_relaxed );
+
+    snapshot_assert( tail - queue->cached_head < (uint32_t) queue->capacity );
+
+    queue->tail.store( tail + 1, std::memory_order_release );
+}
+
+void * snapshot_spsc_queue_front( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+
+    const uint32_t head = queue->head.load( std::memory_order_relaxed );
+
+    if ( head == queue->cached_tail )
+    {
+        queue->cached_tail = queue->tail.load( std::memory_order_acquire );
+        if ( head == queue->cached_tail )
+            return NULL;
+    }
+
+    return queue->entries + (size_t) ( head & ( queue->capacity - 1 ) ) * queue->entry_bytes;
+}
+
+void snapshot_spsc_queue_pop( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+
+    const uint32_t head = queue->head.load( std::memory_order_relaxed );
+
+    snapshot_assert( head != queue->cached_tail );
+
+    queue->head.store( head + 1, std::memory_order_release );
+}
+
+int snapshot_spsc_queue_capacity( struct snapshot_spsc_queue_t * queue )
+{
+    snapshot_assert( queue );
+    return queue->capacity;
+}
@@ -22,17 +22,25 @@
 #include "snapshot_challenge_token.h"
 #include "snapshot_packets.h"
 #include "snapshot_encryption_manager.h"
+#include "snapshot_address_map.h"
+#include "snapshot_timer_wheel.h"
+#include "snapshot_spsc_queue.h"
+#include "snapshot_packet_allocator.h"
+#include "snapshot_arena.h"
+#include "snapshot_sharded_server.h"
 #include "snapshot_replay_protection.h"
 #include "snapshot_sequence_buffer.h"
 #include "snapshot_packet_header.h"
 #include "snapshot_endpoint.h"
 #include "snapshot_base64.h"
+#include "snapshot_delta.h"
 
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <atomic>
 
 static void snapshot_check_handler( const char * condition,
                                     const char * function,
@@ -810,6 +818,376 @@ void test_platform_socket()
 #endif
 }
 
+void test_platform_socket_receive_packets()
+{
+    // non-blocking socket, batched receive (ipv4)
+    {
+        snapshot_address_t bind_address;
+        snapshot_address_t local_address;
+        snapshot_address_parse( &bind_address, "0.0.0.0" );
+        snapshot_address_parse( &local_address, "127.0.0.1" );
+        snapshot_platform_socket_t * socket = snapshot_platform_socket_create( NULL, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        local_address.port = bind_address.port;
+        snapshot_check( socket );
+
+        const int NumPackets = 10;
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            uint8_t packet[256];
+            memset( packet, i, sizeof(packet) );
+            snapshot_platform_socket_send_packet( socket, &local_address, packet, 100 + i );
+        }
+
+        const int BatchSize = 4;
+        uint8_t buffer[BatchSize][256];
+        void * packet_data[BatchSize];
+        int packet_bytes[BatchSize];
+        snapshot_address_t from[BatchSize];
+        for ( int i = 0; i < BatchSize; ++i )
+        {
+            packet_data[i] = buffer[i];
+        }
+
+        int num_packets_received = 0;
+        double start_time = snapshot_platform_time();
+        while ( num_packets_received < NumPackets && snapshot_platform_time() < start_time + 1.0 )
+        {
+            int num_received = 0;
+            int num_packets = snapshot_platform_socket_receive_packets( socket, from, packet_data, packet_bytes, 256, BatchSize, &num_received );
+            snapshot_check( num_packets >= 0 );
+            snapshot_check( num_packets <= BatchSize );
+            snapshot_check( num_received >= num_packets );
+            for ( int i = 0; i < num_packets; ++i )
+            {
+                snapshot_check( snapshot_address_equal( &from[i], &local_address ) );
+                snapshot_check( packet_bytes[i] == 100 + num_packets_received );
+                snapshot_check( ( (uint8_t*) packet_data[i] )[0] == num_packets_received );
+                num_packets_received++;
+            }
+        }
+
+        snapshot_check( num_packets_received == NumPackets );
+
+        int num_received = -1;
+        snapshot_check( snapshot_platform_socket_receive_packets( socket, from, packet_data, packet_bytes, 256, BatchSize, &num_received ) == 0 );
+        snapshot_check( num_received == 0 );
+
+        snapshot_platform_socket_destroy( socket );
+    }
+
+#if SNAPSHOT_PLATFORM == SNAPSHOT_PLATFORM_LINUX
+
+    // a whole batch of truncated packets comes back with nothing in it, but the socket isn't empty until nothing was received
+    {
+        snapshot_address_t bind_address;
+        snapshot_address_t local_address;
+        snapshot_address_parse( &bind_address, "0.0.0.0" );
+        snapshot_address_parse( &local_address, "127.0.0.1" );
+        snapshot_platform_socket_t * socket = snapshot_platform_socket_create( NULL, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        local_address.port = bind_address.port;
+        snapshot_check( socket );
+
+        const int BatchSize = 4;
+        const int NumOversizePackets = BatchSize * 2;
+        const int NumPackets = 10;
+
+        uint8_t packet[512];
+        memset( packet, 0, sizeof(packet) );
+
+        for ( int i = 0; i < NumOversizePackets; ++i )
+        {
+            snapshot_platform_socket_send_packet( socket, &local_address, packet, sizeof(packet) );
+        }
+
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            snapshot_platform_socket_send_packet( socket, &local_address, packet, 100 );
+        }
+
+        uint8_t buffer[BatchSize][256];
+        void * packet_data[BatchSize];
+        int packet_bytes[BatchSize];
+        snapshot_address_t from[BatchSize];
+        for ( int i = 0; i < BatchSize; ++i )
+        {
+            packet_data[i] = buffer[i];
+        }
+
+        // loopback delivers synchronously, so everything is queued by now and one drain picks it all up
+
+        int num_packets_received = 0;
+        int num_empty_batches = 0;
+        while ( 1 )
+        {
+            int num_received = 0;
+            int num_packets = snapshot_platform_socket_receive_packets( socket, from, packet_data, packet_bytes, 256, BatchSize, &num_received );
+            snapshot_check( num_received >= num_packets );
+            if ( num_received == 0 )
+                break;
+            if ( num_packets == 0 )
+                num_empty_batches++;
+            for ( int i = 0; i < num_packets; ++i )
+            {
+                snapshot_check( packet_bytes[i] == 100 );
+            }
+            num_packets_received += num_packets;
+        }
+
+        snapshot_check( num_empty_batches == NumOversizePackets / BatchSize );
+        snapshot_check( num_packets_received == NumPackets );
+
+        snapshot_platform_socket_destroy( socket );
+    }
+
+#endif // #if SNAPSHOT_PLATFORM == SNAPSHOT_PLATFORM_LINUX
+
+#if SNAPSHOT_PLATFORM_HAS_IPV6
+
+    // non-blocking socket, batched receive (ipv6)
+    {
+        snapshot_address_t bind_address;
+        snapshot_address_t local_address;
+        snapshot_address_parse( &bind_address, "[::]" );
+        snapshot_address_parse( &local_address, "[::1]" );
+        snapshot_platform_socket_t * socket = snapshot_platform_socket_create( NULL, &bind_address, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        local_address.port = bind_address.port;
+        snapshot_check( socket );
+
+        const int NumPackets = 10;
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            uint8_t packet[256];
+            memset( packet, i, sizeof(packet) );
+            snapshot_platform_socket_send_packet( socket, &local_address, packet, 100 + i );
+        }
+
+        const int BatchSize = 4;
+        uint8_t buffer[BatchSize][256];
+        void * packet_data[BatchSize];
+        int packet_bytes[BatchSize];
+        snapshot_address_t from[BatchSize];
+        for ( int i = 0; i < BatchSize; ++i )
+        {
+            packet_data[i] = buffer[i];
+        }
+
+        int num_packets_received = 0;
+        double start_time = snapshot_platform_time();
+        while ( num_packets_received < NumPackets && snapshot_platform_time() < start_time + 1.0 )
+        {
+            int num_received = 0;
+            int num_packets = snapshot_platform_socket_receive_packets( socket, from, packet_data, packet_bytes, 256, BatchSize, &num_received );
+            snapshot_check( num_packets >= 0 );
+            snapshot_check( num_packets <= BatchSize );
+            snapshot_check( num_received >= num_packets );
+            for ( int i = 0; i < num_packets; ++i )
+            {
+                snapshot_check( snapshot_address_equal( &from[i], &local_address ) );
+                snapshot_check( packet_bytes[i] == 100 + num_packets_received );
+                snapshot_check( ( (uint8_t*) packet_data[i] )[0] == num_packets_received );
+                num_packets_received++;
+            }
+        }
+
+        snapshot_check( num_packets_received == NumPackets );
+
+        snapshot_platform_socket_destroy( socket );
+    }
+
+#endif
+}
+
+void test_platform_socket_send_packets()
+{
+    // batched send to different ports (ipv4)
+    {
+        snapshot_address_t bind_address_a;
+        snapshot_address_t bind_address_b;
+        snapshot_address_parse( &bind_address_a, "0.0.0.0" );
+        snapshot_address_parse( &bind_address_b, "0.0.0.0" );
+        snapshot_platform_socket_t * socket_a = snapshot_platform_socket_create( NULL, &bind_address_a, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        snapshot_platform_socket_t * socket_b = snapshot_platform_socket_create( NULL, &bind_address_b, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        snapshot_check( socket_a );
+        snapshot_check( socket_b );
+
+        const int NumPackets = 10;
+        uint8_t buffer[NumPackets][256];
+        void * packet_data[NumPackets];
+        int packet_bytes[NumPackets];
+        snapshot_address_t to[NumPackets];
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            memset( buffer[i], i, sizeof(buffer[i]) );
+            packet_data[i] = buffer[i];
+            packet_bytes[i] = 100 + i;
+            snapshot_address_parse( &to[i], "127.0.0.1" );
+            to[i].port = ( i % 2 ) ? bind_address_b.port : bind_address_a.port;
+        }
+
+        snapshot_platform_socket_send_packets( socket_a, to, packet_data, packet_bytes, NumPackets );
+
+        int num_packets_received_a = 0;
+        int num_packets_received_b = 0;
+        double start_time = snapshot_platform_time();
+        while ( num_packets_received_a + num_packets_received_b < NumPackets && snapshot_platform_time() < start_time + 1.0 )
+        {
+            uint8_t packet[256];
+            snapshot_address_t from;
+            int bytes = snapshot_platform_socket_receive_packet( socket_a, &from, packet, sizeof(packet) );
+            if ( bytes > 0 )
+            {
+                snapshot_check( bytes == 100 + packet[0] );
+                snapshot_check( ( packet[0] % 2 ) == 0 );
+                num_packets_received_a++;
+            }
+            bytes = snapshot_platform_socket_receive_packet( socket_b, &from, packet, sizeof(packet) );
+            if ( bytes > 0 )
+            {
+                snapshot_check( bytes == 100 + packet[0] );
+                snapshot_check( ( packet[0] % 2 ) == 1 );
+                num_packets_received_b++;
+            }
+        }
+
+        snapshot_check( num_packets_received_a == NumPackets / 2 );
+        snapshot_check( num_packets_received_b == NumPackets / 2 );
+
+        snapshot_platform_socket_destroy( socket_a );
+        snapshot_platform_socket_destroy( socket_b );
+    }
+
+#if SNAPSHOT_PLATFORM_HAS_IPV6
+
+    // batched send to different ports (ipv6)
+    {
+        snapshot_address_t bind_address_a;
+        snapshot_address_t bind_address_b;
+        snapshot_address_parse( &bind_address_a, "[::]" );
+        snapshot_address_parse( &bind_address_b, "[::]" );
+        snapshot_platform_socket_t * socket_a = snapshot_platform_socket_create( NULL, &bind_address_a, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        snapshot_platform_socket_t * socket_b = snapshot_platform_socket_create( NULL, &bind_address_b, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 64*1024, 64*1024 );
+        snapshot_check( socket_a );
+        snapshot_check( socket_b );
+
+        const int NumPackets = 10;
+        uint8_t buffer[NumPackets][256];
+        void * packet_data[NumPackets];
+        int packet_bytes[NumPackets];
+        snapshot_address_t to[NumPackets];
+        for ( int i = 0; i < NumPackets; ++i )
+        {
+            memset( buffer[i], i, sizeof(buffer[i]) );
+            packet_data[i] = buffer[i];
+            packet_bytes[i] = 100 + i;
+            snapshot_address_parse( &to[i], "[::1]" );
+            to[i].port = ( i % 2 ) ? bind_address_b.port : bind_address_a.port;
+        }
+
+        snapshot_platform_socket_send_packets( socket_a, to, packet_data, packet_bytes, NumPackets );
+
+        int num_packets_received_a = 0;
+        int num_packets_received_b = 0;
+        double start_time = snapshot_platform_time();
+        while ( num_packets_received_a + num_packets_received_b < NumPackets && snapshot_platform_time() < start_time + 1.0 )
+        {
+            uint8_t packet[256];
+            snapshot_address_t from;
+            int bytes = snapshot_platform_socket_receive_packet( socket_a, &from, packet, sizeof(packet) );
+            if ( bytes > 0 )
+            {
+                snapshot_check( bytes == 100 + packet[0] );
+                snapshot_check( ( packet[0] % 2 ) == 0 );
+                num_packets_received_a++;
+            }
+            bytes = snapshot_platform_socket_receive_packet( socket_b, &from, packet, sizeof(packet) );
+            if ( bytes > 0 )
+            {
+                snapshot_check( bytes == 100 + packet[0] );
+                snapshot_check( ( packet[0] % 2 ) == 1 );
+                num_packets_received_b++;
+            }
+        }
+
+        snapshot_check( num_packets_received_a == NumPackets / 2 );
+        snapshot_check( num_packets_received_b == NumPackets / 2 );
+
+        snapshot_platform_socket_destroy( socket_a );
+        snapshot_platform_socket_destroy( socket_b );
+    }
+
+#endif
+}
+
+void test_platform_socket_gso_gro()
+{
+    snapshot_address_t bind_address_a;
+    snapshot_address_t bind_address_b;
+    snapshot_address_t local_address;
+    snapshot_address_parse( &bind_address_a, "0.0.0.0" );
+    snapshot_address_parse( &bind_address_b, "0.0.0.0" );
+    snapshot_address_parse( &local_address, "127.0.0.1" );
+    snapshot_platform_socket_t * socket_a = snapshot_platform_socket_create( NULL, &bind_address_a, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 256*1024, 256*1024 );
+    snapshot_platform_socket_t * socket_b = snapshot_platform_socket_create( NULL, &bind_address_b, SNAPSHOT_PLATFORM_SOCKET_NON_BLOCKING, 0, 256*1024, 256*1024 );
+    snapshot_check( socket_a );
+    snapshot_check( socket_b );
+    local_address.port = bind_address_b.port;
+
+    // gso and gro are optional. whether or not they are available, the same packets must come out the other side
+
+    snapshot_platform_socket_enable_gso( socket_a );
+    snapshot_platform_socket_enable_gro( socket_b );
+
+    // a fragment train: one larger first packet, equal sized packets, then a smaller last packet
+
+    const int NumPackets = 12;
+    uint8_t buffer[NumPackets][1200];
+    void * packet_data[NumPackets];
+    int packet_bytes[NumPackets];
+    snapshot_address_t to[NumPackets];
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        packet_bytes[i] = ( i == 0 ) ? 1100 : ( ( i == NumPackets - 1 ) ? 300 : 1000 );
+        memset( buffer[i], i, sizeof(buffer[i]) );
+        packet_data[i] = buffer[i];
+        to[i] = local_address;
+    }
+
+    snapshot_platform_socket_send_packets( socket_a, to, packet_data, packet_bytes, NumPackets );
+
+    const int BatchSize = 4;
+    uint8_t receive_buffer[BatchSize][2048];
+    void * receive_packet_data[BatchSize];
+    int receive_packet_bytes[BatchSize];
+    snapshot_address_t from[BatchSize];
+
+    int num_packets_received = 0;
+    double start_time = snapshot_platform_time();
+    while ( num_packets_received < NumPackets && snapshot_platform_time() < start_time + 1.0 )
+    {
+        for ( int i = 0; i < BatchSize; ++i )
+        {
+            receive_packet_data[i] = receive_buffer[i];
+        }
+        int num_received = 0;
+        int num_packets = snapshot_platform_socket_receive_packets( socket_b, from, receive_packet_data, receive_packet_bytes, sizeof(receive_buffer[0]), BatchSize, &num_received );
+        snapshot_check( num_packets <= BatchSize );
+        snapshot_check( num_received >= num_packets );
+        for ( int i = 0; i < num_packets; ++i )
+        {
+            snapshot_check( num_packets_received < NumPackets );
+            snapshot_check( receive_packet_bytes[i] == packet_bytes[num_packets_received] );
+            snapshot_check( ( (uint8_t*) receive_packet_data[i] )[0] == num_packets_received );
+            snapshot_check( ( (uint8_t*) receive_packet_data[i] )[receive_packet_bytes[i]-1] == num_packets_received );
+            num_packets_received++;
+        }
+    }
+
+    snapshot_check( num_packets_received == NumPackets );
+
+    snapshot_platform_socket_destroy( socket_a );
+    snapshot_platform_socket_destroy( socket_b );
+}
+
 static bool threads_work = false;
 
 void test_thread_function(void*)
@@ -1066,6 +1444,69 @@ void test_create_and_destroy_packet()
     snapshot_destroy_packet( NULL, packet );
 }
 
+void test_packet_allocator()
+{
+    const int packet_sizes[] = { 1, 100, 1024, SNAPSHOT_PACKET_ALLOCATOR_SMALL_PACKET_BYTES, SNAPSHOT_MAX_PAYLOAD_BYTES, SNAPSHOT_MAX_PACKET_BYTES, SNAPSHOT_MAX_PACKET_BYTES * 2 };
+    const int num_packet_sizes = sizeof( packet_sizes ) / sizeof( int );
+
+    uint8_t * packets[num_packet_sizes];
+
+    for ( int iteration = 0; iteration < 10; iteration++ )
+    {
+        uint64_t start_hits, start_misses;
+        snapshot_packet_allocator_counters( &start_hits, &start_misses );
+
+        // every byte of the packet, prefix and postfix must be writable
+
+        for ( int i = 0; i < num_packet_sizes; i++ )
+        {
+            packets[i] = snapshot_create_packet( NULL, packet_sizes[i] );
+            snapshot_check( packets[i] );
+            memset( packets[i] - SNAPSHOT_PACKET_PREFIX_BYTES, i, SNAPSHOT_PACKET_PREFIX_BYTES + packet_sizes[i] + SNAPSHOT_PACKET_POSTFIX_BYTES );
+        }
+
+        for ( int i = 0; i < num_packet_sizes; i++ )
+        {
+            snapshot_check( packets[i][0] == (uint8_t) i );
+            snapshot_check( packets[i][packet_sizes[i]-1] == (uint8_t) i );
+            snapshot_destroy_packet( NULL, packets[i] );
+        }
+
+        uint64_t hits, misses;
+        snapshot_packet_allocator_counters( &hits, &misses );
+
+        snapshot_check( hits + misses == start_hits + start_misses + num_packet_sizes );
+
+        // after the first pass, everything except the oversize packet is recycled
+
+        if ( iteration > 0 )
+        {
+            snapshot_check( hits - start_hits == uint64_t( num_packet_sizes - 1 ) );
+            snapshot_check( misses - start_misses == 1 );
+        }
+    }
+
+    // packets from a user context never come from the shared free lists, so they can't be handed to another context
+
+    int user_context = 0;
+
+    for ( int iteration = 0; iteration < 2; iteration++ )
+    {
+        uint64_t start_hits, start_misses;
+        snapshot_packet_allocator_counters( &start_hits, &start_misses );
+
+        uint8_t * packet = snapshot_create_packet( &user_context, 100 );
+        snapshot_check( packet );
+        snapshot_destroy_packet( &user_context, packet );
+
+        uint64_t hits, misses;
+        snapshot_packet_allocator_counters( &hits, &misses );
+
+        snapshot_check( hits == start_hits );
+        snapshot_check( misses == start_misses + 1 );
+    }
+}
+
 void test_connection_request_packet()
 {
     // generate a connect token
@@ -1301,6 +1742,8 @@ void test_keep_alive_packet()
     input_packet.packet_type = SNAPSHOT_KEEP_ALIVE_PACKET;
     input_packet.client_index = 10;
     input_packet.max_clients = 16;
+    input_packet.ack = 1000;
+    input_packet.ack_bits = 0xFFFF0F0F;
 
     // write the packet to a buffer
 
@@ -1334,6 +1777,8 @@ void test_keep_alive_packet()
     snapshot_check( output_packet->packet_type == SNAPSHOT_KEEP_ALIVE_PACKET );
     snapshot_check( output_packet->client_index == input_packet.client_index );
     snapshot_check( output_packet->max_clients == input_packet.max_clients );
+    snapshot_check( output_packet->ack == input_packet.ack );
+    snapshot_check( output_packet->ack_bits == input_packet.ack_bits );
 }
 
 void test_payload_packet()
@@ -1389,6 +1834,115 @@ void test_payload_packet()
     snapshot_check( memcmp( output_packet->payload_data, input_payload_data, SNAPSHOT_MAX_PAYLOAD_BYTES ) == 0 );
 }
 
+void test_payload_iovec()
+{
+    // a payload big enough to fragment is written as iovecs, gathered into wire packets, then read back and reassembled
+
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    uint8_t packet_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( packet_key, SNAPSHOT_KEY_BYTES );
+
+    const int payload_sizes[] = { 100, sender_config.fragment_above + 1, SNAPSHOT_MAX_PAYLOAD_BYTES };
+
+    for ( int j = 0; j < (int) ( sizeof( payload_sizes ) / sizeof( int ) ); j++ )
+    {
+        const int payload_bytes = payload_sizes[j];
+
+        uint8_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+        snapshot_crypto_random_bytes( payload_data, payload_bytes );
+
+        int num_iovecs = 0;
+        struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_payload_iovecs( sender, payload_data, payload_bytes, &num_iovecs, iovecs );
+
+        const int expected_num_iovecs = ( payload_bytes <= sender_config.fragment_above ) ? 1 : ( payload_bytes + sender_config.fragment_size - 1 ) / sender_config.fragment_size;
+
+        snapshot_check( num_iovecs == expected_num_iovecs );
+
+        bool received = false;
+
+        for ( int i = 0; i < num_iovecs; i++ )
+        {
+            snapshot_check( iovecs[i].data >= payload_data );
+            snapshot_check( iovecs[i].data + iovecs[i].data_bytes <= payload_data + payload_bytes );
+
+            // payload packets are read in place, so leave room in front of the packet
+
+            uint8_t packet_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES];
+
+            uint8_t * buffer = packet_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+
+            int packet_bytes = 0;
+
+            snapshot_check( snapshot_write_payload_iovec( &iovecs[i], buffer, SNAPSHOT_MAX_PACKET_BYTES, 1000 + i, packet_key, TEST_PROTOCOL_ID, &packet_bytes ) == SNAPSHOT_OK );
+
+            uint64_t sequence;
+
+            uint8_t allowed_packet_types[SNAPSHOT_NUM_PACKETS];
+            memset( allowed_packet_types, 1, sizeof( allowed_packet_types ) );
+
+            uint8_t out_packet_data[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PAYLOAD_BYTES * 2];
+
+            struct snapshot_payload_packet_t * output_packet = (struct snapshot_payload_packet_t*) snapshot_read_packet( buffer, packet_bytes, &sequence, packet_key, TEST_PROTOCOL_ID, time, NULL, allowed_packet_types, out_packet_data + SNAPSHOT_PACKET_PREFIX_BYTES, NULL );
+
+            snapshot_check( output_packet );
+            snapshot_check( output_packet->packet_type == SNAPSHOT_PAYLOAD_PACKET );
+            snapshot_check( sequence == (uint64_t) ( 1000 + i ) );
+            snapshot_check( (int) output_packet->payload_bytes == iovecs[i].header_bytes + iovecs[i].data_bytes );
+
+            uint8_t * out_payload_data = NULL;
+            int out_payload_bytes = 0;
+            uint16_t out_sequence = 0;
+            uint16_t out_ack = 0;
+            uint32_t out_ack_bits = 0;
+
+            snapshot_endpoint_process_packet( receiver, output_packet->payload_data, output_packet->payload_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+            if ( out_payload_data )
+            {
+                snapshot_check( !received );
+                snapshot_check( out_payload_bytes == payload_bytes );
+                snapshot_check( memcmp( out_payload_data, payload_data, payload_bytes ) == 0 );
+                snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+                received = true;
+            }
+        }
+
+        snapshot_check( received );
+    }
+
+    // a buffer too small for the packet is an error, not an overflow
+
+    uint8_t payload_data[256];
+    memset( payload_data, 0, sizeof( payload_data ) );
+
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+    snapshot_endpoint_write_payload_iovecs( sender, payload_data, sizeof( payload_data ), &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == 1 );
+
+    uint8_t buffer[64];
+    int packet_bytes = 0;
+
+    snapshot_check( snapshot_write_payload_iovec( &iovecs[0], buffer, sizeof( buffer ), 1000, packet_key, TEST_PROTOCOL_ID, &packet_bytes ) == SNAPSHOT_ERROR );
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
 void test_passthrough_packet()
 {
     // setup a passthrough packet
@@ -1484,9 +2038,9 @@ void test_disconnect_packet()
 
 void test_encryption_manager()
 {
-    struct snapshot_encryption_manager_t encryption_manager;
+    struct snapshot_encryption_manager_t * encryption_manager = snapshot_encryption_manager_create( NULL, 16 );
 
-    snapshot_encryption_manager_reset( &encryption_manager );
+    snapshot_check( encryption_manager );
 
     double time = 100.0;
 
@@ -1516,14 +2070,14 @@ void test_encryption_manager()
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
         snapshot_check( encryption_index == -1 );
 
-        snapshot_check( snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
-        snapshot_check( snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+        snapshot_check( snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index ) == NULL );
+        snapshot_check( snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index ) == NULL );
 
-        snapshot_check( snapshot_encryption_manager_add_encryption_mapping( &encryption_manager, 
+        snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, 
                                                                   &encryption_mapping[i].address, 
                                                                   encryption_mapping[i].send_key, 
                                                                   encryption_mapping[i].receive_key, 
@@ -1531,10 +2085,10 @@ void test_encryption_manager()
                                                                   -1.0,
                                                                   TEST_TIMEOUT_SECONDS ) );
 
-        encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         snapshot_check( send_key );
         snapshot_check( receive_key );
@@ -1550,23 +2104,23 @@ void test_encryption_manager()
         address.data.ipv6[7] = 1;
         address.port = 50000;
 
-        snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( &encryption_manager, &address, time ) == 0 );
+        snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( encryption_manager, &address, time ) == 0 );
     }
 
     // remove the first and last encryption mappings
 
-    snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == 1 );
+    snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( encryption_manager, &encryption_mapping[0].address, time ) == 1 );
 
-    snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( &encryption_manager, &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, time ) == 1 );
+    snapshot_check( snapshot_encryption_manager_remove_encryption_mapping( encryption_manager, &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, time ) == 1 );
 
     // make sure the encryption mappings that were removed can no longer be looked up by address
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         if ( i != 0 && i != NUM_ENCRYPTION_MAPPINGS - 1 )
         {
@@ -1585,7 +2139,7 @@ void test_encryption_manager()
 
     // add the encryption mappings back in
     
-    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( &encryption_manager, 
+    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, 
                                                                         &encryption_mapping[0].address, 
                                                                         encryption_mapping[0].send_key, 
                                                                         encryption_mapping[0].receive_key, 
@@ -1593,7 +2147,7 @@ void test_encryption_manager()
                                                                         -1.0,
                                                                         TEST_TIMEOUT_SECONDS ) );
     
-    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( &encryption_manager, 
+    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, 
                                                                         &encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].address, 
                                                                         encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].send_key, 
                                                                         encryption_mapping[NUM_ENCRYPTION_MAPPINGS-1].receive_key, 
@@ -1605,10 +2159,10 @@ void test_encryption_manager()
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         snapshot_check( send_key );
         snapshot_check( receive_key );
@@ -1623,10 +2177,10 @@ void test_encryption_manager()
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         snapshot_check( !send_key );
         snapshot_check( !receive_key );
@@ -1636,14 +2190,14 @@ void test_encryption_manager()
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
         snapshot_check( encryption_index == -1 );
 
-        snapshot_check( snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index ) == NULL );
-        snapshot_check( snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index ) == NULL );
+        snapshot_check( snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index ) == NULL );
+        snapshot_check( snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index ) == NULL );
 
-        snapshot_check( snapshot_encryption_manager_add_encryption_mapping( &encryption_manager, 
+        snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, 
                                                                   &encryption_mapping[i].address, 
                                                                   encryption_mapping[i].send_key, 
                                                                   encryption_mapping[i].receive_key, 
@@ -1651,10 +2205,10 @@ void test_encryption_manager()
                                                                   -1.0,
                                                                   TEST_TIMEOUT_SECONDS ) );
 
-        encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         snapshot_check( send_key );
         snapshot_check( receive_key );
@@ -1665,14 +2219,14 @@ void test_encryption_manager()
 
     // reset the encryption mapping and verify that all encryption mappings have been removed
 
-    snapshot_encryption_manager_reset( &encryption_manager );
+    snapshot_encryption_manager_reset( encryption_manager );
 
     for ( int i = 0; i < NUM_ENCRYPTION_MAPPINGS; i++ )
     {
-        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[i].address, time );
+        int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[i].address, time );
 
-        uint8_t * send_key = snapshot_encryption_manager_get_send_key( &encryption_manager, encryption_index );
-        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( &encryption_manager, encryption_index );
+        uint8_t * send_key = snapshot_encryption_manager_get_send_key( encryption_manager, encryption_index );
+        uint8_t * receive_key = snapshot_encryption_manager_get_receive_key( encryption_manager, encryption_index );
 
         snapshot_check( !send_key );
         snapshot_check( !receive_key );
@@ -1680,7 +2234,7 @@ void test_encryption_manager()
 
     // test the expire time for encryption mapping works as expected
 
-    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( &encryption_manager, 
+    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, 
                                                                         &encryption_mapping[0].address, 
                                                                         encryption_mapping[0].send_key, 
                                                                         encryption_mapping[0].receive_key, 
@@ -1688,48 +2242,405 @@ void test_encryption_manager()
                                                                         time + 1.0,
                                                                         TEST_TIMEOUT_SECONDS ) );
 
-    int encryption_index = snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time );
+    int encryption_index = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[0].address, time );
 
     snapshot_check( encryption_index != -1 );
 
-    snapshot_check( snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time + 1.1f ) == -1 );
+    snapshot_check( snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[0].address, time + 1.1f ) == -1 );
+
+    snapshot_encryption_manager_set_expire_time( encryption_manager, encryption_index, -1.0 );
 
-    snapshot_encryption_manager_set_expire_time( &encryption_manager, encryption_index, -1.0 );
+    snapshot_check( snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &encryption_mapping[0].address, time ) == encryption_index );
 
-    snapshot_check( snapshot_encryption_manager_find_encryption_mapping( &encryption_manager, &encryption_mapping[0].address, time ) == encryption_index );
+    snapshot_encryption_manager_destroy( encryption_manager );
 }
 
-void test_replay_protection()
+void test_address_map()
 {
-    struct snapshot_replay_protection_t replay_protection;
+    const int NumEntries = 64;
 
-    for ( int i = 0; i < 2; i++ )
-    {
-        snapshot_replay_protection_reset( &replay_protection );
+    struct snapshot_address_map_entry_t entries[NumEntries];
 
-        snapshot_check( replay_protection.most_recent_sequence == 0 );
+    struct snapshot_address_map_t map;
 
-        // the first time we receive packets, they should not be already received
+    snapshot_address_map_init( &map, entries, NumEntries );
 
-        #define MAX_SEQUENCE ( SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE * 4 )
+    struct snapshot_address_t addresses[NumEntries];
 
-        uint64_t sequence;
-        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
-        {
-            snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == 0 );
-            snapshot_replay_protection_advance_sequence( &replay_protection, sequence );
-        }
+    const int NumAddresses = NumEntries / 2;
 
-        // old packets outside buffer should be considered already received
+    for ( int i = 0; i < NumAddresses; ++i )
+    {
+        char address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+        if ( i & 1 )
+            snprintf( address_string, sizeof(address_string), "[::1]:%d", 20000 + i );
+        else
+            snprintf( address_string, sizeof(address_string), "10.0.0.%d:40000", i );
+        snapshot_check( snapshot_address_parse( &addresses[i], address_string ) == SNAPSHOT_OK );
+    }
 
-        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, 0 ) == 1 );
+    for ( int i = 0; i < NumAddresses; ++i )
+    {
+        snapshot_check( snapshot_address_map_find( &map, &addresses[i] ) == -1 );
+    }
 
-        // packets received a second time should be flagged already received
+    for ( int i = 0; i < NumAddresses; ++i )
+    {
+        snapshot_check( snapshot_address_map_insert( &map, &addresses[i], i ) );
+    }
 
-        for ( sequence = MAX_SEQUENCE - 10; sequence < MAX_SEQUENCE; ++sequence )
-        {
-            snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == 1 );
-        }
+    snapshot_check( map.num_entries == NumAddresses );
+
+    for ( int i = 0; i < NumAddresses; ++i )
+    {
+        snapshot_check( snapshot_address_map_find( &map, &addresses[i] ) == i );
+    }
+
+    // inserting an existing address updates the value in place
+
+    snapshot_check( snapshot_address_map_insert( &map, &addresses[0], 1000 ) );
+    snapshot_check( map.num_entries == NumAddresses );
+    snapshot_check( snapshot_address_map_find( &map, &addresses[0] ) == 1000 );
+    snapshot_check( snapshot_address_map_insert( &map, &addresses[0], 0 ) );
+
+    // remove every other address, the rest must still be found after backward shift
+
+    for ( int i = 0; i < NumAddresses; i += 2 )
+    {
+        snapshot_check( snapshot_address_map_remove( &map, &addresses[i] ) );
+        snapshot_check( !snapshot_address_map_remove( &map, &addresses[i] ) );
+    }
+
+    snapshot_check( map.num_entries == NumAddresses / 2 );
+
+    for ( int i = 0; i < NumAddresses; ++i )
+    {
+        snapshot_check( snapshot_address_map_find( &map, &addresses[i] ) == ( ( i & 1 ) ? i : -1 ) );
+    }
+
+    // fill up the map. one slot is always kept empty
+
+    snapshot_address_map_reset( &map );
+
+    struct snapshot_address_t address;
+    snapshot_check( snapshot_address_parse( &address, "127.0.0.1" ) == SNAPSHOT_OK );
+
+    for ( int i = 0; i < NumEntries - 1; ++i )
+    {
+        address.port = uint16_t( 1000 + i );
+        snapshot_check( snapshot_address_map_insert( &map, &address, i ) );
+    }
+
+    address.port = uint16_t( 1000 + NumEntries );
+    snapshot_check( !snapshot_address_map_insert( &map, &address, NumEntries ) );
+    snapshot_check( snapshot_address_map_find( &map, &address ) == -1 );
+
+    for ( int i = 0; i < NumEntries - 1; ++i )
+    {
+        address.port = uint16_t( 1000 + i );
+        snapshot_check( snapshot_address_map_find( &map, &address ) == i );
+    }
+
+    for ( int i = 0; i < NumEntries - 1; ++i )
+    {
+        address.port = uint16_t( 1000 + i );
+        snapshot_check( snapshot_address_map_remove( &map, &address ) );
+        for ( int j = i + 1; j < NumEntries - 1; ++j )
+        {
+            struct snapshot_address_t other = address;
+            other.port = uint16_t( 1000 + j );
+            snapshot_check( snapshot_address_map_find( &map, &other ) == j );
+        }
+    }
+
+    snapshot_check( map.num_entries == 0 );
+}
+
+void test_timer_wheel()
+{
+    const double tick = 0.01;
+
+    double time = 100.0;
+
+    const int NumTimers = 256;
+
+    struct snapshot_timer_wheel_t * timer_wheel = snapshot_timer_wheel_create( NULL, NumTimers, tick, time );
+
+    snapshot_check( timer_wheel );
+
+    snapshot_check( snapshot_timer_wheel_pop_expired( timer_wheel ) == -1 );
+
+    // deadlines from just past now out to beyond the range of the top level
+
+    double deadline[NumTimers];
+
+    for ( int i = 0; i < NumTimers; i++ )
+    {
+        if ( i < 64 )
+            deadline[i] = time + i * 0.003;
+        else if ( i < 128 )
+            deadline[i] = time + ( rand() % 100000 ) * 0.001;
+        else if ( i < 192 )
+            deadline[i] = time + ( rand() % 10000 ) * 0.1;
+        else if ( i < 255 )
+            deadline[i] = time + ( rand() % 1000 ) * 10.0;
+        else
+            deadline[i] = time + 200000.0;
+
+        snapshot_timer_wheel_schedule( timer_wheel, i, deadline[i] );
+
+        snapshot_check( snapshot_timer_wheel_scheduled( timer_wheel, i ) );
+    }
+
+    // cancel and reschedule some timers
+
+    for ( int i = 0; i < NumTimers; i += 8 )
+    {
+        snapshot_timer_wheel_cancel( timer_wheel, i );
+        snapshot_check( !snapshot_timer_wheel_scheduled( timer_wheel, i ) );
+        deadline[i] = -1.0;
+    }
+
+    for ( int i = 4; i < NumTimers; i += 8 )
+    {
+        deadline[i] = time + ( rand() % 5000 ) * 0.01;
+        snapshot_timer_wheel_schedule( timer_wheel, i, deadline[i] );
+    }
+
+    // step time forward and make sure each timer fires once, never before its deadline and no more than one tick after
+
+    bool fired[NumTimers];
+    memset( fired, 0, sizeof(fired) );
+
+    const double step[] = { 0.001, 0.01, 0.37, 1.0, 10.0, 1000.0 };
+
+    int num_steps = 0;
+
+    while ( time < 100.0 + 250000.0 )
+    {
+        const double dt = step[ ( num_steps / 50 ) % ( sizeof(step) / sizeof(double) ) ];
+        time += dt;
+        num_steps++;
+
+        snapshot_timer_wheel_advance( timer_wheel, time );
+
+        int timer_id;
+        while ( ( timer_id = snapshot_timer_wheel_pop_expired( timer_wheel ) ) != -1 )
+        {
+            snapshot_check( timer_id >= 0 && timer_id < NumTimers );
+            snapshot_check( deadline[timer_id] >= 0.0 );
+            snapshot_check( !fired[timer_id] );
+            snapshot_check( deadline[timer_id] < time );
+            snapshot_check( deadline[timer_id] >= time - dt - tick );
+            snapshot_check( !snapshot_timer_wheel_scheduled( timer_wheel, timer_id ) );
+            fired[timer_id] = true;
+        }
+    }
+
+    for ( int i = 0; i < NumTimers; i++ )
+    {
+        snapshot_check( fired[i] == ( deadline[i] >= 0.0 ) );
+    }
+
+    // a deadline in the past expires on the next pop
+
+    snapshot_timer_wheel_schedule( timer_wheel, 0, time - 1.0 );
+
+    snapshot_check( snapshot_timer_wheel_pop_expired( timer_wheel ) == 0 );
+    snapshot_check( snapshot_timer_wheel_pop_expired( timer_wheel ) == -1 );
+
+    snapshot_timer_wheel_destroy( timer_wheel );
+}
+
+void test_encryption_manager_expiry_timer()
+{
+    double time = 100.0;
+
+    struct snapshot_timer_wheel_t * timer_wheel = snapshot_timer_wheel_create( NULL, 16, 0.01, time );
+
+    struct snapshot_encryption_manager_t * encryption_manager = snapshot_encryption_manager_create( NULL, 8 );
+
+    snapshot_check( timer_wheel );
+    snapshot_check( encryption_manager );
+
+    snapshot_encryption_manager_set_timer_wheel( encryption_manager, timer_wheel, 8 );
+
+    uint8_t send_key[SNAPSHOT_KEY_BYTES];
+    uint8_t receive_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( send_key, SNAPSHOT_KEY_BYTES );
+    snapshot_crypto_random_bytes( receive_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_address_t address[2];
+    snapshot_check( snapshot_address_parse( &address[0], "127.0.0.1:50000" ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_address_parse( &address[1], "127.0.0.1:50001" ) == SNAPSHOT_OK );
+
+    // one mapping expires by timeout, the other by expire time
+
+    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, &address[0], send_key, receive_key, time, -1.0, 5 ) );
+    snapshot_check( snapshot_encryption_manager_add_encryption_mapping( encryption_manager, &address[1], send_key, receive_key, time, time + 2.0, 60 ) );
+
+    const int index_0 = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &address[0], time );
+    const int index_1 = snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &address[1], time );
+
+    snapshot_check( index_0 != -1 );
+    snapshot_check( index_1 != -1 );
+    snapshot_check( snapshot_timer_wheel_scheduled( timer_wheel, 8 + index_0 ) );
+    snapshot_check( snapshot_timer_wheel_scheduled( timer_wheel, 8 + index_1 ) );
+
+    for ( int i = 0; i < 1000; i++ )
+    {
+        time += 0.01;
+
+        // keep touching the first mapping for a while, so its deadline moves out
+
+        if ( time < 103.0 )
+        {
+            snapshot_check( snapshot_encryption_manager_find_encryption_mapping( encryption_manager, &address[0], time ) == index_0 );
+        }
+
+        snapshot_timer_wheel_advance( timer_wheel, time );
+
+        int timer_id;
+        while ( ( timer_id = snapshot_timer_wheel_pop_expired( timer_wheel ) ) != -1 )
+        {
+            snapshot_encryption_manager_process_expiry_timer( encryption_manager, timer_id - 8, time );
+        }
+
+        if ( time > 102.1 )
+        {
+            snapshot_check( encryption_manager->address[index_1].type == SNAPSHOT_ADDRESS_NONE );
+        }
+
+        if ( time < 107.9 )
+        {
+            snapshot_check( encryption_manager->address[index_0].type != SNAPSHOT_ADDRESS_NONE );
+        }
+    }
+
+    // both mappings have been removed by their timers, without anybody looking them up
+
+    snapshot_check( encryption_manager->address[index_0].type == SNAPSHOT_ADDRESS_NONE );
+    snapshot_check( encryption_manager->address[index_1].type == SNAPSHOT_ADDRESS_NONE );
+    snapshot_check( !snapshot_timer_wheel_scheduled( timer_wheel, 8 + index_0 ) );
+    snapshot_check( !snapshot_timer_wheel_scheduled( timer_wheel, 8 + index_1 ) );
+
+    snapshot_encryption_manager_destroy( encryption_manager );
+
+    snapshot_timer_wheel_destroy( timer_wheel );
+}
+
+#define TEST_SPSC_QUEUE_NUM_ENTRIES 10000
+
+static void test_spsc_queue_producer_thread_function( void * arg )
+{
+    struct snapshot_spsc_queue_t * queue = (struct snapshot_spsc_queue_t*) arg;
+
+    for ( int i = 0; i < TEST_SPSC_QUEUE_NUM_ENTRIES; i++ )
+    {
+        int * entry = NULL;
+        while ( ( entry = (int*) snapshot_spsc_queue_begin_push( queue ) ) == NULL )
+        {
+            snapshot_platform_sleep( 0.0001 );
+        }
+        *entry = i;
+        snapshot_spsc_queue_end_push( queue );
+    }
+}
+
+void test_spsc_queue()
+{
+    const int Capacity = 256;
+
+    struct snapshot_spsc_queue_t * queue = snapshot_spsc_queue_create( NULL, Capacity, sizeof(int) );
+
+    snapshot_check( queue );
+    snapshot_check( snapshot_spsc_queue_capacity( queue ) == Capacity );
+    snapshot_check( snapshot_spsc_queue_front( queue ) == NULL );
+
+    // fill the queue, then drain it in order. do it twice so the indices wrap
+
+    for ( int pass = 0; pass < 2; pass++ )
+    {
+        for ( int i = 0; i < Capacity; i++ )
+        {
+            int * entry = (int*) snapshot_spsc_queue_begin_push( queue );
+            snapshot_check( entry );
+            *entry = pass * 1000 + i;
+            snapshot_spsc_queue_end_push( queue );
+        }
+
+        snapshot_check( snapshot_spsc_queue_begin_push( queue ) == NULL );
+
+        for ( int i = 0; i < Capacity; i++ )
+        {
+            int * entry = (int*) snapshot_spsc_queue_front( queue );
+            snapshot_check( entry );
+            snapshot_check( *entry == pass * 1000 + i );
+            snapshot_spsc_queue_pop( queue );
+        }
+
+        snapshot_check( snapshot_spsc_queue_front( queue ) == NULL );
+    }
+
+    // one producer thread and one consumer thread. every entry arrives exactly once, in order
+
+    snapshot_platform_thread_t * thread = snapshot_platform_thread_create( NULL, test_spsc_queue_producer_thread_function, queue );
+
+    snapshot_check( thread );
+
+    int expected = 0;
+    while ( expected < TEST_SPSC_QUEUE_NUM_ENTRIES )
+    {
+        int * entry = (int*) snapshot_spsc_queue_front( queue );
+        if ( !entry )
+        {
+            snapshot_platform_sleep( 0.0001 );
+            continue;
+        }
+        snapshot_check( *entry == expected );
+        snapshot_spsc_queue_pop( queue );
+        expected++;
+    }
+
+    snapshot_platform_thread_join( thread );
+    snapshot_platform_thread_destroy( thread );
+
+    snapshot_check( snapshot_spsc_queue_front( queue ) == NULL );
+
+    snapshot_spsc_queue_destroy( queue );
+}
+
+void test_replay_protection()
+{
+    struct snapshot_replay_protection_t replay_protection;
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        snapshot_replay_protection_reset( &replay_protection );
+
+        snapshot_check( replay_protection.most_recent_sequence == 0 );
+
+        // the first time we receive packets, they should not be already received
+
+        #define MAX_SEQUENCE ( SNAPSHOT_REPLAY_PROTECTION_BUFFER_SIZE * 4 )
+
+        uint64_t sequence;
+        for ( sequence = 0; sequence < MAX_SEQUENCE; ++sequence )
+        {
+            snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == 0 );
+            snapshot_replay_protection_advance_sequence( &replay_protection, sequence );
+        }
+
+        // old packets outside buffer should be considered already received
+
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, 0 ) == 1 );
+
+        // packets received a second time should be flagged already received
+
+        for ( sequence = MAX_SEQUENCE - 10; sequence < MAX_SEQUENCE; ++sequence )
+        {
+            snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == 1 );
+        }
 
         // jumping ahead to a much higher sequence should be considered not already received
 
@@ -1744,6 +2655,76 @@ void test_replay_protection()
     }
 }
 
+void test_replay_protection_window()
+{
+    struct snapshot_replay_protection_t replay_protection;
+    snapshot_replay_protection_reset( &replay_protection );
+
+    // packets arriving in any order inside the window are accepted once, then rejected
+
+    const int num_sequences = SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE;
+
+    uint64_t sequences[num_sequences];
+    for ( int i = 0; i < num_sequences; ++i )
+    {
+        sequences[i] = 1000 + i;
+    }
+
+    for ( int i = num_sequences - 1; i > 0; --i )
+    {
+        const int j = rand() % ( i + 1 );
+        uint64_t temp = sequences[i];
+        sequences[i] = sequences[j];
+        sequences[j] = temp;
+    }
+
+    snapshot_replay_protection_advance_sequence( &replay_protection, 1000 + num_sequences - 1 );
+
+    for ( int i = 0; i < num_sequences; ++i )
+    {
+        if ( sequences[i] == uint64_t( 1000 + num_sequences - 1 ) )
+            continue;
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequences[i] ) == 0 );
+        snapshot_replay_protection_advance_sequence( &replay_protection, sequences[i] );
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequences[i] ) == 1 );
+    }
+
+    for ( int i = 0; i < num_sequences; ++i )
+    {
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequences[i] ) == 1 );
+    }
+
+    // sliding forward by less than a window keeps the overlap, and forgets nothing newer than the window
+
+    const uint64_t slide = SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE / 2 + 3;
+    const uint64_t most_recent = 1000 + num_sequences - 1 + slide;
+
+    snapshot_check( snapshot_replay_protection_already_received( &replay_protection, most_recent ) == 0 );
+    snapshot_replay_protection_advance_sequence( &replay_protection, most_recent );
+
+    for ( uint64_t sequence = most_recent - SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE + 1; sequence < most_recent; ++sequence )
+    {
+        const bool received = sequence < uint64_t( 1000 + num_sequences );
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == ( received ? 1 : 0 ) );
+    }
+
+    snapshot_check( snapshot_replay_protection_already_received( &replay_protection, most_recent - SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE ) == 1 );
+
+    // a jump far ahead clears the whole bitmap
+
+    const uint64_t jump = most_recent + SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE * 10 + 17;
+
+    snapshot_replay_protection_advance_sequence( &replay_protection, jump );
+
+    for ( uint64_t sequence = jump - SNAPSHOT_REPLAY_PROTECTION_WINDOW_SIZE + 1; sequence < jump; ++sequence )
+    {
+        snapshot_check( snapshot_replay_protection_already_received( &replay_protection, sequence ) == 0 );
+    }
+
+    snapshot_check( snapshot_replay_protection_already_received( &replay_protection, jump ) == 1 );
+    snapshot_check( snapshot_replay_protection_already_received( &replay_protection, jump + 1 ) == 0 );
+}
+
 void test_ipv4_client_create_any_port()
 {
     struct snapshot_client_config_t client_config;
@@ -1835,7 +2816,7 @@ void test_ipv4_client_server_connect()
 
 void generate_passthrough_packet( uint8_t * packet_data, int & packet_bytes )
 {
-    packet_bytes = rand() % SNAPSHOT_MAX_PASSTHROUGH_BYTES;
+    packet_bytes = 1 + rand() % ( SNAPSHOT_MAX_PASSTHROUGH_BYTES - 1 );
     const int start = packet_bytes % 256;
     for ( int i = 0; i < packet_bytes; i++ )
     {
@@ -1898,7 +2879,7 @@ void test_ipv4_client_server_passthrough()
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
-    server_config.context = &passthrough_context;
+    server_config.callback_context = &passthrough_context;
     server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
     server_config.process_passthrough_callback = server_process_passthrough_callback;
@@ -1974,45 +2955,22 @@ void test_ipv4_client_server_passthrough()
     snapshot_client_destroy( client );
 }
 
-#if SNAPSHOT_PLATFORM_HAS_IPV6
-
-void test_ipv6_client_create_any_port()
-{
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-
-    struct snapshot_client_t * client = snapshot_client_create( "[::]:0", &client_config, 0.0 );
-
-    snapshot_check( client );
-    snapshot_check( snapshot_client_port( client ) != 0 );
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
-
-    snapshot_client_destroy( client );
-}
-
-void test_ipv6_client_create_specific_port()
+void test_server_send_queue()
 {
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-
-    struct snapshot_client_t * client = snapshot_client_create( "[::]:30000", &client_config, 0.0 );
-
-    snapshot_check( client );
-    snapshot_check( snapshot_client_port( client ) == 30000 );
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
-
-    snapshot_client_destroy( client );
-}
+    passthrough_context_t passthrough_context;
+    memset( &passthrough_context, 0, sizeof(passthrough_context_t) );
 
-void test_ipv6_client_server_connect()
-{
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
+    client_config.context = &passthrough_context;
+    client_config.process_passthrough_callback = client_process_passthrough_callback;
 
-    struct snapshot_client_t * client = snapshot_client_create( "[::]:50000", &client_config, time );
+    // connect client to server
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
 
     snapshot_check( client );
 
@@ -2021,13 +2979,15 @@ void test_ipv6_client_server_connect()
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
+    server_config.callback_context = &passthrough_context;
     server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.process_passthrough_callback = server_process_passthrough_callback;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    const char * server_address = "[::1]:40000";
+    const char * server_address = "127.0.0.1:40000";
 
-    struct snapshot_server_t * server = snapshot_server_create( "[::1]:40000", &server_config, time );
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
 
     snapshot_check( server );
 
@@ -2043,12 +3003,16 @@ void test_ipv6_client_server_connect()
 
     snapshot_client_connect( client, connect_token );
 
+    int num_updates = 0;
+
     while ( 1 )
     {
         snapshot_client_update( client, time );
 
         snapshot_server_update( server, time );
 
+        num_updates++;
+
         if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
             break;
 
@@ -2060,103 +3024,49 @@ void test_ipv6_client_server_connect()
 
     snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    snapshot_server_destroy( server );
-
-    snapshot_client_destroy( client );
-}
-
-void test_ipv6_client_server_passthrough()
-{
-    passthrough_context_t passthrough_context;
-    memset( &passthrough_context, 0, sizeof(passthrough_context_t) );
-
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
-
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.context = &passthrough_context;
-    client_config.process_passthrough_callback = client_process_passthrough_callback;
-
-    // connect client to server
-
-    struct snapshot_client_t * client = snapshot_client_create( "[::]:50000", &client_config, time );
-
-    snapshot_check( client );
-
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
-
-    struct snapshot_server_config_t server_config;
-    snapshot_default_server_config( &server_config );
-    server_config.context = &passthrough_context;
-    server_config.max_clients = 1;
-    server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.process_passthrough_callback = server_process_passthrough_callback;
-    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
-
-    const char * server_address = "[::1]:40000";
-
-    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
-
-    snapshot_check( server );
+    // at most one batched send per server update
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    const uint64_t * server_counters = snapshot_server_counters( server );
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES] <= (uint64_t) num_updates );
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+    // passthrough packets sent outside of update sit in the queue until flushed
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+    const uint64_t flushes_before = server_counters[SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES];
 
-    snapshot_client_connect( client, connect_token );
+    const int NumPackets = 10;
 
-    while ( 1 )
+    for ( int i = 0; i < NumPackets; ++i )
     {
-        snapshot_client_update( client, time );
+        uint8_t passthrough_data[256];
+        const int passthrough_bytes = 100 + i;
+        const int start = passthrough_bytes % 256;
+        for ( int j = 0; j < passthrough_bytes; j++ )
+        {
+            passthrough_data[j] = (uint8_t) ( ( start + j ) % 256 );
+        }
+        snapshot_server_send_passthrough_packet( server, 0, passthrough_data, passthrough_bytes );
+    }
 
-        snapshot_server_update( server, time );
+    snapshot_client_update( client, time );
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    snapshot_check( passthrough_context.num_passthrough_packets_received_on_client == 0 );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
-            break;
+    snapshot_server_flush_packets( server );
 
-        time += delta_time;
-    }
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES] == flushes_before + 1 );
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_server_flush_packets( server );
 
-    // exchange passthrough packets
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_SEND_QUEUE_FLUSHES] == flushes_before + 1 );
 
-    while ( 1 )
+    double start_time = snapshot_platform_time();
+    while ( passthrough_context.num_passthrough_packets_received_on_client < NumPackets && snapshot_platform_time() < start_time + 1.0 )
     {
-        int passthrough_bytes = 0;
-        uint8_t passthrough_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
-        generate_passthrough_packet( passthrough_data, passthrough_bytes );
-
-        snapshot_client_send_passthrough_packet( client, passthrough_data, passthrough_bytes );
-
-        snapshot_server_send_passthrough_packet( server, 0, passthrough_data, passthrough_bytes );
-
         snapshot_client_update( client, time );
-
-        snapshot_server_update( server, time );
-
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        if ( passthrough_context.num_passthrough_packets_received_on_client > 100 && passthrough_context.num_passthrough_packets_received_on_server > 100 )
-            break;
-
-        time += delta_time;
     }
 
-    snapshot_check( passthrough_context.num_passthrough_packets_received_on_client > 100 );
-    snapshot_check( passthrough_context.num_passthrough_packets_received_on_server > 100 );
+    snapshot_check( passthrough_context.num_passthrough_packets_received_on_client == NumPackets );
 
     // clean up
 
@@ -2165,157 +3075,152 @@ void test_ipv6_client_server_passthrough()
     snapshot_client_destroy( client );
 }
 
-#endif // #if SNAPSHOT_PLATFORM_HAS_IPV6
-
-struct loopback_context_t
-{
-    struct snapshot_client_t * client;
-    struct snapshot_server_t * server;
-};
-
-void client_send_loopback_packet_callback( void * context, const snapshot_address_t * from, uint8_t * packet_data, int packet_bytes )
-{
-    loopback_context_t * loopback_context = (loopback_context_t*) context;
-    snapshot_server_process_packet( loopback_context->server, from, packet_data, packet_bytes );
-}
-
-void server_send_loopback_packet_callback( void * context, const snapshot_address_t * from, uint8_t * packet_data, int packet_bytes )
-{
-    loopback_context_t * loopback_context = (loopback_context_t*) context;
-    snapshot_client_process_packet( loopback_context->client, from, packet_data, packet_bytes );
-}
-
-void test_client_server_loopback()
+void test_server_max_clients()
 {
     double time = 0.0;
 
-    loopback_context_t loopback_context;
-
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
-
-    // start the server
-
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
-    server_config.max_clients = 2;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.context = &loopback_context;
-    server_config.send_loopback_packet_callback = server_send_loopback_packet_callback;
-    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
-
-    const char * server_address_string = "127.0.0.1:40000";
-
-    snapshot_address_t server_address;
-    snapshot_check( snapshot_address_parse( &server_address, server_address_string ) == SNAPSHOT_OK );
 
-    struct snapshot_server_t * server = snapshot_server_create( server_address_string, &server_config, time );
-
-    snapshot_check( server );
+    snapshot_check( server_config.max_clients == SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
-    int max_clients = 2;
+    // max clients outside of [1,SNAPSHOT_MAX_CLIENTS] is rejected
 
-    loopback_context.server = server;
+    server_config.max_clients = 0;
+    snapshot_check( snapshot_server_create( "127.0.0.1:40000", &server_config, time ) == NULL );
 
-    // connect a loopback client in slot 0
+    server_config.max_clients = SNAPSHOT_MAX_CLIENTS + 1;
+    snapshot_check( snapshot_server_create( "127.0.0.1:40000", &server_config, time ) == NULL );
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.context = &loopback_context;
-    client_config.send_loopback_packet_callback = client_send_loopback_packet_callback;
+    // a server with the maximum number of clients can use every slot
 
-    struct snapshot_client_t * loopback_client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
-    snapshot_check( loopback_client );
+    server_config.max_clients = SNAPSHOT_MAX_CLIENTS;
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
-    snapshot_client_connect_loopback( loopback_client, &server_address, 0, max_clients );
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-    loopback_context.client = loopback_client;
+    snapshot_check( server );
 
-    snapshot_check( snapshot_client_index( loopback_client ) == 0 );
-    snapshot_check( snapshot_client_loopback( loopback_client ) == 1 );
-    snapshot_check( snapshot_client_max_clients( loopback_client ) == max_clients );
-    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_address_equal( snapshot_client_server_address( loopback_client ), &server_address ) );
+    snapshot_check( snapshot_server_max_clients( server ) == SNAPSHOT_MAX_CLIENTS );
 
-    snapshot_server_connect_loopback_client( server, 0, client_id, NULL );
+    const int client_index[] = { 0, SNAPSHOT_DEFAULT_MAX_CLIENTS, SNAPSHOT_MAX_CLIENTS - 1 };
+    const int num_clients = sizeof(client_index) / sizeof(int);
 
-    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    for ( int i = 0; i < num_clients; i++ )
+    {
+        snapshot_server_connect_loopback_client( server, client_index[i], 1000 + i, NULL );
+    }
 
-    // verify we can disconnect the loopback client
+    snapshot_check( snapshot_server_num_connected_clients( server ) == num_clients );
 
-    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    for ( int i = 0; i < 10; i++ )
+    {
+        time += 0.1;
+        snapshot_server_update( server, time );
+    }
 
-    snapshot_server_disconnect_loopback_client( server, 0 );    
+    for ( int i = 0; i < num_clients; i++ )
+    {
+        snapshot_check( snapshot_server_client_connected( server, client_index[i] ) );
+        snapshot_check( snapshot_server_client_id( server, client_index[i] ) == uint64_t( 1000 + i ) );
+        snapshot_server_disconnect_loopback_client( server, client_index[i] );
+    }
 
-    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
     snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
 
-    snapshot_client_disconnect_loopback( loopback_client );
+    snapshot_server_destroy( server );
+}
 
-    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
+void test_server_connected_clients()
+{
+    double time = 0.0;
 
-    // verify we can reconnect the loopback client
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.max_clients = 16;
 
-    snapshot_server_connect_loopback_client( server, 0, client_id, NULL );
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_client_loopback( server, 1 ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_client_connected( server, 1 ) == 0 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    snapshot_check( server );
 
-    snapshot_client_connect_loopback( loopback_client, &server_address, 0, max_clients );
-    
-    snapshot_check( snapshot_client_index( loopback_client ) == 0 );
-    snapshot_check( snapshot_client_loopback( loopback_client ) == 1 );
-    snapshot_check( snapshot_client_max_clients( loopback_client ) == max_clients );
-    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    for ( int i = 0; i < server_config.max_clients; i++ )
+    {
+        snapshot_server_connect_loopback_client( server, i, 1000 + i, NULL );
+    }
 
-    // verify the loopback client doesn't time out
+    snapshot_check( snapshot_server_num_connected_clients( server ) == server_config.max_clients );
 
-    time += 100000.0;
+    // disconnect from the front, middle and back of the connected client list
 
-    snapshot_server_update( server, time );
+    const int disconnect_index[] = { 0, 7, 15, 8, 1 };
+    const int num_disconnects = sizeof(disconnect_index) / sizeof(int);
 
-    snapshot_client_update( loopback_client, time );
+    for ( int i = 0; i < num_disconnects; i++ )
+    {
+        snapshot_server_disconnect_loopback_client( server, disconnect_index[i] );
+        time += 0.1;
+        snapshot_server_update( server, time );
+    }
 
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == server_config.max_clients - num_disconnects );
 
-    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    for ( int i = 0; i < server_config.max_clients; i++ )
+    {
+        bool disconnected = false;
+        for ( int j = 0; j < num_disconnects; j++ )
+        {
+            if ( disconnect_index[j] == i )
+                disconnected = true;
+        }
+        snapshot_check( snapshot_server_client_connected( server, i ) == ( disconnected ? 0 : 1 ) );
+    }
 
-    // verify that disconnect all clients leaves loopback clients alone
+    // reconnect into the free slots, then disconnect everybody
 
-    snapshot_server_disconnect_all_clients( server );
+    for ( int i = 0; i < num_disconnects; i++ )
+    {
+        snapshot_server_connect_loopback_client( server, disconnect_index[i], 2000 + i, NULL );
+    }
 
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == server_config.max_clients );
 
-    // clean up
+    for ( int i = server_config.max_clients - 1; i >= 0; i-- )
+    {
+        snapshot_server_disconnect_loopback_client( server, ( i * 5 ) % server_config.max_clients );
+    }
 
-    snapshot_client_destroy( loopback_client );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
 
     snapshot_server_destroy( server );
 }
 
-void test_client_server_network_simulator()
+void test_client_server_arena()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    // arena allocations are cache line aligned and fail cleanly when the arena is full
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+    {
+        struct snapshot_arena_t arena;
+        snapshot_check( snapshot_arena_create( &arena, NULL, snapshot_arena_bytes( 1 ) + snapshot_arena_bytes( 100 ) ) == SNAPSHOT_OK );
+        uint8_t * a = (uint8_t*) snapshot_arena_alloc( &arena, 1 );
+        uint8_t * b = (uint8_t*) snapshot_arena_alloc( &arena, 100 );
+        snapshot_check( a );
+        snapshot_check( b );
+        snapshot_check( ( (uintptr_t) a ) % SNAPSHOT_ARENA_ALIGNMENT == 0 );
+        snapshot_check( ( (uintptr_t) b ) % SNAPSHOT_ARENA_ALIGNMENT == 0 );
+        snapshot_check( b >= a + 1 );
+        snapshot_check( snapshot_arena_alloc( &arena, 1 ) == NULL );
+        snapshot_arena_destroy( &arena );
+    }
+
+    // connect a client to a server, with both carved from arenas
 
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+    client_config.use_arena = true;
 
     struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
 
@@ -2326,9 +3231,9 @@ void test_client_server_network_simulator()
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
+    server_config.max_clients = 64;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
+    server_config.use_arena = true;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
     const char * server_address = "127.0.0.1:40000";
@@ -2343,7 +3248,7 @@ void test_client_server_network_simulator()
     snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
     uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+    snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
 
     snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
@@ -2351,8 +3256,6 @@ void test_client_server_network_simulator()
 
     while ( 1 )
     {
-        snapshot_network_simulator_update( network_simulator, time );
-
         snapshot_client_update( client, time );
 
         snapshot_server_update( server, time );
@@ -2366,408 +3269,633 @@ void test_client_server_network_simulator()
         time += delta_time;
     }
 
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    snapshot_check( snapshot_server_client_id( server, snapshot_client_index( client ) ) == client_id );
+
+    for ( int i = 0; i < 64; ++i )
+    {
+        snapshot_client_update( client, time );
+        snapshot_server_update( server, time );
+        time += delta_time;
+    }
+
     snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
     snapshot_server_destroy( server );
 
     snapshot_client_destroy( client );
+}
 
-    snapshot_network_simulator_destroy ( network_simulator );
+struct sharded_server_context_t
+{
+    int num_connects;
+    int num_disconnects;
+    int num_passthrough_packets_received[SNAPSHOT_MAX_CLIENTS];
+};
+
+void sharded_server_connect_disconnect_callback( void * context, int client_index, int connected )
+{
+    (void) client_index;
+    sharded_server_context_t * sharded_context = (sharded_server_context_t*) context;
+    if ( connected )
+        sharded_context->num_connects++;
+    else
+        sharded_context->num_disconnects++;
 }
 
-void test_client_server_keep_alive()
+void sharded_server_process_passthrough_callback( void * context, const snapshot_address_t * client_address, int client_index, const uint8_t * passthrough_data, int passthrough_bytes )
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    (void) client_address;
+    verify_passthrough_packet( passthrough_data, passthrough_bytes );
+    sharded_server_context_t * sharded_context = (sharded_server_context_t*) context;
+    sharded_context->num_passthrough_packets_received[client_index]++;
+}
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+void test_sharded_server()
+{
+    const int NumShards = 2;
+    const int NumClients = 4;
 
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
+    sharded_server_context_t sharded_context;
+    memset( &sharded_context, 0, sizeof(sharded_context) );
+
+    passthrough_context_t passthrough_context;
+    memset( &passthrough_context, 0, sizeof(passthrough_context_t) );
 
     uint8_t private_key[SNAPSHOT_KEY_BYTES];
     snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    // connect client to server
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.callback_context = &sharded_context;
+    server_config.max_clients = NumShards * NumClients;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.connect_disconnect_callback = sharded_server_connect_disconnect_callback;
+    server_config.process_passthrough_callback = sharded_server_process_passthrough_callback;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+    struct snapshot_sharded_server_t * sharded_server = snapshot_sharded_server_create( "127.0.0.1:0", &server_config, NumShards );
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    if ( !sharded_server )
+    {
+        // reuse port sockets are not available on this platform
+        return;
+    }
 
-    snapshot_check( client );
+    snapshot_check( snapshot_sharded_server_num_shards( sharded_server ) == NumShards );
+    snapshot_check( snapshot_sharded_server_max_clients( sharded_server ) == NumShards * NumClients );
+    snapshot_check( snapshot_sharded_server_port( sharded_server ) != 0 );
 
-    struct snapshot_server_config_t server_config;
-    snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
-    server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
-    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+    char server_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+    snprintf( server_address_string, sizeof(server_address_string), "127.0.0.1:%d", snapshot_sharded_server_port( sharded_server ) );
+    const char * server_address = server_address_string;
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+    // connect clients. the kernel spreads them across the shards by source address
 
-    snapshot_check( server );
+    double time = snapshot_platform_time();
 
-    const char * server_address = "127.0.0.1:40000";
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.context = &passthrough_context;
+    client_config.process_passthrough_callback = client_process_passthrough_callback;
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    struct snapshot_client_t * client[NumClients];
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        client[i] = snapshot_client_create( "0.0.0.0:0", &client_config, time );
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+        snapshot_check( client[i] );
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+        uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-    snapshot_client_connect( client, connect_token );
+        uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+        snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
 
-    while ( 1 )
+        snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, 1000 + i, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+        snapshot_client_connect( client[i], connect_token );
+    }
+
+    const double timeout = time + 10.0;
+
+    while ( time < timeout )
     {
-        snapshot_network_simulator_update( network_simulator, time );
+        time = snapshot_platform_time();
 
-        snapshot_client_update( client, time );
+        int num_connected = 0;
 
-        snapshot_server_update( server, time );
+        for ( int i = 0; i < NumClients; i++ )
+        {
+            snapshot_client_update( client[i], time );
+            if ( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+                num_connected++;
+        }
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+        snapshot_sharded_server_update( sharded_server );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+        if ( num_connected == NumClients && snapshot_sharded_server_num_connected_clients( sharded_server ) == NumClients )
             break;
 
-        time += delta_time;
+        snapshot_platform_sleep( 0.01 );
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    snapshot_check( snapshot_sharded_server_num_connected_clients( sharded_server ) == NumClients );
+    snapshot_check( sharded_context.num_connects == NumClients );
 
-    // pump the client and server long enough that they would timeout without keep alive packets
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        snapshot_check( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    }
 
-    int num_iterations = (int) ceil( 1.25f * TEST_TIMEOUT_SECONDS / delta_time );
+    // each client is told its global client index, not the index in its shard
 
-    for ( int i = 0; i < num_iterations; i++ )
+    for ( int i = 0; i < NumClients; i++ )
     {
-        snapshot_network_simulator_update( network_simulator, time );
+        const int client_index = snapshot_client_index( client[i] );
+        snapshot_check( client_index >= 0 );
+        snapshot_check( client_index < NumClients );
+        snapshot_check( snapshot_client_max_clients( client[i] ) == NumShards * NumClients );
+        snapshot_check( snapshot_sharded_server_client_connected( sharded_server, client_index ) );
+        snapshot_check( snapshot_sharded_server_client_id( sharded_server, client_index ) == (uint64_t) ( 1000 + i ) );
+    }
 
-        snapshot_client_update( client, time );
+    // exchange passthrough packets in both directions. server callbacks arrive on this thread with global client indices
 
-        snapshot_server_update( server, time );
+    while ( time < timeout )
+    {
+        time = snapshot_platform_time();
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+        int passthrough_bytes = 0;
+        uint8_t passthrough_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+        generate_passthrough_packet( passthrough_data, passthrough_bytes );
+
+        for ( int i = 0; i < NumClients; i++ )
+        {
+            snapshot_client_send_passthrough_packet( client[i], passthrough_data, passthrough_bytes );
+            snapshot_client_update( client[i], time );
+        }
+
+        for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+        {
+            if ( snapshot_sharded_server_client_connected( sharded_server, i ) )
+            {
+                snapshot_sharded_server_send_passthrough_packet( sharded_server, i, passthrough_data, passthrough_bytes );
+            }
+        }
+
+        snapshot_sharded_server_update( sharded_server );
+
+        int num_clients_done = 0;
+        for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+        {
+            if ( sharded_context.num_passthrough_packets_received[i] > 10 )
+                num_clients_done++;
+        }
+
+        if ( num_clients_done == NumClients && passthrough_context.num_passthrough_packets_received_on_client > 10 * NumClients )
             break;
 
-        time += delta_time;
+        snapshot_platform_sleep( 0.01 );
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+    {
+        const bool connected = snapshot_sharded_server_client_connected( sharded_server, i );
+        snapshot_check( connected == ( sharded_context.num_passthrough_packets_received[i] > 10 ) );
+        if ( connected )
+        {
+            snapshot_check( snapshot_sharded_server_client_id( sharded_server, i ) >= 1000 );
+            snapshot_check( snapshot_sharded_server_client_id( sharded_server, i ) < (uint64_t) ( 1000 + NumClients ) );
+        }
+    }
 
-    snapshot_server_destroy( server );
+    snapshot_check( passthrough_context.num_passthrough_packets_received_on_client > 10 * NumClients );
 
-    snapshot_client_destroy( client );
+    // disconnect one client from the game thread
 
-    snapshot_network_simulator_destroy( network_simulator );
-}
+    int disconnect_index = -1;
+    for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+    {
+        if ( snapshot_sharded_server_client_connected( sharded_server, i ) )
+        {
+            disconnect_index = i;
+            break;
+        }
+    }
 
-void test_client_server_multiple_clients()
-{
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    snapshot_check( disconnect_index != -1 );
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+    snapshot_sharded_server_disconnect_client( sharded_server, disconnect_index );
 
-    #define NUM_START_STOP_ITERATIONS 3
+    while ( time < timeout )
+    {
+        time = snapshot_platform_time();
 
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+        for ( int i = 0; i < NumClients; i++ )
+        {
+            snapshot_client_update( client[i], time );
+        }
 
-    int max_clients[NUM_START_STOP_ITERATIONS] = { 2, 32, 5 };
+        snapshot_sharded_server_update( sharded_server );
 
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
+        if ( !snapshot_sharded_server_client_connected( sharded_server, disconnect_index ) )
+            break;
 
-    for ( int i = 0; i < NUM_START_STOP_ITERATIONS; i++ )
-    {
-        // create the server with max # of clients for this iteration
+        snapshot_platform_sleep( 0.01 );
+    }
 
-        struct snapshot_server_config_t server_config;
-        snapshot_default_server_config( &server_config );
-        server_config.max_clients = max_clients[i];
-        server_config.protocol_id = TEST_PROTOCOL_ID;
-        server_config.network_simulator = network_simulator;
-        memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+    snapshot_check( !snapshot_sharded_server_client_connected( sharded_server, disconnect_index ) );
+    snapshot_check( snapshot_sharded_server_num_connected_clients( sharded_server ) == NumClients - 1 );
+    snapshot_check( sharded_context.num_disconnects == 1 );
 
-        struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+    // clean up
 
-        snapshot_check( server );
+    snapshot_sharded_server_destroy( sharded_server );
 
-        // create # of client objects for this iteration and connect to server
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        snapshot_client_destroy( client[i] );
+    }
+}
 
-        struct snapshot_client_t ** client = (struct snapshot_client_t **) malloc( sizeof( struct snapshot_client_t* ) * max_clients[i] );
+void test_sharded_server_max_clients()
+{
+    // max clients holds across all shards, however the kernel spreads clients across them
 
-        snapshot_check( client );
+    const int NumShards = 2;
+    const int MaxClients = 2;
+    const int NumClients = 4;
 
-        for ( int j = 0; j < max_clients[i]; j++ )
-        {
-            char client_bind_address[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
-            snprintf( client_bind_address, sizeof(client_bind_address), "0.0.0.0:%d", 30000 + j );
+    sharded_server_context_t sharded_context;
+    memset( &sharded_context, 0, sizeof(sharded_context) );
 
-            struct snapshot_client_config_t client_config;
-            snapshot_default_client_config( &client_config );
-            client_config.network_simulator = network_simulator;
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-            client[j] = snapshot_client_create( client_bind_address, &client_config, time );
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.callback_context = &sharded_context;
+    server_config.max_clients = MaxClients;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.connect_disconnect_callback = sharded_server_connect_disconnect_callback;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-            snapshot_check( client[j] );
+    struct snapshot_sharded_server_t * sharded_server = snapshot_sharded_server_create( "127.0.0.1:0", &server_config, NumShards );
 
-            uint64_t client_id = j;
-            snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    if ( !sharded_server )
+    {
+        // reuse port sockets are not available on this platform
+        return;
+    }
 
-            const char * server_address = "127.0.0.1:40000";
+    snapshot_check( snapshot_sharded_server_max_clients( sharded_server ) == MaxClients );
 
-            uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    char server_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+    snprintf( server_address_string, sizeof(server_address_string), "127.0.0.1:%d", snapshot_sharded_server_port( sharded_server ) );
+    const char * server_address = server_address_string;
 
-            uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-            snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
+    double time = snapshot_platform_time();
 
-            snapshot_check( snapshot_generate_connect_token( 1, 
-                                                             &server_address, 
-                                                             TEST_CONNECT_TOKEN_EXPIRY, 
-                                                             TEST_TIMEOUT_SECONDS,
-                                                             client_id, 
-                                                             TEST_PROTOCOL_ID, 
-                                                             private_key, 
-                                                             user_data, 
-                                                             connect_token ) == SNAPSHOT_OK );
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
 
-            snapshot_client_connect( client[j], connect_token );
-        }
+    struct snapshot_client_t * client[NumClients];
 
-        // make sure all clients can connect
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        client[i] = snapshot_client_create( "0.0.0.0:0", &client_config, time );
 
-        while ( 1 )
-        {
-            snapshot_network_simulator_update( network_simulator, time );
+        snapshot_check( client[i] );
 
-            for ( int j = 0; j < max_clients[i]; j++ )
-            {
-                snapshot_client_update( client[j], time );
-            }
+        uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-            snapshot_server_update( server, time );
+        uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+        snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
 
-            int num_connected_clients = 0;
+        snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, 1000 + i, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-            for ( int j = 0; j < max_clients[i]; j++ )
-            {
-                if ( snapshot_client_state( client[j] ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-                    break;
+        snapshot_client_connect( client[i], connect_token );
+    }
 
-                if ( snapshot_client_state( client[j] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
-                    num_connected_clients++;
-            }
+    const double timeout = time + 10.0;
 
-            if ( num_connected_clients == max_clients[i] )
-                break;
+    int num_connected = 0;
+    int num_denied = 0;
 
-            time += delta_time;
-        }
+    while ( time < timeout )
+    {
+        time = snapshot_platform_time();
 
-        snapshot_check( snapshot_server_num_connected_clients( server ) == max_clients[i] );
+        num_connected = 0;
+        num_denied = 0;
 
-        for ( int j = 0; j < max_clients[i]; j++ )
+        for ( int i = 0; i < NumClients; i++ )
         {
-            snapshot_check( snapshot_client_state( client[j] ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-            snapshot_check( snapshot_server_client_connected( server, j ) == 1 );
+            snapshot_client_update( client[i], time );
+            if ( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+                num_connected++;
+            if ( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTION_DENIED )
+                num_denied++;
         }
 
-        for ( int j = 0; j < max_clients[i]; j++ )
-        {
-            snapshot_client_destroy( client[j] );
-        }
+        snapshot_sharded_server_update( sharded_server );
 
-        free( client );
+        if ( num_connected + num_denied == NumClients && snapshot_sharded_server_num_connected_clients( sharded_server ) == MaxClients )
+            break;
 
-        snapshot_server_destroy( server );
+        snapshot_platform_sleep( 0.01 );
     }
 
-    snapshot_network_simulator_destroy( network_simulator );
+    snapshot_check( num_connected == MaxClients );
+    snapshot_check( num_denied == NumClients - MaxClients );
+    snapshot_check( snapshot_sharded_server_num_connected_clients( sharded_server ) == MaxClients );
+    snapshot_check( sharded_context.num_connects == MaxClients );
+
+    snapshot_sharded_server_destroy( sharded_server );
+
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        snapshot_client_destroy( client[i] );
+    }
 }
 
-void test_client_server_multiple_servers()
+static void * test_allocator_server_context;
+static void * test_allocator_client_context;
+static std::atomic<int> test_allocator_num_server_allocs;
+static std::atomic<int> test_allocator_num_foreign;
+
+static void * test_allocator_malloc( void * context, size_t bytes )
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    if ( context == test_allocator_server_context )
+        test_allocator_num_server_allocs++;
+    else if ( context != test_allocator_client_context )
+        test_allocator_num_foreign++;
+    return malloc( bytes );
+}
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+static void test_allocator_free( void * context, void * p )
+{
+    if ( p && context != test_allocator_server_context && context != test_allocator_client_context )
+        test_allocator_num_foreign++;
+    free( p );
+}
 
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+static void * test_default_malloc( void * context, size_t bytes )
+{
+    (void) context;
+    return malloc( bytes );
+}
 
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
+static void test_default_free( void * context, void * p )
+{
+    (void) context;
+    free( p );
+}
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+static bool sharded_server_exchange_passthrough_packets( void * server_allocator_context, void * client_allocator_context, uint64_t * packet_allocator_hits )
+{
+    const int NumShards = 2;
+    const int NumClients = 2;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    sharded_server_context_t sharded_context;
+    memset( &sharded_context, 0, sizeof(sharded_context) );
 
-    snapshot_check( client );
+    passthrough_context_t passthrough_context;
+    memset( &passthrough_context, 0, sizeof(passthrough_context_t) );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
+    server_config.context = server_allocator_context;
+    server_config.callback_context = &sharded_context;
+    server_config.max_clients = NumShards * NumClients;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
+    server_config.connect_disconnect_callback = sharded_server_connect_disconnect_callback;
+    server_config.process_passthrough_callback = sharded_server_process_passthrough_callback;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
-
-    snapshot_check( server );
-
-    const char * server_address[] = { "10.10.10.10:1000", "100.100.100.100:50000", "127.0.0.1:40000" };
+    struct snapshot_sharded_server_t * sharded_server = snapshot_sharded_server_create( "127.0.0.1:0", &server_config, NumShards );
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    if ( !sharded_server )
+    {
+        // reuse port sockets are not available on this platform
+        return false;
+    }
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    char server_address_string[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+    snprintf( server_address_string, sizeof(server_address_string), "127.0.0.1:%d", snapshot_sharded_server_port( sharded_server ) );
+    const char * server_address = server_address_string;
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+    double time = snapshot_platform_time();
 
-    snapshot_check( snapshot_generate_connect_token( 3, server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.context = client_allocator_context;
 
-    snapshot_client_connect( client, connect_token );
+    struct snapshot_client_t * client[NumClients];
 
-    while ( 1 )
+    for ( int i = 0; i < NumClients; i++ )
     {
-        snapshot_network_simulator_update( network_simulator, time );
+        client[i] = snapshot_client_create( "0.0.0.0:0", &client_config, time );
 
-        snapshot_client_update( client, time );
+        snapshot_check( client[i] );
 
-        snapshot_server_update( server, time );
+        uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+        uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+        snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
-            break;
+        snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, 1000 + i, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-        time += delta_time;
+        snapshot_client_connect( client[i], connect_token );
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    const double timeout = time + 10.0;
 
-    snapshot_server_destroy( server );
+    while ( time < timeout )
+    {
+        time = snapshot_platform_time();
 
-    snapshot_client_destroy( client );
+        int num_connected = 0;
 
-    snapshot_network_simulator_destroy( network_simulator );
-}
+        for ( int i = 0; i < NumClients; i++ )
+        {
+            snapshot_client_update( client[i], time );
+            if ( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+                num_connected++;
+        }
 
-void test_client_error_connect_token_expired()
-{
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+        snapshot_sharded_server_update( sharded_server );
 
-    double time = 0.0;
+        if ( num_connected == NumClients && snapshot_sharded_server_num_connected_clients( sharded_server ) == NumClients )
+            break;
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+        snapshot_platform_sleep( 0.01 );
+    }
 
-    snapshot_check( client );
+    snapshot_check( snapshot_sharded_server_num_connected_clients( sharded_server ) == NumClients );
+    snapshot_check( sharded_context.num_connects == NumClients );
 
-    const char * server_address = "127.0.0.1:40000";
+    // the validation payload is fragmented, so each shard allocates packets for it every update
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    snapshot_sharded_server_set_development_flags( sharded_server, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    uint64_t start_hits, start_misses;
+    snapshot_packet_allocator_counters( &start_hits, &start_misses );
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+    while ( time < timeout )
+    {
+        time = snapshot_platform_time();
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, 0, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+        int passthrough_bytes = 0;
+        uint8_t passthrough_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+        generate_passthrough_packet( passthrough_data, passthrough_bytes );
 
-    snapshot_client_connect( client, connect_token );
+        for ( int i = 0; i < NumClients; i++ )
+        {
+            snapshot_client_send_passthrough_packet( client[i], passthrough_data, passthrough_bytes );
+            snapshot_client_update( client[i], time );
+        }
 
-    snapshot_client_update( client, time );
+        snapshot_sharded_server_update( sharded_server );
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECT_TOKEN_EXPIRED );
+        int num_clients_done = 0;
+        for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+        {
+            if ( sharded_context.num_passthrough_packets_received[i] > 100 )
+                num_clients_done++;
+        }
 
-    snapshot_client_destroy( client );
+        if ( num_clients_done == NumClients )
+            break;
+
+        snapshot_platform_sleep( 0.001 );
+    }
+
+    uint64_t hits, misses;
+    snapshot_packet_allocator_counters( &hits, &misses );
+
+    *packet_allocator_hits = hits - start_hits;
+
+    int num_clients_done = 0;
+    for ( int i = 0; i < snapshot_sharded_server_max_clients( sharded_server ); i++ )
+    {
+        if ( sharded_context.num_passthrough_packets_received[i] > 100 )
+            num_clients_done++;
+    }
+
+    snapshot_check( num_clients_done == NumClients );
+
+    snapshot_sharded_server_destroy( sharded_server );
+
+    for ( int i = 0; i < NumClients; i++ )
+    {
+        snapshot_client_destroy( client[i] );
+    }
+
+    return true;
 }
 
-void test_client_error_invalid_connect_token()
+void test_sharded_server_context()
 {
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+    // the context goes to the allocator for everything the shards allocate, while the callbacks get callback_context.
+    // clients have a context of their own so their packets are never pooled, and any pool hits come from the shards
 
-    double time = 0.0;
+    snapshot_allocator( test_allocator_malloc, test_allocator_free );
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
+    int server_context = 0;
+    int client_context = 0;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    test_allocator_server_context = &server_context;
+    test_allocator_client_context = &client_context;
+    test_allocator_num_server_allocs = 0;
+    test_allocator_num_foreign = 0;
 
-    snapshot_check( client );
+    uint64_t packet_allocator_hits = 0;
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
-    snapshot_crypto_random_bytes( connect_token, SNAPSHOT_CONNECT_TOKEN_BYTES );
+    if ( sharded_server_exchange_passthrough_packets( &server_context, &client_context, &packet_allocator_hits ) )
+    {
+        snapshot_check( test_allocator_num_server_allocs > 0 );
+        snapshot_check( test_allocator_num_foreign == 0 );
+        snapshot_check( packet_allocator_hits == 0 );
+    }
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    // with the default context, packets sent and received by the shards are pooled
 
-    snapshot_client_connect( client, connect_token );
+    test_allocator_server_context = NULL;
+    test_allocator_num_server_allocs = 0;
+    test_allocator_num_foreign = 0;
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_INVALID_CONNECT_TOKEN );
+    if ( sharded_server_exchange_passthrough_packets( NULL, &client_context, &packet_allocator_hits ) )
+    {
+        snapshot_check( test_allocator_num_server_allocs > 0 );
+        snapshot_check( test_allocator_num_foreign == 0 );
+        snapshot_check( packet_allocator_hits > 0 );
+    }
+
+    snapshot_allocator( test_default_malloc, test_default_free );
+}
+
+#if SNAPSHOT_PLATFORM_HAS_IPV6
+
+void test_ipv6_client_create_any_port()
+{
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+
+    struct snapshot_client_t * client = snapshot_client_create( "[::]:0", &client_config, 0.0 );
+
+    snapshot_check( client );
+    snapshot_check( snapshot_client_port( client ) != 0 );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
 
     snapshot_client_destroy( client );
 }
 
-void test_client_error_connection_timed_out()
+void test_ipv6_client_create_specific_port()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+    struct snapshot_client_t * client = snapshot_client_create( "[::]:30000", &client_config, 0.0 );
 
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+    snapshot_check( client );
+    snapshot_check( snapshot_client_port( client ) == 30000 );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
 
+    snapshot_client_destroy( client );
+}
+
+void test_ipv6_client_server_connect()
+{
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
-    // connect a client to the server
-
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    struct snapshot_client_t * client = snapshot_client_create( "[::]:50000", &client_config, time );
 
     snapshot_check( client );
 
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
     server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+    const char * server_address = "[::1]:40000";
 
-    snapshot_check( server );
+    struct snapshot_server_t * server = snapshot_server_create( "[::1]:40000", &server_config, time );
 
-    const char * server_address = "127.0.0.1:40000";
+    snapshot_check( server );
 
     uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
@@ -2783,8 +3911,6 @@ void test_client_error_connection_timed_out()
 
     while ( 1 )
     {
-        snapshot_network_simulator_update( network_simulator, time );
-
         snapshot_client_update( client, time );
 
         snapshot_server_update( server, time );
@@ -2799,67 +3925,47 @@ void test_client_error_connection_timed_out()
     }
 
     snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
-
-    // now disable updating the server and verify that the client times out
-
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
-
-        snapshot_client_update( client, time );
-
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        time += delta_time;
-    }
-
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_TIMED_OUT );
 
     snapshot_server_destroy( server );
 
     snapshot_client_destroy( client );
-
-    snapshot_network_simulator_destroy( network_simulator );
 }
 
-void test_client_error_connection_response_timeout()
+void test_ipv6_client_server_passthrough()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
-
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
-
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+    passthrough_context_t passthrough_context;
+    memset( &passthrough_context, 0, sizeof(passthrough_context_t) );
 
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+    client_config.context = &passthrough_context;
+    client_config.process_passthrough_callback = client_process_passthrough_callback;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    // connect client to server
+
+    struct snapshot_client_t * client = snapshot_client_create( "[::]:50000", &client_config, time );
 
     snapshot_check( client );
 
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
+    server_config.callback_context = &passthrough_context;
     server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
+    server_config.process_passthrough_callback = server_process_passthrough_callback;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
-
-    snapshot_check( server );
+    const char * server_address = "[::1]:40000";
 
-    snapshot_server_set_flags( server, SNAPSHOT_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS );
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
 
-    const char * server_address = "127.0.0.1:40000";
+    snapshot_check( server );
 
     uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
@@ -2875,7 +3981,32 @@ void test_client_error_connection_response_timeout()
 
     while ( 1 )
     {
-        snapshot_network_simulator_update( network_simulator, time );
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+
+    // exchange passthrough packets
+
+    while ( 1 )
+    {
+        int passthrough_bytes = 0;
+        uint8_t passthrough_data[SNAPSHOT_MAX_PASSTHROUGH_BYTES];
+        generate_passthrough_packet( passthrough_data, passthrough_bytes );
+
+        snapshot_client_send_passthrough_packet( client, passthrough_data, passthrough_bytes );
+
+        snapshot_server_send_passthrough_packet( server, 0, passthrough_data, passthrough_bytes );
 
         snapshot_client_update( client, time );
 
@@ -2884,225 +4015,167 @@ void test_client_error_connection_response_timeout()
         if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
             break;
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED  )
+        if ( passthrough_context.num_passthrough_packets_received_on_client > 100 && passthrough_context.num_passthrough_packets_received_on_server > 100 )
             break;
 
         time += delta_time;
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT );
+    snapshot_check( passthrough_context.num_passthrough_packets_received_on_client > 100 );
+    snapshot_check( passthrough_context.num_passthrough_packets_received_on_server > 100 );
+
+    // clean up
 
     snapshot_server_destroy( server );
 
     snapshot_client_destroy( client );
-
-    snapshot_network_simulator_destroy( network_simulator );
 }
 
-void test_client_error_connection_request_timeout()
+#endif // #if SNAPSHOT_PLATFORM_HAS_IPV6
+
+struct loopback_context_t
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_client_t * client;
+    struct snapshot_server_t * server;
+};
 
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+void client_send_loopback_packet_callback( void * context, const snapshot_address_t * from, uint8_t * packet_data, int packet_bytes )
+{
+    loopback_context_t * loopback_context = (loopback_context_t*) context;
+    snapshot_server_process_packet( loopback_context->server, from, packet_data, packet_bytes );
+}
 
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+void server_send_loopback_packet_callback( void * context, const snapshot_address_t * from, uint8_t * packet_data, int packet_bytes )
+{
+    loopback_context_t * loopback_context = (loopback_context_t*) context;
+    snapshot_client_process_packet( loopback_context->client, from, packet_data, packet_bytes );
+}
 
+void test_client_server_loopback()
+{
     double time = 0.0;
-    double delta_time = 1.0 / 60.0;
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+    loopback_context_t loopback_context;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_check( client );
+    // start the server
 
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
+    server_config.max_clients = 2;
     server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
+    server_config.callback_context = &loopback_context;
+    server_config.send_loopback_packet_callback = server_send_loopback_packet_callback;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+    const char * server_address_string = "127.0.0.1:40000";
 
-    snapshot_check( server );
+    snapshot_address_t server_address;
+    snapshot_check( snapshot_address_parse( &server_address, server_address_string ) == SNAPSHOT_OK );
 
-    snapshot_server_set_flags( server, SNAPSHOT_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS );
+    struct snapshot_server_t * server = snapshot_server_create( server_address_string, &server_config, time );
 
-    const char * server_address = "[::1]:40000";
+    snapshot_check( server );
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    int max_clients = 2;
 
-    uint64_t client_id = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    loopback_context.server = server;
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
-
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
-
-    snapshot_client_connect( client, connect_token );
-
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
-
-        snapshot_client_update( client, time );
-
-        snapshot_server_update( server, time );
-
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
-
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED  )
-            break;
-
-        time += delta_time;
-    }
-
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT );
-
-    snapshot_server_destroy( server );
-
-    snapshot_client_destroy( client );
-
-    snapshot_network_simulator_destroy( network_simulator );
-}
-
-void test_client_error_connection_denied()
-{
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
-
-    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
-
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
-
-    // start a server and connect one client
-
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
+    // connect a loopback client in slot 0
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
-
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
-
-    snapshot_check( client );
-
-    struct snapshot_server_config_t server_config;
-    snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
-    server_config.protocol_id = TEST_PROTOCOL_ID;
-    server_config.network_simulator = network_simulator;
-    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
-
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
-
-    snapshot_check( server );
+    client_config.context = &loopback_context;
+    client_config.send_loopback_packet_callback = client_send_loopback_packet_callback;
 
-    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    struct snapshot_client_t * loopback_client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    snapshot_check( loopback_client );
 
     uint64_t client_id = 0;
     snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+    snapshot_client_connect_loopback( loopback_client, &server_address, 0, max_clients );
 
-    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
-
-    const char * server_address = "127.0.0.1:40000";
-
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
-
-    snapshot_client_connect( client, connect_token );
-
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
-
-        snapshot_client_update( client, time );
+    loopback_context.client = loopback_client;
 
-        snapshot_server_update( server, time );
+    snapshot_check( snapshot_client_index( loopback_client ) == 0 );
+    snapshot_check( snapshot_client_loopback( loopback_client ) == 1 );
+    snapshot_check( snapshot_client_max_clients( loopback_client ) == max_clients );
+    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_address_equal( snapshot_client_server_address( loopback_client ), &server_address ) );
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    snapshot_server_connect_loopback_client( server, 0, client_id, NULL );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
-            break;
+    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-        time += delta_time;
-    }
+    // verify we can disconnect the loopback client
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
     snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
     snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-    // now attempt to connect a second client. the connection should be denied.
+    snapshot_server_disconnect_loopback_client( server, 0 );    
 
-    struct snapshot_client_t * client2 = snapshot_client_create( "0.0.0.0:30001", &client_config, time );
+    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
 
-    snapshot_check( client2 );
+    snapshot_client_disconnect_loopback( loopback_client );
 
-    uint8_t connect_token2[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
 
-    uint64_t client_id2 = 0;
-    snapshot_crypto_random_bytes( (uint8_t*) &client_id2, 8 );
+    // verify we can reconnect the loopback client
 
-    uint8_t user_data2[SNAPSHOT_USER_DATA_BYTES];
-    snapshot_crypto_random_bytes(user_data2, SNAPSHOT_USER_DATA_BYTES);
+    snapshot_server_connect_loopback_client( server, 0, client_id, NULL );
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id2, TEST_PROTOCOL_ID, private_key, user_data2, connect_token2 ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_client_loopback( server, 1 ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_client_connected( server, 1 ) == 0 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-    snapshot_client_connect( client2, connect_token2 );
+    snapshot_client_connect_loopback( loopback_client, &server_address, 0, max_clients );
+    
+    snapshot_check( snapshot_client_index( loopback_client ) == 0 );
+    snapshot_check( snapshot_client_loopback( loopback_client ) == 1 );
+    snapshot_check( snapshot_client_max_clients( loopback_client ) == max_clients );
+    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
+    // verify the loopback client doesn't time out
 
-        snapshot_client_update( client, time );
+    time += 100000.0;
 
-        snapshot_client_update( client2, time );
+    snapshot_server_update( server, time );
 
-        snapshot_server_update( server, time );
+    snapshot_client_update( loopback_client, time );
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
 
-        if ( snapshot_client_state( client2 ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    snapshot_check( snapshot_client_state( loopback_client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-        time += delta_time;
-    }
+    // verify that disconnect all clients leaves loopback clients alone
+
+    snapshot_server_disconnect_all_clients( server );
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_state( client2 ) == SNAPSHOT_CLIENT_STATE_CONNECTION_DENIED );
     snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    snapshot_check( snapshot_server_client_loopback( server, 0 ) == 1 );
 
-    snapshot_server_destroy( server );
+    // clean up
 
-    snapshot_client_destroy( client );
-    
-    snapshot_client_destroy( client2 );
+    snapshot_client_destroy( loopback_client );
 
-    snapshot_network_simulator_destroy( network_simulator );
+    snapshot_server_destroy( server );
 }
 
-void test_client_side_disconnect()
+void test_client_server_network_simulator()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
     snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
-    uint8_t private_key[SNAPSHOT_KEY_BYTES];
-    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
-
-    // start a server and connect one client
-
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
@@ -3110,10 +4183,13 @@ void test_client_side_disconnect()
     snapshot_default_client_config( &client_config );
     client_config.network_simulator = network_simulator;
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
 
     snapshot_check( client );
 
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
     struct snapshot_server_config_t server_config;
     snapshot_default_server_config( &server_config );
     server_config.max_clients = 1;
@@ -3121,11 +4197,11 @@ void test_client_side_disconnect()
     server_config.network_simulator = network_simulator;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+    const char * server_address = "127.0.0.1:40000";
 
-    snapshot_check( server );
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
 
-    const char * server_address = "127.0.0.1:40000";
+    snapshot_check( server );
 
     uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
@@ -3157,51 +4233,27 @@ void test_client_side_disconnect()
     }
 
     snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
-
-    // disconnect client side and verify that the server sees that client disconnect cleanly, rather than timing out.
-
-    snapshot_client_disconnect( client );
-
-    for ( int i = 0; i < 10; i++ )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
-
-        snapshot_client_update( client, time );
-
-        snapshot_server_update( server, time );
-
-        if ( snapshot_server_client_connected( server, 0 ) == 0 )
-            break;
-
-        time += delta_time;
-    }
-
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
 
     snapshot_server_destroy( server );
 
     snapshot_client_destroy( client );
 
-    snapshot_network_simulator_destroy( network_simulator );
+    snapshot_network_simulator_destroy ( network_simulator );
 }
 
-void test_server_side_disconnect()
+void test_client_server_keep_alive()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
     snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
     uint8_t private_key[SNAPSHOT_KEY_BYTES];
     snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    // start a server and connect one client
-
-    double time = 0.0;
-    double delta_time = 1.0 / 10.0;
+    // connect client to server
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
@@ -3258,11 +4310,11 @@ void test_server_side_disconnect()
     snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
     snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-    // disconnect server side and verify that the client disconnects cleanly, rather than timing out.
+    // pump the client and server long enough that they would timeout without keep alive packets
 
-    snapshot_server_disconnect_client( server, 0 );
+    int num_iterations = (int) ceil( 1.25f * TEST_TIMEOUT_SECONDS / delta_time );
 
-    for ( int i = 0; i < 10; i++ )
+    for ( int i = 0; i < num_iterations; i++ )
     {
         snapshot_network_simulator_update( network_simulator, time );
 
@@ -3270,15 +4322,16 @@ void test_server_side_disconnect()
 
         snapshot_server_update( server, time );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
             break;
 
         time += delta_time;
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
     snapshot_server_destroy( server );
 
@@ -3287,31 +4340,153 @@ void test_server_side_disconnect()
     snapshot_network_simulator_destroy( network_simulator );
 }
 
-void test_client_reconnect()
+void test_client_server_multiple_clients()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
     snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
+    #define NUM_START_STOP_ITERATIONS 3
+
     uint8_t private_key[SNAPSHOT_KEY_BYTES];
     snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    // start a server and connect one client
+    int max_clients[NUM_START_STOP_ITERATIONS] = { 2, 32, 5 };
 
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
-    struct snapshot_client_config_t client_config;
-    snapshot_default_client_config( &client_config );
-    client_config.network_simulator = network_simulator;
+    for ( int i = 0; i < NUM_START_STOP_ITERATIONS; i++ )
+    {
+        // create the server with max # of clients for this iteration
 
-    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+        struct snapshot_server_config_t server_config;
+        snapshot_default_server_config( &server_config );
+        server_config.max_clients = max_clients[i];
+        server_config.protocol_id = TEST_PROTOCOL_ID;
+        server_config.network_simulator = network_simulator;
+        memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_check( client );
+        struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-    struct snapshot_server_config_t server_config;
-    snapshot_default_server_config( &server_config );
-    server_config.max_clients = 1;
+        snapshot_check( server );
+
+        // create # of client objects for this iteration and connect to server
+
+        struct snapshot_client_t ** client = (struct snapshot_client_t **) malloc( sizeof( struct snapshot_client_t* ) * max_clients[i] );
+
+        snapshot_check( client );
+
+        for ( int j = 0; j < max_clients[i]; j++ )
+        {
+            char client_bind_address[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+            snprintf( client_bind_address, sizeof(client_bind_address), "0.0.0.0:%d", 30000 + j );
+
+            struct snapshot_client_config_t client_config;
+            snapshot_default_client_config( &client_config );
+            client_config.network_simulator = network_simulator;
+
+            client[j] = snapshot_client_create( client_bind_address, &client_config, time );
+
+            snapshot_check( client[j] );
+
+            uint64_t client_id = j;
+            snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+            const char * server_address = "127.0.0.1:40000";
+
+            uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+            uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+            snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
+
+            snapshot_check( snapshot_generate_connect_token( 1, 
+                                                             &server_address, 
+                                                             TEST_CONNECT_TOKEN_EXPIRY, 
+                                                             TEST_TIMEOUT_SECONDS,
+                                                             client_id, 
+                                                             TEST_PROTOCOL_ID, 
+                                                             private_key, 
+                                                             user_data, 
+                                                             connect_token ) == SNAPSHOT_OK );
+
+            snapshot_client_connect( client[j], connect_token );
+        }
+
+        // make sure all clients can connect
+
+        while ( 1 )
+        {
+            snapshot_network_simulator_update( network_simulator, time );
+
+            for ( int j = 0; j < max_clients[i]; j++ )
+            {
+                snapshot_client_update( client[j], time );
+            }
+
+            snapshot_server_update( server, time );
+
+            int num_connected_clients = 0;
+
+            for ( int j = 0; j < max_clients[i]; j++ )
+            {
+                if ( snapshot_client_state( client[j] ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+                    break;
+
+                if ( snapshot_client_state( client[j] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+                    num_connected_clients++;
+            }
+
+            if ( num_connected_clients == max_clients[i] )
+                break;
+
+            time += delta_time;
+        }
+
+        snapshot_check( snapshot_server_num_connected_clients( server ) == max_clients[i] );
+
+        for ( int j = 0; j < max_clients[i]; j++ )
+        {
+            snapshot_check( snapshot_client_state( client[j] ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+            snapshot_check( snapshot_server_client_connected( server, j ) == 1 );
+        }
+
+        for ( int j = 0; j < max_clients[i]; j++ )
+        {
+            snapshot_client_destroy( client[j] );
+        }
+
+        free( client );
+
+        snapshot_server_destroy( server );
+    }
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_client_server_multiple_servers()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
+
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+
+    snapshot_check( client );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
     server_config.network_simulator = network_simulator;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
@@ -3320,7 +4495,7 @@ void test_client_reconnect()
 
     snapshot_check( server );
 
-    const char * server_address = "127.0.0.1:40000";
+    const char * server_address[] = { "10.10.10.10:1000", "100.100.100.100:50000", "127.0.0.1:40000" };
 
     uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
@@ -3330,7 +4505,7 @@ void test_client_reconnect()
     uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
     snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_generate_connect_token( 3, server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
     snapshot_client_connect( client, connect_token );
 
@@ -3356,76 +4531,78 @@ void test_client_reconnect()
     snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
     snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-    // wait for a bit, so any packets on the wire go away (otherwise, we sometimes have connection request packets in flight which break the test...)
+    snapshot_server_destroy( server );
 
-    time += 10.0;
+    snapshot_client_destroy( client );
 
-    snapshot_network_simulator_update( network_simulator, time );
+    snapshot_network_simulator_destroy( network_simulator );
+}
 
-    snapshot_client_update( client, time );
+void test_client_error_connect_token_expired()
+{
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_server_update( server, time );
+    double time = 0.0;
 
-    // disconnect client on the server-side and wait until client sees the disconnect
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
 
-    snapshot_server_disconnect_client( server, 0 );
+    snapshot_check( client );
 
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
+    const char * server_address = "127.0.0.1:40000";
 
-        snapshot_client_update( client, time );
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-        snapshot_server_update( server, time );
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-        time += delta_time;
-    }
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, 0, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
+    snapshot_client_connect( client, connect_token );
 
-    // now reconnect the client and verify they connect
+    snapshot_client_update( client, time );
 
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECT_TOKEN_EXPIRED );
 
-    snapshot_client_connect( client, connect_token );
+    snapshot_client_destroy( client );
+}
 
-    while ( 1 )
-    {
-        snapshot_network_simulator_update( network_simulator, time );
+void test_client_error_invalid_connect_token()
+{
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-        snapshot_client_update( client, time );
+    double time = 0.0;
 
-        snapshot_server_update( server, time );
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
 
-        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
-            break;
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
 
-        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
-            break;
+    snapshot_check( client );
 
-        time += delta_time;
-    }
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+    snapshot_crypto_random_bytes( connect_token, SNAPSHOT_CONNECT_TOKEN_BYTES );
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
-    snapshot_check( snapshot_client_index( client ) == 0 );
-    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
-    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-    snapshot_server_destroy( server );
+    snapshot_client_connect( client, connect_token );
 
-    snapshot_client_destroy( client );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_INVALID_CONNECT_TOKEN );
 
-    snapshot_network_simulator_destroy( network_simulator );
+    snapshot_client_destroy( client );
 }
 
-void test_disable_timeout()
+void test_client_error_connection_timed_out()
 {
-    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL );
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
     snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
@@ -3435,6 +4612,8 @@ void test_disable_timeout()
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
+    // connect a client to the server
+
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
     client_config.network_simulator = network_simulator;
@@ -3464,8 +4643,7 @@ void test_disable_timeout()
     uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
     snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-    // IMPORTANT: passing in -1 timeout in connect token disables timeout for that client. This is useful for testing!
-    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, -1, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
     snapshot_client_connect( client, connect_token );
 
@@ -3491,21 +4669,21 @@ void test_disable_timeout()
     snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
     snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
 
-    for ( int i = 0; i < 100; i++ )
+    // now disable updating the server and verify that the client times out
+
+    while ( 1 )
     {
         snapshot_network_simulator_update( network_simulator, time );
 
         snapshot_client_update( client, time );
 
-        snapshot_server_update( server, time );
-
         if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
             break;
 
-        time += 1000.0f;        // normally this would timeout the client
+        time += delta_time;
     }
 
-    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_TIMED_OUT );
 
     snapshot_server_destroy( server );
 
@@ -3514,639 +4692,2589 @@ void test_disable_timeout()
     snapshot_network_simulator_destroy( network_simulator );
 }
 
-struct test_sequence_data_t
+void test_client_error_connection_response_timeout()
 {
-    uint16_t sequence;
-};
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
-#define TEST_SEQUENCE_BUFFER_SIZE 256
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
-void test_sequence_buffer()
-{
-    struct snapshot_sequence_buffer_t * sequence_buffer = snapshot_sequence_buffer_create( NULL, TEST_SEQUENCE_BUFFER_SIZE, sizeof( struct test_sequence_data_t ) );
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_check( sequence_buffer );
-    snapshot_check( sequence_buffer->sequence == 0 );
-    snapshot_check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
-    snapshot_check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
-    {
-        snapshot_check( snapshot_sequence_buffer_find( sequence_buffer, ((uint16_t)i) ) == NULL );
-    }                                                                      
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
 
-    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE*4; i++ )
-    {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
-        snapshot_check( entry );
-        entry->sequence = (uint16_t) i;
-        snapshot_check( sequence_buffer->sequence == i + 1 );
-    }
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
 
-    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; i++ )
-    {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
-        snapshot_check( entry == NULL );
-    }    
-
-    int index = TEST_SEQUENCE_BUFFER_SIZE * 4;
-    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
-    {
-        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_find( sequence_buffer, (uint16_t) index );
-        snapshot_check( entry );
-        snapshot_check( entry->sequence == (uint32_t) index );
-        index--;
-    }
+    snapshot_check( client );
 
-    snapshot_sequence_buffer_reset( sequence_buffer );
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_check( sequence_buffer );
-    snapshot_check( sequence_buffer->sequence == 0 );
-    snapshot_check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
-    snapshot_check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
-    {
-        snapshot_check( snapshot_sequence_buffer_find( sequence_buffer, (uint16_t) i ) == NULL );
-    }
+    snapshot_check( server );
 
-    snapshot_sequence_buffer_destroy( sequence_buffer );
-}
+    snapshot_server_set_flags( server, SNAPSHOT_SERVER_FLAG_IGNORE_CONNECTION_RESPONSE_PACKETS );
 
-void test_generate_ack_bits()
-{
-    struct snapshot_sequence_buffer_t * sequence_buffer = snapshot_sequence_buffer_create( NULL, TEST_SEQUENCE_BUFFER_SIZE, sizeof( struct test_sequence_data_t ) );
+    const char * server_address = "127.0.0.1:40000";
 
-    uint16_t ack = 0;
-    uint32_t ack_bits = 0xFFFFFFFF;
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
-    snapshot_check( ack == 0xFFFF );
-    snapshot_check( ack_bits == 0 );
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; i++ )
-    {
-        snapshot_sequence_buffer_insert( sequence_buffer, (uint16_t) i );
-    }
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
-    snapshot_check( ack == TEST_SEQUENCE_BUFFER_SIZE );
-    snapshot_check( ack_bits == 0xFFFFFFFF );
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-    snapshot_sequence_buffer_reset( sequence_buffer );
+    snapshot_client_connect( client, connect_token );
 
-    uint16_t input_acks[] = { 1, 5, 9, 11 };
-    int input_num_acks = sizeof( input_acks ) / sizeof( uint16_t );
-    for ( int i = 0; i < input_num_acks; i++ )
+    while ( 1 )
     {
-        snapshot_sequence_buffer_insert( sequence_buffer, input_acks[i] );
-    }
+        snapshot_network_simulator_update( network_simulator, time );
 
-    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+        snapshot_client_update( client, time );
 
-    snapshot_check( ack == 11 );
-    snapshot_check( ack_bits == ( 1 | (1<<(11-9)) | (1<<(11-5)) | (1<<(11-1)) ) );
+        snapshot_server_update( server, time );
 
-    snapshot_sequence_buffer_destroy( sequence_buffer );
-}
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-void test_packet_header()
-{
-    uint16_t write_sequence;
-    uint16_t write_ack;
-    uint32_t write_ack_bits;
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED  )
+            break;
 
-    uint16_t read_sequence;
-    uint16_t read_ack;
-    uint32_t read_ack_bits;
+        time += delta_time;
+    }
 
-    uint8_t packet_data[SNAPSHOT_MAX_PACKET_HEADER_BYTES];
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_RESPONSE_TIMED_OUT );
 
-    // worst case, sequence and ack are far apart, no packets acked.
+    snapshot_server_destroy( server );
 
-    write_sequence = 10000;
-    write_ack = 100;
-    write_ack_bits = 0;
+    snapshot_client_destroy( client );
 
-    int bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    snapshot_network_simulator_destroy( network_simulator );
+}
 
-    snapshot_check( bytes_written == SNAPSHOT_MAX_PACKET_HEADER_BYTES );
+void test_client_error_connection_request_timeout()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
-    int bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
-    snapshot_check( bytes_read == bytes_written );
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_check( read_sequence == write_sequence );
-    snapshot_check( read_ack == write_ack );
-    snapshot_check( read_ack_bits == write_ack_bits );
+    double time = 0.0;
+    double delta_time = 1.0 / 60.0;
 
-    // rare case. sequence and ack are far apart, significant # of acks are missing
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
 
-    write_sequence = 10000;
-    write_ack = 100;
-    write_ack_bits = 0xFEFEFFFE;
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
 
-    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    snapshot_check( client );
 
-    snapshot_check( bytes_written == 1 + 2 + 2 + 3 );
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-    snapshot_check( bytes_read == bytes_written );
+    snapshot_check( server );
 
-    snapshot_check( read_sequence == write_sequence );
-    snapshot_check( read_ack == write_ack );
-    snapshot_check( read_ack_bits == write_ack_bits );
+    snapshot_server_set_flags( server, SNAPSHOT_SERVER_FLAG_IGNORE_CONNECTION_REQUEST_PACKETS );
 
-    // common case under packet loss. sequence and ack are close together, some acks are missing
+    const char * server_address = "[::1]:40000";
 
-    write_sequence = 200;
-    write_ack = 100;
-    write_ack_bits = 0xFFFEFFFF;
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-    snapshot_check( bytes_written == 1 + 2 + 1 + 1 );
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-    snapshot_check( bytes_read == bytes_written );
+    snapshot_client_connect( client, connect_token );
 
-    snapshot_check( read_sequence == write_sequence );
-    snapshot_check( read_ack == write_ack );
-    snapshot_check( read_ack_bits == write_ack_bits );
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
 
-    // ideal case. no packet loss.
+        snapshot_client_update( client, time );
 
-    write_sequence = 200;
-    write_ack = 100;
-    write_ack_bits = 0xFFFFFFFF;
+        snapshot_server_update( server, time );
 
-    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-    snapshot_check( bytes_written == 1 + 2 + 1 );
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED  )
+            break;
 
-    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+        time += delta_time;
+    }
 
-    snapshot_check( bytes_read == bytes_written );
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTION_REQUEST_TIMED_OUT );
 
-    snapshot_check( read_sequence == write_sequence );
-    snapshot_check( read_ack == write_ack );
-    snapshot_check( read_ack_bits == write_ack_bits );
-}
+    snapshot_server_destroy( server );
 
-#define TEST_ACKS_NUM_ITERATIONS 256
+    snapshot_client_destroy( client );
 
-void test_acks()
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_client_error_connection_denied()
 {
-    double time = 100.0;
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
 
-    struct snapshot_endpoint_config_t sender_config;
-    struct snapshot_endpoint_config_t receiver_config;
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
 
-    snapshot_endpoint_default_config( &sender_config );
-    snapshot_endpoint_default_config( &receiver_config );
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    snapshot_copy_string( sender_config.name, "sender", sizeof(sender_config.name) );
-    snapshot_copy_string( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+    // start a server and connect one client
 
-    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
-    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    double delta_time = 0.01;
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
 
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
-    {
-        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + 8 + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
 
-        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+    snapshot_check( client );
 
-        int dummy_payload_bytes = 8;
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-        memset( dummy_payload_data, 0, dummy_payload_bytes );
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
 
-        // sender write packet
+    snapshot_check( server );
 
-        int num_sender_packets = 0;
-        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-        snapshot_check( num_sender_packets == 1 );
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-        // receiver process packet
+    const char * server_address = "127.0.0.1:40000";
 
-        uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-        uint8_t * receiver_payload_data = NULL;
-        int receiver_payload_bytes = 0;
-        uint16_t receiver_payload_sequence = 0;
-        uint16_t receiver_payload_ack = 0;
-        uint32_t receiver_payload_ack_bits = 0;
+    snapshot_client_connect( client, connect_token );
 
-        snapshot_endpoint_process_packet( receiver, sender_packet_data[0], sender_packet_bytes[0], buffer, &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
 
-        snapshot_check( receiver_payload_data );
-        snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
-        for ( int j = 0; j < dummy_payload_bytes; j++ )
-        {
-            snapshot_check( receiver_payload_data[j] == 0 );
-        }
+        snapshot_client_update( client, time );
 
-        snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
+        snapshot_server_update( server, time );
 
-        // receiver write packet
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        int num_receiver_packets = 0;
-        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    // now attempt to connect a second client. the connection should be denied.
+
+    struct snapshot_client_t * client2 = snapshot_client_create( "0.0.0.0:30001", &client_config, time );
+
+    snapshot_check( client2 );
+
+    uint8_t connect_token2[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id2 = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id2, 8 );
+
+    uint8_t user_data2[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data2, SNAPSHOT_USER_DATA_BYTES);
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id2, TEST_PROTOCOL_ID, private_key, user_data2, connect_token2 ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client2, connect_token2 );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_client_update( client2, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client2 ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_state( client2 ) == SNAPSHOT_CLIENT_STATE_CONNECTION_DENIED );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
+    
+    snapshot_client_destroy( client2 );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_client_side_disconnect()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
+
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    // start a server and connect one client
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+
+    snapshot_check( client );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+
+    snapshot_check( server );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    // disconnect client side and verify that the server sees that client disconnect cleanly, rather than timing out.
+
+    snapshot_client_disconnect( client );
+
+    for ( int i = 0; i < 10; i++ )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_server_client_connected( server, 0 ) == 0 )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
+
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_server_side_disconnect()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
+
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    // start a server and connect one client
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+
+    snapshot_check( client );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+
+    snapshot_check( server );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    // disconnect server side and verify that the client disconnects cleanly, rather than timing out.
+
+    snapshot_server_disconnect_client( server, 0 );
+
+    for ( int i = 0; i < 10; i++ )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
+
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_client_reconnect()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
+
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    // start a server and connect one client
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+
+    snapshot_check( client );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+
+    snapshot_check( server );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    // wait for a bit, so any packets on the wire go away (otherwise, we sometimes have connection request packets in flight which break the test...)
+
+    time += 10.0;
+
+    snapshot_network_simulator_update( network_simulator, time );
+
+    snapshot_client_update( client, time );
+
+    snapshot_server_update( server, time );
+
+    // disconnect client on the server-side and wait until client sees the disconnect
+
+    snapshot_server_disconnect_client( server, 0 );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_DISCONNECTED );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 0 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 0 );
+
+    // now reconnect the client and verify they connect
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+void test_disable_timeout()
+{
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, SNAPSHOT_DEFAULT_MAX_CLIENTS );
+
+    snapshot_network_simulator_set( network_simulator, 250, 250, 5, 10 );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.network_simulator = network_simulator;
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:30000", &client_config, time );
+
+    snapshot_check( client );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_server_t * server = snapshot_server_create( "127.0.0.1:40000", &server_config, time );
+
+    snapshot_check( server );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+
+    // IMPORTANT: passing in -1 timeout in connect token disables timeout for that client. This is useful for testing!
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, -1, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+    snapshot_check( snapshot_client_index( client ) == 0 );
+    snapshot_check( snapshot_server_client_connected( server, 0 ) == 1 );
+    snapshot_check( snapshot_server_num_connected_clients( server ) == 1 );
+
+    for ( int i = 0; i < 100; i++ )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += 1000.0f;        // normally this would timeout the client
+    }
+
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+struct test_sequence_data_t
+{
+    uint16_t sequence;
+};
+
+#define TEST_SEQUENCE_BUFFER_SIZE 256
+
+void test_sequence_buffer()
+{
+    struct snapshot_sequence_buffer_t * sequence_buffer = snapshot_sequence_buffer_create( NULL, TEST_SEQUENCE_BUFFER_SIZE, sizeof( struct test_sequence_data_t ) );
+
+    snapshot_check( sequence_buffer );
+    snapshot_check( sequence_buffer->sequence == 0 );
+    snapshot_check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
+    snapshot_check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+
+    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
+    {
+        snapshot_check( snapshot_sequence_buffer_find( sequence_buffer, ((uint16_t)i) ) == NULL );
+    }                                                                      
+
+    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE*4; i++ )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
+        snapshot_check( entry );
+        entry->sequence = (uint16_t) i;
+        snapshot_check( sequence_buffer->sequence == i + 1 );
+    }
+
+    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; i++ )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_insert( sequence_buffer, ((uint16_t)i) );
+        snapshot_check( entry == NULL );
+    }    
+
+    int index = TEST_SEQUENCE_BUFFER_SIZE * 4;
+    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
+    {
+        struct test_sequence_data_t * entry = (struct test_sequence_data_t*) snapshot_sequence_buffer_find( sequence_buffer, (uint16_t) index );
+        snapshot_check( entry );
+        snapshot_check( entry->sequence == (uint32_t) index );
+        index--;
+    }
+
+    snapshot_sequence_buffer_reset( sequence_buffer );
+
+    snapshot_check( sequence_buffer );
+    snapshot_check( sequence_buffer->sequence == 0 );
+    snapshot_check( sequence_buffer->num_entries == TEST_SEQUENCE_BUFFER_SIZE );
+    snapshot_check( sequence_buffer->entry_stride == sizeof( struct test_sequence_data_t ) );
+
+    for ( int i = 0; i < TEST_SEQUENCE_BUFFER_SIZE; i++ )
+    {
+        snapshot_check( snapshot_sequence_buffer_find( sequence_buffer, (uint16_t) i ) == NULL );
+    }
+
+    snapshot_sequence_buffer_destroy( sequence_buffer );
+}
+
+void test_generate_ack_bits()
+{
+    struct snapshot_sequence_buffer_t * sequence_buffer = snapshot_sequence_buffer_create( NULL, TEST_SEQUENCE_BUFFER_SIZE, sizeof( struct test_sequence_data_t ) );
+
+    uint16_t ack = 0;
+    uint32_t ack_bits = 0xFFFFFFFF;
+
+    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+    snapshot_check( ack == 0xFFFF );
+    snapshot_check( ack_bits == 0 );
+
+    for ( int i = 0; i <= TEST_SEQUENCE_BUFFER_SIZE; i++ )
+    {
+        snapshot_sequence_buffer_insert( sequence_buffer, (uint16_t) i );
+    }
+
+    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+    snapshot_check( ack == TEST_SEQUENCE_BUFFER_SIZE );
+    snapshot_check( ack_bits == 0xFFFFFFFF );
+
+    snapshot_sequence_buffer_reset( sequence_buffer );
+
+    uint16_t input_acks[] = { 1, 5, 9, 11 };
+    int input_num_acks = sizeof( input_acks ) / sizeof( uint16_t );
+    for ( int i = 0; i < input_num_acks; i++ )
+    {
+        snapshot_sequence_buffer_insert( sequence_buffer, input_acks[i] );
+    }
+
+    snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+
+    snapshot_check( ack == 11 );
+    snapshot_check( ack_bits == ( 1 | (1<<(11-9)) | (1<<(11-5)) | (1<<(11-1)) ) );
+
+    snapshot_sequence_buffer_destroy( sequence_buffer );
+}
+
+void test_generate_ack_bits_random()
+{
+    // the received bits must always agree with a lookup of each of the 32 most recent sequence numbers
+
+    const int buffer_sizes[] = { 16, 33, 64, TEST_SEQUENCE_BUFFER_SIZE };
+
+    for ( int j = 0; j < (int) ( sizeof( buffer_sizes ) / sizeof( int ) ); j++ )
+    {
+        struct snapshot_sequence_buffer_t * sequence_buffer = snapshot_sequence_buffer_create( NULL, buffer_sizes[j], sizeof( struct test_sequence_data_t ) );
+
+        uint16_t sequence = 65000;
+
+        for ( int i = 0; i < 10000; i++ )
+        {
+            int action = rand() % 10;
+            if ( action < 5 )
+            {
+                sequence += (uint16_t) ( rand() % 4 );
+                snapshot_sequence_buffer_insert( sequence_buffer, sequence );
+            }
+            else if ( action < 7 )
+            {
+                snapshot_sequence_buffer_insert( sequence_buffer, sequence - (uint16_t) ( rand() % 40 ) );
+            }
+            else if ( action < 9 )
+            {
+                snapshot_sequence_buffer_remove( sequence_buffer, sequence - (uint16_t) ( rand() % 40 ) );
+            }
+            else
+            {
+                sequence += (uint16_t) ( rand() % 100 );
+                snapshot_sequence_buffer_advance( sequence_buffer, sequence );
+            }
+
+            uint16_t ack = 0;
+            uint32_t ack_bits = 0;
+            snapshot_sequence_buffer_generate_ack_bits( sequence_buffer, &ack, &ack_bits );
+
+            snapshot_check( ack == (uint16_t) ( sequence_buffer->sequence - 1 ) );
+
+            for ( int k = 0; k < 32; k++ )
+            {
+                const bool exists = snapshot_sequence_buffer_exists( sequence_buffer, ack - (uint16_t) k ) != 0;
+                snapshot_check( ( ( ack_bits >> k ) & 1 ) == ( exists ? 1U : 0U ) );
+            }
+        }
+
+        snapshot_sequence_buffer_destroy( sequence_buffer );
+    }
+}
+
+void test_packet_header()
+{
+    uint16_t write_sequence;
+    uint16_t write_ack;
+    uint32_t write_ack_bits;
+
+    uint16_t read_sequence;
+    uint16_t read_ack;
+    uint32_t read_ack_bits;
+
+    uint8_t packet_data[SNAPSHOT_MAX_PACKET_HEADER_BYTES];
+
+    // worst case, sequence and ack are far apart, no packets acked.
+
+    write_sequence = 10000;
+    write_ack = 100;
+    write_ack_bits = 0;
+
+    int bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+
+    snapshot_check( bytes_written == SNAPSHOT_MAX_PACKET_HEADER_BYTES );
+
+    int bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+
+    snapshot_check( bytes_read == bytes_written );
+
+    snapshot_check( read_sequence == write_sequence );
+    snapshot_check( read_ack == write_ack );
+    snapshot_check( read_ack_bits == write_ack_bits );
+
+    // rare case. sequence and ack are far apart, significant # of acks are missing
+
+    write_sequence = 10000;
+    write_ack = 100;
+    write_ack_bits = 0xFEFEFFFE;
+
+    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+
+    snapshot_check( bytes_written == 1 + 2 + 2 + 3 );
+
+    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+
+    snapshot_check( bytes_read == bytes_written );
+
+    snapshot_check( read_sequence == write_sequence );
+    snapshot_check( read_ack == write_ack );
+    snapshot_check( read_ack_bits == write_ack_bits );
+
+    // common case under packet loss. sequence and ack are close together, some acks are missing
+
+    write_sequence = 200;
+    write_ack = 100;
+    write_ack_bits = 0xFFFEFFFF;
+
+    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+
+    snapshot_check( bytes_written == 1 + 2 + 1 + 1 );
+
+    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+
+    snapshot_check( bytes_read == bytes_written );
+
+    snapshot_check( read_sequence == write_sequence );
+    snapshot_check( read_ack == write_ack );
+    snapshot_check( read_ack_bits == write_ack_bits );
+
+    // ideal case. no packet loss.
+
+    write_sequence = 200;
+    write_ack = 100;
+    write_ack_bits = 0xFFFFFFFF;
+
+    bytes_written = snapshot_write_packet_header( packet_data, write_sequence, write_ack, write_ack_bits );
+
+    snapshot_check( bytes_written == 1 + 2 + 1 );
+
+    bytes_read = snapshot_read_packet_header( "test_packet_header", packet_data, bytes_written, &read_sequence, &read_ack, &read_ack_bits );
+
+    snapshot_check( bytes_read == bytes_written );
+
+    snapshot_check( read_sequence == write_sequence );
+    snapshot_check( read_ack == write_ack );
+    snapshot_check( read_ack_bits == write_ack_bits );
+}
+
+#define TEST_ACKS_NUM_ITERATIONS 256
+
+void test_acks()
+{
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    snapshot_copy_string( sender_config.name, "sender", sizeof(sender_config.name) );
+    snapshot_copy_string( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    double delta_time = 0.01;
+
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
+    {
+        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + 8 + SNAPSHOT_PACKET_POSTFIX_BYTES];
+
+        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+
+        int dummy_payload_bytes = 8;
+
+        memset( dummy_payload_data, 0, dummy_payload_bytes );
+
+        // sender write packet
+
+        int num_sender_packets = 0;
+        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+
+        snapshot_check( num_sender_packets == 1 );
+
+        // receiver process packet
+
+        uint8_t * receiver_payload_data = NULL;
+        int receiver_payload_bytes = 0;
+        uint16_t receiver_payload_sequence = 0;
+        uint16_t receiver_payload_ack = 0;
+        uint32_t receiver_payload_ack_bits = 0;
+
+        snapshot_endpoint_process_packet( receiver, sender_packet_data[0], sender_packet_bytes[0], &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+
+        snapshot_check( receiver_payload_data );
+        snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
+        for ( int j = 0; j < dummy_payload_bytes; j++ )
+        {
+            snapshot_check( receiver_payload_data[j] == 0 );
+        }
+
+        snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
+
+        // receiver write packet
+
+        int num_receiver_packets = 0;
+        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+
+        snapshot_check( num_receiver_packets == 1 );
+
+        // sender process packet
+
+        uint8_t * sender_payload_data = NULL;
+        int sender_payload_bytes = 0;
+        uint16_t sender_payload_sequence = 0;
+        uint16_t sender_payload_ack = 0;
+        uint32_t sender_payload_ack_bits = 0;
+
+        snapshot_endpoint_process_packet( receiver, receiver_packet_data[0], receiver_packet_bytes[0], &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+
+        snapshot_check( sender_payload_data );
+        snapshot_check( sender_payload_bytes == dummy_payload_bytes );
+        for ( int j = 0; j < dummy_payload_bytes; j++ )
+        {
+            snapshot_check( sender_payload_data[j] == 0 );
+        }
+
+        snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
+
+        // update endpoints
+
+        snapshot_endpoint_update( sender, time );
+
+        snapshot_endpoint_update( receiver, time );
+
+        time += delta_time;
+    }
+
+    // check sender acks
+
+    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
+    int sender_num_acks;
+    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
+    for ( int i = 0; i < sender_num_acks; i++ )
+    {
+        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            sender_acked_packet[sender_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( sender_acked_packet[i] == 1 );
+    }
+
+    // check receiver acks
+
+    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
+    int receiver_num_acks;
+    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
+    for ( int i = 0; i < receiver_num_acks; i++ )
+    {
+        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            receiver_acked_packet[receiver_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( receiver_acked_packet[i] == 1 );
+    }
+
+    // clean up
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+static void test_endpoint_exchange_packets( snapshot_endpoint_t * sender, snapshot_endpoint_t * receiver, int num_iterations, double * time, double delta_time )
+{
+    // one in four packets from sender to receiver is dropped. everything from receiver to sender gets through
+
+    const int payload_bytes = 100;
+
+    uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + payload_bytes + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    uint8_t * payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+    memset( payload_data, 0, payload_bytes );
+
+    for ( int i = 0; i < num_iterations; i++ )
+    {
+        int num_packets = 0;
+        uint8_t * packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        uint8_t * out_payload_data = NULL;
+        int out_payload_bytes = 0;
+        uint16_t out_sequence = 0;
+        uint16_t out_ack = 0;
+        uint32_t out_ack_bits = 0;
+
+        snapshot_endpoint_write_packets( sender, payload_data, payload_bytes, &num_packets, &packet_data[0], &packet_bytes[0] );
+        snapshot_check( num_packets == 1 );
+
+        if ( ( i % 4 ) != 0 )
+        {
+            snapshot_endpoint_process_packet( receiver, packet_data[0], packet_bytes[0], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+            snapshot_check( out_payload_data );
+            snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+        }
+
+        snapshot_endpoint_write_packets( receiver, payload_data, payload_bytes, &num_packets, &packet_data[0], &packet_bytes[0] );
+        snapshot_check( num_packets == 1 );
+
+        snapshot_endpoint_process_packet( sender, packet_data[0], packet_bytes[0], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+        snapshot_check( out_payload_data );
+        snapshot_endpoint_mark_payload_processed( sender, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+
+        snapshot_endpoint_clear_acks( sender );
+        snapshot_endpoint_clear_acks( receiver );
+
+        *time += delta_time;
+
+        snapshot_endpoint_update( sender, *time );
+        snapshot_endpoint_update( receiver, *time );
+    }
+}
+
+void test_endpoint_packet_loss_and_bandwidth()
+{
+    double time = 100.0;
+    const double delta_time = 0.01;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
+    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    test_endpoint_exchange_packets( sender, receiver, 4096, &time, delta_time );
+
+    // the window spans one less send interval than it has packets in it, so allow some slack
+
+    const float expected_kbps = (float) ( ( sender_config.packet_header_size + 100 ) * 8.0 / delta_time / 1000.0 );
+
+    float sent_bandwidth_kbps, received_bandwidth_kbps, acked_bandwidth_kbps;
+
+    snapshot_endpoint_bandwidth( sender, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+    snapshot_check( fabs( snapshot_endpoint_packet_loss( sender ) - 25.0f ) < 1.0f );
+    snapshot_check( fabs( sent_bandwidth_kbps - expected_kbps ) < expected_kbps * 0.05f );
+    snapshot_check( fabs( received_bandwidth_kbps - expected_kbps ) < expected_kbps * 0.05f );
+    snapshot_check( fabs( acked_bandwidth_kbps - expected_kbps * 0.75f ) < expected_kbps * 0.05f );
+
+    snapshot_endpoint_bandwidth( receiver, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+    snapshot_check( snapshot_endpoint_packet_loss( receiver ) < 1.0f );
+    snapshot_check( fabs( received_bandwidth_kbps - expected_kbps * 0.75f ) < expected_kbps * 0.05f );
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_endpoint_stats_update_interval()
+{
+    double time = 100.0;
+    const double delta_time = 0.01;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
+    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    sender_config.sent_packets_buffer_size = 16;
+    sender_config.stats_update_interval = 1.0;
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    // packets are being dropped, but packet loss and bandwidth stay put until the first stats update
+
+    test_endpoint_exchange_packets( sender, receiver, 50, &time, delta_time );
+
+    float sent_bandwidth_kbps, received_bandwidth_kbps, acked_bandwidth_kbps;
+
+    snapshot_endpoint_bandwidth( sender, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+    snapshot_check( snapshot_endpoint_packet_loss( sender ) == 0.0f );
+    snapshot_check( sent_bandwidth_kbps == 0.0f );
+
+    // once the interval has passed they are recalculated, and then held until the next update
+
+    test_endpoint_exchange_packets( sender, receiver, 51, &time, delta_time );
+
+    const float packet_loss = snapshot_endpoint_packet_loss( sender );
+
+    snapshot_endpoint_bandwidth( sender, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+    snapshot_check( packet_loss > 0.0f );
+    snapshot_check( sent_bandwidth_kbps > 0.0f );
+
+    test_endpoint_exchange_packets( sender, receiver, 50, &time, delta_time );
+
+    snapshot_check( snapshot_endpoint_packet_loss( sender ) == packet_loss );
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+static void test_endpoint_exchange_delayed_packets( snapshot_endpoint_t * sender, snapshot_endpoint_t * receiver, int num_iterations, int start_delay, int delay_step, double * time, double delta_time )
+{
+    // every packet gets through, but packets from receiver to sender are held for a number of iterations. the delay grows by
+    // one iteration every delay_step iterations, which is what a queue building up along the route looks like
+
+    const int MaxDelay = 64;
+    const int payload_bytes = 1000;
+    const int reply_bytes = 100;
+
+    static uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + payload_bytes + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    uint8_t * payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+    memset( payload_data, 0, payload_bytes );
+
+    static uint8_t delayed_buffer[MaxDelay][SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES + reply_bytes + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    int delayed_bytes[MaxDelay];
+    int delayed_iteration[MaxDelay];
+    int delayed_head = 0;
+    int delayed_tail = 0;
+
+    for ( int i = 0; i < num_iterations; i++ )
+    {
+        const int delay = start_delay + ( delay_step > 0 ? i / delay_step : 0 );
+        snapshot_check( delay < MaxDelay );
+
+        int num_packets = 0;
+        uint8_t * packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        uint8_t * out_payload_data = NULL;
+        int out_payload_bytes = 0;
+        uint16_t out_sequence = 0;
+        uint16_t out_ack = 0;
+        uint32_t out_ack_bits = 0;
+
+        snapshot_endpoint_write_packets( sender, payload_data, payload_bytes, &num_packets, &packet_data[0], &packet_bytes[0] );
+        snapshot_check( num_packets == 1 );
+
+        snapshot_endpoint_process_packet( receiver, packet_data[0], packet_bytes[0], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+        snapshot_check( out_payload_data );
+        snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+
+        snapshot_endpoint_write_packets( receiver, payload_data, reply_bytes, &num_packets, &packet_data[0], &packet_bytes[0] );
+        snapshot_check( num_packets == 1 );
+        snapshot_check( delayed_tail - delayed_head < MaxDelay );
+
+        const int index = delayed_tail++ % MaxDelay;
+        memcpy( delayed_buffer[index] + SNAPSHOT_PACKET_PREFIX_BYTES, packet_data[0], packet_bytes[0] );
+        delayed_bytes[index] = packet_bytes[0];
+        delayed_iteration[index] = i + delay;
+
+        while ( delayed_head != delayed_tail && delayed_iteration[delayed_head % MaxDelay] <= i )
+        {
+            const int head = delayed_head++ % MaxDelay;
+            snapshot_endpoint_process_packet( sender, delayed_buffer[head] + SNAPSHOT_PACKET_PREFIX_BYTES, delayed_bytes[head], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+            snapshot_check( out_payload_data );
+            snapshot_endpoint_mark_payload_processed( sender, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+        }
+
+        snapshot_endpoint_clear_acks( sender );
+        snapshot_endpoint_clear_acks( receiver );
+
+        *time += delta_time;
+
+        snapshot_endpoint_update( sender, *time );
+        snapshot_endpoint_update( receiver, *time );
+    }
+}
+
+void test_endpoint_congestion_control()
+{
+    double time = 100.0;
+    const double delta_time = 0.01;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
+    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    sender_config.enable_congestion_control = true;
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    // without congestion control there is no pacing rate, and payloads can be as large as they like
+
+    snapshot_check( snapshot_endpoint_pacing_rate( receiver ) == 0.0f );
+    snapshot_check( snapshot_endpoint_max_payload_bytes( receiver ) == SNAPSHOT_MAX_PAYLOAD_BYTES );
+
+    snapshot_check( snapshot_endpoint_pacing_rate( sender ) == sender_config.congestion_initial_kbps );
+
+    // with a steady 50ms rtt there is no queuing delay, so the rate climbs until it is held to a bit over the acked bandwidth
+
+    test_endpoint_exchange_delayed_packets( sender, receiver, 500, 5, 0, &time, delta_time );
+
+    const float steady_pacing_rate_kbps = snapshot_endpoint_pacing_rate( sender );
+
+    float sent_bandwidth_kbps, received_bandwidth_kbps, acked_bandwidth_kbps;
+    snapshot_endpoint_bandwidth( sender, &sent_bandwidth_kbps, &received_bandwidth_kbps, &acked_bandwidth_kbps );
+
+    snapshot_check( steady_pacing_rate_kbps > sender_config.congestion_initial_kbps );
+    snapshot_check( steady_pacing_rate_kbps <= acked_bandwidth_kbps * 2.0f + 1.0f );
+    snapshot_check( snapshot_endpoint_max_payload_bytes( sender ) >= sender_config.fragment_above );
+    snapshot_check( snapshot_endpoint_max_payload_bytes( sender ) <= SNAPSHOT_MAX_PAYLOAD_BYTES );
+
+    // when the rtt starts climbing, queuing delay goes over the target and the rate backs off
+
+    test_endpoint_exchange_delayed_packets( sender, receiver, 200, 5, 5, &time, delta_time );
+
+    const float congested_pacing_rate_kbps = snapshot_endpoint_pacing_rate( sender );
+
+    snapshot_check( congested_pacing_rate_kbps < steady_pacing_rate_kbps * 0.5f );
+    snapshot_check( congested_pacing_rate_kbps >= sender_config.congestion_min_kbps );
+
+    // once the queue drains, the rate recovers
+
+    test_endpoint_exchange_delayed_packets( sender, receiver, 500, 5, 0, &time, delta_time );
+
+    snapshot_check( snapshot_endpoint_pacing_rate( sender ) > congested_pacing_rate_kbps );
+
+    // reset goes back to the initial rate
+
+    snapshot_endpoint_reset( sender );
+
+    snapshot_check( snapshot_endpoint_pacing_rate( sender ) == sender_config.congestion_initial_kbps );
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_acks_packet_loss()
+{
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
+    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    double delta_time = 0.01;
+
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
+    {
+        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + 8 + SNAPSHOT_PACKET_POSTFIX_BYTES];
+
+        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+
+        int dummy_payload_bytes = 8;
+
+        memset( dummy_payload_data, 0, dummy_payload_bytes );
+
+        // sender write packet
+
+        int num_sender_packets = 0;
+        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+
+        snapshot_check( num_sender_packets == 1 );
+
+        // receiver process packet
+
+        bool drop = ( i % 2 ) != 0;
+
+        uint8_t * receiver_payload_data = NULL;
+        int receiver_payload_bytes = 0;
+        uint16_t receiver_payload_sequence = 0;
+        uint16_t receiver_payload_ack = 0;
+        uint32_t receiver_payload_ack_bits = 0;
+
+        if ( !drop )
+        {
+            snapshot_endpoint_process_packet( receiver, sender_packet_data[0], sender_packet_bytes[0], &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+
+            snapshot_check( receiver_payload_data );
+            snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
+            for ( int j = 0; j < dummy_payload_bytes; j++ )
+            {
+                snapshot_check( receiver_payload_data[j] == 0 );
+            }
+
+            snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
+        }
+
+        // receiver write packet
+
+        int num_receiver_packets = 0;
+        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+
+        snapshot_check( num_receiver_packets == 1 );
+
+        // sender process packet
+
+        if ( !drop )
+        {
+            uint8_t * sender_payload_data = NULL;
+            int sender_payload_bytes = 0;
+            uint16_t sender_payload_sequence = 0;
+            uint16_t sender_payload_ack = 0;
+            uint32_t sender_payload_ack_bits = 0;
+
+            snapshot_endpoint_process_packet( receiver, receiver_packet_data[0], receiver_packet_bytes[0], &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+
+            snapshot_check( sender_payload_data );
+            snapshot_check( sender_payload_bytes == dummy_payload_bytes );
+            for ( int j = 0; j < dummy_payload_bytes; j++ )
+            {
+                snapshot_check( sender_payload_data[j] == 0 );
+            }
+
+            snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
+        }
+
+        // update endpoints
+
+        snapshot_endpoint_update( sender, time );
+
+        snapshot_endpoint_update( receiver, time );
+
+        time += delta_time;
+    }
+
+    // check sender acks
+
+    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
+    int sender_num_acks;
+    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
+    for ( int i = 0; i < sender_num_acks; i++ )
+    {
+        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            sender_acked_packet[sender_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( sender_acked_packet[i] == (i+1) % 2 );
+    }
+
+    // check receiver acks
+
+    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
+    int receiver_num_acks;
+    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
+    for ( int i = 0; i < receiver_num_acks; i++ )
+    {
+        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            receiver_acked_packet[receiver_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( receiver_acked_packet[i] == (i+1) % 2 );
+    }
+
+    // clean up
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_endpoint_payload()
+{
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
+    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    double delta_time = 0.01;
+
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
+    {
+        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PAYLOAD_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+
+        int dummy_payload_bytes = 0;
+        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+        snapshot_generate_packet_data( dummy_payload_data, dummy_payload_bytes, SNAPSHOT_MAX_PAYLOAD_BYTES );
+
+        // sender write packet(s)
+
+        int num_sender_packets = 0;
+        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+
+        // receiver process packet(s)
+
+        uint8_t * receiver_payload_data = NULL;
+        int receiver_payload_bytes = 0;
+        uint16_t receiver_payload_sequence = 0;
+        uint16_t receiver_payload_ack = 0;
+        uint32_t receiver_payload_ack_bits = 0;
+
+        for ( int j = 0; j < num_sender_packets; j++ )
+        {
+            snapshot_endpoint_process_packet( receiver, sender_packet_data[j], sender_packet_bytes[j], &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+
+            if ( receiver_payload_data )
+            {
+                snapshot_check( receiver_payload_data );
+                snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
+
+                snapshot_verify_packet_data( receiver_payload_data, receiver_payload_bytes );
+
+                snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
+            }
+        }
+
+        if ( num_sender_packets > 1 )
+        {
+            for ( int j = 0; j < num_sender_packets; j++ )
+            {
+                snapshot_destroy_packet( NULL, sender_packet_data[j] );
+            }
+        }
+
+        // receiver write packet
+
+        int num_receiver_packets = 0;
+        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+
+        // sender process packet
+
+        uint8_t * sender_payload_data = NULL;
+        int sender_payload_bytes = 0;
+        uint16_t sender_payload_sequence = 0;
+        uint16_t sender_payload_ack = 0;
+        uint32_t sender_payload_ack_bits = 0;
+
+        for ( int j = 0; j < num_receiver_packets; j++ )
+        {
+            snapshot_endpoint_process_packet( sender, receiver_packet_data[j], receiver_packet_bytes[j], &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+
+            if ( sender_payload_data )
+            {
+                snapshot_check( sender_payload_data );
+                snapshot_check( sender_payload_bytes == dummy_payload_bytes );
+
+                snapshot_verify_packet_data( sender_payload_data, sender_payload_bytes );
+
+                snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
+            }
+        }
+
+        if ( num_receiver_packets > 1 )
+        {
+            for ( int j = 0; j < num_receiver_packets; j++ )
+            {
+                snapshot_destroy_packet( NULL, receiver_packet_data[j] );
+            }
+        }
+
+        // update endpoints
+
+        snapshot_endpoint_update( sender, time );
+
+        snapshot_endpoint_update( receiver, time );
+
+        time += delta_time;
+    }
+
+    // check sender acks
+
+    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
+    int sender_num_acks;
+    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
+    for ( int i = 0; i < sender_num_acks; i++ )
+    {
+        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            sender_acked_packet[sender_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( sender_acked_packet[i] == 1 );
+    }
+
+    // check receiver acks
+
+    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
+    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
+    int receiver_num_acks;
+    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
+    for ( int i = 0; i < receiver_num_acks; i++ )
+    {
+        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        {
+            receiver_acked_packet[receiver_acks[i]] = 1;
+        }
+    }
+    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    {
+        snapshot_check( receiver_acked_packet[i] == 1 );
+    }
+
+    // clean up
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_endpoint_reassembly_slab()
+{
+    // fragments arrive in reverse order. payloads are reassembled in the slab and handed off without touching the packet allocator
+
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    uint64_t start_hits, start_misses;
+    snapshot_packet_allocator_counters( &start_hits, &start_misses );
+
+    for ( int i = 0; i < 64; i++ )
+    {
+        uint8_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+        const int payload_bytes = SNAPSHOT_MAX_PAYLOAD_BYTES - i * 41;
+        for ( int j = 0; j < payload_bytes; j++ )
+        {
+            payload_data[j] = (uint8_t) ( i + j );
+        }
+
+        int num_iovecs = 0;
+        struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_payload_iovecs( sender, payload_data, payload_bytes, &num_iovecs, iovecs );
+
+        snapshot_check( num_iovecs > 1 );
+
+        for ( int j = num_iovecs - 1; j >= 0; j-- )
+        {
+            uint8_t packet_data[SNAPSHOT_MAX_PACKET_BYTES];
+            memcpy( packet_data, iovecs[j].header, iovecs[j].header_bytes );
+            memcpy( packet_data + iovecs[j].header_bytes, iovecs[j].data, iovecs[j].data_bytes );
+
+            uint8_t * out_payload_data = NULL;
+            int out_payload_bytes = 0;
+            uint16_t out_sequence = 0;
+            uint16_t out_ack = 0;
+            uint32_t out_ack_bits = 0;
+
+            snapshot_endpoint_process_packet( receiver, packet_data, iovecs[j].header_bytes + iovecs[j].data_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+            if ( j > 0 )
+            {
+                snapshot_check( out_payload_data == NULL );
+                continue;
+            }
+
+            snapshot_check( out_payload_data );
+            snapshot_check( out_payload_bytes == payload_bytes );
+            snapshot_check( memcmp( out_payload_data, payload_data, payload_bytes ) == 0 );
+
+            snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+        }
+    }
+
+    uint64_t hits, misses;
+    snapshot_packet_allocator_counters( &hits, &misses );
+
+    snapshot_check( hits == start_hits );
+    snapshot_check( misses == start_misses );
+
+    // payloads only hold a slab slot while they are being reassembled. starting one more payload than there are slots drops the
+    // oldest unfinished payload, and the rest still complete
+
+    {
+        const int NumPayloads = 9;
+        const int NumFragments = 3;
+        const int PayloadBytes = 3000;
+
+        snapshot_check( NumPayloads == receiver_config.fragment_reassembly_slots + 1 );
+
+        static uint8_t fragment_packet_data[NumPayloads][NumFragments][SNAPSHOT_MAX_PACKET_HEADER_BYTES + SNAPSHOT_FRAGMENT_HEADER_BYTES + 1024];
+        int fragment_packet_bytes[NumPayloads][NumFragments];
+
+        uint8_t payload_data[NumPayloads][PayloadBytes];
+
+        for ( int i = 0; i < NumPayloads; i++ )
+        {
+            for ( int j = 0; j < PayloadBytes; j++ )
+            {
+                payload_data[i][j] = (uint8_t) ( i * 7 + j );
+            }
+
+            int num_iovecs = 0;
+            struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+            snapshot_endpoint_write_payload_iovecs( sender, payload_data[i], PayloadBytes, &num_iovecs, iovecs );
+
+            snapshot_check( num_iovecs == NumFragments );
+
+            for ( int j = 0; j < NumFragments; j++ )
+            {
+                snapshot_check( iovecs[j].header_bytes + iovecs[j].data_bytes <= (int) sizeof( fragment_packet_data[i][j] ) );
+                memcpy( fragment_packet_data[i][j], iovecs[j].header, iovecs[j].header_bytes );
+                memcpy( fragment_packet_data[i][j] + iovecs[j].header_bytes, iovecs[j].data, iovecs[j].data_bytes );
+                fragment_packet_bytes[i][j] = iovecs[j].header_bytes + iovecs[j].data_bytes;
+            }
+        }
+
+        const uint64_t evicted = snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_REASSEMBLIES_EVICTED];
+
+        for ( int i = 0; i < NumPayloads; i++ )
+        {
+            uint8_t * out_payload_data = NULL;
+            int out_payload_bytes = 0;
+            uint16_t out_sequence = 0;
+            uint16_t out_ack = 0;
+            uint32_t out_ack_bits = 0;
+
+            snapshot_endpoint_process_packet( receiver, fragment_packet_data[i][0], fragment_packet_bytes[i][0], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+            snapshot_check( out_payload_data == NULL );
+        }
+
+        snapshot_check( snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_REASSEMBLIES_EVICTED] == evicted + 1 );
+
+        for ( int i = 1; i < NumPayloads; i++ )
+        {
+            for ( int j = 1; j < NumFragments; j++ )
+            {
+                uint8_t * out_payload_data = NULL;
+                int out_payload_bytes = 0;
+                uint16_t out_sequence = 0;
+                uint16_t out_ack = 0;
+                uint32_t out_ack_bits = 0;
+
+                snapshot_endpoint_process_packet( receiver, fragment_packet_data[i][j], fragment_packet_bytes[i][j], &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+                if ( j < NumFragments - 1 )
+                {
+                    snapshot_check( out_payload_data == NULL );
+                    continue;
+                }
+
+                snapshot_check( out_payload_data );
+                snapshot_check( out_payload_bytes == PayloadBytes );
+                snapshot_check( memcmp( out_payload_data, payload_data[i], PayloadBytes ) == 0 );
+
+                snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+            }
+        }
+
+        snapshot_check( snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_REASSEMBLIES_EVICTED] == evicted + 1 );
+    }
+
+    // a fragment count that can't fit in a slab slot is too large to receive
+
+    uint8_t packet_data[SNAPSHOT_FRAGMENT_HEADER_BYTES + SNAPSHOT_MAX_PACKET_HEADER_BYTES + 1024];
+    memset( packet_data, 0, sizeof( packet_data ) );
+    uint8_t * p = packet_data;
+    snapshot_write_uint8( &p, 1 );
+    snapshot_write_uint16( &p, 1000 );
+    snapshot_write_uint8( &p, 1 );
+    snapshot_write_uint8( &p, 7 );
+
+    const uint64_t too_large = snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE];
+
+    uint8_t * out_payload_data = NULL;
+    int out_payload_bytes = 0;
+    uint16_t out_sequence = 0;
+    uint16_t out_ack = 0;
+    uint32_t out_ack_bits = 0;
 
-        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+    snapshot_endpoint_process_packet( receiver, packet_data, SNAPSHOT_FRAGMENT_HEADER_BYTES + receiver_config.fragment_size, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
 
-        snapshot_check( num_receiver_packets == 1 );
+    snapshot_check( out_payload_data == NULL );
+    snapshot_check( snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_PACKETS_TOO_LARGE_TO_RECEIVE] == too_large + 1 );
 
-        // sender process packet
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
 
-        uint8_t * sender_payload_data = NULL;
-        int sender_payload_bytes = 0;
-        uint16_t sender_payload_sequence = 0;
-        uint16_t sender_payload_ack = 0;
-        uint32_t sender_payload_ack_bits = 0;
+static bool test_endpoint_fec_deliver( snapshot_endpoint_t * receiver, const struct snapshot_payload_iovec_t * iovec, const uint8_t * payload_data, int payload_bytes )
+{
+    uint8_t packet_data[SNAPSHOT_MAX_PACKET_BYTES];
+    memcpy( packet_data, iovec->header, iovec->header_bytes );
+    memcpy( packet_data + iovec->header_bytes, iovec->data, iovec->data_bytes );
 
-        snapshot_endpoint_process_packet( receiver, receiver_packet_data[0], receiver_packet_bytes[0], buffer, &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+    uint8_t * out_payload_data = NULL;
+    int out_payload_bytes = 0;
+    uint16_t out_sequence = 0;
+    uint16_t out_ack = 0;
+    uint32_t out_ack_bits = 0;
 
-        snapshot_check( sender_payload_data );
-        snapshot_check( sender_payload_bytes == dummy_payload_bytes );
-        for ( int j = 0; j < dummy_payload_bytes; j++ )
+    snapshot_endpoint_process_packet( receiver, packet_data, iovec->header_bytes + iovec->data_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+    if ( !out_payload_data )
+        return false;
+
+    snapshot_check( out_payload_bytes == payload_bytes );
+    snapshot_check( memcmp( out_payload_data, payload_data, payload_bytes ) == 0 );
+
+    snapshot_endpoint_mark_payload_processed( receiver, out_sequence, out_ack, out_ack_bits, out_payload_bytes );
+
+    return true;
+}
+
+void test_endpoint_fec()
+{
+    // one parity fragment per four fragments. one fragment is lost from every group, and the payload still comes through
+
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t sender_config;
+    struct snapshot_endpoint_config_t receiver_config;
+
+    snapshot_endpoint_default_config( &sender_config );
+    snapshot_endpoint_default_config( &receiver_config );
+
+    sender_config.fragment_above = 256;
+    sender_config.fragment_size = 256;
+    sender_config.fec_overhead = 0.25f;
+
+    receiver_config.fragment_above = 256;
+    receiver_config.fragment_size = 256;
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+
+    const int GroupSize = 4;
+
+    uint64_t num_lost = 0;
+
+    for ( int i = 0; i < 64; i++ )
+    {
+        uint8_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+        const int payload_bytes = SNAPSHOT_MAX_PAYLOAD_BYTES - i * 41;
+        for ( int j = 0; j < payload_bytes; j++ )
         {
-            snapshot_check( sender_payload_data[j] == 0 );
+            payload_data[j] = (uint8_t) ( i * 7 + j );
         }
 
-        snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
+        int num_iovecs = 0;
+        struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
 
-        // update endpoints
+        snapshot_endpoint_write_payload_iovecs( sender, payload_data, payload_bytes, &num_iovecs, iovecs );
 
-        snapshot_endpoint_update( sender, time );
+        const int num_fragments = ( payload_bytes + sender_config.fragment_size - 1 ) / sender_config.fragment_size;
+        const int num_groups = ( num_fragments + GroupSize - 1 ) / GroupSize;
 
-        snapshot_endpoint_update( receiver, time );
+        snapshot_check( num_iovecs == num_fragments + num_groups );
 
-        time += delta_time;
+        bool lost[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+        memset( lost, 0, sizeof( lost ) );
+        for ( int group_index = 0; group_index < num_groups; group_index++ )
+        {
+            int group_fragments = num_fragments - group_index * GroupSize;
+            if ( group_fragments > GroupSize )
+                group_fragments = GroupSize;
+            lost[group_index * GroupSize + ( i + group_index ) % group_fragments] = true;
+            num_lost++;
+        }
+
+        // even payloads arrive parity first, odd payloads arrive in order
+
+        int num_received = 0;
+        for ( int j = 0; j < num_iovecs; j++ )
+        {
+            const int index = ( i % 2 ) == 0 ? num_iovecs - 1 - j : j;
+            if ( lost[index] )
+                continue;
+            if ( test_endpoint_fec_deliver( receiver, &iovecs[index], payload_data, payload_bytes ) )
+                num_received++;
+        }
+
+        snapshot_check( num_received == 1 );
     }
 
-    // check sender acks
+    snapshot_check( snapshot_endpoint_counters( sender )[SNAPSHOT_ENDPOINT_COUNTER_NUM_PARITY_FRAGMENTS_SENT] > 0 );
+    snapshot_check( snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RECOVERED] == num_lost );
+
+    // two fragments lost from one group can't be rebuilt until one of them turns up
 
-    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
-    int sender_num_acks;
-    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
-    for ( int i = 0; i < sender_num_acks; i++ )
     {
-        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        uint8_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+        const int payload_bytes = 1000;
+        for ( int j = 0; j < payload_bytes; j++ )
         {
-            sender_acked_packet[sender_acks[i]] = 1;
+            payload_data[j] = (uint8_t) ( j * 3 );
         }
+
+        int num_iovecs = 0;
+        struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+
+        snapshot_endpoint_write_payload_iovecs( sender, payload_data, payload_bytes, &num_iovecs, iovecs );
+
+        snapshot_check( num_iovecs == 5 );
+
+        snapshot_check( !test_endpoint_fec_deliver( receiver, &iovecs[4], payload_data, payload_bytes ) );
+        snapshot_check( !test_endpoint_fec_deliver( receiver, &iovecs[2], payload_data, payload_bytes ) );
+        snapshot_check( !test_endpoint_fec_deliver( receiver, &iovecs[1], payload_data, payload_bytes ) );
+        snapshot_check( test_endpoint_fec_deliver( receiver, &iovecs[0], payload_data, payload_bytes ) );
     }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_endpoint_fragment_resend()
+{
+    // fragments are lost, the receiver reports what is missing, and only those fragments are sent again
+
+    double time = 100.0;
+
+    struct snapshot_endpoint_config_t config;
+    snapshot_endpoint_default_config( &config );
+    config.fragment_above = 256;
+    config.fragment_size = 256;
+    config.enable_fragment_resend = true;
+
+    snapshot_endpoint_t * sender = snapshot_endpoint_create( &config, time );
+    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &config, time );
+
+    uint8_t payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+    const int payload_bytes = 3000;
+    for ( int j = 0; j < payload_bytes; j++ )
     {
-        snapshot_check( sender_acked_packet[i] == 1 );
+        payload_data[j] = (uint8_t) ( j * 5 );
     }
 
-    // check receiver acks
+    int num_iovecs = 0;
+    struct snapshot_payload_iovec_t iovecs[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
 
-    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
-    int receiver_num_acks;
-    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
-    for ( int i = 0; i < receiver_num_acks; i++ )
+    snapshot_endpoint_write_payload_iovecs( sender, payload_data, payload_bytes, &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == 12 );
+
+    // the payload is kept by the sender, so it may be overwritten once written
+
+    uint8_t original_payload_data[SNAPSHOT_MAX_PAYLOAD_BYTES];
+    memcpy( original_payload_data, payload_data, payload_bytes );
+
+    int num_dropped = 0;
+    for ( int i = 0; i < num_iovecs; i++ )
     {
-        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
+        if ( i == 0 || i == 5 || i == 11 )
         {
-            receiver_acked_packet[receiver_acks[i]] = 1;
+            num_dropped++;
+            continue;
         }
+        snapshot_check( !test_endpoint_fec_deliver( receiver, &iovecs[i], original_payload_data, payload_bytes ) );
     }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+
+    memset( payload_data, 0, sizeof( payload_data ) );
+
+    uint8_t fragment_acks_data[SNAPSHOT_ENDPOINT_FRAGMENT_ACKS_BYTES];
+
+    int fragment_acks_bytes = snapshot_endpoint_write_fragment_acks( receiver, fragment_acks_data, sizeof( fragment_acks_data ) );
+
+    snapshot_check( fragment_acks_bytes > 0 );
+
+    // fragments sent moments ago may still be in flight, so nothing is resent yet
+
+    uint8_t * out_payload_data = NULL;
+    int out_payload_bytes = 0;
+    uint16_t out_sequence = 0;
+    uint16_t out_ack = 0;
+    uint32_t out_ack_bits = 0;
+
+    snapshot_endpoint_process_packet( sender, fragment_acks_data, fragment_acks_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+    snapshot_check( out_payload_data == NULL );
+
+    snapshot_endpoint_write_resend_iovecs( sender, &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == 0 );
+
+    // a little later the missing fragments are resent, and the payload completes
+
+    time += 0.1;
+
+    snapshot_endpoint_update( sender, time );
+
+    snapshot_endpoint_process_packet( sender, fragment_acks_data, fragment_acks_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+    snapshot_endpoint_write_resend_iovecs( sender, &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == num_dropped );
+
+    int num_received = 0;
+    for ( int i = 0; i < num_iovecs; i++ )
     {
-        snapshot_check( receiver_acked_packet[i] == 1 );
+        if ( test_endpoint_fec_deliver( receiver, &iovecs[i], original_payload_data, payload_bytes ) )
+            num_received++;
+    }
+
+    snapshot_check( num_received == 1 );
+
+    snapshot_check( snapshot_endpoint_counters( sender )[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENTS_RESENT] == (uint64_t) num_dropped );
+    snapshot_check( snapshot_endpoint_counters( sender )[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_RECEIVED] == 2 );
+    snapshot_check( snapshot_endpoint_counters( receiver )[SNAPSHOT_ENDPOINT_COUNTER_NUM_FRAGMENT_ACKS_SENT] == 1 );
+
+    // nothing is left to report once the payload is through
+
+    snapshot_check( snapshot_endpoint_write_fragment_acks( receiver, fragment_acks_data, sizeof( fragment_acks_data ) ) == 0 );
+
+    // once the receiver acks the payload, the sender lets it go, and a late fragment ack resends nothing
+
+    uint8_t ack_payload_data[16];
+    memset( ack_payload_data, 0, sizeof( ack_payload_data ) );
+
+    snapshot_endpoint_write_payload_iovecs( receiver, ack_payload_data, sizeof( ack_payload_data ), &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == 1 );
+
+    snapshot_check( test_endpoint_fec_deliver( sender, &iovecs[0], ack_payload_data, sizeof( ack_payload_data ) ) );
+
+    time += 0.1;
+
+    snapshot_endpoint_update( sender, time );
+
+    fragment_acks_bytes = 0;
+    fragment_acks_data[fragment_acks_bytes++] = 5;
+    fragment_acks_data[fragment_acks_bytes++] = 1;
+    fragment_acks_data[fragment_acks_bytes++] = 0;
+    fragment_acks_data[fragment_acks_bytes++] = 0;
+    fragment_acks_data[fragment_acks_bytes++] = 11;
+    fragment_acks_data[fragment_acks_bytes++] = 0;
+    fragment_acks_data[fragment_acks_bytes++] = 0;
+
+    snapshot_endpoint_process_packet( sender, fragment_acks_data, fragment_acks_bytes, &out_payload_data, &out_payload_bytes, &out_sequence, &out_ack, &out_ack_bits );
+
+    snapshot_endpoint_write_resend_iovecs( sender, &num_iovecs, iovecs );
+
+    snapshot_check( num_iovecs == 0 );
+
+    snapshot_endpoint_destroy( sender );
+    snapshot_endpoint_destroy( receiver );
+}
+
+void test_delta_snapshots()
+{
+    const int NumObjects = 1024;
+    const int ObjectBytes = 16;
+    const int ObjectWords = ObjectBytes / 4;
+
+    struct snapshot_delta_world_t * world = snapshot_delta_world_create( NULL, NumObjects, ObjectBytes );
+    struct snapshot_delta_client_t * client = snapshot_delta_client_create( NULL, world );
+    struct snapshot_delta_receiver_t * receiver = snapshot_delta_receiver_create( NULL, NumObjects, ObjectBytes );
+
+    snapshot_check( world );
+    snapshot_check( client );
+    snapshot_check( receiver );
+
+    static uint32_t objects[NumObjects][ObjectWords];
+    memset( objects, 0, sizeof( objects ) );
+
+    uint32_t buffer[SNAPSHOT_MAX_PAYLOAD_BYTES / 4];
+    uint32_t stale_buffer[SNAPSHOT_MAX_PAYLOAD_BYTES / 4];
+
+    uint16_t packet_sequence = 0;
+    int num_deferred = 0;
+
+    // with nothing changed, there is nothing to send
+
+    snapshot_check( snapshot_delta_world_advance( world ) == 1 );
+    snapshot_check( snapshot_delta_client_write( client, packet_sequence, (uint8_t*) buffer, sizeof( buffer ), &num_deferred ) == 0 );
+    snapshot_check( num_deferred == 0 );
+
+    // a few objects change per snapshot and a quarter of snapshots are lost. objects in snapshots that get through are acked,
+    // and objects in lost snapshots stay dirty until they get through
+
+    const int NumSnapshots = 1000;
+
+    int total_bytes = 0;
+
+    for ( int i = 0; i < NumSnapshots; i++ )
+    {
+        for ( int j = 0; j < 4; j++ )
+        {
+            const int object_index = ( rand() % 128 ) * 8;
+            objects[object_index][rand() % ObjectWords] = (uint32_t) rand() | 1;
+            snapshot_delta_world_set_object( world, object_index, (uint8_t*) objects[object_index] );
+        }
+
+        const uint32_t snapshot_sequence = snapshot_delta_world_advance( world );
+
+        const int bytes = snapshot_delta_client_write( client, packet_sequence, (uint8_t*) buffer, sizeof( buffer ), &num_deferred );
+
+        snapshot_check( bytes > 0 );
+        snapshot_check( num_deferred == 0 );
+
+        total_bytes += bytes;
+
+        if ( rand() % 4 )
+        {
+            snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) buffer, bytes ) == SNAPSHOT_OK );
+            snapshot_check( snapshot_delta_receiver_sequence( receiver ) == snapshot_sequence );
+            snapshot_check( memcmp( snapshot_delta_receiver_object( receiver, 0 ), objects, sizeof( objects ) ) == 0 );
+
+            snapshot_delta_client_acked( client, &packet_sequence, 1 );
+
+            snapshot_check( snapshot_delta_client_num_dirty_objects( client ) == 0 );
+        }
+
+        packet_sequence++;
+    }
+
+    // the whole world is 16k, but the deltas only carry the objects that changed since they were last acked
+
+    snapshot_check( total_bytes / NumSnapshots < 128 );
+
+    // an object is never taken back to an older snapshot of it
+
+    objects[8][0] = 1000;
+    snapshot_delta_world_set_object( world, 8, (uint8_t*) objects[8] );
+    snapshot_delta_world_advance( world );
+
+    const int stale_bytes = snapshot_delta_client_write( client, packet_sequence++, (uint8_t*) stale_buffer, sizeof( stale_buffer ), &num_deferred );
+
+    objects[8][0] = 1001;
+    snapshot_delta_world_set_object( world, 8, (uint8_t*) objects[8] );
+    snapshot_delta_world_advance( world );
+
+    int bytes = snapshot_delta_client_write( client, packet_sequence++, (uint8_t*) buffer, sizeof( buffer ), &num_deferred );
+
+    snapshot_check( stale_bytes > 0 );
+    snapshot_check( bytes > 0 );
+    snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) buffer, bytes ) == SNAPSHOT_OK );
+    snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) stale_buffer, stale_bytes ) == SNAPSHOT_OK );
+    snapshot_check( memcmp( snapshot_delta_receiver_object( receiver, 0 ), objects, sizeof( objects ) ) == 0 );
+
+    // when the client falls out of the history, the whole world is scanned for objects it is behind on
+
+    objects[16][0] = 1002;
+    snapshot_delta_world_set_object( world, 16, (uint8_t*) objects[16] );
+
+    for ( int i = 0; i < SNAPSHOT_DELTA_HISTORY_SIZE + 1; i++ )
+    {
+        snapshot_delta_world_advance( world );
+    }
+
+    bytes = snapshot_delta_client_write( client, packet_sequence, (uint8_t*) buffer, sizeof( buffer ), &num_deferred );
+
+    snapshot_check( bytes > 0 );
+    snapshot_check( num_deferred == 0 );
+    snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) buffer, bytes ) == SNAPSHOT_OK );
+    snapshot_check( memcmp( snapshot_delta_receiver_object( receiver, 0 ), objects, sizeof( objects ) ) == 0 );
+
+    snapshot_delta_client_acked( client, &packet_sequence, 1 );
+    packet_sequence++;
+
+    snapshot_check( snapshot_delta_client_num_dirty_objects( client ) == 0 );
+
+    // when every object changes, a snapshot never goes over the budget, and the highest priority objects go first
+
+    const int HighPriorityObjects = 64;
+
+    for ( int i = 0; i < NumObjects; i++ )
+    {
+        for ( int j = 0; j < ObjectWords; j++ )
+        {
+            objects[i][j] = i + j + 1;
+        }
+        snapshot_delta_world_set_object( world, i, (uint8_t*) objects[i] );
+        if ( i >= NumObjects - HighPriorityObjects )
+        {
+            snapshot_delta_world_set_object_priority( world, i, 100.0f );
+        }
+    }
+
+    snapshot_delta_world_advance( world );
+
+    const int BudgetBytes = 256;
+
+    bytes = snapshot_delta_client_write( client, packet_sequence, (uint8_t*) buffer, BudgetBytes, &num_deferred );
+
+    snapshot_check( bytes > 0 );
+    snapshot_check( bytes <= BudgetBytes );
+    snapshot_check( num_deferred > NumObjects - HighPriorityObjects );
+    snapshot_check( snapshot_delta_client_num_dirty_objects( client ) == NumObjects );
+
+    snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) buffer, bytes ) == SNAPSHOT_OK );
+
+    int num_updated = 0;
+    for ( int i = 0; i < NumObjects; i++ )
+    {
+        if ( memcmp( snapshot_delta_receiver_object( receiver, i ), objects[i], ObjectBytes ) == 0 )
+        {
+            snapshot_check( i >= NumObjects - HighPriorityObjects );
+            num_updated++;
+        }
+    }
+    snapshot_check( num_updated == NumObjects - num_deferred );
+
+    snapshot_delta_client_acked( client, &packet_sequence, 1 );
+    packet_sequence++;
+
+    snapshot_check( snapshot_delta_client_num_dirty_objects( client ) == num_deferred );
+
+    // deferred objects carry their priority over, so everything gets through in a few full size payloads
+
+    int num_payloads = 0;
+
+    while ( snapshot_delta_client_num_dirty_objects( client ) > 0 )
+    {
+        snapshot_delta_world_advance( world );
+
+        bytes = snapshot_delta_client_write( client, packet_sequence, (uint8_t*) buffer, sizeof( buffer ), &num_deferred );
+
+        snapshot_check( bytes > 0 );
+        snapshot_check( snapshot_delta_receiver_read( receiver, (uint8_t*) buffer, bytes ) == SNAPSHOT_OK );
+
+        snapshot_delta_client_acked( client, &packet_sequence, 1 );
+        packet_sequence++;
+
+        num_payloads++;
+
+        snapshot_check( num_payloads < 16 );
+    }
+
+    snapshot_check( memcmp( snapshot_delta_receiver_object( receiver, 0 ), objects, sizeof( objects ) ) == 0 );
+
+    snapshot_delta_receiver_destroy( receiver );
+    snapshot_delta_client_destroy( client );
+    snapshot_delta_world_destroy( world );
+}
+
+void test_client_server_payload()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+
+    // connect client to server
+
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
+
+    snapshot_check( client );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
+
+    snapshot_check( server );
+
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
+
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+    snapshot_client_connect( client, connect_token );
+
+    while ( 1 )
+    {
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
+
+        time += delta_time;
     }
 
-    // clean up
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    snapshot_endpoint_destroy( sender );
-    snapshot_endpoint_destroy( receiver );
-}
+    // exchange payload packets
 
-void test_acks_packet_loss()
-{
-    double time = 100.0;
+    snapshot_client_set_development_flags( client, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
+    snapshot_server_set_development_flags( server, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
 
-    struct snapshot_endpoint_config_t sender_config;
-    struct snapshot_endpoint_config_t receiver_config;
+    for ( int i = 0; i < 256; i++ )
+    {
+        snapshot_client_update( client, time );
 
-    snapshot_endpoint_default_config( &sender_config );
-    snapshot_endpoint_default_config( &receiver_config );
+        snapshot_server_update( server, time );
 
-    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
-    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
-    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+        time += delta_time;
+    }
 
-    double delta_time = 0.01;
+    // check client counters
 
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
-    {
-        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + 8 + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    const uint64_t * client_counters = snapshot_client_counters( client );
 
-        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_RECEIVED] > 0 );
 
-        int dummy_payload_bytes = 8;
+    // check server counters
 
-        memset( dummy_payload_data, 0, dummy_payload_bytes );
+    const uint64_t * server_counters = snapshot_server_counters( server );
 
-        // sender write packet
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_RECEIVED] > 0 );
 
-        int num_sender_packets = 0;
-        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+    // clean up
 
-        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+    snapshot_server_destroy( server );
 
-        snapshot_check( num_sender_packets == 1 );
+    snapshot_client_destroy( client );
+}
 
-        // receiver process packet
+void test_client_server_payload_gso_gro()
+{
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-        bool drop = ( i % 2 ) != 0;
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
+    client_config.enable_gro = true;
 
-        uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    // connect client to server
 
-        uint8_t * receiver_payload_data = NULL;
-        int receiver_payload_bytes = 0;
-        uint16_t receiver_payload_sequence = 0;
-        uint16_t receiver_payload_ack = 0;
-        uint32_t receiver_payload_ack_bits = 0;
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
 
-        if ( !drop )
-        {
-            snapshot_endpoint_process_packet( receiver, sender_packet_data[0], sender_packet_bytes[0], buffer, &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+    snapshot_check( client );
 
-            snapshot_check( receiver_payload_data );
-            snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
-            for ( int j = 0; j < dummy_payload_bytes; j++ )
-            {
-                snapshot_check( receiver_payload_data[j] == 0 );
-            }
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-            snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
-        }
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.enable_gso = true;
+    server_config.enable_gro = true;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-        // receiver write packet
+    const char * server_address = "127.0.0.1:40000";
 
-        int num_receiver_packets = 0;
-        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
 
-        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+    snapshot_check( server );
 
-        snapshot_check( num_receiver_packets == 1 );
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-        // sender process packet
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-        if ( !drop )
-        {
-            uint8_t * sender_payload_data = NULL;
-            int sender_payload_bytes = 0;
-            uint16_t sender_payload_sequence = 0;
-            uint16_t sender_payload_ack = 0;
-            uint32_t sender_payload_ack_bits = 0;
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-            snapshot_endpoint_process_packet( receiver, receiver_packet_data[0], receiver_packet_bytes[0], buffer, &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-            snapshot_check( sender_payload_data );
-            snapshot_check( sender_payload_bytes == dummy_payload_bytes );
-            for ( int j = 0; j < dummy_payload_bytes; j++ )
-            {
-                snapshot_check( sender_payload_data[j] == 0 );
-            }
+    snapshot_client_connect( client, connect_token );
 
-            snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
-        }
+    while ( 1 )
+    {
+        snapshot_client_update( client, time );
 
-        // update endpoints
+        snapshot_server_update( server, time );
 
-        snapshot_endpoint_update( sender, time );
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        snapshot_endpoint_update( receiver, time );
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
 
         time += delta_time;
     }
 
-    // check sender acks
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
-    int sender_num_acks;
-    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
-    for ( int i = 0; i < sender_num_acks; i++ )
-    {
-        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-        {
-            sender_acked_packet[sender_acks[i]] = 1;
-        }
-    }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
-    {
-        snapshot_check( sender_acked_packet[i] == (i+1) % 2 );
-    }
+    // exchange payload packets
 
-    // check receiver acks
+    snapshot_client_set_development_flags( client, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
+    snapshot_server_set_development_flags( server, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
 
-    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
-    int receiver_num_acks;
-    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
-    for ( int i = 0; i < receiver_num_acks; i++ )
-    {
-        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-        {
-            receiver_acked_packet[receiver_acks[i]] = 1;
-        }
-    }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
+    for ( int i = 0; i < 256; i++ )
     {
-        snapshot_check( receiver_acked_packet[i] == (i+1) % 2 );
+        snapshot_client_update( client, time );
+
+        snapshot_server_update( server, time );
+
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
+
+        time += delta_time;
     }
 
+    // check client counters
+
+    const uint64_t * client_counters = snapshot_client_counters( client );
+
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_RECEIVED] > 0 );
+
+    // check server counters
+
+    const uint64_t * server_counters = snapshot_server_counters( server );
+
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_RECEIVED] > 0 );
+
     // clean up
 
-    snapshot_endpoint_destroy( sender );
-    snapshot_endpoint_destroy( receiver );
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
 }
 
-void test_endpoint_payload()
+void test_client_server_payload_pacing()
 {
-    double time = 100.0;
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
 
-    struct snapshot_endpoint_config_t sender_config;
-    struct snapshot_endpoint_config_t receiver_config;
+    struct snapshot_client_config_t client_config;
+    snapshot_default_client_config( &client_config );
 
-    snapshot_endpoint_default_config( &sender_config );
-    snapshot_endpoint_default_config( &receiver_config );
+    // connect client to server
 
-    strncpy( sender_config.name, "sender", sizeof(sender_config.name) );
-    strncpy( receiver_config.name, "receiver", sizeof(receiver_config.name) );
+    struct snapshot_client_t * client = snapshot_client_create( "0.0.0.0:50000", &client_config, time );
 
-    snapshot_endpoint_t * sender = snapshot_endpoint_create( &sender_config, time );
-    snapshot_endpoint_t * receiver = snapshot_endpoint_create( &receiver_config, time );
+    snapshot_check( client );
 
-    double delta_time = 0.01;
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
 
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS; i++ )
-    {
-        uint8_t payload_buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PAYLOAD_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = 1;
+    server_config.enable_pacing = true;
+    server_config.pacing_rate_kbps = 1000.0f;
+    server_config.fec_overhead = 1.0f;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
-        int dummy_payload_bytes = 0;
-        uint8_t * dummy_payload_data = payload_buffer + SNAPSHOT_PACKET_PREFIX_BYTES;
-        snapshot_generate_packet_data( dummy_payload_data, dummy_payload_bytes, SNAPSHOT_MAX_PAYLOAD_BYTES );
+    const char * server_address = "127.0.0.1:40000";
 
-        // sender write packet(s)
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
 
-        int num_sender_packets = 0;
-        uint8_t * sender_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int sender_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+    snapshot_check( server );
 
-        snapshot_endpoint_write_packets( sender, dummy_payload_data, dummy_payload_bytes, &num_sender_packets, &sender_packet_data[0], &sender_packet_bytes[0] );
+    uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
 
-        // receiver process packet(s)
+    uint64_t client_id = 0;
+    snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
 
-        uint8_t buffer[SNAPSHOT_PACKET_PREFIX_BYTES + SNAPSHOT_MAX_PACKET_BYTES + SNAPSHOT_PACKET_POSTFIX_BYTES];
+    uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+    snapshot_crypto_random_bytes(user_data, SNAPSHOT_USER_DATA_BYTES);
 
-        uint8_t * receiver_payload_data = NULL;
-        int receiver_payload_bytes = 0;
-        uint16_t receiver_payload_sequence = 0;
-        uint16_t receiver_payload_ack = 0;
-        uint32_t receiver_payload_ack_bits = 0;
+    snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
 
-        for ( int j = 0; j < num_sender_packets; j++ )
-        {
-            snapshot_endpoint_process_packet( receiver, sender_packet_data[j], sender_packet_bytes[j], buffer, &receiver_payload_data, &receiver_payload_bytes, &receiver_payload_sequence, &receiver_payload_ack, &receiver_payload_ack_bits );
+    snapshot_client_connect( client, connect_token );
 
-            if ( receiver_payload_data )
-            {
-                snapshot_check( receiver_payload_data );
-                snapshot_check( receiver_payload_bytes == dummy_payload_bytes );
+    while ( 1 )
+    {
+        snapshot_client_update( client, time );
 
-                snapshot_verify_packet_data( receiver_payload_data, receiver_payload_bytes );
+        snapshot_server_update( server, time );
 
-                snapshot_endpoint_mark_payload_processed( receiver, receiver_payload_sequence, receiver_payload_ack, receiver_payload_ack_bits, receiver_payload_bytes );
-            }
-        }
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        if ( num_sender_packets > 1 )
-        {
-            for ( int j = 0; j < num_sender_packets; j++ )
-            {
-                snapshot_destroy_packet( NULL, sender_packet_data[j] );
-            }
-        }
+        if ( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+            break;
 
-        // receiver write packet
+        time += delta_time;
+    }
 
-        int num_receiver_packets = 0;
-        uint8_t * receiver_packet_data[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
-        int receiver_packet_bytes[SNAPSHOT_ENDPOINT_MAX_WRITE_PACKETS];
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-        snapshot_endpoint_write_packets( receiver, dummy_payload_data, dummy_payload_bytes, &num_receiver_packets, &receiver_packet_data[0], &receiver_packet_bytes[0] );
+    // exchange payload packets. with a parity fragment for every fragment, a max size payload is a train of eight packets, and
+    // at 1mbps it takes longer to go out than the time between updates, so fragment trains are still being released after the
+    // server update has returned
 
-        // sender process packet
+    snapshot_client_set_development_flags( client, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
+    snapshot_server_set_development_flags( server, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
 
-        uint8_t * sender_payload_data = NULL;
-        int sender_payload_bytes = 0;
-        uint16_t sender_payload_sequence = 0;
-        uint16_t sender_payload_ack = 0;
-        uint32_t sender_payload_ack_bits = 0;
+    const uint64_t * server_counters = snapshot_server_counters( server );
 
-        for ( int j = 0; j < num_receiver_packets; j++ )
-        {
-            snapshot_endpoint_process_packet( sender, receiver_packet_data[j], receiver_packet_bytes[j], buffer, &sender_payload_data, &sender_payload_bytes, &sender_payload_sequence, &sender_payload_ack, &sender_payload_ack_bits );
+    bool released_between_updates = false;
 
-            if ( sender_payload_data )
-            {
-                snapshot_check( sender_payload_data );
-                snapshot_check( sender_payload_bytes == dummy_payload_bytes );
+    for ( int i = 0; i < 32; i++ )
+    {
+        snapshot_client_update( client, time );
 
-                snapshot_verify_packet_data( sender_payload_data, sender_payload_bytes );
+        snapshot_server_update( server, time );
 
-                snapshot_endpoint_mark_payload_processed( sender, sender_payload_sequence, sender_payload_ack, sender_payload_ack_bits, sender_payload_bytes );
-            }
-        }
+        if ( snapshot_client_state( client ) <= SNAPSHOT_CLIENT_STATE_DISCONNECTED )
+            break;
 
-        if ( num_receiver_packets > 1 )
+        for ( int j = 0; j < 4; j++ )
         {
-            for ( int j = 0; j < num_receiver_packets; j++ )
-            {
-                snapshot_destroy_packet( NULL, receiver_packet_data[j] );
-            }
-        }
+            const uint64_t paced_packets_sent = server_counters[SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT];
 
-        // update endpoints
+            snapshot_platform_sleep( 0.01 );
 
-        snapshot_endpoint_update( sender, time );
+            snapshot_server_send_paced_packets( server );
 
-        snapshot_endpoint_update( receiver, time );
+            if ( server_counters[SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT] > paced_packets_sent )
+                released_between_updates = true;
+        }
 
         time += delta_time;
     }
 
-    // check sender acks
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    uint8_t sender_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( sender_acked_packet, 0, sizeof( sender_acked_packet ) );
-    int sender_num_acks;
-    uint16_t * sender_acks = snapshot_endpoint_get_acks( sender, &sender_num_acks );
-    for ( int i = 0; i < sender_num_acks; i++ )
-    {
-        if ( sender_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-        {
-            sender_acked_packet[sender_acks[i]] = 1;
-        }
-    }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
-    {
-        snapshot_check( sender_acked_packet[i] == 1 );
-    }
+    // check client counters
 
-    // check receiver acks
+    const uint64_t * client_counters = snapshot_client_counters( client );
 
-    uint8_t receiver_acked_packet[TEST_ACKS_NUM_ITERATIONS];
-    memset( receiver_acked_packet, 0, sizeof( receiver_acked_packet ) );
-    int receiver_num_acks;
-    uint16_t * receiver_acks = snapshot_endpoint_get_acks( receiver, &receiver_num_acks );
-    for ( int i = 0; i < receiver_num_acks; i++ )
-    {
-        if ( receiver_acks[i] < TEST_ACKS_NUM_ITERATIONS )
-        {
-            receiver_acked_packet[receiver_acks[i]] = 1;
-        }
-    }
-    for ( int i = 0; i < TEST_ACKS_NUM_ITERATIONS / 2; i++ )
-    {
-        snapshot_check( receiver_acked_packet[i] == 1 );
-    }
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_RECEIVED] > 0 );
+
+    // check server counters
+
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_RECEIVED] > 0 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PACED_PACKETS_SENT] > 0 );
+    snapshot_check( released_between_updates );
 
     // clean up
 
-    snapshot_endpoint_destroy( sender );
-    snapshot_endpoint_destroy( receiver );
+    snapshot_server_destroy( server );
+
+    snapshot_client_destroy( client );
 }
 
-void test_client_server_payload()
+void test_client_server_snapshots()
 {
+    const int NumObjects = 64;
+    const int ObjectBytes = 8;
+
     double time = 0.0;
     double delta_time = 1.0 / 10.0;
 
     struct snapshot_client_config_t client_config;
     snapshot_default_client_config( &client_config );
+    client_config.num_snapshot_objects = NumObjects;
+    client_config.snapshot_object_bytes = ObjectBytes;
 
     // connect client to server
 
@@ -4161,6 +7289,8 @@ void test_client_server_payload()
     snapshot_default_server_config( &server_config );
     server_config.max_clients = 1;
     server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.num_snapshot_objects = NumObjects;
+    server_config.snapshot_object_bytes = ObjectBytes;
     memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
 
     const char * server_address = "127.0.0.1:40000";
@@ -4198,13 +7328,20 @@ void test_client_server_payload()
 
     snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
 
-    // exchange payload packets
+    // move a few objects every update, then let the client catch up
 
-    snapshot_client_set_development_flags( client, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
-    snapshot_server_set_development_flags( server, SNAPSHOT_DEVELOPMENT_FLAG_VALIDATE_PAYLOAD );
+    uint8_t objects[NumObjects][ObjectBytes];
+    memset( objects, 0, sizeof( objects ) );
 
     for ( int i = 0; i < 256; i++ )
     {
+        if ( i < 200 )
+        {
+            const int object_index = rand() % NumObjects;
+            objects[object_index][rand() % ObjectBytes] = (uint8_t) rand();
+            snapshot_server_set_snapshot_object( server, object_index, objects[object_index] );
+        }
+
         snapshot_client_update( client, time );
 
         snapshot_server_update( server, time );
@@ -4215,19 +7352,27 @@ void test_client_server_payload()
         time += delta_time;
     }
 
-    // check client counters
+    snapshot_check( snapshot_client_state( client ) == SNAPSHOT_CLIENT_STATE_CONNECTED );
+
+    snapshot_check( snapshot_client_snapshot_sequence( client ) > 0 );
+
+    for ( int i = 0; i < NumObjects; i++ )
+    {
+        snapshot_check( memcmp( snapshot_client_snapshot_object( client, i ), objects[i], ObjectBytes ) == 0 );
+    }
+
+    // acks go back to the server on keep alives, so the client never sends a payload of its own
 
     const uint64_t * client_counters = snapshot_client_counters( client );
 
-    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_SENT] > 0 );
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_SENT] == 0 );
     snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_PAYLOADS_RECEIVED] > 0 );
-
-    // check server counters
+    snapshot_check( client_counters[SNAPSHOT_CLIENT_COUNTER_KEEP_ALIVE_PACKETS_SENT] >= 200 );
 
     const uint64_t * server_counters = snapshot_server_counters( server );
 
     snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_SENT] > 0 );
-    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_PAYLOADS_RECEIVED] > 0 );
+    snapshot_check( server_counters[SNAPSHOT_SERVER_COUNTER_SNAPSHOT_OBJECTS_DEFERRED] == 0 );
 
     // clean up
 
@@ -4247,6 +7392,258 @@ void test_base64()
     snapshot_check( snapshot_base64_decode_string( encoded, decoded, 10 ) == 0 );
 }
 
+void benchmark_server_process_packet()
+{
+    // connect a full server through the network simulator, then time how long the server spends receiving passthrough
+    // packets from every client each frame. clients are visited in order, so per-client state is walked the same way
+    // a real server walks it, and the cost of touching it shows up in the per packet time
+
+    const int num_clients = SNAPSHOT_DEFAULT_MAX_CLIENTS;
+    const int num_frames = 100;
+
+    struct snapshot_network_simulator_t * network_simulator = snapshot_network_simulator_create( NULL, num_clients );
+
+    uint8_t private_key[SNAPSHOT_KEY_BYTES];
+    snapshot_crypto_random_bytes( private_key, SNAPSHOT_KEY_BYTES );
+
+    double time = 0.0;
+    double delta_time = 1.0 / 10.0;
+
+    struct snapshot_server_config_t server_config;
+    snapshot_default_server_config( &server_config );
+    server_config.max_clients = num_clients;
+    server_config.protocol_id = TEST_PROTOCOL_ID;
+    server_config.network_simulator = network_simulator;
+    memcpy( &server_config.private_key, private_key, SNAPSHOT_KEY_BYTES );
+
+    const char * server_address = "127.0.0.1:40000";
+
+    struct snapshot_server_t * server = snapshot_server_create( server_address, &server_config, time );
+
+    snapshot_check( server );
+
+    struct snapshot_client_t ** client = (struct snapshot_client_t **) malloc( sizeof( struct snapshot_client_t* ) * num_clients );
+
+    snapshot_check( client );
+
+    for ( int i = 0; i < num_clients; i++ )
+    {
+        char client_bind_address[SNAPSHOT_MAX_ADDRESS_STRING_LENGTH];
+        snprintf( client_bind_address, sizeof(client_bind_address), "0.0.0.0:%d", 30000 + i );
+
+        struct snapshot_client_config_t client_config;
+        snapshot_default_client_config( &client_config );
+        client_config.network_simulator = network_simulator;
+
+        client[i] = snapshot_client_create( client_bind_address, &client_config, time );
+
+        snapshot_check( client[i] );
+
+        uint64_t client_id = 0;
+        snapshot_crypto_random_bytes( (uint8_t*) &client_id, 8 );
+
+        uint8_t user_data[SNAPSHOT_USER_DATA_BYTES];
+        snapshot_crypto_random_bytes( user_data, SNAPSHOT_USER_DATA_BYTES );
+
+        uint8_t connect_token[SNAPSHOT_CONNECT_TOKEN_BYTES];
+
+        snapshot_check( snapshot_generate_connect_token( 1, &server_address, TEST_CONNECT_TOKEN_EXPIRY, TEST_TIMEOUT_SECONDS, client_id, TEST_PROTOCOL_ID, private_key, user_data, connect_token ) == SNAPSHOT_OK );
+
+        snapshot_client_connect( client[i], connect_token );
+    }
+
+    while ( 1 )
+    {
+        snapshot_network_simulator_update( network_simulator, time );
+
+        int num_connected_clients = 0;
+
+        for ( int i = 0; i < num_clients; i++ )
+        {
+            snapshot_client_update( client[i], time );
+            snapshot_check( snapshot_client_state( client[i] ) > SNAPSHOT_CLIENT_STATE_DISCONNECTED );
+            if ( snapshot_client_state( client[i] ) == SNAPSHOT_CLIENT_STATE_CONNECTED )
+                num_connected_clients++;
+        }
+
+        snapshot_server_update( server, time );
+
+        if ( num_connected_clients == num_clients )
+            break;
+
+        time += delta_time;
+    }
+
+    uint8_t passthrough_data[64];
+    memset( passthrough_data, 0, sizeof(passthrough_data) );
+
+    const uint64_t start_packets_processed = snapshot_server_counters( server )[SNAPSHOT_SERVER_COUNTER_PACKETS_PROCESSED];
+
+    double server_time = 0.0;
+
+    for ( int frame = 0; frame < num_frames; frame++ )
+    {
+        for ( int i = 0; i < num_clients; i++ )
+        {
+            snapshot_client_send_passthrough_packet( client[i], passthrough_data, sizeof(passthrough_data) );
+            snapshot_client_update( client[i], time );
+        }
+
+        snapshot_network_simulator_update( network_simulator, time );
+
+        const double start_time = snapshot_platform_time();
+
+        snapshot_server_update( server, time );
+
+        server_time += snapshot_platform_time() - start_time;
+
+        time += delta_time;
+    }
+
+    const uint64_t packets_processed = snapshot_server_counters( server )[SNAPSHOT_SERVER_COUNTER_PACKETS_PROCESSED] - start_packets_processed;
+
+    snapshot_check( packets_processed >= uint64_t( num_clients * num_frames ) );
+
+    printf( "    benchmark_server_process_packet: %d clients, %.1f ns per packet processed by the server\n", num_clients, server_time * 1000000000.0 / packets_processed );
+
+    for ( int i = 0; i < num_clients; i++ )
+    {
+        snapshot_client_destroy( client[i] );
+    }
+
+    free( client );
+
+    snapshot_server_destroy( server );
+
+    snapshot_network_simulator_destroy( network_simulator );
+}
+
+// the per-client state the server touches when it receives a packet, laid out the way it was before it was packed into one
+// cache line, and the way it is now in snapshot_server_client_hot_t
+
+#define BENCHMARK_HOT_STATE_CLIENTS                                   1048576
+#define BENCHMARK_HOT_STATE_PACKETS                                   4000000
+
+struct benchmark_client_arrays_t
+{
+    struct snapshot_address_t * address;
+    int * encryption_index;
+    int * connected;
+    int * confirmed;
+    int * loopback;
+    int * timeout;
+    uint64_t * sequence;
+    double * last_packet_receive_time;
+    double * last_internal_packet_send_time;
+};
+
+struct benchmark_client_hot_t
+{
+    struct snapshot_address_t address;
+    int encryption_index;
+    int connected;
+    int confirmed;
+    int loopback;
+    int timeout;
+    uint64_t sequence;
+    double last_packet_receive_time;
+    double last_internal_packet_send_time;
+};
+
+void benchmark_server_client_hot_state()
+{
+    // clients are visited in random order over far more clients than fit in cache, so every packet pays for however many
+    // cache lines its client's state is spread over. this isolates the layout from the crypto and socket costs that dominate
+    // benchmark_server_process_packet
+
+    const int num_clients = BENCHMARK_HOT_STATE_CLIENTS;
+    const int num_packets = BENCHMARK_HOT_STATE_PACKETS;
+
+    int * packet_client_index = (int*) malloc( sizeof(int) * num_packets );
+    snapshot_check( packet_client_index );
+    for ( int i = 0; i < num_packets; i++ )
+    {
+        packet_client_index[i] = rand() % num_clients;
+    }
+
+    struct snapshot_address_t from;
+    memset( &from, 0, sizeof(from) );
+    from.type = SNAPSHOT_ADDRESS_IPV4;
+
+    struct benchmark_client_arrays_t arrays;
+    arrays.address = (struct snapshot_address_t*) calloc( num_clients, sizeof(struct snapshot_address_t) );
+    arrays.encryption_index = (int*) calloc( num_clients, sizeof(int) );
+    arrays.connected = (int*) calloc( num_clients, sizeof(int) );
+    arrays.confirmed = (int*) calloc( num_clients, sizeof(int) );
+    arrays.loopback = (int*) calloc( num_clients, sizeof(int) );
+    arrays.timeout = (int*) calloc( num_clients, sizeof(int) );
+    arrays.sequence = (uint64_t*) calloc( num_clients, sizeof(uint64_t) );
+    arrays.last_packet_receive_time = (double*) calloc( num_clients, sizeof(double) );
+    arrays.last_internal_packet_send_time = (double*) calloc( num_clients, sizeof(double) );
+
+    struct benchmark_client_hot_t * hot = (struct benchmark_client_hot_t*) calloc( num_clients, sizeof(struct benchmark_client_hot_t) );
+
+    for ( int i = 0; i < num_clients; i++ )
+    {
+        arrays.address[i] = from;
+        arrays.connected[i] = 1;
+        hot[i].address = from;
+        hot[i].connected = 1;
+    }
+
+    uint64_t checksum = 0;
+
+    double start_time = snapshot_platform_time();
+
+    for ( int i = 0; i < num_packets; i++ )
+    {
+        const int client_index = packet_client_index[i];
+        if ( arrays.connected[client_index] && !arrays.loopback[client_index] && snapshot_address_equal( &arrays.address[client_index], &from ) )
+        {
+            checksum += arrays.encryption_index[client_index] + arrays.timeout[client_index];
+            arrays.confirmed[client_index] = 1;
+            arrays.sequence[client_index]++;
+            arrays.last_packet_receive_time[client_index] = i;
+            checksum += (uint64_t) arrays.last_internal_packet_send_time[client_index];
+        }
+    }
+
+    const double arrays_time = snapshot_platform_time() - start_time;
+
+    start_time = snapshot_platform_time();
+
+    for ( int i = 0; i < num_packets; i++ )
+    {
+        struct benchmark_client_hot_t * client = &hot[packet_client_index[i]];
+        if ( client->connected && !client->loopback && snapshot_address_equal( &client->address, &from ) )
+        {
+            checksum += client->encryption_index + client->timeout;
+            client->confirmed = 1;
+            client->sequence++;
+            client->last_packet_receive_time = i;
+            checksum += (uint64_t) client->last_internal_packet_send_time;
+        }
+    }
+
+    const double hot_time = snapshot_platform_time() - start_time;
+
+    snapshot_check( checksum == 0 );
+
+    printf( "    benchmark_server_client_hot_state: %d clients, %.1f ns per packet with separate arrays, %.1f ns per packet with packed hot state\n", num_clients, arrays_time * 1000000000.0 / num_packets, hot_time * 1000000000.0 / num_packets );
+
+    free( arrays.address );
+    free( arrays.encryption_index );
+    free( arrays.connected );
+    free( arrays.confirmed );
+    free( arrays.loopback );
+    free( arrays.timeout );
+    free( arrays.sequence );
+    free( arrays.last_packet_receive_time );
+    free( arrays.last_internal_packet_send_time );
+    free( hot );
+    free( packet_client_index );
+}
+
 #define RUN_TEST( test_function )                                           \
     do                                                                      \
     {                                                                       \
@@ -4279,6 +7676,9 @@ void snapshot_run_tests()
         RUN_TEST( test_crypto_sign_detached );
         RUN_TEST( test_crypto_key_exchange );
         RUN_TEST( test_platform_socket );
+        RUN_TEST( test_platform_socket_receive_packets );
+        RUN_TEST( test_platform_socket_send_packets );
+        RUN_TEST( test_platform_socket_gso_gro );
         RUN_TEST( test_platform_thread );
         RUN_TEST( test_platform_mutex );
         RUN_TEST( test_sequence );
@@ -4286,19 +7686,33 @@ void snapshot_run_tests()
         RUN_TEST( test_connect_token_public );
         RUN_TEST( test_challenge_token );
         RUN_TEST( test_create_and_destroy_packet );
+        RUN_TEST( test_packet_allocator );
         RUN_TEST( test_connection_request_packet );
         RUN_TEST( test_connection_denied_packet );
         RUN_TEST( test_connection_challenge_packet );
         RUN_TEST( test_connection_response_packet );
         RUN_TEST( test_payload_packet );
+        RUN_TEST( test_payload_iovec );
         RUN_TEST( test_passthrough_packet );
         RUN_TEST( test_disconnect_packet );        
         RUN_TEST( test_encryption_manager );
+        RUN_TEST( test_address_map );
+        RUN_TEST( test_timer_wheel );
+        RUN_TEST( test_encryption_manager_expiry_timer );
+        RUN_TEST( test_spsc_queue );
         RUN_TEST( test_replay_protection );
+        RUN_TEST( test_replay_protection_window );
         RUN_TEST( test_ipv4_client_create_any_port );
         RUN_TEST( test_ipv4_client_create_specific_port );
         RUN_TEST( test_ipv4_client_server_connect );
         RUN_TEST( test_ipv4_client_server_passthrough );
+        RUN_TEST( test_server_send_queue );
+        RUN_TEST( test_server_max_clients );
+        RUN_TEST( test_server_connected_clients );
+        RUN_TEST( test_client_server_arena );
+        RUN_TEST( test_sharded_server );
+        RUN_TEST( test_sharded_server_max_clients );
+        RUN_TEST( test_sharded_server_context );
 #if SNAPSHOT_PLATFORM_HAS_IPV6
         RUN_TEST( test_ipv6_client_create_any_port );
         RUN_TEST( test_ipv6_client_create_specific_port );
@@ -4322,11 +7736,22 @@ void snapshot_run_tests()
         RUN_TEST( test_disable_timeout );
         RUN_TEST( test_sequence_buffer );
         RUN_TEST( test_generate_ack_bits );
+        RUN_TEST( test_generate_ack_bits_random );
         RUN_TEST( test_packet_header );
         RUN_TEST( test_acks );
+        RUN_TEST( test_endpoint_packet_loss_and_bandwidth );
+        RUN_TEST( test_endpoint_stats_update_interval );
+        RUN_TEST( test_endpoint_congestion_control );
         RUN_TEST( test_acks_packet_loss );
         RUN_TEST( test_endpoint_payload );
+        RUN_TEST( test_endpoint_reassembly_slab );
+        RUN_TEST( test_endpoint_fec );
+        RUN_TEST( test_endpoint_fragment_resend );
+        RUN_TEST( test_delta_snapshots );
         RUN_TEST( test_client_server_payload );
+        RUN_TEST( test_client_server_payload_gso_gro );
+        RUN_TEST( test_client_server_payload_pacing );
+        RUN_TEST( test_client_server_snapshots );
         RUN_TEST( test_base64 );
     }
 
@@ -4335,6 +7760,20 @@ void snapshot_run_tests()
     fflush( stdout );
 }
 
+void snapshot_run_benchmarks()
+{
+    printf( "\n[benchmark]\n\n" );
+
+    snapshot_quiet( true );
+
+    RUN_TEST( benchmark_server_client_hot_state );
+    RUN_TEST( benchmark_server_process_packet );
+
+    printf( "\n" );
+
+    fflush( stdout );
+}
+
 #else // #if SNAPSHOT_DEVELOPMENT
 
 #include <stdio.h>
@@ -4344,4 +7783,9 @@ void snapshot_run_tests()
     printf( "\n[tests are not included in this build]\n\n" );
 }
 
+void snapshot_run_benchmarks()
+{
+    printf( "\n[benchmarks are not included in this build]\n\n" );
+}
+
 #endif // #if SNAPSHOT_DEVELOPMENT
@@ -0,0 +1,292 @@
+/*
+    Snapshot Copyright © 2023 Mas Bandwidth LLC. This source code is licensed under GPL version 3 or any later version.
+    Commercial licensing under different terms is available. Please email licensing@mas-bandwidth.com for details.
+*/
+
+#include "snapshot_timer_wheel.h"
+#include <math.h>
+
+#define SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET         ( SNAPSHOT_TIMER_WHEEL_LEVELS * SNAPSHOT_TIMER_WHEEL_SLOTS )
+#define SNAPSHOT_TIMER_WHEEL_NUM_BUCKETS     ( SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET + 1 )
+#define SNAPSHOT_TIMER_WHEEL_MAX_TICKS      ( 1ULL << ( SNAPSHOT_TIMER_WHEEL_SLOT_BITS * SNAPSHOT_TIMER_WHEEL_LEVELS ) )
+
+struct snapshot_timer_wheel_t
+{
+    void * context;
+    int max_timers;
+    int num_pending;
+    double tick_seconds;
+    uint64_t current_tick;
+    int bucket_head[SNAPSHOT_TIMER_WHEEL_NUM_BUCKETS];
+    uint64_t * deadline_tick;
+    int * bucket;
+    int * next;
+    int * prev;
+};
+
+struct snapshot_timer_wheel_t * snapshot_timer_wheel_create( void * context, int max_timers, double tick_seconds, double time )
+{
+    snapshot_assert( max_timers > 0 );
+    snapshot_assert( tick_seconds > 0.0 );
+    snapshot_assert( time >= 0.0 );
+
+    struct snapshot_timer_wheel_t * timer_wheel = (struct snapshot_timer_wheel_t*) snapshot_malloc( context, sizeof( struct snapshot_timer_wheel_t ) );
+    if ( !timer_wheel )
+        return NULL;
+
+    memset( timer_wheel, 0, sizeof( struct snapshot_timer_wheel_t ) );
+
+    timer_wheel->context = context;
+    timer_wheel->max_timers = max_timers;
+    timer_wheel->tick_seconds = tick_seconds;
+    timer_wheel->current_tick = (uint64_t) floor( time / tick_seconds );
+
+    timer_wheel->deadline_tick = (uint64_t*) snapshot_malloc( context, max_timers * sizeof( uint64_t ) );
+    timer_wheel->bucket = (int*) snapshot_malloc( context, max_timers * sizeof( int ) );
+    timer_wheel->next = (int*) snapshot_malloc( context, max_timers * sizeof( int ) );
+    timer_wheel->prev = (int*) snapshot_malloc( context, max_timers * sizeof( int ) );
+
+    if ( !timer_wheel->deadline_tick || !timer_wheel->bucket || !timer_wheel->next || !timer_wheel->prev )
+    {
+        snapshot_timer_wheel_destroy( timer_wheel );
+        return NULL;
+    }
+
+    for ( int i = 0; i < SNAPSHOT_TIMER_WHEEL_NUM_BUCKETS; ++i )
+    {
+        timer_wheel->bucket_head[i] = -1;
+    }
+
+    for ( int i = 0; i < max_timers; ++i )
+    {
+        timer_wheel->deadline_tick[i] = 0;
+        timer_wheel->bucket[i] = -1;
+        timer_wheel->next[i] = -1;
+        timer_wheel->prev[i] = -1;
+    }
+
+    return timer_wheel;
+}
+
+void snapshot_timer_wheel_destroy( struct snapshot_timer_wheel_t * timer_wheel )
+{
+    snapshot_assert( timer_wheel );
+
+    void * context = timer_wheel->context;
+
+    if ( timer_wheel->deadline_tick )
+        snapshot_free( context, timer_wheel->deadline_tick );
+    if ( timer_wheel->bucket )
+        snapshot_free( context, timer_wheel->bucket );
+    if ( timer_wheel->next )
+        snapshot_free( context, timer_wheel->next );
+    if ( timer_wheel->prev )
+        snapshot_free( context, timer_wheel->prev );
+
+    snapshot_free( context, timer_wheel );
+}
+
+static void snapshot_timer_wheel_link( struct snapshot_timer_wheel_t * timer_wheel, int timer_id, int bucket )
+{
+    const int head = timer_wheel->bucket_head[bucket];
+    timer_wheel->bucket[timer_id] = bucket;
+    timer_wheel->prev[timer_id] = -1;
+    timer_wheel->next[timer_id] = head;
+    if ( head != -1 )
+    {
+        timer_wheel->prev[head] = timer_id;
+    }
+    timer_wheel->bucket_head[bucket] = timer_id;
+
+    if ( bucket != SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET )
+    {
+        timer_wheel->num_pending++;
+    }
+}
+
+static void snapshot_timer_wheel_unlink( struct snapshot_timer_wheel_t * timer_wheel, int timer_id )
+{
+    const int bucket = timer_wheel->bucket[timer_id];
+
+    snapshot_assert( bucket != -1 );
+
+    const int next = timer_wheel->next[timer_id];
+    const int prev = timer_wheel->prev[timer_id];
+
+    if ( prev != -1 )
+    {
+        timer_wheel->next[prev] = next;
+    }
+    else
+    {
+        timer_wheel->bucket_head[bucket] = next;
+    }
+
+    if ( next != -1 )
+    {
+        timer_wheel->prev[next] = prev;
+    }
+
+    timer_wheel->bucket[timer_id] = -1;
+    timer_wheel->next[timer_id] = -1;
+    timer_wheel->prev[timer_id] = -1;
+
+    if ( bucket != SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET )
+    {
+        timer_wheel->num_pending--;
+        snapshot_assert( timer_wheel->num_pending >= 0 );
+    }
+}
+
+static void snapshot_timer_wheel_insert( struct snapshot_timer_wheel_t * timer_wheel, int timer_id )
+{
+    const uint64_t deadline_tick = timer_wheel->deadline_tick[timer_id];
+
+    if ( deadline_tick <= timer_wheel->current_tick )
+    {
+        snapshot_timer_wheel_link( timer_wheel, timer_id, SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET );
+        return;
+    }
+
+    // pick the lowest level whose range covers the deadline. deadlines past the top level park in its furthest slot and are re-inserted when that slot cascades
+
+    uint64_t slot_tick = deadline_tick;
+
+    const uint64_t delta = deadline_tick - timer_wheel->current_tick;
+
+    int level = 0;
+    while ( level < SNAPSHOT_TIMER_WHEEL_LEVELS && delta >= ( 1ULL << ( SNAPSHOT_TIMER_WHEEL_SLOT_BITS * ( level + 1 ) ) ) )
+    {
+        level++;
+    }
+
+    if ( level == SNAPSHOT_TIMER_WHEEL_LEVELS )
+    {
+        level = SNAPSHOT_TIMER_WHEEL_LEVELS - 1;
+        slot_tick = timer_wheel->current_tick + SNAPSHOT_TIMER_WHEEL_MAX_TICKS - 1;
+    }
+
+    const int slot = (int) ( ( slot_tick >> ( SNAPSHOT_TIMER_WHEEL_SLOT_BITS * level ) ) & ( SNAPSHOT_TIMER_WHEEL_SLOTS - 1 ) );
+
+    snapshot_timer_wheel_link( timer_wheel, timer_id, level * SNAPSHOT_TIMER_WHEEL_SLOTS + slot );
+}
+
+void snapshot_timer_wheel_schedule( struct snapshot_timer_wheel_t * timer_wheel, int timer_id, double deadline )
+{
+    snapshot_assert( timer_wheel );
+    snapshot_assert( timer_id >= 0 );
+    snapshot_assert( timer_id < timer_wheel->max_timers );
+
+    if ( timer_wheel->bucket[timer_id] != -1 )
+    {
+        snapshot_timer_wheel_unlink( timer_wheel, timer_id );
+    }
+
+    // fire on the first tick strictly after the deadline
+
+    timer_wheel->deadline_tick[timer_id] = ( deadline >= 0.0 ) ? (uint64_t) floor( deadline / timer_wheel->tick_seconds ) + 1 : 0;
+
+    snapshot_timer_wheel_insert( timer_wheel, timer_id );
+}
+
+void snapshot_timer_wheel_cancel( struct snapshot_timer_wheel_t * timer_wheel, int timer_id )
+{
+    snapshot_assert( timer_wheel );
+    snapshot_assert( timer_id >= 0 );
+    snapshot_assert( timer_id < timer_wheel->max_timers );
+
+    if ( timer_wheel->bucket[timer_id] != -1 )
+    {
+        snapshot_timer_wheel_unlink( timer_wheel, timer_id );
+    }
+}
+
+bool snapshot_timer_wheel_scheduled( struct snapshot_timer_wheel_t * timer_wheel, int timer_id )
+{
+    snapshot_assert( timer_wheel );
+    snapshot_assert( timer_id >= 0 );
+    snapshot_assert( timer_id < timer_wheel->max_timers );
+    return timer_wheel->bucket[timer_id] != -1;
+}
+
+static void snapshot_timer_wheel_cascade( struct snapshot_timer_wheel_t * timer_wheel, int bucket )
+{
+    int timer_id = timer_wheel->bucket_head[bucket];
+
+    while ( timer_id != -1 )
+    {
+        const int next = timer_wheel->next[timer_id];
+        snapshot_timer_wheel_unlink( timer_wheel, timer_id );
+        snapshot_timer_wheel_insert( timer_wheel, timer_id );
+        timer_id = next;
+    }
+}
+
+void snapshot_timer_wheel_advance( struct snapshot_timer_wheel_t * timer_wheel, double time )
+{
+    snapshot_assert( timer_wheel );
+
+    const uint64_t target_tick = (uint64_t) floor( time / timer_wheel->tick_seconds );
+
+    while ( timer_wheel->current_tick < target_tick )
+    {
+        // nothing left in the wheel, so there is nothing to cascade or expire on the way
+
+        if ( timer_wheel->num_pending == 0 )
+        {
+            timer_wheel->current_tick = target_tick;
+            break;
+        }
+
+        timer_wheel->current_tick++;
+
+        const uint64_t tick = timer_wheel->current_tick;
+
+        // when a lower level wraps, move the next slot of the level above down
+
+        for ( int level = 1; level < SNAPSHOT_TIMER_WHEEL_LEVELS; ++level )
+        {
+            if ( ( tick & ( ( 1ULL << ( SNAPSHOT_TIMER_WHEEL_SLOT_BITS * level ) ) - 1 ) ) != 0 )
+                break;
+
+            const int slot = (int) ( ( tick >> ( SNAPSHOT_TIMER_WHEEL_SLOT_BITS * level ) ) & ( SNAPSHOT_TIMER_WHEEL_SLOTS - 1 ) );
+
+            snapshot_timer_wheel_cascade( timer_wheel, level * SNAPSHOT_TIMER_WHEEL_SLOTS + slot );
+        }
+
+        // everything in the current level 0 slot is due now
+
+        const int bucket = (int) ( tick & ( SNAPSHOT_TIMER_WHEEL_SLOTS - 1 ) );
+
+        int timer_id = timer_wheel->bucket_head[bucket];
+
+        while ( timer_id != -1 )
+        {
+            const int next = timer_wheel->next[timer_id];
+            snapshot_assert( timer_wheel->deadline_tick[timer_id] <= tick );
+            snapshot_timer_wheel_unlink( timer_wheel, timer_id );
+            snapshot_timer_wheel_link( timer_wheel, timer_id, SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET );
+            timer_id = next;
+        }
+    }
+}
+
+int snapshot_timer_wheel_pop_expired( struct snapshot_timer_wheel_t * timer_wheel )
+{
+    snapshot_assert( timer_wheel );
+
+    const int timer_id = timer_wheel->bucket_head[SNAPSHOT_TIMER_WHEEL_EXPIRED_BUCKET];
+
+    if ( timer_id != -1 )
+    {
+        snapshot_timer_wheel_unlink( timer_wheel, timer_id );
+    }
+
+    return timer_id;
+}
+
+double snapshot_timer_wheel_tick_seconds( struct snapshot_timer_wheel_t * timer_wheel )
+{
+    snapshot_assert( timer_wheel );
+    return timer_wheel->tick_seconds;
+}
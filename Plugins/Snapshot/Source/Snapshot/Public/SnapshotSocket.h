@@ -10,6 +10,8 @@
 #include "Sockets.h"
 #include "SnapshotModule.h"
 
+#define SNAPSHOT_PACKET_QUEUE_SIZE 1024
+
 /*
     There are two types of sockets in the Snapshot Unreal Plugin:
 
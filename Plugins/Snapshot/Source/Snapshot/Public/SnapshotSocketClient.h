@@ -8,6 +8,7 @@
 #include "SnapshotSocket.h"
 
 struct snapshot_client_t;
+struct snapshot_spsc_queue_t;
 
 #ifndef SNAPSHOT_ADDRESS_ALREADY_DEFINED
 struct snapshot_address_t
@@ -31,12 +32,9 @@ private:
     bool bConnected;
     bool bUpdatedThisFrame;
 
-    struct PacketData {
-        uint8_t* packet_data;
-        int packet_bytes;
-    };
+    // Fixed size ring of received passthrough packets. Slots are preallocated, so receiving a packet never allocates
 
-    TQueue<PacketData> PacketQueue;
+    snapshot_spsc_queue_t* PacketQueue;
 
 public:
 
@@ -6,8 +6,13 @@
 #pragma once
 
 #include "SnapshotSocket.h"
+#include "HAL/CriticalSection.h"
+
+#include <atomic>
 
 struct snapshot_server_t;
+struct snapshot_spsc_queue_t;
+struct snapshot_platform_thread_t;
 
 #ifndef SNAPSHOT_ADDRESS_ALREADY_DEFINED
 struct snapshot_address_t
@@ -27,13 +32,37 @@ private:
 
     bool bUpdatedThisFrame;
 
-    struct PacketData {
-        snapshot_address_t from;
-        uint8_t* packet_data;
-        int packet_bytes;
+    // Fixed size ring of received passthrough packets. Slots are preallocated, so receiving a packet never allocates
+
+    snapshot_spsc_queue_t* PacketQueue;
+
+    // Optional dedicated network thread. When enabled it owns the snapshot server, passthrough packets reach the game thread via PacketQueue and SendTo goes to the network thread via SendQueue
+
+    bool bUseIOThread;
+
+    double IOThreadUpdateSeconds;
+
+    snapshot_platform_thread_t* IOThread;
+
+    std::atomic<bool> bQuitIOThread;
+
+    snapshot_spsc_queue_t* SendQueue;
+
+    // Unreal address for each connected client, filled when the client connects, so SendTo and RecvFrom convert addresses without formatting or parsing strings.
+    // Connects and disconnects come from the network thread when it is enabled, so access goes through ClientAddressCacheLock
+
+    struct FClientAddressCacheEntry
+    {
+        TSharedPtr<FInternetAddr> Address;
+        TArray<uint8> RawIp;
+        uint64 ClientId;
     };
 
-    TQueue<PacketData> PacketQueue;
+    TArray<FClientAddressCacheEntry> ClientAddressCache;
+
+    TMultiMap<uint32, int32> ClientIndexByAddressHash;
+
+    FCriticalSection ClientAddressCacheLock;
 
 public:
 
@@ -101,4 +130,16 @@ protected:
     // Callback when clients connect and disconnect
 
     static void ClientConnectDisconnect(void* context, int client_index, int connect);
+
+    // Finds the connected client with this address in the address cache. Returns -1 if there is none
+
+    int32 FindClientIndex(const FInternetAddr& Address, uint64& OutClientId);
+
+    // Network thread entry point. Updates the server at a fixed rate until the socket is closed
+
+    static void IOThreadFunction(void* arg);
+
+    // Sends passthrough packets queued by SendTo. Called on the network thread
+
+    void ProcessSendQueue();
 };